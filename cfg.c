@@ -129,6 +129,27 @@ cfg_init(u32 *labels, u32 nblocks)
     return(cfg);
 }
 
+// NOTE: a deep copy of the vertices, edges and conditions, keeping the order of the edges.
+// The dominators are not copied, they have to be recomputed for the copy
+static struct ir_cfg
+cfg_copy(struct ir_cfg *cfg)
+{
+    struct ir_cfg copy = cfg_init(cfg->labels.data, cfg->labels.size);
+    
+    memcpy(copy.conditions, cfg->conditions, cfg->labels.size * sizeof(u32));
+    
+    for (u32 i = 0; i < cfg->labels.size; ++i) {
+        for (struct edge_list *edge = cfg->out[i]; edge; edge = edge->next) {
+            edge_list_push(copy.out + i, edge->data);
+        }
+        for (struct edge_list *edge = cfg->in[i]; edge; edge = edge->next) {
+            edge_list_push(copy.in + i, edge->data);
+        }
+    }
+    
+    return(copy);
+}
+
 bool
 cfg_add_edge(struct ir_cfg *cfg, u32 from, u32 to)
 {
@@ -161,9 +182,11 @@ cfg_add_vertex(struct ir_cfg *cfg, u32 label)
     
     cfg->out = realloc(cfg->out, cfg->labels.size * sizeof(struct edge_list *));
     cfg->in = realloc(cfg->in, cfg->labels.size * sizeof(struct edge_list *));
+    cfg->conditions = realloc(cfg->conditions, cfg->labels.size * sizeof(u32));
     
     cfg->out[cfg->labels.size - 1] = 0x00;
     cfg->in[cfg->labels.size - 1] = 0x00;
+    cfg->conditions[cfg->labels.size - 1] = 0;
 }
 
 void
@@ -173,16 +196,24 @@ cfg_remove_vertex(struct ir_cfg *cfg, u32 index)
     struct edge_list *in = cfg->in[index];
     
     cfg->labels.data[index] = 0;
+    cfg->conditions[index] = 0;
     
-    do {
+    // NOTE: either list can be empty (e.g. an unreachable block has no predecessors)
+    while (out) {
         edge_list_remove(cfg->in + out->data, index);
         out = out->next;
-    } while (out);
+    }
     
-    do {
+    while (in) {
         edge_list_remove(cfg->out + in->data, index);
         in = in->next;
-    } while (in);
+    }
+    
+    edge_list_free(cfg->out[index]);
+    edge_list_free(cfg->in[index]);
+    
+    cfg->out[index] = NULL;
+    cfg->in[index] = NULL;
 }
 
 void
@@ -268,6 +299,16 @@ cfg_dfs(struct ir_cfg *cfg)
     return(dfs);
 }
 
+static void
+cfg_dfs_free(struct cfg_dfs_result *dfs)
+{
+    free(dfs->preorder);
+    free(dfs->postorder);
+    free(dfs->parent);
+    free(dfs->sorted_preorder);
+    free(dfs->sorted_postorder);
+}
+
 static struct uint_vector
 cfg_bfs_order_(struct ir_cfg *cfg, u32 root, s32 terminate)
 {
@@ -369,13 +410,20 @@ cfg_dominators(struct ir_cfg *input, struct cfg_dfs_result *dfs)
     }
     
     // NOTE: for all vertices in reverse preorder except ROOT! Root always 
-    // has preorder 0, so we can just skip the first (last) element
-    for (u32 i = 0; i < nver - 1; ++i) {
-        u32 w = dfs->sorted_preorder[nver - 1 - i];
+    // has preorder 0, so we can just skip the first (last) element. Vertices 
+    // which are not reachable from the root are not in the preorder at all, 
+    // they keep -1 as their dominator
+    for (u32 i = 0; i + 1 < dfs->size; ++i) {
+        u32 w = dfs->sorted_preorder[dfs->size - 1 - i];
         
-        // NOTE: for each incident edge
+        // NOTE: for each incident edge from a reachable vertex
         struct edge_list *in_edge = input->in[w];
         while (in_edge) {
+            if (in_edge->data != 0 && dfs->preorder[in_edge->data] == 0) {
+                in_edge = in_edge->next;
+                continue;
+            }
+            
             u32 u = cfg_find_min(dfs->preorder, sdom, label, ancestor, in_edge->data);
             if (cfg_preorder_less(dfs->preorder, sdom[u], sdom[w])) {
                 sdom[w] = sdom[u];
@@ -398,7 +446,7 @@ cfg_dominators(struct ir_cfg *input, struct cfg_dfs_result *dfs)
     }
     
     // NOTE: for all vertices except ROOT in preorder
-    for (u32 i = 1; i < nver; ++i) {
+    for (u32 i = 1; i < dfs->size; ++i) {
         u32 w = dfs->sorted_preorder[i];
         if (dom[w] != (s32) sdom[w]) {
             dom[w] = dom[dom[w]];
@@ -5,9 +5,15 @@
 #include <string.h>
 
 #ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
 #pragma warning(disable:4996) // fopen
 #pragma warning(disable:4201) // nameless struct/union
 #pragma warning(disable:4204) // nameless non-constant aggregate initializer
+#else
+#include <pthread.h>
+#include <unistd.h>
 #endif
 
 typedef uint64_t u64;
@@ -36,4 +42,5 @@ typedef double f64;
 #include "utils.c"
 #include "vector.c"
 #include "stack.c"
-#include "queue.c"
\ No newline at end of file
+#include "queue.c"
+#include "thread.c"
\ No newline at end of file
@@ -44,14 +44,20 @@ NOTE: one should refer themselves to the inst.h header, in which
 /*****************IR  MANIPULATION  FUNCTIONS*****************/
 /*************************************************************/
 
-// NOTE: read a sequence of 4 byte words and produce an intermideate representation
+// NOTE: read a sequence of 4 byte words and produce an intermideate representation.
+// With 'strip' set, the debug instructions (OpSource, OpString, OpName, OpLine, ...) are
+// dropped while parsing and the passes do not generate names
 struct ir 
-ir_eat(u32 *data, u32 size);
+ir_eat(u32 *data, u32 size, bool strip);
 
 // NOTE: dump the intermideate representation to a binary file
 void 
 ir_dump(struct ir *file, const char *filename);
 
+// NOTE: same as ir_dump, but the words of the module replace the contents of 'words'
+void
+ir_serialize(struct ir *file, struct uint_vector *words);
+
 // NOTE: delete instruction from (either from a basic block or from pre- or post-cfg)
 void 
 ir_delete_instruction(struct basic_block *block, struct instruction_list *inst);
@@ -69,6 +75,50 @@ ir_append_instruction(struct basic_block *block, struct instruction_t instructio
 u32
 ir_add_bb(struct ir *file);
 
+// NOTE: delete a basic block with all its instructions and edges. The index stays 
+// valid, the block is marked as deleted (zero label). Phi functions which name the 
+// block as a parent are not updated
+void
+ir_remove_bb(struct ir *file, u32 block_index);
+
+// NOTE: renumber the basic blocks densely, dropping the ones deleted by ir_remove_bb. 
+// Block indices taken before the call are not valid anymore
+void
+ir_compact_blocks(struct ir *file);
+
+// NOTE: copy and insert the instruction at the end of the global declarations (right before
+// OpFunction). Useful for declaring new constants, types and OpUndef's
+struct instruction_list *
+ir_add_global(struct ir *file, struct instruction_t instruction);
+
+// NOTE: copy-on-write snapshots for speculative transformations. Taking a snapshot is O(1),
+// nothing is copied until it is about to change. A pass which runs while a snapshot is active
+// calls ir_block_write before it changes (or takes instructions out of) a block, ir_cfg_write
+// before it changes the edges, labels or conditions, and ir_globals_write before it changes
+// pre_cfg or post_cfg. The ir_* functions which take the whole file do this by themselves.
+// ir_write_all saves everything for a pass which does not know about snapshots. ir_restore
+// brings the module back to the snapshot, ir_commit keeps the changes. One snapshot at a time
+void
+ir_snapshot(struct ir *file);
+
+void
+ir_block_write(struct ir *file, u32 block_index);
+
+void
+ir_cfg_write(struct ir *file);
+
+void
+ir_globals_write(struct ir *file);
+
+void
+ir_write_all(struct ir *file);
+
+void
+ir_restore(struct ir *file);
+
+void
+ir_commit(struct ir *file);
+
 // NOTE: free resources allocated by the intermideate represenation. After this procedure 
 // the intermideate represenation can not be used
 void 
@@ -78,6 +128,33 @@ ir_destroy(struct ir *file);
 void
 ssa_convert(struct ir *file);
 
+// NOTE: same as ssa_convert, but phi placement and renaming are split between 'thread_count'
+// threads by variable. The result is the same for any number of threads. It is not faster than
+// ssa_convert: the rest of the conversion is serial, and it takes most of the time (see README)
+void
+ssa_convert_parallel(struct ir *file, u32 thread_count);
+
+// NOTE: same as ssa_convert, but only the variables for which 'select' returns true are promoted,
+// all the other ones are left in memory. Phi functions are placed for the promoted ones only
+void
+ssa_convert_selected(struct ir *file, bool (*select)(struct instruction_t *variable, void *data), void *data);
+
+// NOTE: same as ssa_convert_selected, for an explicit set of OpVariable ids
+void
+ssa_convert_ids(struct ir *file, u32 *ids, u32 count);
+
+// NOTE: a cheap tier for debug builds: promote only the variables which are 
+// accessed inside the structured loops (found by their OpLoopMerge's)
+void
+ssa_convert_loops(struct ir *file);
+
+// NOTE: same as ssa_convert, but as per Braun M. et al: a single pass in reverse postorder
+// which does not need the dominator tree. Trivial phi functions are not inserted. This is a
+// reference implementation to check ssa_convert against, it is only on par for a few dozen
+// variables and slower from there on
+void
+ssa_convert_braun(struct ir *file);
+
 /*************************************************************/
 /*************END  OF  IR  MANIPULATION  FUNCTIONS************/
 /*************************************************************/
@@ -4,9 +4,11 @@ static bool
 supported_in_cfg(enum opcode_t opcode)
 {
     switch (opcode) {
+        case OpUndef:
         case OpVariable:
         case OpLoad:
         case OpStore:
+        case OpAccessChain:
         case OpCopyObject:
         case OpSNegate:
         case OpFNegate:
@@ -61,6 +63,11 @@ instruction_parse(u32 *word)
         case OpReturn: {
         } break;
         
+        case OpUndef: {
+            instruction.OpUndef.result_type = *(word++);
+            instruction.OpUndef.result_id = *(word++);
+        } break;
+        
         case OpName: {
             instruction.OpName.target_id = *(word++);
             instruction.OpName.name = (char *) word;
@@ -75,7 +82,7 @@ instruction_parse(u32 *word)
             instruction.OpVariable.result_id = *(word++);
             instruction.OpVariable.storage_class = *(word++);
             if (instruction.wordcount == 5) {
-                instruction.OpVariable.result_type = *(word++);
+                instruction.OpVariable.initializer = *(word++);
             }
         } break;
         
@@ -85,6 +92,29 @@ instruction_parse(u32 *word)
             instruction.OpTypePointer.type = *(word++);
         } break;
         
+        case OpTypeArray: {
+            instruction.OpTypeArray.result_id = *(word++);
+            instruction.OpTypeArray.element_type = *(word++);
+            instruction.OpTypeArray.length = *(word++);
+        } break;
+        
+        case OpTypeStruct: {
+            instruction.OpTypeStruct.result_id = *(word++);
+            instruction.OpTypeStruct.members = memdup(word, (instruction.wordcount - 2) * sizeof(u32));
+        } break;
+        
+        case OpConstantTrue:
+        case OpConstantFalse: {
+            instruction.OpConstantTrue.result_type = *(word++);
+            instruction.OpConstantTrue.result_id = *(word++);
+        } break;
+        
+        case OpConstant: {
+            instruction.OpConstant.result_type = *(word++);
+            instruction.OpConstant.result_id = *(word++);
+            instruction.OpConstant.value = *(word++);
+        } break;
+        
         case OpBranch: {
             instruction.OpBranch.target_label = *(word++);
         } break;
@@ -100,7 +130,7 @@ instruction_parse(u32 *word)
             instruction.OpPhi.result_id = *(word++);
             instruction.OpPhi.variables = malloc((instruction.wordcount - 3) / 2 * sizeof(u32));
             instruction.OpPhi.parents = malloc((instruction.wordcount - 3) / 2 * sizeof(u32));
-            for (u32 i = 0; i < instruction.wordcount - 3; ++i) {
+            for (u32 i = 0; i < (instruction.wordcount - 3) / 2; ++i) {
                 instruction.OpPhi.variables[i] = *(word++);
                 instruction.OpPhi.parents[i] = *(word++);
             }
@@ -140,6 +170,13 @@ instruction_parse(u32 *word)
             }
         } break;
         
+        case OpAccessChain: {
+            instruction.OpAccessChain.result_type = *(word++);
+            instruction.OpAccessChain.result_id = *(word++);
+            instruction.OpAccessChain.base = *(word++);
+            instruction.OpAccessChain.indexes = memdup(word, (instruction.wordcount - 4) * sizeof(u32));
+        } break;
+        
         case OpSNegate: 
         case OpFNegate: {
             instruction.unary_arithmetics.result_type = *(word++);
@@ -184,6 +221,11 @@ instruction_dump(struct instruction_t *inst, u32 *buffer)
         case OpReturn: {
         } break;
         
+        case OpUndef: {
+            buffer[1] = inst->OpUndef.result_type;
+            buffer[2] = inst->OpUndef.result_id;
+        } break;
+        
         case OpName: {
             buffer[1] = inst->OpName.target_id;
             memcpy(buffer + 2, inst->OpName.name, (inst->wordcount - 2) * 4);
@@ -198,7 +240,7 @@ instruction_dump(struct instruction_t *inst, u32 *buffer)
             buffer[2] = inst->OpVariable.result_id;
             buffer[3] = inst->OpVariable.storage_class;
             if (inst->wordcount == 5) {
-                buffer[4] = inst->OpVariable.result_type;
+                buffer[4] = inst->OpVariable.initializer;
             }
         } break;
         
@@ -208,6 +250,33 @@ instruction_dump(struct instruction_t *inst, u32 *buffer)
             buffer[3] = inst->OpTypePointer.type;
         } break;
         
+        case OpTypeArray: {
+            buffer[1] = inst->OpTypeArray.result_id;
+            buffer[2] = inst->OpTypeArray.element_type;
+            buffer[3] = inst->OpTypeArray.length;
+        } break;
+        
+        case OpTypeStruct: {
+            buffer[1] = inst->OpTypeStruct.result_id;
+            memcpy(buffer + 2, inst->OpTypeStruct.members, (inst->wordcount - 2) * 4);
+        } break;
+        
+        case OpConstantTrue:
+        case OpConstantFalse: {
+            buffer[1] = inst->OpConstantTrue.result_type;
+            buffer[2] = inst->OpConstantTrue.result_id;
+        } break;
+        
+        case OpConstant: {
+            buffer[1] = inst->OpConstant.result_type;
+            buffer[2] = inst->OpConstant.result_id;
+            buffer[3] = inst->OpConstant.value;
+            // NOTE: the high order words of wide constants are not parsed
+            for (u32 i = 4; i < inst->wordcount; ++i) {
+                buffer[i] = inst->unparsed_words[i];
+            }
+        } break;
+        
         case OpBranch: {
             buffer[1] = inst->OpBranch.target_label;
         } break;
@@ -255,6 +324,13 @@ instruction_dump(struct instruction_t *inst, u32 *buffer)
             }
         } break;
         
+        case OpAccessChain: {
+            buffer[1] = inst->OpAccessChain.result_type;
+            buffer[2] = inst->OpAccessChain.result_id;
+            buffer[3] = inst->OpAccessChain.base;
+            memcpy(buffer + 4, inst->OpAccessChain.indexes, (inst->wordcount - 4) * 4);
+        } break;
+        
         case OpCopyObject: {
             buffer[1] = inst->OpCopyObject.result_type;
             buffer[2] = inst->OpCopyObject.result_id;
@@ -300,8 +376,16 @@ static bool
 produces_result_id(enum opcode_t opcode)
 {
     switch (opcode) {
+        case OpUndef:
         case OpVariable:
+        case OpTypeArray:
+        case OpTypeStruct:
+        case OpTypePointer:
+        case OpConstantTrue:
+        case OpConstantFalse:
+        case OpConstant:
         case OpLoad:
+        case OpAccessChain:
         case OpCopyObject:
         case OpSNegate:
         case OpFNegate:
@@ -345,8 +429,16 @@ static u32
 get_result_id(struct instruction_t *instruction)
 {
     switch (instruction->opcode) {
+        case OpUndef: return(instruction->OpUndef.result_id);
         case OpVariable: return(instruction->OpVariable.result_id);
+        case OpTypeArray: return(instruction->OpTypeArray.result_id);
+        case OpTypeStruct: return(instruction->OpTypeStruct.result_id);
+        case OpTypePointer: return(instruction->OpTypePointer.result_id);
+        case OpConstantTrue: return(instruction->OpConstantTrue.result_id);
+        case OpConstantFalse: return(instruction->OpConstantFalse.result_id);
+        case OpConstant: return(instruction->OpConstant.result_id);
         case OpLoad: return(instruction->OpLoad.result_id);
+        case OpAccessChain: return(instruction->OpAccessChain.result_id);
         case OpCopyObject: return(instruction->OpCopyObject.result_id);
         
         case OpSNegate:
@@ -380,4 +472,291 @@ get_result_id(struct instruction_t *instruction)
             SHOULDNOTHAPPEN;
         }
     }
-}
\ No newline at end of file
+}
+
+// NOTE: instructions, which are not parsed, but all the words after the result id of which
+// are <id> operands. Most of the arithmetics, logic, comparisons and conversions are like that
+static bool
+instruction_all_operands(enum opcode_t opcode)
+{
+    return(opcode == OpConstantComposite || opcode == OpCompositeConstruct || opcode == OpTranspose ||
+           (opcode >= OpConvertFToU && opcode <= OpBitcast) ||
+           (opcode >= OpVectorTimesScalar && opcode <= OpDot) ||
+           (opcode >= OpAny && opcode <= OpIsInf) ||
+           (opcode >= OpLogicalEqual && opcode <= OpFUnordGreaterThanEqual) ||
+           (opcode >= OpShiftRightLogical && opcode <= OpNot));
+}
+
+// NOTE: result id of an instruction, 0 if there is none or the layout of the instruction is not known
+static u32
+instruction_result_id(struct instruction_t *instruction)
+{
+    switch (instruction->opcode) {
+        case OpUndef:
+        case OpVariable:
+        case OpTypeArray:
+        case OpTypeStruct:
+        case OpTypePointer:
+        case OpConstantTrue:
+        case OpConstantFalse:
+        case OpConstant:
+        case OpLoad:
+        case OpAccessChain:
+        case OpCopyObject:
+        case OpSNegate:
+        case OpFNegate:
+        case OpIAdd:
+        case OpFAdd:
+        case OpISub:
+        case OpFSub:
+        case OpIMul:
+        case OpFMul:
+        case OpUDiv:
+        case OpSDiv:
+        case OpFDiv:
+        case OpUMod:
+        case OpSRem:
+        case OpSMod:
+        case OpFRem:
+        case OpFMod:
+        case OpPhi: {
+            return(get_result_id(instruction));
+        }
+        
+        case OpExtInst:
+        case OpVectorShuffle:
+        case OpCompositeExtract:
+        case OpCompositeInsert: {
+            return(instruction->unparsed_words[2]);
+        }
+        
+        default: {
+            return(instruction_all_operands(instruction->opcode) ? instruction->unparsed_words[2] : 0);
+        }
+    }
+}
+
+// NOTE: collect pointers to the <id> operands of an instruction, i.e. all the ids it reads 
+// except for the result type and the labels. Returns the number of operands, or -1 if the 
+// layout of the instruction is not known, in which case any of its words may be an id
+static s32
+instruction_operands(struct instruction_t *instruction, u32 **operands)
+{
+    s32 count = 0;
+    
+    switch (instruction->opcode) {
+        // NOTE: only literals (numbers and strings) follow
+        case OpSource:
+        case OpExtInstImport:
+        case OpMemoryModel:
+        case OpCapability:
+        case OpTypeVoid:
+        case OpTypeBool:
+        case OpTypeInt:
+        case OpTypeFloat:
+        case OpName:
+        case OpUndef:
+        case OpConstantTrue:
+        case OpConstantFalse:
+        case OpConstant:
+        case OpLoopMerge:
+        case OpSelectionMerge:
+        case OpLabel:
+        case OpBranch:
+        case OpReturn: {
+        } break;
+        
+        case OpVariable: {
+            if (instruction->wordcount == 5) {
+                operands[count++] = &instruction->OpVariable.initializer;
+            }
+        } break;
+        
+        case OpTypePointer: {
+            operands[count++] = &instruction->OpTypePointer.type;
+        } break;
+        
+        case OpTypeArray: {
+            operands[count++] = &instruction->OpTypeArray.element_type;
+            operands[count++] = &instruction->OpTypeArray.length;
+        } break;
+        
+        case OpTypeStruct: {
+            for (u32 i = 0; i < instruction->wordcount - 2; ++i) {
+                operands[count++] = instruction->OpTypeStruct.members + i;
+            }
+        } break;
+        
+        case OpLoad: {
+            operands[count++] = &instruction->OpLoad.pointer;
+        } break;
+        
+        case OpStore: {
+            operands[count++] = &instruction->OpStore.pointer;
+            operands[count++] = &instruction->OpStore.object;
+        } break;
+        
+        case OpAccessChain: {
+            operands[count++] = &instruction->OpAccessChain.base;
+            for (u32 i = 0; i < instruction->wordcount - 4; ++i) {
+                operands[count++] = instruction->OpAccessChain.indexes + i;
+            }
+        } break;
+        
+        case OpCopyObject: {
+            operands[count++] = &instruction->OpCopyObject.operand;
+        } break;
+        
+        case OpSNegate:
+        case OpFNegate: {
+            operands[count++] = &instruction->unary_arithmetics.operand;
+        } break;
+        
+        case OpIAdd:
+        case OpFAdd:
+        case OpISub:
+        case OpFSub:
+        case OpIMul:
+        case OpFMul:
+        case OpUDiv:
+        case OpSDiv:
+        case OpFDiv:
+        case OpUMod:
+        case OpSRem:
+        case OpSMod:
+        case OpFRem:
+        case OpFMod: {
+            operands[count++] = &instruction->binary_arithmetics.operand_1;
+            operands[count++] = &instruction->binary_arithmetics.operand_2;
+        } break;
+        
+        case OpPhi: {
+            for (u32 i = 0; i < (instruction->wordcount - 3) / 2; ++i) {
+                operands[count++] = instruction->OpPhi.variables + i;
+            }
+        } break;
+        
+        case OpBranchConditional: {
+            operands[count++] = &instruction->OpBranchConditional.condition;
+        } break;
+        
+        // NOTE: the instruction set and the instruction number are followed by the operands
+        case OpExtInst: {
+            operands[count++] = instruction->unparsed_words + 3;
+            for (u32 i = 5; i < instruction->wordcount; ++i) {
+                operands[count++] = instruction->unparsed_words + i;
+            }
+        } break;
+        
+        // NOTE: the component indices are literals
+        case OpVectorShuffle:
+        case OpCompositeInsert: {
+            operands[count++] = instruction->unparsed_words + 3;
+            operands[count++] = instruction->unparsed_words + 4;
+        } break;
+        
+        case OpCompositeExtract: {
+            operands[count++] = instruction->unparsed_words + 3;
+        } break;
+        
+        default: {
+            if (!instruction_all_operands(instruction->opcode)) {
+                return(-1);
+            }
+            for (u32 i = 3; i < instruction->wordcount; ++i) {
+                operands[count++] = instruction->unparsed_words + i;
+            }
+        }
+    }
+    
+    return(count);
+}
+
+// NOTE: pointer to the result id of an instruction, NULL where instruction_result_id gives 0
+static u32 *
+instruction_result_pointer(struct instruction_t *instruction)
+{
+    switch (instruction->opcode) {
+        case OpTypeArray: return(&instruction->OpTypeArray.result_id);
+        case OpTypeStruct: return(&instruction->OpTypeStruct.result_id);
+        case OpTypePointer: return(&instruction->OpTypePointer.result_id);
+        case OpUndef: return(&instruction->OpUndef.result_id);
+        case OpVariable: return(&instruction->OpVariable.result_id);
+        case OpConstantTrue: return(&instruction->OpConstantTrue.result_id);
+        case OpConstantFalse: return(&instruction->OpConstantFalse.result_id);
+        case OpConstant: return(&instruction->OpConstant.result_id);
+        case OpLoad: return(&instruction->OpLoad.result_id);
+        case OpAccessChain: return(&instruction->OpAccessChain.result_id);
+        case OpCopyObject: return(&instruction->OpCopyObject.result_id);
+        case OpPhi: return(&instruction->OpPhi.result_id);
+        
+        case OpSNegate:
+        case OpFNegate: {
+            return(&instruction->unary_arithmetics.result_id);
+        }
+        
+        case OpIAdd:
+        case OpFAdd:
+        case OpISub:
+        case OpFSub:
+        case OpIMul:
+        case OpFMul:
+        case OpUDiv:
+        case OpSDiv:
+        case OpFDiv:
+        case OpUMod:
+        case OpSRem:
+        case OpSMod:
+        case OpFRem:
+        case OpFMod: {
+            return(&instruction->binary_arithmetics.result_id);
+        }
+        
+        case OpExtInst:
+        case OpVectorShuffle:
+        case OpCompositeExtract:
+        case OpCompositeInsert: {
+            return(instruction->unparsed_words + 2);
+        }
+        
+        default: {
+            return(instruction_all_operands(instruction->opcode) ? instruction->unparsed_words + 2 : NULL);
+        }
+    }
+}
+
+// NOTE: a deep copy of an instruction, which does not share any arrays with the original.
+// The parsed instructions only keep their parsed fields
+static struct instruction_t
+instruction_clone(struct instruction_t *instruction)
+{
+    struct instruction_t copy = *instruction;
+    
+    // NOTE: the words of a parsed instruction are stale once it has been modified
+    if (supported_in_cfg(instruction->opcode)) {
+        copy.unparsed_words = NULL;
+    } else if (instruction->unparsed_words) {
+        copy.unparsed_words = memdup(instruction->unparsed_words, instruction->wordcount * sizeof(u32));
+    }
+    
+    switch (instruction->opcode) {
+        case OpPhi: {
+            u32 count = (instruction->wordcount - 3) / 2;
+            copy.OpPhi.variables = memdup(instruction->OpPhi.variables, count * sizeof(u32));
+            copy.OpPhi.parents = memdup(instruction->OpPhi.parents, count * sizeof(u32));
+        } break;
+        
+        case OpAccessChain: {
+            copy.OpAccessChain.indexes = memdup(instruction->OpAccessChain.indexes, (instruction->wordcount - 4) * sizeof(u32));
+        } break;
+        
+        case OpTypeStruct: {
+            copy.OpTypeStruct.members = memdup(instruction->OpTypeStruct.members, (instruction->wordcount - 2) * sizeof(u32));
+        } break;
+        
+        default: {
+        }
+    }
+    
+    return(copy);
+}
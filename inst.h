@@ -2,17 +2,53 @@ static const u32 WORDCOUNT_MASK     = 0xFFFF0000;
 static const u32 OPCODE_MASK        = 0x0000FFFF;
 
 enum opcode_t {
+    OpUndef = 1,
     OpSourceContinued = 2, // enum only, is not parsed
     OpSource = 3,          // enum only, is not parsed
     OpSourceExtension = 4, // enum only, is not parsed
     OpName = 5,
+    OpMemberName = 6,      // enum only, is not parsed
     OpString = 7,          // enum only, is not parsed
+    OpLine = 8,            // enum only, is not parsed
+    OpExtension = 10,      // enum only, is not parsed
+    OpExtInstImport = 11,  // enum only, is not parsed
+    OpExtInst = 12,        // enum only, is not parsed
+    OpMemoryModel = 14,    // enum only, is not parsed
+    OpEntryPoint = 15,     // enum only, is not parsed
     OpExecutionMode = 16,  // enum only, is not parsed
+    OpCapability = 17,     // enum only, is not parsed
+    OpTypeVoid = 19,       // enum only, is not parsed
+    OpTypeBool = 20,       // enum only, is not parsed
+    OpTypeInt = 21,        // enum only, is not parsed
+    OpTypeFloat = 22,      // enum only, is not parsed
+    OpTypeVector = 23,     // enum only, is not parsed
+    OpTypeArray = 28,
+    OpTypeStruct = 30,
     OpTypePointer = 32,
+    OpTypeForwardPointer = 39, // enum only, is not parsed (the first non-type after the types)
+    OpConstantTrue = 41,
+    OpConstantFalse = 42,
+    OpConstant = 43,
+    OpConstantComposite = 44, // enum only, is not parsed
+    OpSpecConstantOp = 52,    // enum only, is not parsed (the last constant)
+    OpFunction = 54,       // enum only, is not parsed
+    OpFunctionParameter = 55, // enum only, is not parsed
+    OpFunctionEnd = 56,       // enum only, is not parsed
+    OpFunctionCall = 57,      // enum only, is not parsed
     OpVariable = 59,
     OpLoad = 61,
     OpStore = 62,
+    OpAccessChain = 65,
+    OpDecorate = 71,            // enum only, is not parsed
+    OpMemberDecorate = 72,      // enum only, is not parsed
+    OpVectorShuffle = 79,       // enum only, is not parsed
+    OpCompositeConstruct = 80,  // enum only, is not parsed
+    OpCompositeExtract = 81,    // enum only, is not parsed
+    OpCompositeInsert = 82,     // enum only, is not parsed
     OpCopyObject = 83,
+    OpTranspose = 84,           // enum only, is not parsed
+    OpConvertFToU = 109,        // enum only, is not parsed (the first conversion)
+    OpBitcast = 124,            // enum only, is not parsed (the last conversion)
     OpSNegate = 126,
     OpFNegate = 127,
     OpIAdd = 128,
@@ -31,6 +67,23 @@ enum opcode_t {
     OpFMod = 141,
     
     /* Enum only */
+    OpVectorTimesScalar = 142,
+    OpMatrixTimesScalar = 143,
+    OpVectorTimesMatrix = 144,
+    OpMatrixTimesVector = 145,
+    OpMatrixTimesMatrix = 146,
+    OpOuterProduct = 147,
+    OpDot = 148,
+    OpAny = 154,
+    OpAll = 155,
+    OpIsNan = 156,
+    OpIsInf = 157,
+    OpLogicalEqual = 164,
+    OpLogicalNotEqual = 165,
+    OpLogicalOr = 166,
+    OpLogicalAnd = 167,
+    OpLogicalNot = 168,
+    OpSelect = 169,
     OpIEqual = 170,
     OpINotEqual = 171,
     OpUGreaterThan = 172,
@@ -53,6 +106,13 @@ enum opcode_t {
     OpFUnordLessThanEqual = 189 ,
     OpFOrdGreaterThanEqual = 190,
     OpFUnordGreaterThanEqual = 191,
+    OpShiftRightLogical = 194,
+    OpShiftRightArithmetic = 195,
+    OpShiftLeftLogical = 196,
+    OpBitwiseOr = 197,
+    OpBitwiseXor = 198,
+    OpBitwiseAnd = 199,
+    OpNot = 200,
     
     /*************/
     
@@ -62,7 +122,36 @@ enum opcode_t {
     OpLabel = 248,
     OpBranch = 249,
     OpBranchConditional = 250,
+    OpSwitch = 251,        // enum only, is not parsed
+    OpKill = 252,          // enum only, is not parsed
     OpReturn = 253,
+    OpReturnValue = 254,   // enum only, is not parsed
+    OpUnreachable = 255,   // enum only, is not parsed
+    OpNoLine = 317,        // enum only, is not parsed
+    OpModuleProcessed = 330, // enum only, is not parsed
+};
+
+enum storage_class_t {
+    StorageClassUniformConstant = 0,
+    StorageClassInput = 1,
+    StorageClassUniform = 2,
+    StorageClassOutput = 3,
+    StorageClassWorkgroup = 4,
+    StorageClassCrossWorkgroup = 5,
+    StorageClassPrivate = 6,
+    StorageClassFunction = 7,
+    StorageClassPushConstant = 9,
+};
+
+enum decoration_t {
+    DecorationVolatile = 21,
+    DecorationCoherent = 23,
+};
+
+enum loop_control_t {
+    LoopControlNone = 0x0,
+    LoopControlUnroll = 0x1,
+    LoopControlDontUnroll = 0x2,
 };
 
 struct opname_t {
@@ -70,6 +159,11 @@ struct opname_t {
     char *name;
 };
 
+struct opundef_t {
+    u32 result_type;
+    u32 result_id;
+};
+
 struct oplabel_t {
     u32 result_id;
 };
@@ -87,6 +181,29 @@ struct optypepointer_t {
     u32 type;
 };
 
+struct optypearray_t {
+    u32 result_id;
+    u32 element_type;
+    u32 length; // NOTE: id of a constant
+};
+
+struct optypestruct_t {
+    u32 result_id;
+    u32 *members; // NOTE: wordcount - 2 member types
+};
+
+// NOTE: OpConstantTrue and OpConstantFalse
+struct opconstantbool_t {
+    u32 result_type;
+    u32 result_id;
+};
+
+struct opconstant_t {
+    u32 result_type;
+    u32 result_id;
+    u32 value; // NOTE: only the low order word of wider constants
+};
+
 struct opbranch_t {
     u32 target_label;
 };
@@ -129,6 +246,13 @@ struct opload_t {
     u32 memory_access; // optional
 };
 
+struct opaccesschain_t {
+    u32 result_type;
+    u32 result_id;
+    u32 base;
+    u32 *indexes; // NOTE: wordcount - 4 indexes
+};
+
 struct opcopyobject_t {
     u32 result_type;
     u32 result_id;
@@ -154,10 +278,16 @@ struct instruction_t {
     u32 *unparsed_words;
     
     union {
+        struct opundef_t OpUndef;
         struct opname_t OpName;
         struct oplabel_t OpLabel;
         struct opvariable_t OpVariable;
         struct optypepointer_t OpTypePointer;
+        struct optypearray_t OpTypeArray;
+        struct optypestruct_t OpTypeStruct;
+        struct opconstantbool_t OpConstantTrue;
+        struct opconstantbool_t OpConstantFalse;
+        struct opconstant_t OpConstant;
         struct opbranch_t OpBranch;
         struct opbranchconditional_t OpBranchConditional;
         struct opphi_t OpPhi;
@@ -165,6 +295,7 @@ struct instruction_t {
         struct oploopmerge_t OpLoopMerge;
         struct opstore_t OpStore;
         struct opload_t OpLoad;
+        struct opaccesschain_t OpAccessChain;
         struct opcopyobject_t OpCopyObject;
         struct unary_arithmetics_layout unary_arithmetics;
         struct binary_arithmetics_layout binary_arithmetics;
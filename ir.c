@@ -17,38 +17,89 @@ struct basic_block {
     struct instruction_list *instructions;
 };
 
+// NOTE: the state of the module at the time of ir_snapshot. Nothing is copied up front,
+// whatever changes afterwards is saved right before its first change: every block on its
+// own, the CFG and the global instructions as a whole. Blocks added after the snapshot are
+// simply dropped by ir_restore
+struct ir_snapshot {
+    bool active;
+    u32 stamp;                   // NOTE: of the current snapshot, a new one gets a new stamp
+    u32 *saved_stamp;            // NOTE: block index -> stamp of the snapshot the block was saved in
+    u32 stamp_capacity;
+    struct uint_vector saved;    // NOTE: indices of the saved blocks
+    struct basic_block *blocks;  // NOTE: copies of the saved blocks, in the same order
+    u32 block_capacity;
+    u32 block_count;
+    struct ir_header header;
+    bool cfg_saved;
+    struct ir_cfg cfg;
+    bool globals_saved;
+    struct instruction_list *pre_cfg;
+    struct instruction_list *post_cfg;
+};
+
 struct ir {
     struct ir_header header;
     struct ir_cfg cfg;
     struct basic_block *blocks;
     struct instruction_list *pre_cfg;
     struct instruction_list *post_cfg;
+    bool strip; // NOTE: no debug instructions and names, neither parsed nor generated
+    struct ir_snapshot snapshot;
 };
 
+// NOTE: instructions which only carry debug information. OpString is kept when a
+// non-semantic instruction set (e.g. NonSemantic.Shader.DebugInfo) might refer to it
+static bool
+ir_debug_instruction(enum opcode_t opcode, bool keep_strings)
+{
+    return((opcode >= OpSourceContinued && opcode <= OpLine && !(opcode == OpString && keep_strings)) ||
+           opcode == OpNoLine || opcode == OpModuleProcessed);
+}
+
 struct ir
-ir_eat(u32 *data, u32 size)
+ir_eat(u32 *data, u32 size, bool strip)
 {
-    u32 labels[100] = { 0 };
-    u32 bb_count = 0;
+    struct uint_vector labels = vector_init();
     
     struct ir file;
     file.header = *((struct ir_header *) data);
+    file.strip = strip;
+    file.snapshot = (struct ir_snapshot) { .active = false, .saved = vector_init() };
     
     struct instruction_list *all_instructions = NULL;
     struct instruction_list *inst = NULL;
     struct instruction_list *last = NULL;
+    bool first_function = true;
+    bool keep_strings = false;
     
     u32 offset = sizeof(struct ir_header) / 4;
     u32 *word = data + offset;
     
     // NOTE: get all instructions in a list, count basic blocks
-    do {
+    while (offset != size) {
+        enum opcode_t opcode = *word & OPCODE_MASK;
+        
+        if (opcode == OpExtInstImport && !strncmp((char *) (word + 2), "NonSemantic.", 12)) {
+            keep_strings = true;
+        }
+        
+        // NOTE: stripped instructions are skipped before they get a list node
+        if (strip && ir_debug_instruction(opcode, keep_strings)) {
+            offset += (*word & WORDCOUNT_MASK) >> 16;
+            word = data + offset;
+            continue;
+        }
+        
         inst = malloc(sizeof(struct instruction_list));
         inst->data = instruction_parse(word);
         inst->prev = last;
         
-        if (inst->data.opcode == OpLabel) {
-            labels[bb_count++] = inst->data.OpLabel.result_id;
+        // NOTE: only the first function becomes the CFG, the labels of the other ones stay unparsed
+        if (inst->data.opcode == OpLabel && first_function) {
+            vector_push(&labels, inst->data.OpLabel.result_id);
+        } else if (inst->data.opcode == OpFunctionEnd) {
+            first_function = false;
         }
         
         offset += inst->data.wordcount;
@@ -61,13 +112,20 @@ ir_eat(u32 *data, u32 size)
         
         last = inst;
         word = data + offset;
-    } while (offset != size);
+    }
     
     last->next = NULL;
     // =======================
     
     
-    file.blocks = malloc(sizeof(struct basic_block) * bb_count);
+    // NOTE: label id -> basic block index, so that resolving a branch target
+    // does not have to search through all the labels
+    s32 *label_index = malloc(file.header.bound * sizeof(s32));
+    for (u32 i = 0; i < labels.size; ++i) {
+        label_index[labels.data[i]] = i;
+    }
+    
+    file.blocks = malloc(sizeof(struct basic_block) * labels.size);
     
     
     // NOTE: all pre-cfg instructions
@@ -83,7 +141,7 @@ ir_eat(u32 *data, u32 size)
     
     
     // NOTE: reconstruct the cfg
-    file.cfg = cfg_init(labels, bb_count);
+    file.cfg = cfg_init(labels.data, labels.size);
     
     struct basic_block block;
     u32 block_number = 0;
@@ -102,12 +160,12 @@ ir_eat(u32 *data, u32 size)
         
         if (inst->data.opcode == OpBranch) {
             u32 edge_id = inst->data.OpBranch.target_label;
-            u32 edge_index = search_item_u32(labels, bb_count, edge_id);
+            u32 edge_index = label_index[edge_id];
             cfg_add_edge(&file.cfg, block_number, edge_index);
         } else if (inst->data.opcode == OpBranchConditional) {
             file.cfg.conditions[block_number] = inst->data.OpBranchConditional.condition;
-            u32 true_edge = search_item_u32(labels, bb_count, inst->data.OpBranchConditional.true_label);
-            u32 false_edge = search_item_u32(labels, bb_count, inst->data.OpBranchConditional.false_label);
+            u32 true_edge = label_index[inst->data.OpBranchConditional.true_label];
+            u32 false_edge = label_index[inst->data.OpBranchConditional.false_label];
             cfg_add_edge(&file.cfg, block_number, true_edge);
             cfg_add_edge(&file.cfg, block_number, false_edge);
         }
@@ -136,40 +194,59 @@ ir_eat(u32 *data, u32 size)
     file.post_cfg = inst;
     // =======================
     
+    free(label_index);
+    vector_free(&labels);
+    
     return(file);
 }
 
+static void
+ir_serialize_instruction(struct instruction_t *instruction, u32 *buffer, struct uint_vector *words)
+{
+    u32 *instruction_words = instruction_dump(instruction, buffer);
+    for (u32 i = 0; i < instruction->wordcount; ++i) {
+        vector_push(words, instruction_words[i]);
+    }
+}
+
 void
-ir_dump(struct ir *file, const char *filename)
+ir_serialize(struct ir *file, struct uint_vector *words)
 {
     struct cfg_dfs_result dfs = cfg_dfs(&file->cfg);
+    free(file->cfg.dominators);
     file->cfg.dominators = cfg_dominators(&file->cfg, &dfs);
     
     struct ir_cfg dominator_graph = cfg_init(file->cfg.labels.data, file->cfg.labels.size);
     for (u32 i = 1; i < file->cfg.labels.size; ++i) {
-        cfg_add_edge(&dominator_graph, file->cfg.dominators[i], i);
+        if (file->cfg.dominators[i] != -1) {
+            cfg_add_edge(&dominator_graph, file->cfg.dominators[i], i);
+        }
     }
     
     //cfg_show(&dominator_graph);
     
     struct uint_vector dom_bfs = cfg_bfs_order(&dominator_graph);
     
-    FILE *stream = fopen(filename, "wb");
-    u32 buffer[256];
-    
-    if (!file) {
-        fprintf(stderr, "[ERROR] Can not write output\n");
-        exit(1);
+    // NOTE: unreachable blocks have no dominator, they go last
+    for (u32 i = 1; i < file->cfg.labels.size; ++i) {
+        if (file->cfg.dominators[i] == -1) {
+            vector_push(&dom_bfs, i);
+        }
     }
     
-    fwrite(&file->header, sizeof(struct ir_header), 1, stream);
+    // NOTE: enough for the largest instruction (the word count is 16 bits wide)
+    u32 *buffer = malloc((WORDCOUNT_MASK >> 16) * sizeof(u32));
+    u32 *header = (u32 *) &file->header;
+    
+    words->size = 0;
+    for (u32 i = 0; i < sizeof(struct ir_header) / 4; ++i) {
+        vector_push(words, header[i]);
+    }
     
     struct instruction_list *inst = file->pre_cfg;
-    u32 *words;
     
     do {
-        words = instruction_dump(&inst->data, buffer);
-        fwrite(words, inst->data.wordcount * 4, 1, stream);
+        ir_serialize_instruction(&inst->data, buffer, words);
         inst = inst->next;
     } while (inst);
     
@@ -177,7 +254,7 @@ ir_dump(struct ir *file, const char *filename)
     // way the validation rule 'The order of blocks in a function 
     // must satisfy the rule that blocks appear before all blocks 
     // they dominate' is fulfilled
-    for (u32 i = 0; i < file->cfg.labels.size; ++i) {
+    for (u32 i = 0; i < dom_bfs.size; ++i) {
         u32 block_index = dom_bfs.data[i];
         if (file->cfg.labels.data[block_index] == 0) {
             continue;
@@ -194,13 +271,11 @@ ir_dump(struct ir *file, const char *filename)
             .OpLabel = label_operand
         };
         
-        words = instruction_dump(&label_inst, buffer);
-        fwrite(words, label_inst.wordcount * 4, 1, stream);
+        ir_serialize_instruction(&label_inst, buffer, words);
         
         inst = block.instructions;
         while (inst) {
-            words = instruction_dump(&inst->data, buffer);
-            fwrite(words, inst->data.wordcount * 4, 1, stream);
+            ir_serialize_instruction(&inst->data, buffer, words);
             inst = inst->next;
         }
         
@@ -232,18 +307,38 @@ ir_dump(struct ir *file, const char *filename)
             ASSERT(false);
         }
         
-        words = instruction_dump(&termination_inst, buffer);
-        fwrite(buffer, termination_inst.wordcount * 4, 1, stream);
+        ir_serialize_instruction(&termination_inst, buffer, words);
     }
     
     inst = file->post_cfg;
     do {
-        words = instruction_dump(&inst->data, buffer);
-        fwrite(words, inst->data.wordcount * 4, 1, stream);
+        ir_serialize_instruction(&inst->data, buffer, words);
         inst = inst->next;
     } while (inst);
     
+    free(buffer);
+    vector_free(&dom_bfs);
+    cfg_free(&dominator_graph);
+    cfg_dfs_free(&dfs);
+}
+
+void
+ir_dump(struct ir *file, const char *filename)
+{
+    struct uint_vector words = vector_init();
+    ir_serialize(file, &words);
+    
+    FILE *stream = fopen(filename, "wb");
+    
+    if (!stream) {
+        fprintf(stderr, "[ERROR] Can not write output\n");
+        exit(1);
+    }
+    
+    fwrite(words.data, words.size * sizeof(u32), 1, stream);
+    
     fclose(stream);
+    vector_free(&words);
 }
 
 void
@@ -313,6 +408,31 @@ ir_append_instruction(struct basic_block *block, struct instruction_t instructio
     block->count++;
 }
 
+// NOTE: insert after 'after', or at the beginning of the block if 'after' is NULL. Returns
+// the new list entry, so that a sequence can be inserted without walking the list again
+static struct instruction_list *
+ir_insert_instruction(struct basic_block *block, struct instruction_list *after, struct instruction_t instruction)
+{
+    if (!after) {
+        ir_prepend_instruction(block, instruction);
+        return(block->instructions);
+    }
+    
+    struct instruction_list *inserted = malloc(sizeof(struct instruction_list));
+    inserted->data = instruction;
+    inserted->prev = after;
+    inserted->next = after->next;
+    
+    if (after->next) {
+        after->next->prev = inserted;
+    }
+    
+    after->next = inserted;
+    block->count++;
+    
+    return(inserted);
+}
+
 static void
 instruction_list_free(struct instruction_list *list)
 {
@@ -337,9 +457,187 @@ instruction_list_free(struct instruction_list *list)
     }
 }
 
+static struct instruction_list *
+ir_copy_instructions(struct instruction_list *list)
+{
+    struct instruction_list *first = NULL;
+    struct instruction_list *last = NULL;
+    
+    for (; list; list = list->next) {
+        struct instruction_list *copy = malloc(sizeof(struct instruction_list));
+        copy->data = instruction_clone(&list->data);
+        copy->next = NULL;
+        copy->prev = last;
+        
+        if (last) {
+            last->next = copy;
+        } else {
+            first = copy;
+        }
+        
+        last = copy;
+    }
+    
+    return(first);
+}
+
+void
+ir_snapshot(struct ir *file)
+{
+    struct ir_snapshot *snapshot = &file->snapshot;
+    u32 block_count = file->cfg.labels.size;
+    
+    ASSERT(!snapshot->active);
+    
+    // NOTE: the stamps are kept between the snapshots, so they only have to grow with the module
+    if (snapshot->stamp_capacity < block_count) {
+        snapshot->saved_stamp = realloc(snapshot->saved_stamp, block_count * sizeof(u32));
+        memset(snapshot->saved_stamp + snapshot->stamp_capacity, 0, (block_count - snapshot->stamp_capacity) * sizeof(u32));
+        snapshot->stamp_capacity = block_count;
+    }
+    
+    snapshot->active = true;
+    snapshot->stamp += 1;
+    snapshot->saved.size = 0;
+    snapshot->block_count = block_count;
+    snapshot->header = file->header;
+    snapshot->cfg_saved = false;
+    snapshot->globals_saved = false;
+}
+
+void
+ir_block_write(struct ir *file, u32 block_index)
+{
+    struct ir_snapshot *snapshot = &file->snapshot;
+    
+    if (!snapshot->active || block_index >= snapshot->block_count || 
+        snapshot->saved_stamp[block_index] == snapshot->stamp) {
+        return;
+    }
+    
+    snapshot->saved_stamp[block_index] = snapshot->stamp;
+    vector_push(&snapshot->saved, block_index);
+    
+    if (snapshot->saved.size > snapshot->block_capacity) {
+        snapshot->block_capacity = 2 * snapshot->saved.size;
+        snapshot->blocks = realloc(snapshot->blocks, snapshot->block_capacity * sizeof(struct basic_block));
+    }
+    
+    struct basic_block *block = file->blocks + block_index;
+    struct basic_block copy = {
+        .count = block->count,
+        .instructions = ir_copy_instructions(block->instructions)
+    };
+    
+    snapshot->blocks[snapshot->saved.size - 1] = copy;
+}
+
+void
+ir_cfg_write(struct ir *file)
+{
+    struct ir_snapshot *snapshot = &file->snapshot;
+    
+    if (snapshot->active && !snapshot->cfg_saved) {
+        snapshot->cfg = cfg_copy(&file->cfg);
+        snapshot->cfg_saved = true;
+    }
+}
+
+void
+ir_globals_write(struct ir *file)
+{
+    struct ir_snapshot *snapshot = &file->snapshot;
+    
+    if (snapshot->active && !snapshot->globals_saved) {
+        snapshot->pre_cfg = ir_copy_instructions(file->pre_cfg);
+        snapshot->post_cfg = ir_copy_instructions(file->post_cfg);
+        snapshot->globals_saved = true;
+    }
+}
+
+void
+ir_write_all(struct ir *file)
+{
+    ir_cfg_write(file);
+    ir_globals_write(file);
+    
+    for (u32 block_index = 0; block_index < file->cfg.labels.size; ++block_index) {
+        ir_block_write(file, block_index);
+    }
+}
+
+void
+ir_restore(struct ir *file)
+{
+    struct ir_snapshot *snapshot = &file->snapshot;
+    
+    ASSERT(snapshot->active);
+    
+    for (u32 i = 0; i < snapshot->saved.size; ++i) {
+        u32 block_index = snapshot->saved.data[i];
+        instruction_list_free(file->blocks[block_index].instructions);
+        file->blocks[block_index] = snapshot->blocks[i];
+    }
+    
+    for (u32 block_index = snapshot->block_count; block_index < file->cfg.labels.size; ++block_index) {
+        instruction_list_free(file->blocks[block_index].instructions);
+    }
+    
+    // NOTE: ir_add_bb saves the CFG, so the number of blocks can only change if it is saved
+    if (snapshot->cfg_saved) {
+        cfg_free(&file->cfg);
+        file->cfg = snapshot->cfg;
+        
+        struct cfg_dfs_result dfs = cfg_dfs(&file->cfg);
+        file->cfg.dominators = cfg_dominators(&file->cfg, &dfs);
+        cfg_dfs_free(&dfs);
+    }
+    
+    if (snapshot->globals_saved) {
+        instruction_list_free(file->pre_cfg);
+        instruction_list_free(file->post_cfg);
+        file->pre_cfg = snapshot->pre_cfg;
+        file->post_cfg = snapshot->post_cfg;
+    }
+    
+    file->header = snapshot->header;
+    snapshot->active = false;
+}
+
+void
+ir_commit(struct ir *file)
+{
+    struct ir_snapshot *snapshot = &file->snapshot;
+    
+    ASSERT(snapshot->active);
+    
+    for (u32 i = 0; i < snapshot->saved.size; ++i) {
+        instruction_list_free(snapshot->blocks[i].instructions);
+    }
+    
+    if (snapshot->cfg_saved) {
+        cfg_free(&snapshot->cfg);
+    }
+    
+    if (snapshot->globals_saved) {
+        instruction_list_free(snapshot->pre_cfg);
+        instruction_list_free(snapshot->post_cfg);
+    }
+    
+    snapshot->active = false;
+}
+
 void
 ir_destroy(struct ir *file)
 {
+    if (file->snapshot.active) {
+        ir_commit(file);
+    }
+    
+    free(file->snapshot.saved_stamp);
+    free(file->snapshot.blocks);
+    vector_free(&file->snapshot.saved);
+    
     for (u32 i = 0; i < file->cfg.labels.size; ++i) {
         instruction_list_free(file->blocks[i].instructions);
     }
@@ -356,6 +654,7 @@ ir_add_bb(struct ir *file)
     u32 label = file->header.bound;
     file->header.bound++;
     
+    ir_cfg_write(file);
     cfg_add_vertex(&file->cfg, label);
     
     struct basic_block new_block = {
@@ -370,40 +669,140 @@ ir_add_bb(struct ir *file)
 }
 
 void
-ir_add_opname(struct ir *file, u32 target_id, char *name)
+ir_remove_bb(struct ir *file, u32 block_index)
 {
-    struct instruction_list *inst = file->pre_cfg;
-    while (inst) {
-        if (inst->data.opcode == OpExecutionMode) {
-            u32 next_opcode = inst->next->data.opcode;
-            
-            while (next_opcode >= OpSourceContinued && next_opcode <= OpName) {
-                inst = inst->next;
-                next_opcode = inst->next->data.opcode;
-            }
-            
-            struct instruction_list *newinst = malloc(sizeof(struct instruction_list));
-            
-            newinst->next = inst->next;
-            newinst->prev = inst;
-            
-            if (inst->next) {
-                inst->next->prev = newinst;
-            }
-            
-            newinst->data.opcode = OpName;
-            newinst->data.unparsed_words = NULL;
-            newinst->data.OpName.target_id = target_id;
-            newinst->data.OpName.name = strdup(name);
-            
-            u32 literal_len = (u32) strlen(name) + 1;
-            newinst->data.wordcount = 2 + literal_len / 4 + 1;
-            
-            inst->next = newinst;
+    ir_block_write(file, block_index);
+    ir_cfg_write(file);
+    cfg_remove_vertex(&file->cfg, block_index);
+    instruction_list_free(file->blocks[block_index].instructions);
+    
+    file->blocks[block_index].instructions = NULL;
+    file->blocks[block_index].count = 0;
+}
+
+// NOTE: the deleted blocks (zero labels) are dropped from the block arrays and the 
+// edges are renumbered, keeping the order of the remaining blocks
+void
+ir_compact_blocks(struct ir *file)
+{
+    struct ir_cfg *cfg = &file->cfg;
+    u32 block_count = cfg->labels.size;
+    s32 *index = malloc(block_count * sizeof(s32));
+    u32 count = 0;
+    
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        index[block_index] = (cfg->labels.data[block_index] ? (s32) count++ : -1);
+    }
+    
+    if (count == block_count) {
+        free(index);
+        return;
+    }
+    
+    // NOTE: the blocks move, a snapshot has to be able to put every one of them back
+    ir_write_all(file);
+    
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        if (index[block_index] == -1) {
+            continue;
+        }
+        
+        u32 to = index[block_index];
+        cfg->labels.data[to] = cfg->labels.data[block_index];
+        cfg->conditions[to] = cfg->conditions[block_index];
+        cfg->out[to] = cfg->out[block_index];
+        cfg->in[to] = cfg->in[block_index];
+        file->blocks[to] = file->blocks[block_index];
+        
+        for (struct edge_list *edge = cfg->out[to]; edge; edge = edge->next) {
+            edge->data = index[edge->data];
         }
         
+        for (struct edge_list *edge = cfg->in[to]; edge; edge = edge->next) {
+            edge->data = index[edge->data];
+        }
+    }
+    
+    // NOTE: the lists at the end have moved, they must not be freed twice
+    for (u32 block_index = count; block_index < block_count; ++block_index) {
+        file->blocks[block_index].instructions = NULL;
+        file->blocks[block_index].count = 0;
+    }
+    
+    cfg->labels.size = count;
+    
+    struct cfg_dfs_result dfs = cfg_dfs(cfg);
+    free(cfg->dominators);
+    cfg->dominators = cfg_dominators(cfg, &dfs);
+    cfg_dfs_free(&dfs);
+    
+    free(index);
+}
+
+// NOTE: OpName's go after the entry points, execution modes and all the
+// debug instructions that are already there
+static struct instruction_list *
+ir_opname_anchor(struct ir *file)
+{
+    // NOTE: the anchor is only ever taken to insert names after it
+    ir_globals_write(file);
+    
+    struct instruction_list *inst = file->pre_cfg;
+    struct instruction_list *anchor = NULL;
+    
+    while (inst && inst->data.opcode != OpFunction) {
+        if (inst->data.opcode == OpEntryPoint || inst->data.opcode == OpExecutionMode) {
+            anchor = inst;
+        }
         inst = inst->next;
     }
+    
+    if (anchor) {
+        while (anchor->next && anchor->next->data.opcode >= OpSourceContinued && anchor->next->data.opcode <= OpString) {
+            anchor = anchor->next;
+        }
+    }
+    
+    return(anchor);
+}
+
+// NOTE: inserts an OpName right after 'after' and returns it, so that
+// many names can be inserted in order without searching for the anchor again
+static struct instruction_list *
+ir_insert_opname(struct instruction_list *after, u32 target_id, char *name)
+{
+    struct instruction_list *newinst = malloc(sizeof(struct instruction_list));
+    
+    newinst->next = after->next;
+    newinst->prev = after;
+    
+    if (after->next) {
+        after->next->prev = newinst;
+    }
+    
+    // NOTE: the literal is nul-terminated and padded with zeroes to a word boundary
+    u32 literal_words = ((u32) strlen(name) + 1 + 3) / 4;
+    
+    newinst->data.opcode = OpName;
+    newinst->data.unparsed_words = NULL;
+    newinst->data.OpName.target_id = target_id;
+    newinst->data.OpName.name = calloc(literal_words, sizeof(u32));
+    newinst->data.wordcount = 2 + literal_words;
+    
+    strcpy(newinst->data.OpName.name, name);
+    
+    after->next = newinst;
+    
+    return(newinst);
+}
+
+void
+ir_add_opname(struct ir *file, u32 target_id, char *name)
+{
+    struct instruction_list *anchor = (file->strip ? NULL : ir_opname_anchor(file));
+    if (anchor) {
+        ir_insert_opname(anchor, target_id, name);
+    }
 }
 
 void 
@@ -413,6 +812,8 @@ ir_delete_opname(struct ir *file, u32 target_id)
     while (inst) {
         if (inst->data.opcode == OpName) {
             if (inst->data.OpName.target_id == target_id) {
+                ir_globals_write(file);
+                
                 // NOTE: we know that OpName can not be the first instrction
                 inst->prev->next = inst->next;
                 if (inst->next) {
@@ -424,4 +825,130 @@ ir_delete_opname(struct ir *file, u32 target_id)
         }
         inst = inst->next;
     }
+}
+
+// NOTE: deletes the OpName's of all ids marked in 'targets' (indexed by id) in one go
+void
+ir_delete_opnames(struct ir *file, bool *targets)
+{
+    struct instruction_list *inst = file->pre_cfg;
+    while (inst) {
+        struct instruction_list *next = inst->next;
+        if (inst->data.opcode == OpName && targets[inst->data.OpName.target_id]) {
+            ir_globals_write(file);
+            
+            // NOTE: we know that OpName can not be the first instrction
+            inst->prev->next = inst->next;
+            if (inst->next) {
+                inst->next->prev = inst->prev;
+            }
+            free(inst);
+        }
+        inst = next;
+    }
+}
+
+// NOTE: deletes the decorations of all ids marked in 'targets' and takes them out of the
+// interface of the entry points, for the variables which are not declared anymore
+void
+ir_delete_decorations(struct ir *file, bool *targets)
+{
+    struct instruction_list *inst = file->pre_cfg;
+    while (inst) {
+        struct instruction_list *next = inst->next;
+        enum opcode_t opcode = inst->data.opcode;
+        u32 *words = inst->data.unparsed_words;
+        
+        if ((opcode == OpDecorate || opcode == OpMemberDecorate) && targets[words[1]]) {
+            ir_globals_write(file);
+            
+            // NOTE: we know that OpDecorate can not be the first instrction
+            inst->prev->next = inst->next;
+            if (inst->next) {
+                inst->next->prev = inst->prev;
+            }
+            free(words);
+            free(inst);
+        } else if (opcode == OpEntryPoint) {
+            // NOTE: the interface starts after the name, the last word of which has a zero top byte
+            u32 from = 3;
+            while (from < inst->data.wordcount && (words[from++] >> 24)) {
+            }
+            
+            bool changed = false;
+            for (u32 i = from; i < inst->data.wordcount; ++i) {
+                changed |= targets[words[i]];
+            }
+            
+            if (changed) {
+                ir_globals_write(file);
+                
+                u32 to = from;
+                for (u32 i = from; i < inst->data.wordcount; ++i) {
+                    if (!targets[words[i]]) {
+                        words[to++] = words[i];
+                    }
+                }
+                
+                inst->data.wordcount = to;
+                words[0] = (words[0] & OPCODE_MASK) | (to << 16);
+            }
+        }
+        
+        inst = next;
+    }
+}
+
+// NOTE: adds 'id' to the interface of every entry point which lists 'like', e.g. a Private
+// variable which replaces another one (SPIR-V 1.4 lists all the global variables there)
+void
+ir_add_interface(struct ir *file, u32 like, u32 id)
+{
+    for (struct instruction_list *inst = file->pre_cfg; inst; inst = inst->next) {
+        if (inst->data.opcode != OpEntryPoint) {
+            continue;
+        }
+        
+        u32 *words = inst->data.unparsed_words;
+        u32 from = 3;
+        while (from < inst->data.wordcount && (words[from++] >> 24)) {
+        }
+        
+        for (u32 i = from; i < inst->data.wordcount; ++i) {
+            if (words[i] == like) {
+                ir_globals_write(file);
+                
+                u32 count = inst->data.wordcount + 1;
+                words = realloc(words, count * sizeof(u32));
+                words[count - 1] = id;
+                words[0] = (words[0] & OPCODE_MASK) | (count << 16);
+                
+                inst->data.unparsed_words = words;
+                inst->data.wordcount = count;
+                break;
+            }
+        }
+    }
+}
+
+// NOTE: inserts a copy of the instruction into pre_cfg right before OpFunction,
+// i.e. at the end of the global declarations
+struct instruction_list *
+ir_add_global(struct ir *file, struct instruction_t instruction)
+{
+    ir_globals_write(file);
+    
+    struct instruction_list *inst = file->pre_cfg;
+    while (inst->data.opcode != OpFunction) {
+        inst = inst->next;
+    }
+    
+    struct instruction_list *newinst = malloc(sizeof(struct instruction_list));
+    newinst->data = instruction;
+    newinst->next = inst;
+    newinst->prev = inst->prev;
+    inst->prev->next = newinst;
+    inst->prev = newinst;
+    
+    return(newinst);
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include "headers.h"
 
 #include "opt.c"
+#include "pass.c"
 
 static u32 *
 get_binary(const char *filename, u32 *size)
@@ -27,25 +28,65 @@ get_binary(const char *filename, u32 *size)
     return(buffer);
 }
 
+static void
+usage(const char *name)
+{
+    fprintf(stderr, "[ERROR] Usage: ./%s [-p pass,pass,...] [-r rounds] [-s] [--strip] in out\n", name);
+}
+
 s32
 main(s32 argc, char **argv)
 {
-    if (argc != 3) {
-        fprintf(stderr, "[ERROR] Usage: ./%s in out", argv[0]);
+    struct pipeline pipeline = {
+        .passes = vector_init(),
+        .speculative = vector_init(),
+        .rounds = 1,
+        .stats = false
+    };
+    
+    const char *passes = "ssa,licm";
+    bool strip = false;
+    s32 arg = 1;
+    
+    for (; arg < argc - 2; ++arg) {
+        if (!strcmp(argv[arg], "-p") && arg + 1 < argc - 2) {
+            passes = argv[++arg];
+        } else if (!strcmp(argv[arg], "-r") && arg + 1 < argc - 2) {
+            char *end;
+            long rounds = strtol(argv[++arg], &end, 10);
+            pipeline.rounds = (*end || rounds <= 0 ? 0 : (u32) rounds); // NOTE: 0 is rejected below
+        } else if (!strcmp(argv[arg], "-s")) {
+            pipeline.stats = true;
+        } else if (!strcmp(argv[arg], "--strip")) {
+            strip = true;
+        } else {
+            break;
+        }
+    }
+    
+    if (argc < 3 || arg != argc - 2 || pipeline.rounds == 0) {
+        usage(argv[0]);
+        return(1);
+    }
+    
+    if (!pipeline_parse(&pipeline, passes)) {
         return(1);
     }
     
     u32 num_words;
-    u32 *words = get_binary(argv[1], &num_words);
+    u32 *words = get_binary(argv[arg], &num_words);
     ASSERT(words);
     
-    struct ir file = ir_eat(words, num_words);
+    struct ir file = ir_eat(words, num_words, strip);
     
-    ssa_convert(&file);
-    loop_invariant_code_motion(&file);
+    pipeline_run(&file, &pipeline);
     
-    ir_dump(&file, argv[2]);
+    ir_dump(&file, argv[arg + 1]);
     ir_destroy(&file);
     
+    vector_free(&pipeline.passes);
+    vector_free(&pipeline.speculative);
+    free(words);
+    
     return(0);
 }
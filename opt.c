@@ -1,274 +1,6562 @@
-static bool
-is_invariant(struct uint_vector *invariant, struct uint_vector *expressions, 
-             struct instruction_t *instructions, u32 operand)
+// NOTE: what the pointers of the function point to. A pointer is an OpVariable, an access
+// chain into another pointer or a copy of one. The root of a pointer is the variable it
+// points into, 0 if it is not known (e.g. a function parameter). Two different variables
+// never overlap, unless both live in memory shared with the outside: two Uniform class
+// variables might be bound to the same buffer
+struct memory {
+    u32 bound;
+    u32 **operands;
+    u32 *base;          // NOTE: id -> base of an access chain or operand of a copy, 0 if neither
+    bool *chain;        // NOTE: id -> is an access chain
+    u32 *storage_class; // NOTE: variable id -> storage class + 1, 0 if not a variable
+    bool *coherent;     // NOTE: variable id -> is decorated Volatile or Coherent, might change any time
+};
+
+static struct memory
+memory_init(struct ir *file)
 {
-    s32 invariant_index = search_item_u32(invariant->data, invariant->size, operand);
-    s32 expression_index = search_item_u32(expressions->data, expressions->size, operand);
+    u32 bound = file->header.bound;
     
-    if (invariant_index != -1 || expression_index == -1) {
-        return(true);
-    } else {
-        struct instruction_t instruction = instructions[expression_index];
-        switch (instruction.opcode) {
-            case OpPhi: {
-                return(false);
-            } break;
-            
-            case OpLoad: {
-                // NOTE: this has to be an OpLoad from an Input class variable
-                return(true);
-            } break;
-            
-            case OpCopyObject: {
-                u32 operand = instruction.OpCopyObject.operand;
-                return(is_invariant(invariant, expressions, instructions, operand));
-            } break;
+    struct memory memory = {
+        .bound = bound,
+        .operands = malloc((WORDCOUNT_MASK >> 16) * sizeof(u32 *)),
+        .base = calloc(bound, sizeof(u32)),
+        .chain = calloc(bound, sizeof(bool)),
+        .storage_class = calloc(bound, sizeof(u32)),
+        .coherent = calloc(bound, sizeof(bool))
+    };
+    
+    for (struct instruction_list *inst = file->pre_cfg; inst; inst = inst->next) {
+        struct instruction_t *instruction = &inst->data;
+        
+        if (instruction->opcode == OpVariable) {
+            memory.storage_class[instruction->OpVariable.result_id] = instruction->OpVariable.storage_class + 1;
+        } else if (instruction->opcode == OpDecorate && instruction->wordcount >= 3 && instruction->unparsed_words[1] < bound &&
+                   (instruction->unparsed_words[2] == DecorationVolatile || instruction->unparsed_words[2] == DecorationCoherent)) {
+            memory.coherent[instruction->unparsed_words[1]] = true;
+        }
+    }
+    
+    for (u32 block_index = 0; block_index < file->cfg.labels.size; ++block_index) {
+        for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+            struct instruction_t *instruction = &inst->data;
             
-            default: {
-                if (instruction.wordcount == 4) {
-                    // unary arithmetics
-                    u32 operand_1 = instruction.unary_arithmetics.operand;
-                    return(is_invariant(invariant, expressions, instructions, operand_1));
-                } else {
-                    // binary arithmetics
-                    u32 operand_1 = instruction.binary_arithmetics.operand_1;
-                    u32 operand_2 = instruction.binary_arithmetics.operand_2;
-                    
-                    bool invariant_1 = is_invariant(invariant, expressions, instructions, operand_1);
-                    bool invariant_2 = is_invariant(invariant, expressions, instructions, operand_2);
-                    
-                    return(invariant_1 && invariant_2);
-                }
+            if (instruction->opcode == OpVariable) {
+                memory.storage_class[instruction->OpVariable.result_id] = instruction->OpVariable.storage_class + 1;
+            } else if (instruction->opcode == OpAccessChain) {
+                memory.base[instruction->OpAccessChain.result_id] = instruction->OpAccessChain.base;
+                memory.chain[instruction->OpAccessChain.result_id] = true;
+            } else if (instruction->opcode == OpCopyObject) {
+                memory.base[instruction->OpCopyObject.result_id] = instruction->OpCopyObject.operand;
             }
         }
     }
+    
+    return(memory);
+}
+
+static void
+memory_free(struct memory *memory)
+{
+    free(memory->operands);
+    free(memory->base);
+    free(memory->chain);
+    free(memory->storage_class);
+    free(memory->coherent);
+}
+
+// NOTE: the pointer with the copies looked through. Two pointers with the same canonical
+// id always point to the same place, different ids might still overlap
+static u32
+memory_canonical(struct memory *memory, u32 pointer)
+{
+    while (pointer < memory->bound && memory->base[pointer] && !memory->chain[pointer]) {
+        pointer = memory->base[pointer];
+    }
+    return(pointer);
+}
+
+static u32
+memory_root(struct memory *memory, u32 pointer)
+{
+    while (pointer < memory->bound && memory->base[pointer]) {
+        pointer = memory->base[pointer];
+    }
+    return(pointer < memory->bound && memory->storage_class[pointer] ? pointer : 0);
+}
+
+// NOTE: only the stores of the invocation to the variable itself can change it
+static bool
+memory_private(struct memory *memory, u32 variable)
+{
+    u32 storage_class = memory->storage_class[variable] - 1;
+    return(storage_class == StorageClassFunction || storage_class == StorageClassPrivate);
+}
+
+static bool
+memory_read_only(struct memory *memory, u32 variable)
+{
+    u32 storage_class = memory->storage_class[variable] - 1;
+    return(storage_class == StorageClassInput || storage_class == StorageClassUniformConstant ||
+           storage_class == StorageClassPushConstant);
+}
+
+// NOTE: a value loaded from the variable stays valid until the invocation stores to it (or to
+// a variable which might overlap it). Other invocations writing to a Uniform class storage
+// buffer at the same time would be a data race, unless the variable is Coherent
+static bool
+memory_tracked(struct memory *memory, u32 variable)
+{
+    return(!memory->coherent[variable] &&
+           (memory_private(memory, variable) || memory_read_only(memory, variable) ||
+            memory->storage_class[variable] - 1 == StorageClassUniform));
 }
 
+// NOTE: instructions which might write anywhere: calls, extended instructions with pointer
+// operands (e.g. modf) and everything which is not understood (e.g. atomics and barriers)
 static bool
-mark_block(struct instruction_list **invariant, struct uint_vector *invariant_operands,
-           struct uint_vector *expressions, struct instruction_t *instructions, struct basic_block *block)
+memory_clobbers(struct memory *memory, struct instruction_t *instruction)
+{
+    return(instruction->opcode == OpExtInst || instruction_operands(instruction, memory->operands) == -1);
+}
+
+// NOTE: state of one loop invariant code motion run. Values and blocks are marked
+// with the stamp of the loop which is being processed, so nothing has to be
+// cleared between the loops
+struct licm {
+    struct ir *file;
+    u32 *buffer;
+    u32 id_capacity;
+    s32 *def_block;  // NOTE: id -> index of the defining block, -1 if defined outside of the blocks
+    u32 *invariant;  // NOTE: id -> stamp of the last loop the value was invariant in
+    struct memory memory;
+    u32 *written;    // NOTE: variable id -> stamp of the last loop which stores to it
+    u32 clobbered;   // NOTE: stamp of the last loop which might write anywhere
+    u32 shared;      // NOTE: stamp of the last loop which stores to a variable that is not private
+    u32 stamp;       // NOTE: the loop being processed
+    u32 *in_loop;    // NOTE: block index -> stamp of the last loop the block belonged to
+    u32 *visited;    // NOTE: block index -> 2 * stamp when entered, 2 * stamp + 1 when left
+    bool *reachable;
+};
+
+struct licm_loop {
+    u32 header;
+    u32 size;
+};
+
+static s32
+licm_compare_loops(const void *a, const void *b)
+{
+    const struct licm_loop *loop_a = a;
+    const struct licm_loop *loop_b = b;
+    
+    if (loop_a->size != loop_b->size) {
+        return(loop_a->size < loop_b->size ? -1 : 1);
+    }
+    
+    return(loop_a->header < loop_b->header ? -1 : (loop_a->header > loop_b->header));
+}
+
+// NOTE: the natural loop of a header: all blocks which reach a back edge
+// to the header without going through the header
+static struct uint_vector
+licm_body(struct licm *licm, u32 header, u32 stamp)
 {
-    bool changes = false;
-    struct instruction_list *instruction = block->instructions;
+    struct ir_cfg *cfg = &licm->file->cfg;
+    struct uint_vector body = vector_init();
+    struct int_stack work = stack_init();
+    
+    licm->in_loop[header] = stamp;
+    vector_push(&body, header);
+    
+    for (struct edge_list *edge = cfg->in[header]; edge; edge = edge->next) {
+        u32 latch = edge->data;
+        if (licm->reachable[latch] && licm->in_loop[latch] != stamp && dominates(header, latch, cfg->dominators)) {
+            licm->in_loop[latch] = stamp;
+            vector_push(&body, latch);
+            stack_push(&work, latch);
+        }
+    }
     
-    while (instruction) {
-        s32 object = -1;
-        if (instruction->data.opcode == OpCopyObject) { 
-            // NOTE: OpCopyObject is guranteed to back-reach all live operands
-            // except for an OpStore to an Output class variable
-            object = instruction->data.OpCopyObject.operand;
-        } else if (instruction->data.opcode == OpStore) {
-            // NOTE: OpStore to an Output class variable (that's the only one we generate)
-            // is always supported by a single OpCopyObject producer
-            u32 object = instruction->data.OpStore.object;
-            s32 source_index = search_item_u32(expressions->data, expressions->size, object);
-            ASSERT(source_index != -1);
-            object = instructions[source_index].OpCopyObject.operand;
+    while (work.size) {
+        u32 block_index = stack_pop(&work);
+        for (struct edge_list *edge = cfg->in[block_index]; edge; edge = edge->next) {
+            u32 pred = edge->data;
+            if (licm->reachable[pred] && licm->in_loop[pred] != stamp) {
+                licm->in_loop[pred] = stamp;
+                vector_push(&body, pred);
+                stack_push(&work, pred);
+            }
         }
+    }
+    
+    stack_free(&work);
+    
+    return(body);
+}
+
+// NOTE: blocks of the loop in reverse postorder, so that every value is
+// seen after all of its operands, except for the operands of OpPhi's
+static struct uint_vector
+licm_order(struct licm *licm, u32 header, u32 stamp, u32 size)
+{
+    struct ir_cfg *cfg = &licm->file->cfg;
+    struct uint_vector order = vector_init_sized(size);
+    struct int_stack node_stack = stack_init();
+    
+    order.size = size;
+    stack_push(&node_stack, header);
+    
+    while (node_stack.size) {
+        u32 node = stack_pop(&node_stack);
         
-        if (object != -1) {
-            if (is_invariant(invariant_operands, expressions, instructions, object)) {
-                if (vector_push_maybe(invariant_operands, object)) {
-                    invariant[invariant_operands->head - 1] = instruction;
+        if (licm->visited[node] < 2 * stamp) {
+            licm->visited[node] = 2 * stamp;
+            stack_push(&node_stack, node);
+            
+            for (struct edge_list *edge = cfg->out[node]; edge; edge = edge->next) {
+                u32 child = edge->data;
+                if (licm->in_loop[child] == stamp && licm->visited[child] < 2 * stamp) {
+                    stack_push(&node_stack, child);
                 }
-                changes = true;
             }
+        } else if (licm->visited[node] == 2 * stamp) {
+            licm->visited[node] = 2 * stamp + 1;
+            order.data[--size] = node;
         }
-        
-        instruction = instruction->next;
     }
     
-    return(changes);
+    ASSERT(size == 0);
+    
+    stack_free(&node_stack);
+    
+    return(order);
 }
 
-// NOTE: OpStore to this variable dominates all uses
-// a.k.a. there are no phi functions with this pointer
-// TODO: re-write for clean SSA
+// NOTE: the load reads memory which the loop being processed never writes to
 static bool
-dom_uses(struct ir *file, struct uint_vector *bfs, u32 pointer)
+licm_load_invariant(struct licm *licm, struct instruction_t *instruction)
 {
-    for (u32 block_index = 0; block_index < bfs->size; ++block_index) {
-        struct basic_block *block = file->blocks + bfs->data[block_index];
-        struct instruction_list *instruction = block->instructions;
-        
-        while (instruction) {
-            if (instruction->data.opcode == OpPhi) {
-                u32 var_count = (instruction->data.wordcount - 3) / 2;
-                for (u32 var_index = 0; var_index < var_count; ++var_index) {
-                    if (instruction->data.OpPhi.variables[var_index] == pointer) {
-                        return(false);
+    struct memory *memory = &licm->memory;
+    u32 root = memory_root(memory, instruction->OpLoad.pointer);
+    
+    if (!root || !memory_tracked(memory, root) || instruction->wordcount != 4) {
+        return(false);
+    }
+    
+    if (licm->written[root] == licm->stamp) {
+        return(false);
+    }
+    
+    return(memory_read_only(memory, root) ||
+           (licm->clobbered != licm->stamp && (memory_private(memory, root) || licm->shared != licm->stamp)));
+}
+
+// NOTE: the stores and the clobbers of a loop, see licm_load_invariant
+static void
+licm_mark_writes(struct licm *licm, struct uint_vector *body, u32 stamp)
+{
+    struct memory *memory = &licm->memory;
+    
+    licm->stamp = stamp;
+    
+    for (u32 i = 0; i < body->size; ++i) {
+        for (struct instruction_list *inst = licm->file->blocks[body->data[i]].instructions; inst; inst = inst->next) {
+            if (inst->data.opcode == OpStore) {
+                u32 root = memory_root(memory, inst->data.OpStore.pointer);
+                if (!root) {
+                    licm->clobbered = stamp;
+                } else {
+                    licm->written[root] = stamp;
+                    if (!memory_private(memory, root)) {
+                        licm->shared = stamp;
                     }
                 }
+            } else if (memory_clobbers(memory, &inst->data)) {
+                licm->clobbered = stamp;
             }
-            
-            instruction = instruction->next;
         }
     }
+}
+
+// NOTE: instructions without side effects, which can be executed once before the
+// loop. An OpLoad is only hoisted if the loop does not write to the memory it reads
+static bool
+licm_hoistable(struct licm *licm, struct instruction_t *instruction)
+{
+    switch (instruction->opcode) {
+        case OpLoad: {
+            return(licm_load_invariant(licm, instruction));
+        }
+        
+        case OpAccessChain:
+        case OpCopyObject:
+        case OpSNegate:
+        case OpFNegate:
+        case OpIAdd:
+        case OpFAdd:
+        case OpISub:
+        case OpFSub:
+        case OpIMul:
+        case OpFMul:
+        case OpUDiv:
+        case OpSDiv:
+        case OpFDiv:
+        case OpUMod:
+        case OpSRem:
+        case OpSMod:
+        case OpFRem:
+        case OpFMod: {
+            return(true);
+        }
+        
+        default: {
+            // NOTE: comparisons are not parsed, but all of them are pure
+            return(instruction->opcode >= OpIEqual && instruction->opcode <= OpFUnordGreaterThanEqual);
+        }
+    }
+}
+
+static u32
+licm_result_id(struct instruction_t *instruction)
+{
+    if (instruction->opcode >= OpIEqual && instruction->opcode <= OpFUnordGreaterThanEqual) {
+        return(instruction->unparsed_words[2]);
+    }
     
-    return(true);
+    return(get_result_id(instruction));
 }
 
-// NOTE: OpStore dominates all exits
-// TODO: re-write for clean SSA
+// NOTE: all operands are either defined outside of the loop, or are invariant
+// themselves. Literal operands, which look like ids, make this conservative
 static bool
-dom_exits(struct ir *file, struct uint_vector *bfs, u32 var_block_index)
+licm_invariant(struct licm *licm, u32 *words, u32 wordcount, u32 stamp)
 {
-    struct basic_block header = file->blocks[bfs->data[0]];
-    struct instruction_list *instruction = header.instructions;
-    u32 merge_block = 0;
+    for (u32 i = 3; i < wordcount; ++i) {
+        u32 operand = words[i];
+        if (operand < licm->id_capacity && licm->def_block[operand] != -1 &&
+            licm->in_loop[licm->def_block[operand]] == stamp && licm->invariant[operand] != stamp) {
+            return(false);
+        }
+    }
     
-    while (instruction) {
-        if (instruction->data.opcode == OpLoopMerge) {
-            merge_block = instruction->data.OpLoopMerge.merge_block;
-            break;
+    return(true);
+}
+
+// NOTE: the block right before the header, which is executed once per entry to the loop.
+// The only block entering the loop is reused if it does nothing but enter the loop
+static s32
+licm_preheader(struct licm *licm, u32 header, u32 stamp)
+{
+    struct ir *file = licm->file;
+    struct uint_vector outside = vector_init();
+    
+    for (struct edge_list *edge = file->cfg.in[header]; edge; edge = edge->next) {
+        if (licm->in_loop[edge->data] != stamp) {
+            vector_push(&outside, edge->data);
         }
-        instruction = instruction->next;
     }
     
-    ASSERT(merge_block != 0);
-    u32 merge_block_index = search_item_u32(file->cfg.labels.data, 
-                                            file->cfg.labels.size,
-                                            merge_block);
+    if (outside.size == 0) {
+        vector_free(&outside);
+        return(-1);
+    }
     
-    for (u32 i = 0; i < bfs->size; ++i) {
-        u32 block_index = bfs->data[i];
-        struct edge_list *edge = file->cfg.out[block_index];
-        while (edge) {
-            if (edge->data == merge_block_index) {
-                if (!dominates(var_block_index, block_index, file->cfg.dominators)) {
-                    return(false);
-                }
+    if (outside.size == 1 && !file->cfg.out[outside.data[0]]->next) {
+        bool merge = false;
+        for (struct instruction_list *inst = file->blocks[outside.data[0]].instructions; inst; inst = inst->next) {
+            merge |= (inst->data.opcode == OpLoopMerge || inst->data.opcode == OpSelectionMerge);
+        }
+        if (!merge) {
+            u32 preheader_index = outside.data[0];
+            vector_free(&outside);
+            return(preheader_index);
+        }
+    }
+    
+    u32 preheader_index = ir_add_bb(file);
+    u32 preheader_label = file->cfg.labels.data[preheader_index];
+    
+    file->cfg.dominators = realloc(file->cfg.dominators, file->cfg.labels.size * sizeof(s32));
+    file->cfg.dominators[preheader_index] = file->cfg.dominators[header];
+    file->cfg.dominators[header] = preheader_index;
+    licm->reachable[preheader_index] = true;
+    licm->in_loop[preheader_index] = 0;
+    licm->visited[preheader_index] = 0;
+    
+    for (u32 i = 0; i < outside.size; ++i) {
+        cfg_redirect_edge(&file->cfg, outside.data[i], header, preheader_index);
+        outside.data[i] = file->cfg.labels.data[outside.data[i]];
+    }
+    
+    cfg_add_edge(&file->cfg, preheader_index, header);
+    
+    // NOTE: the operands coming from outside of the loop now come from the preheader.
+    // If there were several, they are merged by a new OpPhi in the preheader
+    for (struct instruction_list *inst = file->blocks[header].instructions; inst && inst->data.opcode == OpPhi; inst = inst->next) {
+        struct instruction_t *phi = &inst->data;
+        u32 count = (phi->wordcount - 3) / 2;
+        u32 kept = 0;
+        u32 merged_count = 0;
+        u32 *merged_variables = malloc(count * sizeof(u32));
+        u32 *merged_parents = malloc(count * sizeof(u32));
+        
+        for (u32 i = 0; i < count; ++i) {
+            if (search_item_u32(outside.data, outside.size, phi->OpPhi.parents[i]) != -1) {
+                merged_variables[merged_count] = phi->OpPhi.variables[i];
+                merged_parents[merged_count++] = phi->OpPhi.parents[i];
+            } else {
+                phi->OpPhi.variables[kept] = phi->OpPhi.variables[i];
+                phi->OpPhi.parents[kept++] = phi->OpPhi.parents[i];
             }
-            edge = edge->next;
         }
+        
+        u32 value = merged_variables[0];
+        
+        if (merged_count > 1) {
+            struct instruction_t merged = {
+                .opcode = OpPhi,
+                .wordcount = 3 + merged_count * 2,
+                .unparsed_words = NULL
+            };
+            
+            merged.OpPhi.result_type = phi->OpPhi.result_type;
+            merged.OpPhi.result_id = file->header.bound++;
+            merged.OpPhi.variables = merged_variables;
+            merged.OpPhi.parents = merged_parents;
+            
+            ir_append_instruction(file->blocks + preheader_index, merged);
+            licm->def_block[merged.OpPhi.result_id] = preheader_index;
+            value = merged.OpPhi.result_id;
+        } else {
+            free(merged_variables);
+            free(merged_parents);
+        }
+        
+        phi->OpPhi.variables[kept] = value;
+        phi->OpPhi.parents[kept++] = preheader_label;
+        phi->wordcount = 3 + kept * 2;
     }
     
-    return(true);
+    vector_free(&outside);
+    
+    return(preheader_index);
 }
 
+// NOTE: hoist everything invariant in one pass over the loop in reverse postorder. The
+// invariance of a value is decided once, when it is reached, from its operands
 static void
-process_loop(struct ir *file, u32 header_block, u32 merge_block)
+licm_process_loop(struct licm *licm, u32 header, u32 stamp)
 {
-    struct uint_vector bfs = cfg_bfs_order_r(&file->cfg, header_block, merge_block);
-    struct uint_vector expressions = vector_init();
-    struct instruction_t instructions[128]; // TODO: count and malloc
+    struct ir *file = licm->file;
+    struct uint_vector body = licm_body(licm, header, stamp);
+    struct uint_vector order = licm_order(licm, header, stamp, body.size);
+    struct uint_vector hoisted_blocks = vector_init();
+    u32 hoisted_count = 0;
+    u32 instruction_count = 0;
     
-    // NOTE: collect 'expressions' from cycle
-    for (u32 block_index = 0; block_index < bfs.size; ++block_index) {
-        struct basic_block *block = file->blocks + bfs.data[block_index];
-        struct instruction_list *instruction = block->instructions;
-        while (instruction) {
-            enum opcode_t opcode = instruction->data.opcode;
-            if (produces_result_id(opcode)) {
-                instructions[expressions.head] = instruction->data;
-                vector_push(&expressions, get_result_id(&instruction->data));
-            }
-            instruction = instruction->next;
+    for (u32 i = 0; i < body.size; ++i) {
+        for (struct instruction_list *inst = file->blocks[body.data[i]].instructions; inst; inst = inst->next) {
+            ++instruction_count;
         }
     }
     
-    bool changes = true;
-    struct instruction_list *invariant[100];  // TODO: count and malloc
-    struct uint_vector invariant_operands = vector_init();
-    struct uint_vector blocks = vector_init();
+    struct instruction_list **hoisted = malloc(instruction_count * sizeof(struct instruction_list *));
     
-    while (changes) {
-        changes = false;
-        for (u32 i = 0; i < bfs.size; ++i) {
-            u32 block_index = bfs.data[i];
-            struct basic_block *block = file->blocks + block_index;
-            u32 last_invariant_size = invariant_operands.size;
-            
-            if (mark_block(invariant, &invariant_operands, 
-                           &expressions, instructions, block) && invariant_operands.size > last_invariant_size) {
-                // NOTE: we will later need to know the basic block for each invariant operand
-                while (last_invariant_size != invariant_operands.size) {
-                    vector_push(&blocks, block_index);
-                    ++last_invariant_size;
+    licm_mark_writes(licm, &body, stamp);
+    
+    for (u32 i = 0; i < order.size; ++i) {
+        u32 block_index = order.data[i];
+        for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+            if (licm_hoistable(licm, &inst->data)) {
+                u32 *words = instruction_dump(&inst->data, licm->buffer);
+                if (licm_invariant(licm, words, inst->data.wordcount, stamp)) {
+                    licm->invariant[licm_result_id(&inst->data)] = stamp;
+                    hoisted[hoisted_count++] = inst;
+                    vector_push(&hoisted_blocks, block_index);
                 }
-                
-                changes = true;
             }
         }
     }
     
-    if (invariant_operands.size > 0) {
-        u32 header_index = bfs.data[0];
-        u32 preheader_index = ir_add_bb(file);
+    s32 preheader_index = (hoisted_count ? licm_preheader(licm, header, stamp) : -1);
+    
+    if (preheader_index != -1) {
         struct basic_block *preheader = file->blocks + preheader_index;
+        struct instruction_list *tail = preheader->instructions;
+        
+        while (tail && tail->next) {
+            tail = tail->next;
+        }
+        
+        for (u32 i = 0; i < hoisted_count; ++i) {
+            u32 result_id = licm_result_id(&hoisted[i]->data);
+            tail = ir_insert_instruction(preheader, tail, hoisted[i]->data);
+            ir_delete_instruction(file->blocks + hoisted_blocks.data[i], hoisted[i]);
+            licm->def_block[result_id] = preheader_index;
+        }
+    }
+    
+    free(hoisted);
+    vector_free(&hoisted_blocks);
+    vector_free(&order);
+    vector_free(&body);
+}
+
+// NOTE: the state shared by the loop passes: dominators, definitions and all the 
+// structured loops, sorted innermost first (an inner loop is strictly contained in the 
+// outer one, so it is smaller). The loop at index i uses the stamp 'loop_count + i + 1'. 
+// 'extra_ids' is room for the ids the caller is going to create
+static struct licm
+licm_init(struct ir *file, struct cfg_dfs_result *dfs, struct licm_loop **loops_out, u32 *loop_count_out, u32 extra_ids)
+{
+    u32 bound = file->header.bound;
+    u32 block_count = file->cfg.labels.size;
+    
+    free(file->cfg.dominators);
+    file->cfg.dominators = cfg_dominators(&file->cfg, dfs);
+    
+    struct licm licm = {
+        .file = file,
+        .buffer = malloc((WORDCOUNT_MASK >> 16) * sizeof(u32)),
+        .memory = memory_init(file),
+        .written = calloc(bound, sizeof(u32))
+    };
+    
+    // NOTE: locate all loops (header and merge block identify a structured loop) and all
+    // definitions in one walk. Each loop adds at most one preheader, and one OpPhi per 
+    // OpPhi in the header. The result of an instruction, which is not parsed, is guessed 
+    // to be the third word. Such a guess never overrides a known definition, so it can only 
+    // prevent hoisting
+    struct licm_loop *loops = malloc(block_count * sizeof(struct licm_loop));
+    struct uint_vector defined = vector_init();
+    struct uint_vector guessed = vector_init();
+    u32 loop_count = 0;
+    u32 new_ids = extra_ids;
+    
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        bool reachable = (block_index == 0 || dfs->preorder[block_index] != 0);
         
-        for (u32 i = 0; i < invariant_operands.size; ++i) {
-            bool cond1 = dom_uses(file, &bfs, blocks.data[i]);
-            //bool cond2 = dom_exits(&file, &bfs, blocks.data[i]);
+        for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+            enum opcode_t opcode = inst->data.opcode;
             
-            if (cond1) {
-                struct basic_block *block = file->blocks + blocks.data[i];
-                ir_append_instruction(preheader, invariant[i]->data);
-                ir_delete_instruction(block, invariant[i]);
+            if (opcode == OpPhi || opcode == OpVariable || opcode == OpLoad || licm_hoistable(&licm, &inst->data)) {
+                vector_push(&defined, licm_result_id(&inst->data));
+                vector_push(&defined, block_index);
+                new_ids += (opcode == OpPhi);
+            } else if (opcode == OpLoopMerge) {
+                if (reachable) {
+                    loops[loop_count++].header = block_index;
+                }
+                ++new_ids;
+            } else if (opcode != OpStore && opcode != OpSelectionMerge && 
+                       inst->data.wordcount >= 3 && inst->data.unparsed_words) {
+                vector_push(&guessed, inst->data.unparsed_words[2]);
+                vector_push(&guessed, block_index);
             }
         }
-        
-        // NOTE: redirect all header incoming edges (but not from the loop itself!)
-        struct uint_vector header_incoming = vector_init();
-        struct edge_list *edge = file->cfg.in[header_index];
-        while (edge) {
-            u32 from = edge->data;
-            if (search_item_u32(bfs.data, bfs.size, from) == -1) {
-                vector_push(&header_incoming, edge->data);
+    }
+    
+    u32 block_capacity = block_count + loop_count;
+    
+    licm.id_capacity = bound + new_ids;
+    licm.def_block = malloc(licm.id_capacity * sizeof(s32));
+    licm.invariant = calloc(licm.id_capacity, sizeof(u32));
+    licm.in_loop = calloc(block_capacity, sizeof(u32));
+    licm.visited = calloc(block_capacity, sizeof(u32));
+    licm.reachable = calloc(block_capacity, sizeof(bool));
+    
+    memset(licm.def_block, 0xFF, licm.id_capacity * sizeof(s32));
+    
+    for (u32 i = 0; i < defined.size; i += 2) {
+        licm.def_block[defined.data[i]] = defined.data[i + 1];
+    }
+    
+    for (u32 i = 0; i < guessed.size; i += 2) {
+        if (guessed.data[i] < licm.id_capacity && licm.def_block[guessed.data[i]] == -1) {
+            licm.def_block[guessed.data[i]] = guessed.data[i + 1];
+        }
+    }
+    
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        licm.reachable[block_index] = (block_index == 0 || dfs->preorder[block_index] != 0);
+    }
+    
+    for (u32 i = 0; i < loop_count; ++i) {
+        struct uint_vector body = licm_body(&licm, loops[i].header, i + 1);
+        loops[i].size = body.size;
+        vector_free(&body);
+    }
+    
+    qsort(loops, loop_count, sizeof(struct licm_loop), licm_compare_loops);
+    
+    vector_free(&defined);
+    vector_free(&guessed);
+    
+    *loops_out = loops;
+    *loop_count_out = loop_count;
+    
+    return(licm);
+}
+
+static void
+licm_free(struct licm *licm)
+{
+    free(licm->buffer);
+    free(licm->def_block);
+    free(licm->invariant);
+    memory_free(&licm->memory);
+    free(licm->written);
+    free(licm->in_loop);
+    free(licm->visited);
+    free(licm->reachable);
+}
+
+// NOTE: loops are processed innermost first, so that a value can be hoisted 
+// through all the loop levels it is invariant in during one run
+static void
+loop_invariant_code_motion(struct ir *file) 
+{
+    struct cfg_dfs_result dfs = cfg_dfs(&file->cfg);
+    struct licm_loop *loops;
+    u32 loop_count;
+    struct licm licm = licm_init(file, &dfs, &loops, &loop_count, 0);
+    
+    for (u32 i = 0; i < loop_count; ++i) {
+        licm_process_loop(&licm, loops[i].header, loop_count + i + 1);
+    }
+    
+    free(loops);
+    licm_free(&licm);
+    cfg_dfs_free(&dfs);
+}
+
+// NOTE: the layout of an instruction is not known, so any of its words may be an id 
+// (e.g. the target of an OpDecorate). Such ids have to stay as they are
+static void
+opt_mark_opaque(struct instruction_t *instruction, u32 **operands, bool *opaque, u32 bound)
+{
+    if (instruction_operands(instruction, operands) == -1) {
+        for (u32 word = 1; word < instruction->wordcount; ++word) {
+            if (instruction->unparsed_words[word] < bound) {
+                opaque[instruction->unparsed_words[word]] = true;
+            }
+        }
+    }
+}
+
+static u32
+copy_find(u32 *replace, u32 id)
+{
+    u32 root = id;
+    while (replace[root] != root) {
+        root = replace[root];
+    }
+    
+    // NOTE: path compression
+    while (replace[id] != root) {
+        u32 next = replace[id];
+        replace[id] = root;
+        id = next;
+    }
+    
+    return(root);
+}
+
+// NOTE: every use of an OpCopyObject result is replaced with its operand, and so is
+// every use of a trivial phi function, i.e. one which merges a single value (and maybe 
+// itself). Removing a trivial phi can make another one trivial, so this is repeated 
+// until nothing changes. The copies and phis are deleted afterwards, unless their result 
+// is referenced by an instruction which is not parsed (e.g. OpDecorate): such an id is 
+// kept, only its own operand is updated
+static void
+copy_propagation(struct ir *file)
+{
+    u32 bound = file->header.bound;
+    u32 block_count = file->cfg.labels.size;
+    u32 **operands = malloc((WORDCOUNT_MASK >> 16) * sizeof(u32 *));
+    u32 *replace = malloc(bound * sizeof(u32));
+    bool *opaque = calloc(bound, sizeof(bool));
+    bool *deleted = calloc(bound, sizeof(bool));
+    struct instruction_t **phis = NULL;
+    u32 phi_count = 0;
+    u32 phi_capacity = 0;
+    
+    for (u32 id = 0; id < bound; ++id) {
+        replace[id] = id;
+    }
+    
+    struct instruction_list *globals[] = { file->pre_cfg, file->post_cfg };
+    for (u32 i = 0; i < 2; ++i) {
+        for (struct instruction_list *inst = globals[i]; inst; inst = inst->next) {
+            opt_mark_opaque(&inst->data, operands, opaque, bound);
+        }
+    }
+    
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+            struct instruction_t *instruction = &inst->data;
+            
+            if (instruction->opcode == OpCopyObject) {
+                u32 operand = copy_find(replace, instruction->OpCopyObject.operand);
+                if (operand != instruction->OpCopyObject.result_id) {
+                    replace[instruction->OpCopyObject.result_id] = operand;
+                }
+            } else if (instruction->opcode == OpPhi) {
+                if (phi_count == phi_capacity) {
+                    phi_capacity = (phi_capacity ? phi_capacity * 2 : 64);
+                    phis = realloc(phis, phi_capacity * sizeof(struct instruction_t *));
+                }
+                phis[phi_count++] = instruction;
+            } else {
+                opt_mark_opaque(instruction, operands, opaque, bound);
             }
-            edge = edge->next;
         }
+    }
+    
+    bool changed = true;
+    while (changed) {
+        changed = false;
         
-        // NOTE: redirect all incoming edges to preheader and correct OpPhi operands
-        for (u32 i = 0; i < header_incoming.size; ++i) {
-            cfg_redirect_edge(&file->cfg, header_incoming.data[i], header_index, preheader_index);
+        for (u32 i = 0; i < phi_count; ++i) {
+            struct instruction_t *phi = phis[i];
+            u32 result_id = phi->OpPhi.result_id;
             
-            u32 from_label = file->cfg.labels.data[header_incoming.data[i]];
-            u32 preheader_label = file->cfg.labels.data[preheader_index];
-            struct instruction_list *header_instructions = file->blocks[header_block].instructions;
+            if (replace[result_id] != result_id) {
+                continue;
+            }
             
-            while (header_instructions) {
-                if (header_instructions->data.opcode == OpPhi) {
-                    u32 phi_parents_count = (header_instructions->data.wordcount - 3) / 2;
-                    for (u32 phi_parent = 0; phi_parent < phi_parents_count; ++phi_parent) {
-                        if (header_instructions->data.OpPhi.parents[phi_parent] == from_label) {
-                            header_instructions->data.OpPhi.parents[phi_parent] = preheader_label;
-                        }
-                    }
-                } else {
-                    // NOTE: there are no more OpPhi's. That's defined by the SPIR-V specification
+            u32 value = 0;
+            bool trivial = true;
+            
+            for (u32 j = 0; j < (phi->wordcount - 3) / 2; ++j) {
+                u32 operand = copy_find(replace, phi->OpPhi.variables[j]);
+                if (operand == result_id || operand == value) {
+                    continue;
+                }
+                
+                if (value != 0) {
+                    trivial = false;
                     break;
                 }
-                header_instructions = header_instructions->next;
+                
+                value = operand;
+            }
+            
+            // NOTE: a phi which only merges itself is unreachable, leave it be
+            if (trivial && value != 0) {
+                replace[result_id] = value;
+                changed = true;
             }
         }
+    }
+    
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        struct instruction_list *inst = file->blocks[block_index].instructions;
         
-        // NOTE: make an edge from preheader to header
-        cfg_add_edge(&file->cfg, preheader_index, header_index);
+        while (inst) {
+            struct instruction_list *next = inst->next;
+            struct instruction_t *instruction = &inst->data;
+            s32 count = instruction_operands(instruction, operands);
+            
+            for (s32 i = 0; i < count; ++i) {
+                *operands[i] = copy_find(replace, *operands[i]);
+            }
+            
+            if (instruction->opcode == OpCopyObject || instruction->opcode == OpPhi) {
+                u32 result_id = instruction_result_id(instruction);
+                if (replace[result_id] != result_id && !opaque[result_id]) {
+                    deleted[result_id] = true;
+                    ir_delete_instruction(file->blocks + block_index, inst);
+                }
+            }
+            
+            inst = next;
+        }
         
+        if (file->cfg.conditions[block_index]) {
+            file->cfg.conditions[block_index] = copy_find(replace, file->cfg.conditions[block_index]);
+        }
     }
     
-    vector_free(&invariant_operands);
-    vector_free(&bfs);
-    vector_free(&expressions);
-    vector_free(&blocks);
+    ir_delete_opnames(file, deleted);
+    
+    free(phis);
+    free(operands);
+    free(replace);
+    free(opaque);
+    free(deleted);
 }
 
+// NOTE: state of a dead code elimination run
+struct adce {
+    u32 bound;
+    struct instruction_t **definition; // NOTE: id -> instruction in the blocks which defines it
+    bool *live;                        // NOTE: id -> is used by something live
+    struct int_stack worklist;
+    struct instruction_t **stores;
+    s32 *first_store;                  // NOTE: variable id -> first store to it, -1 if none
+    s32 *next_store;                   // NOTE: store -> next store to the same variable, -1 if none
+    u32 **operands;
+};
+
 static void
-loop_invariant_code_motion(struct ir *file) 
+adce_mark(struct adce *adce, u32 id)
 {
-    // NOTE: locate all loops (header and merge block 
-    // identify a structured loop)
-    for (u32 block_index = 0; block_index < file->cfg.labels.size; ++block_index) {
-        struct instruction_list *inst = file->blocks[block_index].instructions;
-        while (inst) {
-            if (inst->data.opcode == OpLoopMerge) {
-                u32 header_block = block_index;
-                u32 merge_block = inst->data.OpLoopMerge.merge_block;
-                process_loop(file, header_block, merge_block);
-                break;
-            }
-            inst = inst->next;
+    if (id < adce->bound && !adce->live[id]) {
+        adce->live[id] = true;
+        stack_push(&adce->worklist, id);
+    }
+}
+
+static void
+adce_mark_operands(struct adce *adce, struct instruction_t *instruction)
+{
+    s32 count = instruction_operands(instruction, adce->operands);
+    
+    if (count == -1) {
+        // NOTE: any of the words could be an id
+        for (u32 word = 1; word < instruction->wordcount; ++word) {
+            adce_mark(adce, instruction->unparsed_words[word]);
         }
     }
-}
\ No newline at end of file
+    
+    for (s32 i = 0; i < count; ++i) {
+        adce_mark(adce, *adce->operands[i]);
+    }
+}
+
+// NOTE: extended instructions are kept as well, not every instruction set is pure
+static bool
+adce_root(struct adce *adce, struct instruction_t *instruction)
+{
+    return(instruction->opcode == OpLoopMerge || instruction->opcode == OpSelectionMerge ||
+           instruction->opcode == OpExtInst || instruction_operands(instruction, adce->operands) == -1);
+}
+
+// NOTE: the Function class variable a pointer points into, 0 if it is anything else
+static u32
+adce_local_variable(struct adce *adce, u32 pointer)
+{
+    while (pointer < adce->bound && adce->definition[pointer]) {
+        struct instruction_t *instruction = adce->definition[pointer];
+        
+        if (instruction->opcode == OpAccessChain) {
+            pointer = instruction->OpAccessChain.base;
+        } else if (instruction->opcode == OpCopyObject) {
+            pointer = instruction->OpCopyObject.operand;
+        } else if (instruction->opcode == OpVariable && instruction->OpVariable.storage_class == StorageClassFunction) {
+            return(pointer);
+        } else {
+            return(0);
+        }
+    }
+    
+    return(0);
+}
+
+// NOTE: blocks which can not be reached from the entry are deleted, except for the 
+// merge blocks and continue targets of the structured constructs, which have to stay. 
+// Those are emptied and lose their outgoing edges instead, only a continue target keeps 
+// branching back to its loop header. The phi functions of the header get an OpUndef from it
+static void
+adce_remove_unreachable(struct ir *file)
+{
+    u32 bound = file->header.bound;
+    u32 block_count = file->cfg.labels.size;
+    struct cfg_dfs_result dfs = cfg_dfs(&file->cfg);
+    bool *reachable = calloc(block_count, sizeof(bool));
+    bool *structural = calloc(block_count, sizeof(bool));
+    bool *removed = calloc(bound, sizeof(bool)); // NOTE: label -> block was removed
+    u32 *label_block = malloc(bound * sizeof(u32));
+    u32 *loop_header = calloc(block_count, sizeof(u32)); // NOTE: continue target -> header + 1, 0 if none
+    u32 *undefs = calloc(bound, sizeof(u32));
+    
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        if (file->cfg.labels.data[block_index]) {
+            reachable[block_index] = (block_index == 0 || dfs.preorder[block_index] != 0);
+            label_block[file->cfg.labels.data[block_index]] = block_index;
+        }
+    }
+    
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        if (!reachable[block_index]) {
+            continue;
+        }
+        
+        for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+            if (inst->data.opcode == OpSelectionMerge) {
+                structural[label_block[inst->data.OpSelectionMerge.merge_block]] = true;
+            } else if (inst->data.opcode == OpLoopMerge) {
+                structural[label_block[inst->data.OpLoopMerge.merge_block]] = true;
+                structural[label_block[inst->data.OpLoopMerge.continue_block]] = true;
+                loop_header[label_block[inst->data.OpLoopMerge.continue_block]] = block_index + 1;
+            }
+        }
+    }
+    
+    // NOTE: the existing OpUndef's are reused, so that running this again changes nothing
+    for (struct instruction_list *inst = file->pre_cfg; inst; inst = inst->next) {
+        if (inst->data.opcode == OpUndef) {
+            undefs[inst->data.OpUndef.result_type] = inst->data.OpUndef.result_id;
+        }
+    }
+    
+    bool any_removed = false;
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        u32 label = file->cfg.labels.data[block_index];
+        if (reachable[block_index] || !label) {
+            continue;
+        }
+        
+        bool back_edge = false;
+        for (struct edge_list *edge = file->cfg.out[block_index]; edge; edge = edge->next) {
+            back_edge |= (edge->data + 1 == loop_header[block_index]);
+        }
+        
+        // NOTE: the results go away with the block, and so do their names
+        for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+            u32 result_id = instruction_result_id(&inst->data);
+            if (result_id && result_id < bound) {
+                removed[result_id] = true;
+            }
+        }
+        
+        ir_remove_bb(file, block_index);
+        removed[label] = true;
+        any_removed = true;
+        
+        // NOTE: an empty block without edges, written out as a lone OpReturn
+        if (structural[block_index]) {
+            file->cfg.labels.data[block_index] = label;
+        }
+        
+        if (back_edge) {
+            cfg_add_edge(&file->cfg, block_index, loop_header[block_index] - 1);
+        } else {
+            loop_header[block_index] = 0;
+        }
+    }
+    
+    // NOTE: drop the phi operands which come from the removed blocks
+    for (u32 block_index = 0; any_removed && block_index < block_count; ++block_index) {
+        for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+            if (inst->data.opcode != OpPhi) {
+                continue;
+            }
+            
+            struct opphi_t *phi = &inst->data.OpPhi;
+            u32 kept = 0;
+            
+            for (u32 i = 0; i < (inst->data.wordcount - 3) / 2; ++i) {
+                u32 parent = label_block[phi->parents[i]];
+                
+                if (!removed[phi->parents[i]]) {
+                    phi->variables[kept] = phi->variables[i];
+                    phi->parents[kept] = phi->parents[i];
+                    ++kept;
+                } else if (loop_header[parent] == block_index + 1) {
+                    phi->variables[kept] = ssa_undef(file, undefs, phi->result_type);
+                    phi->parents[kept] = phi->parents[i];
+                    ++kept;
+                }
+            }
+            
+            inst->data.wordcount = 3 + kept * 2;
+        }
+    }
+    
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        if (file->cfg.labels.data[block_index]) {
+            removed[file->cfg.labels.data[block_index]] = false;
+        }
+    }
+    
+    if (any_removed) {
+        ir_delete_opnames(file, removed);
+    }
+    
+    free(reachable);
+    free(structural);
+    free(removed);
+    free(label_block);
+    free(loop_header);
+    free(undefs);
+    cfg_dfs_free(&dfs);
+}
+
+// NOTE: mark and sweep. The roots are the instructions with side effects: stores to 
+// anything but Function class variables, the branch conditions, the merge instructions 
+// and everything which is not understood. A store to a Function class variable only becomes 
+// live when the variable does, i.e. when something live loads from it. All the other 
+// instructions with a result are deleted unless their result is (transitively) used by a root
+static void
+aggressive_dead_code_elimination(struct ir *file)
+{
+    adce_remove_unreachable(file);
+    
+    u32 bound = file->header.bound;
+    u32 block_count = file->cfg.labels.size;
+    
+    struct adce adce = {
+        .bound = bound,
+        .definition = calloc(bound, sizeof(struct instruction_t *)),
+        .live = calloc(bound, sizeof(bool)),
+        .worklist = stack_init(),
+        .first_store = malloc(bound * sizeof(s32)),
+        .operands = malloc((WORDCOUNT_MASK >> 16) * sizeof(u32 *))
+    };
+    
+    u32 store_count = 0;
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+            u32 result_id = instruction_result_id(&inst->data);
+            if (result_id && result_id < bound) {
+                adce.definition[result_id] = &inst->data;
+            }
+            store_count += (inst->data.opcode == OpStore);
+        }
+    }
+    
+    adce.stores = malloc((store_count + 1) * sizeof(struct instruction_t *));
+    adce.next_store = malloc((store_count + 1) * sizeof(s32));
+    memset(adce.first_store, 0xFF, bound * sizeof(s32));
+    store_count = 0;
+    
+    // NOTE: the ids referenced by the global instructions (entry points, decorations) stay
+    struct instruction_list *globals[] = { file->pre_cfg, file->post_cfg };
+    for (u32 i = 0; i < 2; ++i) {
+        for (struct instruction_list *inst = globals[i]; inst; inst = inst->next) {
+            if (inst->data.opcode != OpName) {
+                adce_mark_operands(&adce, &inst->data);
+            }
+        }
+    }
+    
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        if (!file->cfg.labels.data[block_index]) {
+            continue;
+        }
+        
+        if (file->cfg.conditions[block_index]) {
+            adce_mark(&adce, file->cfg.conditions[block_index]);
+        }
+        
+        for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+            struct instruction_t *instruction = &inst->data;
+            
+            if (instruction->opcode == OpStore) {
+                u32 variable = adce_local_variable(&adce, instruction->OpStore.pointer);
+                if (variable) {
+                    adce.stores[store_count] = instruction;
+                    adce.next_store[store_count] = adce.first_store[variable];
+                    adce.first_store[variable] = store_count++;
+                } else {
+                    adce_mark_operands(&adce, instruction);
+                }
+            } else if (adce_root(&adce, instruction)) {
+                adce_mark_operands(&adce, instruction);
+            }
+        }
+    }
+    
+    while (adce.worklist.size > 0) {
+        u32 id = stack_pop(&adce.worklist);
+        
+        if (adce.definition[id]) {
+            adce_mark_operands(&adce, adce.definition[id]);
+        }
+        
+        for (s32 store = adce.first_store[id]; store != -1; store = adce.next_store[store]) {
+            adce_mark_operands(&adce, adce.stores[store]);
+        }
+    }
+    
+    bool *deleted = calloc(bound, sizeof(bool));
+    
+    // NOTE: the stores go first, finding their variable follows the definitions of the
+    // pointers, which might be deleted as well
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        struct instruction_list *inst = file->blocks[block_index].instructions;
+        
+        while (inst) {
+            struct instruction_list *next = inst->next;
+            
+            if (inst->data.opcode == OpStore) {
+                u32 variable = adce_local_variable(&adce, inst->data.OpStore.pointer);
+                if (variable != 0 && !adce.live[variable]) {
+                    ir_delete_instruction(file->blocks + block_index, inst);
+                }
+            }
+            
+            inst = next;
+        }
+    }
+    
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        struct instruction_list *inst = file->blocks[block_index].instructions;
+        
+        while (inst) {
+            struct instruction_list *next = inst->next;
+            u32 result_id = instruction_result_id(&inst->data);
+            
+            if (result_id && result_id < bound && !adce_root(&adce, &inst->data) && !adce.live[result_id]) {
+                deleted[result_id] = true;
+                ir_delete_instruction(file->blocks + block_index, inst);
+            }
+            
+            inst = next;
+        }
+    }
+    
+    ir_delete_opnames(file, deleted);
+    
+    free(deleted);
+    free(adce.definition);
+    free(adce.live);
+    free(adce.stores);
+    free(adce.first_store);
+    free(adce.next_store);
+    free(adce.operands);
+    stack_free(&adce.worklist);
+}
+
+// NOTE: one value in the scoped hash table of the value numbering. The key is the 
+// instruction without its result id: (opcode, result type, operands...)
+struct gvn_entry {
+    u32 hash;
+    u32 key;    // NOTE: offset of the key in 'keys'
+    u32 length; // NOTE: zero marks an empty slot
+    u32 value;
+};
+
+struct gvn {
+    struct gvn_entry *table;
+    u32 mask;
+    struct uint_vector keys;
+    struct int_stack undo; // NOTE: slots filled in the current dominator tree path, in order
+    u32 *replace;          // NOTE: id -> the dominating id with the same value
+    u32 *buffer;
+    u32 *key;
+};
+
+static bool
+gvn_commutative(enum opcode_t opcode)
+{
+    switch (opcode) {
+        case OpIAdd:
+        case OpFAdd:
+        case OpIMul:
+        case OpFMul:
+        case OpLogicalEqual:
+        case OpLogicalNotEqual:
+        case OpLogicalOr:
+        case OpLogicalAnd:
+        case OpIEqual:
+        case OpINotEqual:
+        case OpBitwiseOr:
+        case OpBitwiseXor:
+        case OpBitwiseAnd: {
+            return(true);
+        }
+        
+        default: {
+            return(false);
+        }
+    }
+}
+
+// NOTE: instructions without side effects, the result of which only depends on the operands
+static bool
+gvn_candidate(struct instruction_t *instruction)
+{
+    enum opcode_t opcode = instruction->opcode;
+    return((opcode >= OpSNegate && opcode <= OpFMod) || opcode == OpAccessChain || 
+           opcode == OpVectorShuffle || opcode == OpCompositeExtract || opcode == OpCompositeInsert ||
+           instruction_all_operands(opcode));
+}
+
+// NOTE: everything but the result id: (opcode, result type, operands...). The operands of 
+// the commutative opcodes are sorted. Returns the length of the key
+static u32
+gvn_key(struct instruction_t *instruction, u32 *buffer, u32 *key)
+{
+    u32 *words = instruction_dump(instruction, buffer);
+    u32 length = instruction->wordcount - 1;
+    
+    key[0] = words[0];
+    key[1] = words[1];
+    memcpy(key + 2, words + 3, (length - 2) * sizeof(u32));
+    
+    if (gvn_commutative(instruction->opcode) && key[2] > key[3]) {
+        u32 swap = key[2];
+        key[2] = key[3];
+        key[3] = swap;
+    }
+    
+    return(length);
+}
+
+static u32
+gvn_hash(u32 *key, u32 length)
+{
+    // NOTE: FNV-1a over the words
+    u32 hash = 2166136261u;
+    for (u32 i = 0; i < length; ++i) {
+        hash = (hash ^ key[i]) * 16777619u;
+    }
+    return(hash);
+}
+
+// NOTE: returns the value with the same key if there is one in scope, otherwise
+// adds 'value' under the key and returns it
+static u32
+gvn_find_or_insert(struct gvn *gvn, u32 *key, u32 length, u32 value)
+{
+    u32 hash = gvn_hash(key, length);
+    u32 slot = hash & gvn->mask;
+    
+    while (gvn->table[slot].length) {
+        struct gvn_entry *entry = gvn->table + slot;
+        if (entry->hash == hash && entry->length == length && 
+            !memcmp(gvn->keys.data + entry->key, key, length * sizeof(u32))) {
+            return(entry->value);
+        }
+        slot = (slot + 1) & gvn->mask;
+    }
+    
+    struct gvn_entry entry = {
+        .hash = hash,
+        .key = gvn->keys.size,
+        .length = length,
+        .value = value
+    };
+    
+    for (u32 i = 0; i < length; ++i) {
+        vector_push(&gvn->keys, key[i]);
+    }
+    
+    gvn->table[slot] = entry;
+    stack_push(&gvn->undo, slot);
+    
+    return(value);
+}
+
+// NOTE: leave a dominator tree node. Entries are removed in the reverse order of
+// insertion, so with linear probing the slots can simply be emptied
+static void
+gvn_restore(struct gvn *gvn, u32 undo_mark, u32 keys_mark)
+{
+    while (gvn->undo.size > undo_mark) {
+        gvn->table[stack_pop(&gvn->undo)].length = 0;
+    }
+    gvn->keys.size = keys_mark;
+}
+
+// NOTE: value numbering in a preorder walk of the dominator tree: an instruction which 
+// computes the same (opcode, type, operands) as one in a dominating block is deleted and
+// its uses are given the dominating result. The operands of the commutative opcodes are 
+// sorted in the key, so 'a + b' and 'b + a' get the same number. Loads, phis and everything 
+// with side effects are left alone, and so are the results referenced by decorations
+static void
+global_value_numbering(struct ir *file)
+{
+    u32 bound = file->header.bound;
+    u32 block_count = file->cfg.labels.size;
+    struct cfg_dfs_result dfs = cfg_dfs(&file->cfg);
+    
+    free(file->cfg.dominators);
+    file->cfg.dominators = cfg_dominators(&file->cfg, &dfs);
+    
+    u32 **operands = malloc((WORDCOUNT_MASK >> 16) * sizeof(u32 *));
+    bool *opaque = calloc(bound, sizeof(bool));
+    bool *deleted = calloc(bound, sizeof(bool));
+    u32 candidates = 0;
+    
+    struct instruction_list *globals[] = { file->pre_cfg, file->post_cfg };
+    for (u32 i = 0; i < 2; ++i) {
+        for (struct instruction_list *inst = globals[i]; inst; inst = inst->next) {
+            opt_mark_opaque(&inst->data, operands, opaque, bound);
+        }
+    }
+    
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+            opt_mark_opaque(&inst->data, operands, opaque, bound);
+            candidates += gvn_candidate(&inst->data);
+        }
+    }
+    
+    u32 capacity = 16;
+    while (capacity < candidates * 2) {
+        capacity *= 2;
+    }
+    
+    struct gvn gvn = {
+        .table = calloc(capacity, sizeof(struct gvn_entry)),
+        .mask = capacity - 1,
+        .keys = vector_init(),
+        .undo = stack_init(),
+        .replace = malloc(bound * sizeof(u32)),
+        .buffer = malloc((WORDCOUNT_MASK >> 16) * sizeof(u32)),
+        .key = malloc((WORDCOUNT_MASK >> 16) * sizeof(u32))
+    };
+    
+    for (u32 id = 0; id < bound; ++id) {
+        gvn.replace[id] = id;
+    }
+    
+    s32 *first_child = malloc(block_count * sizeof(s32));
+    s32 *next_sibling = malloc(block_count * sizeof(s32));
+    u32 *undo_mark = malloc(block_count * sizeof(u32));
+    u32 *keys_mark = malloc(block_count * sizeof(u32));
+    
+    memset(first_child, 0xFF, block_count * sizeof(s32));
+    for (u32 i = block_count - 1; i > 0; --i) {
+        s32 parent = file->cfg.dominators[i];
+        if (parent != -1) {
+            next_sibling[i] = first_child[parent];
+            first_child[parent] = i;
+        }
+    }
+    
+    // NOTE: a negative entry -(block + 1) means that the subtree of the block is done
+    struct int_stack walk = stack_init();
+    stack_push(&walk, 0);
+    
+    while (walk.size > 0) {
+        s32 top = stack_pop(&walk);
+        
+        if (top < 0) {
+            gvn_restore(&gvn, undo_mark[-top - 1], keys_mark[-top - 1]);
+            continue;
+        }
+        
+        u32 block_index = top;
+        undo_mark[block_index] = gvn.undo.size;
+        keys_mark[block_index] = gvn.keys.size;
+        stack_push(&walk, -top - 1);
+        
+        for (s32 child = first_child[block_index]; child != -1; child = next_sibling[child]) {
+            stack_push(&walk, child);
+        }
+        
+        struct instruction_list *inst = file->blocks[block_index].instructions;
+        while (inst) {
+            struct instruction_list *next = inst->next;
+            struct instruction_t *instruction = &inst->data;
+            s32 count = instruction_operands(instruction, operands);
+            
+            for (s32 i = 0; i < count; ++i) {
+                *operands[i] = gvn.replace[*operands[i]];
+            }
+            
+            u32 result_id = instruction_result_id(instruction);
+            
+            if (gvn_candidate(instruction) && !opaque[result_id]) {
+                u32 length = gvn_key(instruction, gvn.buffer, gvn.key);
+                u32 value = gvn_find_or_insert(&gvn, gvn.key, length, result_id);
+                if (value != result_id) {
+                    gvn.replace[result_id] = value;
+                    deleted[result_id] = true;
+                    ir_delete_instruction(file->blocks + block_index, inst);
+                }
+            }
+            
+            inst = next;
+        }
+    }
+    
+    // NOTE: phis can use a value in a block which is not dominated by its definition
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+            s32 count = instruction_operands(&inst->data, operands);
+            for (s32 i = 0; i < count; ++i) {
+                *operands[i] = gvn.replace[*operands[i]];
+            }
+        }
+        
+        file->cfg.conditions[block_index] = gvn.replace[file->cfg.conditions[block_index]];
+    }
+    
+    ir_delete_opnames(file, deleted);
+    
+    stack_free(&walk);
+    stack_free(&gvn.undo);
+    vector_free(&gvn.keys);
+    free(gvn.table);
+    free(gvn.replace);
+    free(gvn.buffer);
+    free(gvn.key);
+    free(first_child);
+    free(next_sibling);
+    free(undo_mark);
+    free(keys_mark);
+    free(operands);
+    free(opaque);
+    free(deleted);
+    cfg_dfs_free(&dfs);
+}
+
+enum constant_kind {
+    CONSTANT_NONE,
+    CONSTANT_BOOL,
+    CONSTANT_INT,
+    CONSTANT_FLOAT
+};
+
+// NOTE: the typed constant table. Only the 32 bit (and boolean) scalars are known, 
+// wider types, vectors, composites and specialization constants are not in the table
+struct constants {
+    struct ir *file;
+    u32 bound;
+    u8 *kind;                // NOTE: id -> kind of the scalar type, or of the type of the constant
+    bool *known;             // NOTE: id -> is a constant with a known value
+    u32 *value;              // NOTE: id -> value of the constant, the bit pattern for floats
+    struct uint_vector list; // NOTE: (id, type, value) of all constants, including the new ones
+};
+
+static struct constants
+constants_init(struct ir *file)
+{
+    u32 bound = file->header.bound;
+    struct constants constants = {
+        .file = file,
+        .bound = bound,
+        .kind = calloc(bound, sizeof(u8)),
+        .known = calloc(bound, sizeof(bool)),
+        .value = calloc(bound, sizeof(u32)),
+        .list = vector_init()
+    };
+    
+    for (struct instruction_list *inst = file->pre_cfg; inst; inst = inst->next) {
+        struct instruction_t *instruction = &inst->data;
+        u32 type = 0;
+        u32 id = 0;
+        u32 value = 0;
+        
+        switch (instruction->opcode) {
+            case OpTypeBool: {
+                constants.kind[instruction->unparsed_words[1]] = CONSTANT_BOOL;
+            } break;
+            
+            case OpTypeInt: {
+                if (instruction->unparsed_words[2] == 32) {
+                    constants.kind[instruction->unparsed_words[1]] = CONSTANT_INT;
+                }
+            } break;
+            
+            case OpTypeFloat: {
+                if (instruction->unparsed_words[2] == 32) {
+                    constants.kind[instruction->unparsed_words[1]] = CONSTANT_FLOAT;
+                }
+            } break;
+            
+            case OpConstantTrue:
+            case OpConstantFalse: {
+                type = instruction->OpConstantTrue.result_type;
+                id = instruction->OpConstantTrue.result_id;
+                value = (instruction->opcode == OpConstantTrue);
+            } break;
+            
+            case OpConstant: {
+                if (instruction->wordcount == 4) {
+                    type = instruction->OpConstant.result_type;
+                    id = instruction->OpConstant.result_id;
+                    value = instruction->OpConstant.value;
+                }
+            } break;
+            
+            default: {
+            }
+        }
+        
+        if (id && constants.kind[type] != CONSTANT_NONE) {
+            constants.kind[id] = constants.kind[type];
+            constants.known[id] = true;
+            constants.value[id] = value;
+            vector_push(&constants.list, id);
+            vector_push(&constants.list, type);
+            vector_push(&constants.list, value);
+        }
+    }
+    
+    return(constants);
+}
+
+static void
+constants_free(struct constants *constants)
+{
+    free(constants->kind);
+    free(constants->known);
+    free(constants->value);
+    vector_free(&constants->list);
+}
+
+// NOTE: id of a constant of the given scalar type and value. A new one is declared if
+// the module does not have it yet. Shaders have few constants, a linear search will do
+static u32
+constants_get(struct constants *constants, u32 type, u32 value)
+{
+    for (u32 i = 0; i < constants->list.size; i += 3) {
+        if (constants->list.data[i + 1] == type && constants->list.data[i + 2] == value) {
+            return(constants->list.data[i]);
+        }
+    }
+    
+    struct ir *file = constants->file;
+    u32 id = file->header.bound++;
+    struct instruction_t instruction = { .unparsed_words = NULL };
+    
+    if (constants->kind[type] == CONSTANT_BOOL) {
+        instruction.opcode = (value ? OpConstantTrue : OpConstantFalse);
+        instruction.wordcount = 3;
+        instruction.OpConstantTrue.result_type = type;
+        instruction.OpConstantTrue.result_id = id;
+    } else {
+        instruction.opcode = OpConstant;
+        instruction.wordcount = 4;
+        instruction.OpConstant.result_type = type;
+        instruction.OpConstant.result_id = id;
+        instruction.OpConstant.value = value;
+    }
+    
+    ir_add_global(file, instruction);
+    
+    vector_push(&constants->list, id);
+    vector_push(&constants->list, type);
+    vector_push(&constants->list, value);
+    
+    return(id);
+}
+
+static f32
+constant_float(u32 bits)
+{
+    f32 value;
+    memcpy(&value, &bits, sizeof(f32));
+    return(value);
+}
+
+static u32
+constant_bits(f32 value)
+{
+    u32 bits;
+    memcpy(&bits, &value, sizeof(u32));
+    return(bits);
+}
+
+// NOTE: evaluate an instruction on 32 bit scalar operands. Returns false if the opcode 
+// can not be folded or the result is undefined (e.g. division by zero, a shift by 32 or 
+// more bits). Integers wrap around, floats are computed in single precision
+static bool
+constant_fold(enum opcode_t opcode, u32 *operands, u32 count, u32 *result)
+{
+    u32 a = operands[0];
+    u32 b = (count > 1 ? operands[1] : 0);
+    s32 sa = (s32) a;
+    s32 sb = (s32) b;
+    f32 fa = constant_float(a);
+    f32 fb = constant_float(b);
+    bool unordered = (fa != fa || fb != fb);
+    
+    switch (opcode) {
+        case OpSNegate: *result = 0u - a; break;
+        case OpFNegate: *result = a ^ 0x80000000u; break;
+        case OpIAdd: *result = a + b; break;
+        case OpISub: *result = a - b; break;
+        case OpIMul: *result = a * b; break;
+        case OpFAdd: *result = constant_bits(fa + fb); break;
+        case OpFSub: *result = constant_bits(fa - fb); break;
+        case OpFMul: *result = constant_bits(fa * fb); break;
+        case OpFDiv: *result = constant_bits(fa / fb); break;
+        
+        case OpUDiv:
+        case OpUMod: {
+            if (b == 0) {
+                return(false);
+            }
+            *result = (opcode == OpUDiv ? a / b : a % b);
+        } break;
+        
+        case OpSDiv:
+        case OpSRem:
+        case OpSMod: {
+            if (sb == 0 || (sa == INT32_MIN && sb == -1)) {
+                return(false);
+            }
+            
+            s32 remainder = sa % sb;
+            
+            if (opcode == OpSDiv) {
+                *result = (u32) (sa / sb);
+            } else if (opcode == OpSRem) {
+                *result = (u32) remainder;
+            } else {
+                // NOTE: the sign of the result follows the second operand
+                *result = (u32) (remainder != 0 && ((remainder < 0) != (sb < 0)) ? remainder + sb : remainder);
+            }
+        } break;
+        
+        case OpLogicalEqual: *result = (a == b); break;
+        case OpLogicalNotEqual: *result = (a != b); break;
+        case OpLogicalOr: *result = (a || b); break;
+        case OpLogicalAnd: *result = (a && b); break;
+        case OpLogicalNot: *result = !a; break;
+        case OpSelect: *result = (a ? b : operands[2]); break;
+        
+        case OpIEqual: *result = (a == b); break;
+        case OpINotEqual: *result = (a != b); break;
+        case OpUGreaterThan: *result = (a > b); break;
+        case OpSGreaterThan: *result = (sa > sb); break;
+        case OpUGreaterThanEqual: *result = (a >= b); break;
+        case OpSGreaterThanEqual: *result = (sa >= sb); break;
+        case OpULessThan: *result = (a < b); break;
+        case OpSLessThan: *result = (sa < sb); break;
+        case OpULessThanEqual: *result = (a <= b); break;
+        case OpSLessThanEqual: *result = (sa <= sb); break;
+        
+        case OpFOrdEqual: *result = (!unordered && fa == fb); break;
+        case OpFUnordEqual: *result = (unordered || fa == fb); break;
+        case OpFOrdNotEqual: *result = (!unordered && fa != fb); break;
+        case OpFUnordNotEqual: *result = (unordered || fa != fb); break;
+        case OpFOrdLessThan: *result = (!unordered && fa < fb); break;
+        case OpFUnordLessThan: *result = (unordered || fa < fb); break;
+        case OpFOrdGreaterThan: *result = (!unordered && fa > fb); break;
+        case OpFUnordGreaterThan: *result = (unordered || fa > fb); break;
+        case OpFOrdLessThanEqual: *result = (!unordered && fa <= fb); break;
+        case OpFUnordLessThanEqual: *result = (unordered || fa <= fb); break;
+        case OpFOrdGreaterThanEqual: *result = (!unordered && fa >= fb); break;
+        case OpFUnordGreaterThanEqual: *result = (unordered || fa >= fb); break;
+        
+        case OpShiftRightLogical:
+        case OpShiftRightArithmetic:
+        case OpShiftLeftLogical: {
+            if (b >= 32) {
+                return(false);
+            }
+            
+            if (opcode == OpShiftRightLogical) {
+                *result = a >> b;
+            } else if (opcode == OpShiftLeftLogical) {
+                *result = a << b;
+            } else {
+                // NOTE: right shift of a negative number is implementation defined in C
+                *result = (sa < 0 ? ~(~a >> b) : a >> b);
+            }
+        } break;
+        
+        case OpBitwiseOr: *result = a | b; break;
+        case OpBitwiseXor: *result = a ^ b; break;
+        case OpBitwiseAnd: *result = a & b; break;
+        case OpNot: *result = ~a; break;
+        
+        default: {
+            return(false);
+        }
+    }
+    
+    return(true);
+}
+
+enum sccp_state {
+    SCCP_TOP,      // NOTE: not known yet, the definition has not been reached
+    SCCP_CONSTANT,
+    SCCP_BOTTOM    // NOTE: not a constant
+};
+
+// NOTE: an instruction which uses a value. A NULL instruction stands for the branch condition
+struct sccp_use {
+    u32 block;
+    struct instruction_t *instruction;
+};
+
+struct sccp {
+    struct ir *file;
+    struct constants *constants;
+    u32 bound;
+    u8 *state;
+    u32 *value;
+    bool *defined;          // NOTE: id -> is defined in a basic block
+    u32 *use_first;         // NOTE: id -> first index in 'uses', the uses of 'id' end at use_first[id + 1]
+    struct sccp_use *uses;
+    u32 *label_block;
+    bool *executable_block;
+    bool *executable_edge;  // NOTE: 2 * block + position in the list of successors
+    struct int_stack edge_worklist;
+    struct int_stack value_worklist;
+    u32 **operands;
+    u32 *buffer;
+};
+
+static enum sccp_state
+sccp_get(struct sccp *sccp, u32 id, u32 *value)
+{
+    if (sccp->constants->known[id]) {
+        *value = sccp->constants->value[id];
+        return(SCCP_CONSTANT);
+    }
+    
+    if (!sccp->defined[id]) {
+        return(SCCP_BOTTOM);
+    }
+    
+    *value = sccp->value[id];
+    return(sccp->state[id]);
+}
+
+// NOTE: values only go down the lattice: TOP -> CONSTANT -> BOTTOM. Two different
+// constants meet at BOTTOM
+static void
+sccp_set(struct sccp *sccp, u32 id, enum sccp_state state, u32 value)
+{
+    enum sccp_state old = sccp->state[id];
+    
+    if (old == SCCP_BOTTOM || state == SCCP_TOP) {
+        return;
+    }
+    
+    if (old == SCCP_CONSTANT && state == SCCP_CONSTANT) {
+        if (value == sccp->value[id]) {
+            return;
+        }
+        state = SCCP_BOTTOM;
+    }
+    
+    sccp->state[id] = state;
+    sccp->value[id] = value;
+    stack_push(&sccp->value_worklist, id);
+}
+
+static void
+sccp_mark_edge(struct sccp *sccp, u32 block_index, u32 position)
+{
+    if (!sccp->executable_edge[block_index * 2 + position]) {
+        sccp->executable_edge[block_index * 2 + position] = true;
+        stack_push(&sccp->edge_worklist, block_index * 2 + position);
+    }
+}
+
+static bool
+sccp_edge_executable(struct sccp *sccp, u32 from, u32 to)
+{
+    u32 position = 0;
+    for (struct edge_list *edge = sccp->file->cfg.out[from]; edge; edge = edge->next, ++position) {
+        if (edge->data == to) {
+            return(sccp->executable_edge[from * 2 + position]);
+        }
+    }
+    return(false);
+}
+
+static void
+sccp_evaluate(struct sccp *sccp, u32 block_index, struct instruction_t *instruction)
+{
+    u32 result_id = instruction_result_id(instruction);
+    if (!result_id || !sccp->defined[result_id]) {
+        return;
+    }
+    
+    enum opcode_t opcode = instruction->opcode;
+    u32 result_type = instruction_dump(instruction, sccp->buffer)[1];
+    u32 value = 0;
+    
+    if (opcode == OpPhi) {
+        enum sccp_state state = SCCP_TOP;
+        
+        // NOTE: the meet of the operands which come through the executable edges
+        for (u32 i = 0; i < (instruction->wordcount - 3) / 2 && state != SCCP_BOTTOM; ++i) {
+            u32 parent = sccp->label_block[instruction->OpPhi.parents[i]];
+            u32 operand_value = 0;
+            
+            if (!sccp_edge_executable(sccp, parent, block_index)) {
+                continue;
+            }
+            
+            enum sccp_state operand = sccp_get(sccp, instruction->OpPhi.variables[i], &operand_value);
+            if (operand == SCCP_BOTTOM || (operand == SCCP_CONSTANT && state == SCCP_CONSTANT && operand_value != value)) {
+                state = SCCP_BOTTOM;
+            } else if (operand == SCCP_CONSTANT) {
+                state = SCCP_CONSTANT;
+                value = operand_value;
+            }
+        }
+        
+        sccp_set(sccp, result_id, state, value);
+        return;
+    }
+    
+    if (opcode == OpCopyObject) {
+        enum sccp_state state = sccp_get(sccp, instruction->OpCopyObject.operand, &value);
+        sccp_set(sccp, result_id, state, value);
+        return;
+    }
+    
+    s32 count = instruction_operands(instruction, sccp->operands);
+    
+    if (sccp->constants->kind[result_type] == CONSTANT_NONE || count < 1 || count > 3) {
+        sccp_set(sccp, result_id, SCCP_BOTTOM, 0);
+        return;
+    }
+    
+    u32 values[3];
+    enum sccp_state state = SCCP_CONSTANT;
+    
+    for (s32 i = 0; i < count; ++i) {
+        enum sccp_state operand = sccp_get(sccp, *sccp->operands[i], values + i);
+        state = (operand == SCCP_BOTTOM || state == SCCP_BOTTOM ? SCCP_BOTTOM : (operand == SCCP_TOP ? SCCP_TOP : state));
+    }
+    
+    // NOTE: a known condition selects one of the operands, whatever the other one is
+    if (opcode == OpSelect && state != SCCP_CONSTANT) {
+        u32 condition;
+        if (sccp_get(sccp, *sccp->operands[0], &condition) == SCCP_CONSTANT) {
+            state = sccp_get(sccp, *sccp->operands[condition ? 1 : 2], &value);
+            sccp_set(sccp, result_id, state, value);
+            return;
+        }
+    }
+    
+    if (state == SCCP_CONSTANT && !constant_fold(opcode, values, count, &value)) {
+        state = SCCP_BOTTOM;
+    }
+    
+    sccp_set(sccp, result_id, state, value);
+}
+
+static void
+sccp_evaluate_branch(struct sccp *sccp, u32 block_index)
+{
+    struct edge_list *out = sccp->file->cfg.out[block_index];
+    
+    if (!out) {
+        return;
+    }
+    
+    if (!out->next) {
+        sccp_mark_edge(sccp, block_index, 0);
+        return;
+    }
+    
+    u32 value = 0;
+    enum sccp_state state = sccp_get(sccp, sccp->file->cfg.conditions[block_index], &value);
+    
+    if (state == SCCP_CONSTANT) {
+        sccp_mark_edge(sccp, block_index, value ? 0 : 1);
+    } else if (state == SCCP_BOTTOM) {
+        sccp_mark_edge(sccp, block_index, 0);
+        sccp_mark_edge(sccp, block_index, 1);
+    }
+}
+
+static bool
+sccp_tracked(struct sccp *sccp, u32 id)
+{
+    return(id < sccp->bound && sccp->defined[id]);
+}
+
+// NOTE: def-use chains of the values defined in the blocks, in one array. The first 
+// pass counts the uses, the second one fills them in
+static void
+sccp_build_uses(struct sccp *sccp)
+{
+    struct ir *file = sccp->file;
+    u32 block_count = file->cfg.labels.size;
+    u32 total = 0;
+    
+    memset(sccp->use_first, 0, (sccp->bound + 1) * sizeof(u32));
+    
+    for (u32 pass = 0; pass < 2; ++pass) {
+        for (u32 block_index = 0; block_index < block_count; ++block_index) {
+            for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+                s32 count = instruction_operands(&inst->data, sccp->operands);
+                for (s32 i = 0; i < count; ++i) {
+                    u32 id = *sccp->operands[i];
+                    if (!sccp_tracked(sccp, id)) {
+                        continue;
+                    }
+                    
+                    if (pass == 0) {
+                        ++sccp->use_first[id];
+                    } else {
+                        struct sccp_use use = { block_index, &inst->data };
+                        sccp->uses[sccp->use_first[id]++] = use;
+                    }
+                }
+            }
+            
+            u32 condition = file->cfg.conditions[block_index];
+            if (condition && sccp_tracked(sccp, condition)) {
+                if (pass == 0) {
+                    ++sccp->use_first[condition];
+                } else {
+                    struct sccp_use use = { block_index, NULL };
+                    sccp->uses[sccp->use_first[condition]++] = use;
+                }
+            }
+        }
+        
+        // NOTE: counts to the starting positions
+        if (pass == 0) {
+            for (u32 id = 0; id <= sccp->bound; ++id) {
+                u32 count = sccp->use_first[id];
+                sccp->use_first[id] = total;
+                total += count;
+            }
+            sccp->uses = malloc((total + 1) * sizeof(struct sccp_use));
+        }
+    }
+    
+    // NOTE: filling in moved every start to the start of the next id
+    for (u32 id = sccp->bound; id > 0; --id) {
+        sccp->use_first[id] = sccp->use_first[id - 1];
+    }
+    sccp->use_first[0] = 0;
+}
+
+static void
+sccp_visit_block(struct sccp *sccp, u32 block_index, bool phis_only)
+{
+    for (struct instruction_list *inst = sccp->file->blocks[block_index].instructions; inst; inst = inst->next) {
+        if (phis_only && inst->data.opcode != OpPhi) {
+            break;
+        }
+        sccp_evaluate(sccp, block_index, &inst->data);
+    }
+    
+    if (!phis_only) {
+        sccp_evaluate_branch(sccp, block_index);
+    }
+}
+
+// NOTE: a conditional branch with a known condition becomes unconditional. The edge
+// is not removed if that would break the structure of a loop: a loop header only 
+// loses the edge to its merge block, and back edges always stay
+static void
+sccp_fold_branch(struct sccp *sccp, u32 block_index, u32 taken)
+{
+    struct ir *file = sccp->file;
+    struct edge_list *out = file->cfg.out[block_index];
+    u32 target = (taken == 0 ? out->next->data : out->data);
+    struct instruction_list *merge = NULL;
+    
+    for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+        if (inst->data.opcode == OpLoopMerge) {
+            if (file->cfg.labels.data[target] != inst->data.OpLoopMerge.merge_block) {
+                return;
+            }
+        } else if (inst->data.opcode == OpSelectionMerge) {
+            merge = inst;
+        }
+    }
+    
+    if (dominates(target, block_index, file->cfg.dominators)) {
+        return;
+    }
+    
+    cfg_remove_edge(&file->cfg, block_index, target);
+    file->cfg.conditions[block_index] = 0;
+    
+    if (merge) {
+        ir_delete_instruction(file->blocks + block_index, merge);
+    }
+    
+    u32 label = file->cfg.labels.data[block_index];
+    for (struct instruction_list *inst = file->blocks[target].instructions; inst && inst->data.opcode == OpPhi; inst = inst->next) {
+        struct opphi_t *phi = &inst->data.OpPhi;
+        u32 kept = 0;
+        
+        for (u32 i = 0; i < (inst->data.wordcount - 3) / 2; ++i) {
+            if (phi->parents[i] != label) {
+                phi->variables[kept] = phi->variables[i];
+                phi->parents[kept] = phi->parents[i];
+                ++kept;
+            }
+        }
+        
+        inst->data.wordcount = 3 + kept * 2;
+    }
+}
+
+// NOTE: sparse conditional constant propagation as per Wegman M. and Zadeck F. Values
+// and CFG edges are only visited once they are found to be reachable, so constants are 
+// propagated through the branches which can not be taken. The constant results are then
+// replaced with (possibly new) OpConstant's, the known branches become unconditional and
+// the blocks which can not be reached anymore are removed
+static void
+sparse_conditional_constant_propagation(struct ir *file)
+{
+    u32 bound = file->header.bound;
+    u32 block_count = file->cfg.labels.size;
+    struct constants constants = constants_init(file);
+    struct cfg_dfs_result dfs = cfg_dfs(&file->cfg);
+    
+    free(file->cfg.dominators);
+    file->cfg.dominators = cfg_dominators(&file->cfg, &dfs);
+    
+    struct sccp sccp = {
+        .file = file,
+        .constants = &constants,
+        .bound = bound,
+        .state = calloc(bound, sizeof(u8)),
+        .value = calloc(bound, sizeof(u32)),
+        .defined = calloc(bound, sizeof(bool)),
+        .use_first = malloc((bound + 1) * sizeof(u32)),
+        .label_block = malloc(bound * sizeof(u32)),
+        .executable_block = calloc(block_count, sizeof(bool)),
+        .executable_edge = calloc(block_count * 2, sizeof(bool)),
+        .edge_worklist = stack_init(),
+        .value_worklist = stack_init(),
+        .operands = malloc((WORDCOUNT_MASK >> 16) * sizeof(u32 *)),
+        .buffer = malloc((WORDCOUNT_MASK >> 16) * sizeof(u32))
+    };
+    
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        sccp.label_block[file->cfg.labels.data[block_index]] = block_index;
+        for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+            u32 result_id = instruction_result_id(&inst->data);
+            if (result_id && result_id < bound) {
+                sccp.defined[result_id] = true;
+            }
+        }
+    }
+    
+    sccp_build_uses(&sccp);
+    
+    sccp.executable_block[0] = true;
+    sccp_visit_block(&sccp, 0, false);
+    
+    while (sccp.edge_worklist.size > 0 || sccp.value_worklist.size > 0) {
+        if (sccp.edge_worklist.size > 0) {
+            u32 edge = stack_pop(&sccp.edge_worklist);
+            struct edge_list *out = file->cfg.out[edge / 2];
+            u32 target = (edge % 2 == 0 ? out->data : out->next->data);
+            
+            if (sccp.executable_block[target]) {
+                sccp_visit_block(&sccp, target, true);
+            } else {
+                sccp.executable_block[target] = true;
+                sccp_visit_block(&sccp, target, false);
+            }
+        } else {
+            u32 id = stack_pop(&sccp.value_worklist);
+            for (u32 i = sccp.use_first[id]; i < sccp.use_first[id + 1]; ++i) {
+                struct sccp_use use = sccp.uses[i];
+                if (!sccp.executable_block[use.block]) {
+                    continue;
+                }
+                
+                if (use.instruction) {
+                    sccp_evaluate(&sccp, use.block, use.instruction);
+                } else {
+                    sccp_evaluate_branch(&sccp, use.block);
+                }
+            }
+        }
+    }
+    
+    // NOTE: replace the constant results
+    bool *opaque = calloc(bound, sizeof(bool));
+    bool *deleted = calloc(bound, sizeof(bool));
+    u32 *replace = malloc(bound * sizeof(u32));
+    
+    for (u32 id = 0; id < bound; ++id) {
+        replace[id] = id;
+    }
+    
+    struct instruction_list *globals[] = { file->pre_cfg, file->post_cfg };
+    for (u32 i = 0; i < 2; ++i) {
+        for (struct instruction_list *inst = globals[i]; inst; inst = inst->next) {
+            opt_mark_opaque(&inst->data, sccp.operands, opaque, bound);
+        }
+    }
+    
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+            opt_mark_opaque(&inst->data, sccp.operands, opaque, bound);
+        }
+    }
+    
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        if (!sccp.executable_block[block_index]) {
+            continue;
+        }
+        
+        struct instruction_list *inst = file->blocks[block_index].instructions;
+        while (inst) {
+            struct instruction_list *next = inst->next;
+            u32 result_id = instruction_result_id(&inst->data);
+            
+            if (result_id && sccp_tracked(&sccp, result_id) && sccp.state[result_id] == SCCP_CONSTANT && !opaque[result_id]) {
+                u32 result_type = instruction_dump(&inst->data, sccp.buffer)[1];
+                replace[result_id] = constants_get(&constants, result_type, sccp.value[result_id]);
+                deleted[result_id] = true;
+                ir_delete_instruction(file->blocks + block_index, inst);
+            }
+            
+            inst = next;
+        }
+    }
+    
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        u32 value = 0;
+        struct edge_list *out = file->cfg.out[block_index];
+        
+        if (sccp.executable_block[block_index] && out && out->next &&
+            sccp_get(&sccp, file->cfg.conditions[block_index], &value) == SCCP_CONSTANT) {
+            sccp_fold_branch(&sccp, block_index, value ? 0 : 1);
+        }
+        
+        for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+            s32 count = instruction_operands(&inst->data, sccp.operands);
+            for (s32 i = 0; i < count; ++i) {
+                if (*sccp.operands[i] < bound) {
+                    *sccp.operands[i] = replace[*sccp.operands[i]];
+                }
+            }
+        }
+        
+        if (file->cfg.conditions[block_index] < bound) {
+            file->cfg.conditions[block_index] = replace[file->cfg.conditions[block_index]];
+        }
+    }
+    
+    adce_remove_unreachable(file);
+    ir_delete_opnames(file, deleted);
+    
+    stack_free(&sccp.edge_worklist);
+    stack_free(&sccp.value_worklist);
+    free(sccp.state);
+    free(sccp.value);
+    free(sccp.defined);
+    free(sccp.use_first);
+    free(sccp.uses);
+    free(sccp.label_block);
+    free(sccp.executable_block);
+    free(sccp.executable_edge);
+    free(sccp.operands);
+    free(sccp.buffer);
+    free(opaque);
+    free(deleted);
+    free(replace);
+    constants_free(&constants);
+    cfg_dfs_free(&dfs);
+}
+
+// NOTE: a basic induction variable: an OpPhi in the loop header 'i = phi(init, next)', 
+// where 'next' is 'i + step' or 'i - step' computed inside of the loop and the step is 
+// loop invariant. The value of 'i' in the n-th iteration is the affine 'init +/- n * step'
+struct induction {
+    u32 phi;
+    u32 type;
+    u32 init;
+    u32 next;
+    u32 step;
+    bool decrement;
+    u32 latch;                       // NOTE: label of the block the back edge comes from
+    u32 update_block;
+    struct instruction_list *update; // NOTE: the instruction which computes 'next'
+};
+
+// NOTE: what the induction variable analysis needs on top of the loop state
+struct induction_ids {
+    struct instruction_list **definition; // NOTE: id -> instruction in the blocks which defines it
+    u32 *label_block;
+};
+
+static struct induction_ids
+induction_ids_init(struct licm *licm)
+{
+    struct ir *file = licm->file;
+    struct induction_ids ids = {
+        .definition = calloc(licm->id_capacity, sizeof(struct instruction_list *)),
+        .label_block = calloc(licm->id_capacity, sizeof(u32))
+    };
+    
+    for (u32 block_index = 0; block_index < file->cfg.labels.size; ++block_index) {
+        ids.label_block[file->cfg.labels.data[block_index]] = block_index;
+        for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+            u32 result_id = instruction_result_id(&inst->data);
+            if (result_id && result_id < licm->id_capacity) {
+                ids.definition[result_id] = inst;
+            }
+        }
+    }
+    
+    return(ids);
+}
+
+static void
+induction_ids_free(struct induction_ids *ids)
+{
+    free(ids->definition);
+    free(ids->label_block);
+}
+
+// NOTE: the value behind a chain of OpCopyObject's, so that the
+// analysis does not depend on copyprop
+static u32
+induction_value(struct induction_ids *ids, u32 capacity, u32 id)
+{
+    while (id < capacity && ids->definition[id] && ids->definition[id]->data.opcode == OpCopyObject) {
+        id = ids->definition[id]->data.OpCopyObject.operand;
+    }
+    
+    return(id);
+}
+
+static bool
+induction_invariant(struct licm *licm, u32 id, u32 stamp)
+{
+    return(id >= licm->id_capacity || licm->def_block[id] == -1 || licm->in_loop[licm->def_block[id]] != stamp);
+}
+
+// NOTE: the basic induction variables of the loop with the given header, the blocks of
+// which have to be marked with the stamp. Returns their number, at most 'capacity'
+static u32
+induction_find(struct licm *licm, struct induction_ids *ids, u32 header, u32 stamp, struct induction *found, u32 capacity)
+{
+    u32 count = 0;
+    
+    for (struct instruction_list *inst = licm->file->blocks[header].instructions; 
+         inst && inst->data.opcode == OpPhi && count < capacity; inst = inst->next) {
+        struct opphi_t *phi = &inst->data.OpPhi;
+        
+        if (inst->data.wordcount != 7) {
+            continue;
+        }
+        
+        // NOTE: one value comes from the outside, the other one through the back edge
+        bool first_inside = (licm->in_loop[ids->label_block[phi->parents[0]]] == stamp);
+        bool second_inside = (licm->in_loop[ids->label_block[phi->parents[1]]] == stamp);
+        
+        if (first_inside == second_inside) {
+            continue;
+        }
+        
+        u32 inside = (first_inside ? 0 : 1);
+        u32 next = induction_value(ids, licm->id_capacity, phi->variables[inside]);
+        
+        if (next >= licm->id_capacity || induction_invariant(licm, next, stamp) || !ids->definition[next]) {
+            continue;
+        }
+        
+        struct instruction_t *update = &ids->definition[next]->data;
+        struct binary_arithmetics_layout *arithmetics = &update->binary_arithmetics;
+        u32 operand_1 = induction_value(ids, licm->id_capacity, arithmetics->operand_1);
+        u32 operand_2 = induction_value(ids, licm->id_capacity, arithmetics->operand_2);
+        u32 step = 0;
+        
+        if (update->opcode == OpIAdd && operand_1 == phi->result_id) {
+            step = arithmetics->operand_2;
+        } else if (update->opcode == OpIAdd && operand_2 == phi->result_id) {
+            step = arithmetics->operand_1;
+        } else if (update->opcode == OpISub && operand_1 == phi->result_id) {
+            step = arithmetics->operand_2;
+        } else {
+            continue;
+        }
+        
+        if (arithmetics->result_type != phi->result_type || !induction_invariant(licm, step, stamp)) {
+            continue;
+        }
+        
+        struct induction induction = {
+            .phi = phi->result_id,
+            .type = phi->result_type,
+            .init = phi->variables[1 - inside],
+            .next = next,
+            .step = step,
+            .decrement = (update->opcode == OpISub),
+            .latch = phi->parents[inside],
+            .update_block = licm->def_block[next],
+            .update = ids->definition[next]
+        };
+        
+        found[count++] = induction;
+    }
+    
+    return(count);
+}
+
+// NOTE: 'i * k' for an induction variable 'i' and an invariant 'k' becomes a new 
+// induction variable 't = phi(init * k, t +/- step * k)', so the multiply inside of the
+// loop turns into an addition. The same goes for 'next * k', which is 't +/- step * k'
+struct reduction {
+    u32 induction;
+    u32 factor;
+    u32 phi;
+    u32 next;
+};
+
+static void
+strength_reduce_loop(struct licm *licm, struct induction_ids *ids, u32 header, u32 stamp, u32 *replace, bool *opaque, bool *deleted)
+{
+    struct ir *file = licm->file;
+    struct uint_vector body = licm_body(licm, header, stamp);
+    struct induction inductions[16];
+    u32 induction_count = induction_find(licm, ids, header, stamp, inductions, 16);
+    struct uint_vector candidates = vector_init(); // NOTE: (block, induction, 0 for 'i' or 1 for 'next')
+    struct instruction_list **multiplies = NULL;
+    u32 multiply_count = 0;
+    
+    for (u32 i = 0; i < body.size && induction_count > 0; ++i) {
+        for (struct instruction_list *inst = file->blocks[body.data[i]].instructions; inst; inst = inst->next) {
+            struct binary_arithmetics_layout *arithmetics = &inst->data.binary_arithmetics;
+            
+            if (inst->data.opcode != OpIMul || opaque[arithmetics->result_id]) {
+                continue;
+            }
+            
+            for (u32 j = 0; j < induction_count; ++j) {
+                struct induction *induction = inductions + j;
+                u32 a = arithmetics->operand_1;
+                u32 b = arithmetics->operand_2;
+                bool uses_phi = (a == induction->phi || b == induction->phi);
+                bool uses_next = (a == induction->next || b == induction->next);
+                u32 factor = (a == induction->phi || a == induction->next ? b : a);
+                
+                if ((uses_phi || uses_next) && arithmetics->result_type == induction->type &&
+                    induction_invariant(licm, factor, stamp)) {
+                    vector_push(&candidates, body.data[i]);
+                    vector_push(&candidates, j);
+                    vector_push(&candidates, uses_next && !uses_phi);
+                    multiplies = realloc(multiplies, (multiply_count + 1) * sizeof(struct instruction_list *));
+                    multiplies[multiply_count++] = inst;
+                    break;
+                }
+            }
+        }
+    }
+    
+    s32 preheader_index = (multiply_count ? licm_preheader(licm, header, stamp) : -1);
+    
+    if (preheader_index != -1) {
+        u32 preheader_label = file->cfg.labels.data[preheader_index];
+        struct basic_block *preheader = file->blocks + preheader_index;
+        struct instruction_list *tail = preheader->instructions;
+        struct reduction *reductions = malloc(multiply_count * sizeof(struct reduction));
+        u32 reduction_count = 0;
+        
+        while (tail && tail->next) {
+            tail = tail->next;
+        }
+        
+        for (u32 i = 0; i < multiply_count; ++i) {
+            struct induction *induction = inductions + candidates.data[i * 3 + 1];
+            struct binary_arithmetics_layout *multiply = &multiplies[i]->data.binary_arithmetics;
+            u32 factor = (multiply->operand_1 == induction->phi || multiply->operand_1 == induction->next ? 
+                          multiply->operand_2 : multiply->operand_1);
+            u32 r = 0;
+            
+            while (r < reduction_count && (reductions[r].induction != candidates.data[i * 3 + 1] || reductions[r].factor != factor)) {
+                ++r;
+            }
+            
+            // NOTE: the multiplies created for the inner loops are not accounted for in the
+            // id capacity, the ones which do not fit anymore stay as they are
+            if (r == reduction_count && file->header.bound + 4 > licm->id_capacity) {
+                continue;
+            }
+            
+            if (r == reduction_count) {
+                // NOTE: the value on entry comes from the preheader now
+                u32 init = induction->init;
+                for (struct instruction_list *inst = file->blocks[header].instructions; inst && inst->data.opcode == OpPhi; inst = inst->next) {
+                    if (inst->data.OpPhi.result_id == induction->phi) {
+                        for (u32 j = 0; j < (inst->data.wordcount - 3) / 2; ++j) {
+                            if (inst->data.OpPhi.parents[j] == preheader_label) {
+                                init = inst->data.OpPhi.variables[j];
+                            }
+                        }
+                    }
+                }
+                
+                struct instruction_t start = { .opcode = OpIMul, .wordcount = 5, .unparsed_words = NULL };
+                start.binary_arithmetics.result_type = induction->type;
+                start.binary_arithmetics.result_id = file->header.bound++;
+                start.binary_arithmetics.operand_1 = init;
+                start.binary_arithmetics.operand_2 = factor;
+                
+                struct instruction_t step = start;
+                step.binary_arithmetics.result_id = file->header.bound++;
+                step.binary_arithmetics.operand_1 = induction->step;
+                
+                struct instruction_t phi = { .opcode = OpPhi, .wordcount = 7, .unparsed_words = NULL };
+                phi.OpPhi.result_type = induction->type;
+                phi.OpPhi.result_id = file->header.bound++;
+                phi.OpPhi.variables = malloc(2 * sizeof(u32));
+                phi.OpPhi.parents = malloc(2 * sizeof(u32));
+                
+                struct instruction_t next = { .opcode = (induction->decrement ? OpISub : OpIAdd), .wordcount = 5, .unparsed_words = NULL };
+                next.binary_arithmetics.result_type = induction->type;
+                next.binary_arithmetics.result_id = file->header.bound++;
+                next.binary_arithmetics.operand_1 = phi.OpPhi.result_id;
+                next.binary_arithmetics.operand_2 = step.binary_arithmetics.result_id;
+                
+                phi.OpPhi.variables[0] = start.binary_arithmetics.result_id;
+                phi.OpPhi.parents[0] = preheader_label;
+                phi.OpPhi.variables[1] = next.binary_arithmetics.result_id;
+                phi.OpPhi.parents[1] = induction->latch;
+                
+                tail = ir_insert_instruction(preheader, tail, start);
+                tail = ir_insert_instruction(preheader, tail, step);
+                ir_prepend_instruction(file->blocks + header, phi);
+                ir_insert_instruction(file->blocks + induction->update_block, induction->update, next);
+                
+                licm->def_block[start.binary_arithmetics.result_id] = preheader_index;
+                licm->def_block[step.binary_arithmetics.result_id] = preheader_index;
+                licm->def_block[phi.OpPhi.result_id] = header;
+                licm->def_block[next.binary_arithmetics.result_id] = induction->update_block;
+                
+                struct reduction reduction = {
+                    .induction = candidates.data[i * 3 + 1],
+                    .factor = factor,
+                    .phi = phi.OpPhi.result_id,
+                    .next = next.binary_arithmetics.result_id
+                };
+                
+                reductions[reduction_count++] = reduction;
+            }
+            
+            replace[multiply->result_id] = (candidates.data[i * 3 + 2] ? reductions[r].next : reductions[r].phi);
+            deleted[multiply->result_id] = true;
+            ir_delete_instruction(file->blocks + candidates.data[i * 3], multiplies[i]);
+        }
+        
+        free(reductions);
+    }
+    
+    free(multiplies);
+    vector_free(&candidates);
+    vector_free(&body);
+}
+
+// NOTE: induction variable analysis and strength reduction of the multiplies by them,
+// innermost loops first. The multiplies moved to the preheaders become candidates for
+// the enclosing loop
+static void
+strength_reduction(struct ir *file)
+{
+    u32 bound = file->header.bound;
+    u32 block_count = file->cfg.labels.size;
+    u32 multiply_count = 0;
+    
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+            multiply_count += (inst->data.opcode == OpIMul);
+        }
+    }
+    
+    // NOTE: every reduced multiply creates four new ids
+    struct cfg_dfs_result dfs = cfg_dfs(&file->cfg);
+    struct licm_loop *loops;
+    u32 loop_count;
+    struct licm licm = licm_init(file, &dfs, &loops, &loop_count, 4 * multiply_count);
+    
+    struct induction_ids ids = induction_ids_init(&licm);
+    u32 **operands = malloc((WORDCOUNT_MASK >> 16) * sizeof(u32 *));
+    u32 *replace = malloc(licm.id_capacity * sizeof(u32));
+    bool *opaque = calloc(licm.id_capacity, sizeof(bool));
+    bool *deleted = calloc(licm.id_capacity, sizeof(bool));
+    
+    for (u32 id = 0; id < licm.id_capacity; ++id) {
+        replace[id] = id;
+    }
+    
+    struct instruction_list *globals[] = { file->pre_cfg, file->post_cfg };
+    for (u32 i = 0; i < 2; ++i) {
+        for (struct instruction_list *inst = globals[i]; inst; inst = inst->next) {
+            opt_mark_opaque(&inst->data, operands, opaque, bound);
+        }
+    }
+    
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+            opt_mark_opaque(&inst->data, operands, opaque, bound);
+        }
+    }
+    
+    for (u32 i = 0; i < loop_count; ++i) {
+        strength_reduce_loop(&licm, &ids, loops[i].header, loop_count + i + 1, replace, opaque, deleted);
+        
+        // NOTE: the preheader and the new instructions
+        for (u32 block_index = block_count; block_index < file->cfg.labels.size; ++block_index) {
+            ids.label_block[file->cfg.labels.data[block_index]] = block_index;
+        }
+        block_count = file->cfg.labels.size;
+    }
+    
+    for (u32 block_index = 0; block_index < file->cfg.labels.size; ++block_index) {
+        for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+            s32 count = instruction_operands(&inst->data, operands);
+            for (s32 i = 0; i < count; ++i) {
+                if (*operands[i] < licm.id_capacity) {
+                    *operands[i] = replace[*operands[i]];
+                }
+            }
+        }
+        
+        if (file->cfg.conditions[block_index] < licm.id_capacity) {
+            file->cfg.conditions[block_index] = replace[file->cfg.conditions[block_index]];
+        }
+    }
+    
+    ir_delete_opnames(file, deleted);
+    
+    induction_ids_free(&ids);
+    free(operands);
+    free(replace);
+    free(opaque);
+    free(deleted);
+    free(loops);
+    licm_free(&licm);
+    cfg_dfs_free(&dfs);
+}
+
+// NOTE: the peephole rules, grouped by the opcode of the root instruction. A rule is
+// RULE(first, second, rewrite): the patterns the two operands have to match (unary 
+// instructions only have the first one, the second is ANY) and what the instruction 
+// is rewritten to. The rules of an opcode are tried in order, the first one which 
+// applies wins. The table is expanded into a switch over the opcode in peephole_apply,
+// so a new rule costs a comparison or two for its own opcode and nothing for the rest
+#define PEEPHOLE_RULES(OPCODE, RULE)                                                    \
+    OPCODE(OpIAdd,                 RULE(ANY,     ZERO,  FIRST)                          \
+                                   RULE(ZERO,    ANY,   SECOND))                        \
+    OPCODE(OpISub,                 RULE(ANY,     ZERO,  FIRST)                          \
+                                   RULE(ANY,     SAME,  NULL_VALUE))                    \
+    OPCODE(OpIMul,                 RULE(ANY,     ONE,   FIRST)                          \
+                                   RULE(ONE,     ANY,   SECOND)                         \
+                                   RULE(ANY,     ZERO,  NULL_VALUE)                     \
+                                   RULE(ZERO,    ANY,   NULL_VALUE)                     \
+                                   RULE(ANY,     POW2,  SHIFT_FIRST)                    \
+                                   RULE(POW2,    ANY,   SHIFT_SECOND))                  \
+    OPCODE(OpUDiv,                 RULE(ANY,     ONE,   FIRST))                         \
+    OPCODE(OpSDiv,                 RULE(ANY,     ONE,   FIRST))                         \
+    OPCODE(OpUMod,                 RULE(ANY,     ONE,   NULL_VALUE))                    \
+    OPCODE(OpSRem,                 RULE(ANY,     ONE,   NULL_VALUE))                    \
+    OPCODE(OpSMod,                 RULE(ANY,     ONE,   NULL_VALUE))                    \
+    OPCODE(OpFMul,                 RULE(ANY,     F_ONE, FIRST)                          \
+                                   RULE(F_ONE,   ANY,   SECOND))                        \
+    OPCODE(OpFDiv,                 RULE(ANY,     F_ONE, FIRST))                         \
+    OPCODE(OpSNegate,              RULE(NEGATED, ANY,   INNER))                         \
+    OPCODE(OpFNegate,              RULE(NEGATED, ANY,   INNER))                         \
+    OPCODE(OpNot,                  RULE(NEGATED, ANY,   INNER))                         \
+    OPCODE(OpLogicalNot,           RULE(NEGATED, ANY,   INNER))                         \
+    OPCODE(OpShiftLeftLogical,     RULE(ANY,     ZERO,  FIRST))                         \
+    OPCODE(OpShiftRightLogical,    RULE(ANY,     ZERO,  FIRST))                         \
+    OPCODE(OpShiftRightArithmetic, RULE(ANY,     ZERO,  FIRST))                         \
+    OPCODE(OpBitwiseOr,            RULE(ANY,     ZERO,  FIRST)                          \
+                                   RULE(ZERO,    ANY,   SECOND)                         \
+                                   RULE(ANY,     SAME,  FIRST))                         \
+    OPCODE(OpBitwiseXor,           RULE(ANY,     ZERO,  FIRST)                          \
+                                   RULE(ZERO,    ANY,   SECOND)                         \
+                                   RULE(ANY,     SAME,  NULL_VALUE))                    \
+    OPCODE(OpBitwiseAnd,           RULE(ANY,     ONES,  FIRST)                          \
+                                   RULE(ONES,    ANY,   SECOND)                         \
+                                   RULE(ANY,     ZERO,  NULL_VALUE)                     \
+                                   RULE(ZERO,    ANY,   NULL_VALUE)                     \
+                                   RULE(ANY,     SAME,  FIRST))                         \
+    OPCODE(OpLogicalAnd,           RULE(ANY,     TRUE,  FIRST)                          \
+                                   RULE(TRUE,    ANY,   SECOND)                         \
+                                   RULE(ANY,     FALSE, NULL_VALUE)                     \
+                                   RULE(FALSE,   ANY,   NULL_VALUE)                     \
+                                   RULE(ANY,     SAME,  FIRST))                         \
+    OPCODE(OpLogicalOr,            RULE(ANY,     FALSE, FIRST)                          \
+                                   RULE(FALSE,   ANY,   SECOND)                         \
+                                   RULE(ANY,     SAME,  FIRST))
+
+struct peephole {
+    struct constants *constants;
+    struct instruction_list **definition; // NOTE: id -> instruction which defines it
+    u32 *buffer;
+    u32 bound;
+    struct instruction_t *root;
+    u32 type;
+    u32 first;
+    u32 second;
+};
+
+static u32
+peephole_type(struct peephole *p, u32 id)
+{
+    if (id >= p->bound || !p->definition[id]) {
+        return(0);
+    }
+    
+    return(instruction_dump(&p->definition[id]->data, p->buffer)[1]);
+}
+
+static bool
+peephole_constant(struct peephole *p, u32 id, enum constant_kind kind, u32 value)
+{
+    struct constants *constants = p->constants;
+    return(id < constants->bound && constants->known[id] && constants->kind[id] == kind && constants->value[id] == value);
+}
+
+// NOTE: the operand patterns
+static bool peephole_is_ANY(struct peephole *p, u32 id)   { (void) p; (void) id; return(true); }
+static bool peephole_is_ZERO(struct peephole *p, u32 id)  { return(peephole_constant(p, id, CONSTANT_INT, 0)); }
+static bool peephole_is_ONE(struct peephole *p, u32 id)   { return(peephole_constant(p, id, CONSTANT_INT, 1)); }
+static bool peephole_is_ONES(struct peephole *p, u32 id)  { return(peephole_constant(p, id, CONSTANT_INT, 0xFFFFFFFFu)); }
+static bool peephole_is_F_ONE(struct peephole *p, u32 id) { return(peephole_constant(p, id, CONSTANT_FLOAT, 0x3F800000u)); }
+static bool peephole_is_TRUE(struct peephole *p, u32 id)  { return(peephole_constant(p, id, CONSTANT_BOOL, 1)); }
+static bool peephole_is_FALSE(struct peephole *p, u32 id) { return(peephole_constant(p, id, CONSTANT_BOOL, 0)); }
+static bool peephole_is_SAME(struct peephole *p, u32 id)  { return(id == p->first); }
+
+static bool
+peephole_is_POW2(struct peephole *p, u32 id)
+{
+    struct constants *constants = p->constants;
+    if (id >= constants->bound || !constants->known[id] || constants->kind[id] != CONSTANT_INT) {
+        return(false);
+    }
+    
+    u32 value = constants->value[id];
+    return(value > 1 && (value & (value - 1)) == 0);
+}
+
+// NOTE: the operand is computed by the same (self inverse) instruction as the root
+static bool
+peephole_is_NEGATED(struct peephole *p, u32 id)
+{
+    return(id < p->bound && p->definition[id] && p->definition[id]->data.opcode == p->root->opcode);
+}
+
+// NOTE: the rewrites return the id which replaces the result of the root, the result 
+// itself if the root was changed in place, or 0 if the rule does not apply after all 
+// (the types do not match)
+static u32
+peephole_keep(struct peephole *p, u32 id)
+{
+    return(peephole_type(p, id) == p->type ? id : 0);
+}
+
+static u32 peephole_FIRST(struct peephole *p)  { return(peephole_keep(p, p->first)); }
+static u32 peephole_SECOND(struct peephole *p) { return(peephole_keep(p, p->second)); }
+
+static u32
+peephole_INNER(struct peephole *p)
+{
+    u32 *operand;
+    instruction_operands(&p->definition[p->first]->data, &operand);
+    return(peephole_keep(p, *operand));
+}
+
+static u32
+peephole_NULL_VALUE(struct peephole *p)
+{
+    u8 kind = (p->type < p->constants->bound ? p->constants->kind[p->type] : CONSTANT_NONE);
+    return(kind == CONSTANT_INT || kind == CONSTANT_BOOL ? constants_get(p->constants, p->type, 0) : 0);
+}
+
+// NOTE: 'x * 2^k' is 'x << k'. The root is not parsed anymore, all of its words are explicit
+static u32
+peephole_shift(struct peephole *p, u32 value, u32 amount)
+{
+    if (peephole_type(p, value) != p->type || p->constants->kind[p->type] != CONSTANT_INT) {
+        return(0);
+    }
+    
+    u32 shift = 0;
+    while ((1u << shift) != p->constants->value[amount]) {
+        ++shift;
+    }
+    
+    struct instruction_t *root = p->root;
+    u32 result_id = instruction_result_id(root);
+    u32 *words = malloc(5 * sizeof(u32));
+    
+    words[0] = OpShiftLeftLogical | (5 << 16);
+    words[1] = p->type;
+    words[2] = result_id;
+    words[3] = value;
+    words[4] = constants_get(p->constants, p->type, shift);
+    
+    free(root->unparsed_words);
+    root->opcode = OpShiftLeftLogical;
+    root->wordcount = 5;
+    root->unparsed_words = words;
+    
+    return(result_id);
+}
+
+static u32 peephole_SHIFT_FIRST(struct peephole *p)  { return(peephole_shift(p, p->first, p->second)); }
+static u32 peephole_SHIFT_SECOND(struct peephole *p) { return(peephole_shift(p, p->second, p->first)); }
+
+#define PEEPHOLE_CASE(opcode, rules) case opcode: { rules } break;
+#define PEEPHOLE_RULE(pattern_1, pattern_2, rewrite)                                   \
+    if (peephole_is_##pattern_1(p, p->first) && peephole_is_##pattern_2(p, p->second)) { \
+        u32 value = peephole_##rewrite(p);                                               \
+        if (value) {                                                                     \
+            return(value);                                                               \
+        }                                                                                \
+    }
+
+// NOTE: the first rule which applies to the root, see the rewrites above for the result
+static u32
+peephole_apply(struct peephole *p)
+{
+    switch (p->root->opcode) {
+        PEEPHOLE_RULES(PEEPHOLE_CASE, PEEPHOLE_RULE)
+        default: break;
+    }
+    
+    return(0);
+}
+
+#undef PEEPHOLE_CASE
+#undef PEEPHOLE_RULE
+
+// NOTE: algebraic simplifications from the rule table above, in one walk over the blocks
+// in reverse postorder. The operands are looked up through the replacements found so far,
+// so a chain like '(x * 1) + 0' collapses in a single walk. The replaced instructions are 
+// deleted, unless their result is referenced by an instruction which is not parsed
+static void
+peephole_optimization(struct ir *file)
+{
+    u32 bound = file->header.bound;
+    u32 block_count = file->cfg.labels.size;
+    struct cfg_dfs_result dfs = cfg_dfs(&file->cfg);
+    struct constants constants = constants_init(file);
+    u32 **operands = malloc((WORDCOUNT_MASK >> 16) * sizeof(u32 *));
+    u32 *replace = malloc(bound * sizeof(u32));
+    bool *opaque = calloc(bound, sizeof(bool));
+    bool *deleted = calloc(bound, sizeof(bool));
+    
+    struct peephole p = {
+        .constants = &constants,
+        .definition = calloc(bound, sizeof(struct instruction_list *)),
+        .buffer = malloc((WORDCOUNT_MASK >> 16) * sizeof(u32)),
+        .bound = bound
+    };
+    
+    for (u32 id = 0; id < bound; ++id) {
+        replace[id] = id;
+    }
+    
+    struct instruction_list *globals[] = { file->pre_cfg, file->post_cfg };
+    for (u32 i = 0; i < 2; ++i) {
+        for (struct instruction_list *inst = globals[i]; inst; inst = inst->next) {
+            u32 result_id = instruction_result_id(&inst->data);
+            if (result_id && result_id < bound) {
+                p.definition[result_id] = inst;
+            }
+            opt_mark_opaque(&inst->data, operands, opaque, bound);
+        }
+    }
+    
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+            u32 result_id = instruction_result_id(&inst->data);
+            if (result_id && result_id < bound) {
+                p.definition[result_id] = inst;
+            }
+            opt_mark_opaque(&inst->data, operands, opaque, bound);
+        }
+    }
+    
+    for (u32 i = dfs.size; i > 0; --i) {
+        u32 block_index = dfs.sorted_postorder[i - 1];
+        struct instruction_list *inst = file->blocks[block_index].instructions;
+        
+        while (inst) {
+            struct instruction_list *next = inst->next;
+            struct instruction_t *instruction = &inst->data;
+            s32 count = instruction_operands(instruction, operands);
+            
+            for (s32 j = 0; j < count; ++j) {
+                if (*operands[j] < bound) {
+                    *operands[j] = copy_find(replace, *operands[j]);
+                }
+            }
+            
+            u32 result_id = instruction_result_id(instruction);
+            
+            if (count >= 1 && count <= 2 && result_id && result_id < bound && !opaque[result_id]) {
+                p.root = instruction;
+                p.type = instruction_dump(instruction, p.buffer)[1];
+                p.first = *operands[0];
+                p.second = (count == 2 ? *operands[1] : 0);
+                
+                u32 value = peephole_apply(&p);
+                
+                if (value && value != result_id) {
+                    replace[result_id] = value;
+                    deleted[result_id] = true;
+                    p.definition[result_id] = NULL;
+                    ir_delete_instruction(file->blocks + block_index, inst);
+                }
+            }
+            
+            inst = next;
+        }
+    }
+    
+    // NOTE: phis can use a value which is defined later in the walk
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+            s32 count = instruction_operands(&inst->data, operands);
+            for (s32 i = 0; i < count; ++i) {
+                if (*operands[i] < bound) {
+                    *operands[i] = copy_find(replace, *operands[i]);
+                }
+            }
+        }
+        
+        if (file->cfg.conditions[block_index] < bound) {
+            file->cfg.conditions[block_index] = copy_find(replace, file->cfg.conditions[block_index]);
+        }
+    }
+    
+    ir_delete_opnames(file, deleted);
+    
+    free(p.definition);
+    free(p.buffer);
+    free(operands);
+    free(replace);
+    free(opaque);
+    free(deleted);
+    constants_free(&constants);
+    cfg_dfs_free(&dfs);
+}
+
+// NOTE: the limits of the loop unrolling, in instructions added per loop. The loops
+// with the Unroll hint get the larger ones. Partial unrolling keeps the loop, but 
+// only tests the exit condition every UNROLL_FACTOR iterations
+static const u32 UNROLL_MAX_TRIP_COUNT = 16;
+static const u32 UNROLL_MAX_TRIP_COUNT_HINT = 256;
+static const u32 UNROLL_MAX_GROWTH = 256;
+static const u32 UNROLL_MAX_GROWTH_HINT = 4096;
+static const u32 UNROLL_MAX_TOTAL_GROWTH = 16384;
+static const u32 UNROLL_MAX_SIMULATED = 65536;
+static const u32 UNROLL_FACTOR = 4;
+
+// NOTE: a loop, which can be unrolled: the exit test of a single basic induction variable 
+// against a constant is the only way out of the loop, and it runs exactly once per iteration
+struct unroll {
+    u32 header;
+    u32 latch;       // NOTE: the block with the back edge
+    u32 exit;        // NOTE: the block with the exit test, the only one with an edge out of the loop
+    u32 inside;      // NOTE: the successor of the exit block in the loop (the header if exit == latch)
+    u32 merge;
+    u32 trip_count;  // NOTE: the number of times the back edge is taken
+    u32 size;        // NOTE: instructions in the loop, including the labels
+    u32 region_size; // NOTE: the same for the part of an iteration up to the exit test
+    bool hint;
+    struct uint_vector body;
+    bool *region;    // NOTE: block index -> is executed before the exit test in an iteration
+};
+
+static bool
+unroll_constant(struct constants *constants, u32 id)
+{
+    return(id < constants->bound && constants->known[id] && constants->kind[id] == CONSTANT_INT);
+}
+
+// NOTE: the number of iterations, simulated on the constants. Returns false if the loop does not 
+// exit in UNROLL_MAX_SIMULATED iterations or the test is not on a basic induction variable
+static bool
+unroll_trip_count(struct licm *licm, struct induction_ids *ids, struct constants *constants, struct unroll *unroll, u32 stamp)
+{
+    struct ir_cfg *cfg = &licm->file->cfg;
+    u32 condition = cfg->conditions[unroll->exit];
+    
+    if (condition >= licm->id_capacity || !ids->definition[condition]) {
+        return(false);
+    }
+    
+    struct instruction_t *compare = &ids->definition[condition]->data;
+    if (compare->opcode < OpIEqual || compare->opcode > OpSLessThanEqual) {
+        return(false);
+    }
+    
+    struct induction inductions[16];
+    u32 count = induction_find(licm, ids, unroll->header, stamp, inductions, 16);
+    u32 a = induction_value(ids, licm->id_capacity, compare->unparsed_words[3]);
+    u32 b = induction_value(ids, licm->id_capacity, compare->unparsed_words[4]);
+    bool stay_if_true = (cfg->out[unroll->exit]->data == unroll->inside);
+    
+    for (u32 i = 0; i < count; ++i) {
+        struct induction *induction = inductions + i;
+        u32 slot = (a == induction->phi || a == induction->next ? 0 : 1);
+        u32 variable = (slot == 0 ? a : b);
+        u32 other = (slot == 0 ? b : a);
+        
+        u32 init_id = induction_value(ids, licm->id_capacity, induction->init);
+        u32 step_id = induction_value(ids, licm->id_capacity, induction->step);
+        
+        if ((variable != induction->phi && variable != induction->next) || !unroll_constant(constants, other) ||
+            !unroll_constant(constants, init_id) || !unroll_constant(constants, step_id)) {
+            continue;
+        }
+        
+        u32 init = constants->value[init_id];
+        u32 step = constants->value[step_id];
+        u32 values[2];
+        
+        values[1 - slot] = constants->value[other];
+        
+        for (u32 t = 0; t < UNROLL_MAX_SIMULATED; ++t) {
+            u32 iteration = t + (variable == induction->next);
+            u32 result = 0;
+            
+            values[slot] = (induction->decrement ? init - iteration * step : init + iteration * step);
+            constant_fold(compare->opcode, values, 2, &result);
+            
+            if ((result != 0) != stay_if_true) {
+                unroll->trip_count = t;
+                return(true);
+            }
+        }
+    }
+    
+    return(false);
+}
+
+// NOTE: checks the shape of the loop with the given header (see struct unroll) and finds its trip count
+static bool
+unroll_analyze(struct licm *licm, struct induction_ids *ids, struct constants *constants, u32 **operands, 
+               u32 header, u32 stamp, struct unroll *unroll)
+{
+    struct ir *file = licm->file;
+    struct ir_cfg *cfg = &file->cfg;
+    struct oploopmerge_t *loop_merge = NULL;
+    
+    for (struct instruction_list *inst = file->blocks[header].instructions; inst; inst = inst->next) {
+        if (inst->data.opcode == OpLoopMerge) {
+            loop_merge = &inst->data.OpLoopMerge;
+        }
+    }
+    
+    unroll->header = header;
+    unroll->body = licm_body(licm, header, stamp);
+    
+    if (!loop_merge || (loop_merge->loop_control & LoopControlDontUnroll)) {
+        return(false);
+    }
+    
+    unroll->hint = (loop_merge->loop_control & LoopControlUnroll);
+    
+    u32 exit_count = 0;
+    u32 latch_count = 0;
+    
+    for (u32 i = 0; i < unroll->body.size; ++i) {
+        u32 block_index = unroll->body.data[i];
+        
+        for (struct edge_list *edge = cfg->out[block_index]; edge; edge = edge->next) {
+            if (licm->in_loop[edge->data] != stamp) {
+                if (cfg->labels.data[edge->data] != loop_merge->merge_block) {
+                    return(false);
+                }
+                unroll->exit = block_index;
+                unroll->merge = edge->data;
+                ++exit_count;
+            } else if (edge->data == header) {
+                unroll->latch = block_index;
+                ++latch_count;
+            }
+        }
+        
+        // NOTE: the operands of every instruction have to be known to be renamed in the copies.
+        // A nested construct is copied whole, its merge block and continue target can not be
+        // outside of the body (unreachable), the copies would share them
+        ++unroll->size;
+        for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+            if (instruction_operands(&inst->data, operands) == -1) {
+                return(false);
+            }
+            
+            if (block_index != header && (inst->data.opcode == OpSelectionMerge || inst->data.opcode == OpLoopMerge)) {
+                bool loop = (inst->data.opcode == OpLoopMerge);
+                u32 labels[] = {
+                    loop ? inst->data.OpLoopMerge.merge_block : inst->data.OpSelectionMerge.merge_block,
+                    loop ? inst->data.OpLoopMerge.continue_block : 0
+                };
+                
+                for (u32 l = 0; l < 2 && labels[l]; ++l) {
+                    s32 target = search_item_u32(cfg->labels.data, cfg->labels.size, labels[l]);
+                    if (target == -1 || licm->in_loop[target] != stamp) {
+                        return(false);
+                    }
+                }
+            }
+            
+            ++unroll->size;
+        }
+    }
+    
+    if (exit_count != 1 || latch_count != 1 || !cfg->out[unroll->exit]->next ||
+        cfg->labels.data[unroll->latch] != loop_merge->continue_block) {
+        return(false);
+    }
+    
+    struct edge_list *out = cfg->out[unroll->exit];
+    unroll->inside = (out->data == unroll->merge ? out->next->data : out->data);
+    
+    // NOTE: no 'continue' statements, the latch becomes an ordinary block in the copies
+    u32 latch = unroll->latch;
+    if (latch != header && latch != unroll->exit && cfg->in[latch]->next) {
+        return(false);
+    }
+    
+    // NOTE: the exit test is on every path through an iteration, and not in a nested loop
+    if (!dominates(unroll->exit, latch, cfg->dominators)) {
+        return(false);
+    }
+    
+    for (u32 block_index = unroll->exit; block_index != header; block_index = cfg->dominators[block_index]) {
+        for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+            if (inst->data.opcode == OpLoopMerge) {
+                return(false);
+            }
+        }
+    }
+    
+    if (!unroll_trip_count(licm, ids, constants, unroll, stamp) || unroll->trip_count == 0) {
+        return(false);
+    }
+    
+    // NOTE: the blocks reachable from the header without passing the exit test
+    struct int_stack work = stack_init();
+    unroll->region = calloc(cfg->labels.size, sizeof(bool));
+    unroll->region[header] = true;
+    stack_push(&work, header);
+    
+    while (work.size) {
+        u32 block_index = stack_pop(&work);
+        
+        unroll->region_size += 1;
+        for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+            ++unroll->region_size;
+        }
+        
+        if (block_index == unroll->exit) {
+            continue;
+        }
+        
+        for (struct edge_list *edge = cfg->out[block_index]; edge; edge = edge->next) {
+            if (!unroll->region[edge->data] && licm->in_loop[edge->data] == stamp) {
+                unroll->region[edge->data] = true;
+                stack_push(&work, edge->data);
+            }
+        }
+    }
+    
+    stack_free(&work);
+    
+    return(true);
+}
+
+// NOTE: a copy of an instruction of the loop with the ids (and labels) renamed
+static struct instruction_t
+unroll_rename(struct instruction_t *instruction, u32 *map, u32 bound, u32 **operands)
+{
+    struct instruction_t copy = instruction_clone(instruction);
+    u32 *result = instruction_result_pointer(&copy);
+    s32 count = instruction_operands(&copy, operands);
+    
+    if (result) {
+        *result = map[*result];
+    }
+    
+    for (s32 i = 0; i < count; ++i) {
+        if (*operands[i] < bound) {
+            *operands[i] = map[*operands[i]];
+        }
+    }
+    
+    if (copy.opcode == OpPhi) {
+        for (u32 i = 0; i < (copy.wordcount - 3) / 2; ++i) {
+            copy.OpPhi.parents[i] = map[copy.OpPhi.parents[i]];
+        }
+    } else if (copy.opcode == OpLoopMerge) {
+        copy.OpLoopMerge.merge_block = map[copy.OpLoopMerge.merge_block];
+        copy.OpLoopMerge.continue_block = map[copy.OpLoopMerge.continue_block];
+    } else if (copy.opcode == OpSelectionMerge) {
+        copy.OpSelectionMerge.merge_block = map[copy.OpSelectionMerge.merge_block];
+    }
+    
+    return(copy);
+}
+
+// NOTE: the blocks of the loop are cloned 'copies' times, with fresh ids. The latch of each 
+// copy branches to the header of the next one, and the exit tests of the copies are gone, 
+// since their outcome is known. The phis in the headers of the copies become copies of the 
+// value from the previous iteration. Full unrolling clones the loop once per iteration: the 
+// last copy only runs up to the exit test, which is where the loop is left. Partial unrolling
+// keeps the loop, the exit test of the original blocks is the only one
+static void
+unroll_loop(struct ir *file, struct unroll *unroll, bool full, u32 copies)
+{
+    struct ir_cfg *cfg = &file->cfg;
+    u32 bound = file->header.bound;
+    u32 block_count = cfg->labels.size;
+    u32 size = unroll->body.size;
+    u32 *body = unroll->body.data;
+    u32 **operands = malloc((WORDCOUNT_MASK >> 16) * sizeof(u32 *));
+    u32 *map = malloc(bound * sizeof(u32));
+    u32 *previous = malloc(bound * sizeof(u32));
+    u32 *position = malloc(block_count * sizeof(u32));
+    s32 *clone = malloc((copies + 1) * size * sizeof(s32)); // NOTE: (copy, position in the body) -> block index
+    struct uint_vector defined = vector_init();
+    
+    for (u32 id = 0; id < bound; ++id) {
+        map[id] = id;
+        previous[id] = id;
+    }
+    
+    for (u32 i = 0; i < size; ++i) {
+        position[body[i]] = i;
+        clone[i] = body[i];
+        vector_push(&defined, cfg->labels.data[body[i]]);
+        for (struct instruction_list *inst = file->blocks[body[i]].instructions; inst; inst = inst->next) {
+            u32 result_id = instruction_result_id(&inst->data);
+            if (result_id) {
+                vector_push(&defined, result_id);
+            }
+        }
+    }
+    
+    u32 header = unroll->header;
+    u32 latch_label = cfg->labels.data[unroll->latch];
+    
+    // NOTE: the copies are new blocks, of the original ones only the header and the exit change
+    ir_cfg_write(file);
+    ir_block_write(file, header);
+    if (full) {
+        ir_block_write(file, unroll->exit);
+    }
+    
+    for (u32 k = 1; k <= copies; ++k) {
+        u32 *swap = previous;
+        previous = map;
+        map = swap;
+        
+        for (u32 i = 0; i < defined.size; ++i) {
+            map[defined.data[i]] = defined.data[i];
+        }
+        
+        for (u32 i = 0; i < size; ++i) {
+            if (full && k == copies && !unroll->region[body[i]]) {
+                clone[k * size + i] = -1;
+                continue;
+            }
+            
+            u32 block_index = ir_add_bb(file);
+            clone[k * size + i] = block_index;
+            map[cfg->labels.data[body[i]]] = cfg->labels.data[block_index];
+            
+            for (struct instruction_list *inst = file->blocks[body[i]].instructions; inst; inst = inst->next) {
+                u32 result_id = instruction_result_id(&inst->data);
+                if (result_id) {
+                    map[result_id] = file->header.bound++;
+                }
+            }
+        }
+        
+        for (u32 i = 0; i < size; ++i) {
+            s32 block_index = clone[k * size + i];
+            if (block_index == -1) {
+                continue;
+            }
+            
+            for (struct instruction_list *inst = file->blocks[body[i]].instructions; inst; inst = inst->next) {
+                struct instruction_t *instruction = &inst->data;
+                
+                if ((body[i] == header && instruction->opcode == OpLoopMerge) ||
+                    (body[i] == unroll->exit && instruction->opcode == OpSelectionMerge)) {
+                    continue;
+                }
+                
+                if (body[i] == header && instruction->opcode == OpPhi) {
+                    struct instruction_t copy = { .opcode = OpCopyObject, .wordcount = 4, .unparsed_words = NULL };
+                    copy.OpCopyObject.result_type = instruction->OpPhi.result_type;
+                    copy.OpCopyObject.result_id = map[instruction->OpPhi.result_id];
+                    
+                    for (u32 j = 0; j < (instruction->wordcount - 3) / 2; ++j) {
+                        if (instruction->OpPhi.parents[j] == latch_label) {
+                            u32 variable = instruction->OpPhi.variables[j];
+                            copy.OpCopyObject.operand = (variable < bound ? previous[variable] : variable);
+                        }
+                    }
+                    
+                    ir_append_instruction(file->blocks + block_index, copy);
+                    continue;
+                }
+                
+                ir_append_instruction(file->blocks + block_index, unroll_rename(instruction, map, bound, operands));
+            }
+            
+            u32 condition = cfg->conditions[body[i]];
+            cfg->conditions[block_index] = (body[i] == unroll->exit || condition >= bound ? 0 : map[condition]);
+        }
+    }
+    
+    // NOTE: the edges of the copies
+    for (u32 k = 1; k <= copies; ++k) {
+        for (u32 i = 0; i < size; ++i) {
+            s32 from = clone[k * size + i];
+            if (from == -1) {
+                continue;
+            }
+            
+            for (struct edge_list *edge = cfg->out[body[i]]; edge; edge = edge->next) {
+                u32 to = edge->data;
+                s32 target = -1;
+                
+                if (body[i] == unroll->exit && to == unroll->merge) {
+                    target = (full && k == copies ? (s32) to : -1);
+                } else if (body[i] == unroll->exit && full && k == copies) {
+                    target = -1;
+                } else if (to == header) {
+                    target = (k < copies ? clone[(k + 1) * size] : (s32) header);
+                } else {
+                    target = clone[k * size + position[to]];
+                }
+                
+                if (target != -1) {
+                    cfg_add_edge(cfg, from, target);
+                }
+            }
+        }
+    }
+    
+    // NOTE: the original blocks are the first copy
+    u32 last_latch = clone[copies * size + position[unroll->latch]];
+    cfg_redirect_edge(cfg, unroll->latch, header, clone[size]);
+    
+    if (full) {
+        u32 last_exit = clone[copies * size + position[unroll->exit]];
+        
+        cfg_remove_edge(cfg, unroll->exit, unroll->merge);
+        cfg->conditions[unroll->exit] = 0;
+        
+        struct instruction_list *inst = file->blocks[unroll->exit].instructions;
+        while (inst) {
+            struct instruction_list *next = inst->next;
+            if (inst->data.opcode == OpSelectionMerge) {
+                ir_delete_instruction(file->blocks + unroll->exit, inst);
+            }
+            inst = next;
+        }
+        
+        inst = file->blocks[header].instructions;
+        while (inst) {
+            struct instruction_list *next = inst->next;
+            struct instruction_t *instruction = &inst->data;
+            
+            if (instruction->opcode == OpLoopMerge) {
+                ir_delete_instruction(file->blocks + header, inst);
+            } else if (instruction->opcode == OpPhi) {
+                u32 kept = 0;
+                for (u32 j = 0; j < (instruction->wordcount - 3) / 2; ++j) {
+                    if (instruction->OpPhi.parents[j] != latch_label) {
+                        instruction->OpPhi.variables[kept] = instruction->OpPhi.variables[j];
+                        instruction->OpPhi.parents[kept++] = instruction->OpPhi.parents[j];
+                    }
+                }
+                
+                instruction->wordcount = 3 + kept * 2;
+                
+                if (kept == 1) {
+                    struct instruction_t copy = { .opcode = OpCopyObject, .wordcount = 4, .unparsed_words = NULL };
+                    copy.OpCopyObject.result_type = instruction->OpPhi.result_type;
+                    copy.OpCopyObject.result_id = instruction->OpPhi.result_id;
+                    copy.OpCopyObject.operand = instruction->OpPhi.variables[0];
+                    inst->data = copy;
+                }
+            }
+            
+            inst = next;
+        }
+        
+        // NOTE: the loop is left from the last copy, the values defined before the exit 
+        // test are used from there. 'map' is the renaming of the last copy
+        bool *in_body = calloc(block_count, sizeof(bool));
+        for (u32 i = 0; i < size; ++i) {
+            in_body[body[i]] = true;
+        }
+        
+        for (u32 block_index = 0; block_index < block_count; ++block_index) {
+            if (in_body[block_index]) {
+                continue;
+            }
+            
+            for (inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+                s32 count = instruction_operands(&inst->data, operands);
+                for (s32 i = 0; i < count; ++i) {
+                    if (*operands[i] < bound && map[*operands[i]] != *operands[i]) {
+                        ir_block_write(file, block_index);
+                        *operands[i] = map[*operands[i]];
+                    }
+                }
+                
+                if (inst->data.opcode == OpPhi) {
+                    for (u32 j = 0; j < (inst->data.wordcount - 3) / 2; ++j) {
+                        if (inst->data.OpPhi.parents[j] == cfg->labels.data[unroll->exit]) {
+                            ir_block_write(file, block_index);
+                            inst->data.OpPhi.parents[j] = cfg->labels.data[last_exit];
+                        }
+                    }
+                }
+            }
+            
+            if (cfg->conditions[block_index] < bound) {
+                cfg->conditions[block_index] = map[cfg->conditions[block_index]];
+            }
+        }
+        
+        free(in_body);
+    } else {
+        for (struct instruction_list *inst = file->blocks[header].instructions; inst; inst = inst->next) {
+            struct instruction_t *instruction = &inst->data;
+            
+            if (instruction->opcode == OpLoopMerge) {
+                instruction->OpLoopMerge.continue_block = cfg->labels.data[last_latch];
+            } else if (instruction->opcode == OpPhi) {
+                for (u32 j = 0; j < (instruction->wordcount - 3) / 2; ++j) {
+                    if (instruction->OpPhi.parents[j] == latch_label) {
+                        u32 variable = instruction->OpPhi.variables[j];
+                        instruction->OpPhi.variables[j] = (variable < bound ? map[variable] : variable);
+                        instruction->OpPhi.parents[j] = cfg->labels.data[last_latch];
+                    }
+                }
+            }
+        }
+    }
+    
+    vector_free(&defined);
+    free(operands);
+    free(map);
+    free(previous);
+    free(position);
+    free(clone);
+}
+
+// NOTE: full unrolling of the loops with a small constant trip count, partial unrolling of 
+// the larger ones, innermost first. Only the SSA form is handled: the induction variables
+// are the phis in the loop headers. The loops are found anew after every unrolled loop
+static void
+loop_unrolling(struct ir *file)
+{
+    struct uint_vector done = vector_init(); // NOTE: labels of the headers of the partially unrolled loops
+    u32 growth = 0;
+    bool unrolled = true;
+    
+    while (unrolled && growth < UNROLL_MAX_TOTAL_GROWTH) {
+        unrolled = false;
+        
+        struct cfg_dfs_result dfs = cfg_dfs(&file->cfg);
+        struct licm_loop *loops;
+        u32 loop_count;
+        struct licm licm = licm_init(file, &dfs, &loops, &loop_count, 0);
+        struct induction_ids ids = induction_ids_init(&licm);
+        struct constants constants = constants_init(file);
+        u32 **operands = malloc((WORDCOUNT_MASK >> 16) * sizeof(u32 *));
+        
+        for (u32 i = 0; i < loop_count && !unrolled; ++i) {
+            struct unroll unroll = { .region = NULL };
+            u32 header_label = file->cfg.labels.data[loops[i].header];
+            
+            if (search_item_u32(done.data, done.size, header_label) == -1 &&
+                unroll_analyze(&licm, &ids, &constants, operands, loops[i].header, loop_count + i + 1, &unroll)) {
+                u32 max_trip_count = (unroll.hint ? UNROLL_MAX_TRIP_COUNT_HINT : UNROLL_MAX_TRIP_COUNT);
+                u32 max_growth = (unroll.hint ? UNROLL_MAX_GROWTH_HINT : UNROLL_MAX_GROWTH);
+                u32 full_growth = (unroll.trip_count - 1) * unroll.size + unroll.region_size;
+                u32 partial_growth = (UNROLL_FACTOR - 1) * unroll.size;
+                
+                if (unroll.trip_count <= max_trip_count && full_growth <= max_growth) {
+                    unroll_loop(file, &unroll, true, unroll.trip_count);
+                    growth += full_growth;
+                    unrolled = true;
+                } else if (unroll.trip_count % UNROLL_FACTOR == 0 && partial_growth <= max_growth &&
+                           unroll.latch != unroll.header && unroll.latch != unroll.exit) {
+                    unroll_loop(file, &unroll, false, UNROLL_FACTOR - 1);
+                    vector_push(&done, header_label);
+                    growth += partial_growth;
+                    unrolled = true;
+                }
+            }
+            
+            vector_free(&unroll.body);
+            free(unroll.region);
+        }
+        
+        free(operands);
+        free(loops);
+        constants_free(&constants);
+        induction_ids_free(&ids);
+        licm_free(&licm);
+        cfg_dfs_free(&dfs);
+    }
+    
+    vector_free(&done);
+}
+
+
+// NOTE: parent 'from' of the phi functions at the start of the block becomes 'to'
+static void
+simplify_relabel_phis(struct basic_block *block, u32 from, u32 to)
+{
+    for (struct instruction_list *inst = block->instructions; inst && inst->data.opcode == OpPhi; inst = inst->next) {
+        for (u32 i = 0; i < (inst->data.wordcount - 3) / 2; ++i) {
+            if (inst->data.OpPhi.parents[i] == from) {
+                inst->data.OpPhi.parents[i] = to;
+            }
+        }
+    }
+}
+
+static bool
+simplify_has_edge(struct edge_list *edges, u32 to)
+{
+    for (; edges; edges = edges->next) {
+        if (edges->data == to) {
+            return(true);
+        }
+    }
+    
+    return(false);
+}
+
+// NOTE: an empty block with a single successor is bypassed, its predecessors branch to the
+// successor directly. Unless it is the only predecessor, the successor must not have phi 
+// functions, the incoming value would have to be duplicated for every new parent. The edges 
+// are a set, so a predecessor which already branches to the successor keeps the block too
+static bool
+simplify_forward_empty(struct ir *file, bool *structural, u32 block_index)
+{
+    struct ir_cfg *cfg = &file->cfg;
+    struct edge_list *out = cfg->out[block_index];
+    
+    if (block_index == 0 || !cfg->labels.data[block_index] || structural[block_index] || 
+        file->blocks[block_index].instructions || !out || out->next || out->data == block_index) {
+        return(false);
+    }
+    
+    u32 target = out->data;
+    u32 label = cfg->labels.data[block_index];
+    struct instruction_list *first = file->blocks[target].instructions;
+    
+    if (!cfg->in[block_index] || (cfg->in[block_index]->next && first && first->data.opcode == OpPhi)) {
+        return(false);
+    }
+    
+    for (struct edge_list *pred = cfg->in[block_index]; pred; pred = pred->next) {
+        if (simplify_has_edge(cfg->out[pred->data], target)) {
+            return(false);
+        }
+    }
+    
+    // NOTE: the list changes as the edges are redirected
+    while (cfg->in[block_index]) {
+        u32 pred = cfg->in[block_index]->data;
+        cfg_redirect_edge(cfg, pred, block_index, target);
+        simplify_relabel_phis(file->blocks + target, label, cfg->labels.data[pred]);
+    }
+    
+    ir_remove_bb(file, block_index);
+    
+    return(true);
+}
+
+// NOTE: 'to' is the only successor of 'from' and 'from' is its only predecessor. The 
+// instructions of 'to' are moved to the end of 'from', which takes over its edges. A merge 
+// instruction of 'from' has to stay right before the terminator, so it's moved after them
+static void
+simplify_merge_blocks(struct ir *file, u32 from, u32 to)
+{
+    struct ir_cfg *cfg = &file->cfg;
+    struct basic_block *block = file->blocks + from;
+    struct basic_block *next = file->blocks + to;
+    u32 from_label = cfg->labels.data[from];
+    u32 to_label = cfg->labels.data[to];
+    struct instruction_list *merge = NULL;
+    struct instruction_list *last = NULL;
+    
+    for (struct instruction_list *inst = next->instructions; inst && inst->data.opcode == OpPhi; inst = inst->next) {
+        struct instruction_t copy = { .opcode = OpCopyObject, .wordcount = 4, .unparsed_words = NULL };
+        copy.OpCopyObject.result_type = inst->data.OpPhi.result_type;
+        copy.OpCopyObject.result_id = inst->data.OpPhi.result_id;
+        copy.OpCopyObject.operand = inst->data.OpPhi.variables[0];
+        inst->data = copy;
+    }
+    
+    for (struct instruction_list *inst = block->instructions; inst; inst = inst->next) {
+        if (inst->data.opcode == OpSelectionMerge || inst->data.opcode == OpLoopMerge) {
+            merge = inst;
+        }
+        last = inst;
+    }
+    
+    // NOTE: unlink the merge instruction, it goes back in at the very end. The first 
+    // instruction of a parsed block still points back to its OpLabel, so 'prev' is not checked
+    if (merge && next->instructions) {
+        if (block->instructions == merge) {
+            block->instructions = merge->next;
+        } else {
+            merge->prev->next = merge->next;
+        }
+        
+        if (merge->next) {
+            merge->next->prev = merge->prev;
+        }
+        
+        if (last == merge) {
+            last = (block->instructions ? merge->prev : NULL);
+        }
+        
+        merge->prev = NULL;
+        merge->next = NULL;
+    } else {
+        merge = NULL;
+    }
+    
+    // NOTE: splice the lists, no instruction is copied
+    if (next->instructions) {
+        if (last) {
+            last->next = next->instructions;
+            next->instructions->prev = last;
+        } else {
+            block->instructions = next->instructions;
+            next->instructions->prev = NULL;
+        }
+        
+        last = next->instructions;
+        while (last->next) {
+            last = last->next;
+        }
+    }
+    
+    if (merge) {
+        last->next = merge;
+        merge->prev = last;
+    }
+    
+    block->count += next->count;
+    next->instructions = NULL;
+    next->count = 0;
+    
+    cfg_remove_edge(cfg, from, to);
+    for (struct edge_list *edge = cfg->out[to]; edge; edge = edge->next) {
+        cfg_add_edge(cfg, from, edge->data);
+        simplify_relabel_phis(file->blocks + edge->data, to_label, from_label);
+    }
+    
+    cfg->conditions[from] = cfg->conditions[to];
+    
+    ir_remove_bb(file, to);
+}
+
+static bool
+simplify_has_merge(struct basic_block *block)
+{
+    for (struct instruction_list *inst = block->instructions; inst; inst = inst->next) {
+        if (inst->data.opcode == OpSelectionMerge || inst->data.opcode == OpLoopMerge) {
+            return(true);
+        }
+    }
+    
+    return(false);
+}
+
+// NOTE: removes the unreachable blocks, bypasses the empty forwarding blocks and merges the 
+// straight-line chains (a single successor with a single predecessor). The merge blocks and 
+// continue targets of the structured constructs are never removed or merged into their 
+// predecessor, the structured control flow rules require them to stay separate blocks. In the 
+// end the block arrays are renumbered densely
+static void
+simplify_cfg(struct ir *file)
+{
+    adce_remove_unreachable(file);
+    
+    struct ir_cfg *cfg = &file->cfg;
+    u32 bound = file->header.bound;
+    u32 block_count = cfg->labels.size;
+    bool *structural = calloc(block_count, sizeof(bool));
+    bool *deleted = calloc(bound, sizeof(bool));
+    u32 *label_block = malloc(bound * sizeof(u32));
+    
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        if (cfg->labels.data[block_index]) {
+            label_block[cfg->labels.data[block_index]] = block_index;
+        }
+    }
+    
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+            if (inst->data.opcode == OpSelectionMerge) {
+                structural[label_block[inst->data.OpSelectionMerge.merge_block]] = true;
+            } else if (inst->data.opcode == OpLoopMerge) {
+                structural[label_block[inst->data.OpLoopMerge.merge_block]] = true;
+                structural[label_block[inst->data.OpLoopMerge.continue_block]] = true;
+            }
+        }
+    }
+    
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        u32 label = cfg->labels.data[block_index];
+        if (simplify_forward_empty(file, structural, block_index)) {
+            deleted[label] = true;
+        }
+    }
+    
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        while (cfg->labels.data[block_index] && cfg->out[block_index] && !cfg->out[block_index]->next) {
+            u32 next = cfg->out[block_index]->data;
+            
+            if (next == 0 || next == block_index || structural[next] || cfg->in[next]->next ||
+                (simplify_has_merge(file->blocks + block_index) && simplify_has_merge(file->blocks + next))) {
+                break;
+            }
+            
+            deleted[cfg->labels.data[next]] = true;
+            simplify_merge_blocks(file, block_index, next);
+        }
+    }
+    
+    ir_delete_opnames(file, deleted);
+    ir_compact_blocks(file);
+    
+    free(structural);
+    free(deleted);
+    free(label_block);
+}
+
+#define SLP_MAX_LANES 4
+
+// NOTE: units of the SLP cost model. A vector ALU does an operation on all the lanes at 
+// once, moving scalars in and out of a vector costs per lane, a shuffle is one instruction
+static const u32 SLP_COST_ARITHMETIC = 4;
+static const u32 SLP_COST_LANE = 1;
+static const u32 SLP_COST_SHUFFLE = 2;
+
+enum slp_source_kind {
+    SLP_SOURCE_CONSTRUCT, // NOTE: OpCompositeConstruct of the scalar operands
+    SLP_SOURCE_CONSTANT,  // NOTE: all operands are constants, an OpConstantComposite is declared
+    SLP_SOURCE_GROUP,     // NOTE: the operands are the lanes of another group
+    SLP_SOURCE_VECTOR     // NOTE: the operands are extracted from the same vector
+};
+
+// NOTE: where the vector operand of a group comes from. The lane i of the vector 
+// is the component 'indices[i]' of 'from' (a group index or a vector id)
+struct slp_source {
+    enum slp_source_kind kind;
+    u32 from;
+    u32 indices[SLP_MAX_LANES];
+    bool shuffle;
+};
+
+// NOTE: isomorphic scalar operations, one per lane, which can become a single vector operation
+struct slp_group {
+    enum opcode_t opcode;
+    u32 type;  // NOTE: scalar type of the lanes
+    u32 size;
+    u32 lanes[SLP_MAX_LANES];
+    struct instruction_list *last; // NOTE: the vector code goes right after the last lane
+    struct slp_source sources[2];
+    u32 vector;
+    bool selected;
+};
+
+// NOTE: a scalar candidate keyed either by (opcode, operand slot, vector) for the operands 
+// which are extracted from a vector, or by (operand, operand slot) for the def-use chains
+struct slp_entry {
+    u32 key[3];
+    u32 index;
+    u32 position;
+    u32 id;
+};
+
+struct slp {
+    struct ir *file;
+    u32 bound;
+    u32 **operands;
+    struct instruction_list **definition; // NOTE: id -> instruction which defines it
+    u32 *position;                        // NOTE: id -> position in the block
+    u32 *uses;                            // NOTE: id -> number of uses, unknown instructions use all their words
+    u32 *packed_uses;                     // NOTE: id -> uses which take the vector of the group instead
+    s32 *group;                           // NOTE: id -> group of the lane, -1 if not packed
+    u8 *lane;
+    bool *constant;
+    bool *scalar_float;                   // NOTE: type id -> is a scalar float type
+    u32 *vector_size;                     // NOTE: type id -> number of components, 0 if not a vector
+    u32 *vector_component;
+    struct uint_vector vector_types;      // NOTE: (id, component, size) of all vector types, including the new ones
+    struct slp_group *groups;
+    u32 group_count;
+    u32 group_capacity;
+};
+
+static bool
+slp_arithmetic(enum opcode_t opcode)
+{
+    return(opcode == OpFNegate || opcode == OpFAdd || opcode == OpFSub || opcode == OpFMul || 
+           opcode == OpFDiv || opcode == OpFRem || opcode == OpFMod);
+}
+
+static u32
+slp_arity(enum opcode_t opcode)
+{
+    return(opcode == OpFNegate ? 1 : 2);
+}
+
+static u32 *
+slp_operand(struct instruction_t *instruction, u32 slot)
+{
+    if (instruction->opcode == OpFNegate) {
+        return(&instruction->unary_arithmetics.operand);
+    }
+    
+    return(slot == 0 ? &instruction->binary_arithmetics.operand_1 : &instruction->binary_arithmetics.operand_2);
+}
+
+// NOTE: result type of an instruction, 0 if it is not known
+static u32
+slp_result_type(struct instruction_t *instruction)
+{
+    switch (instruction->opcode) {
+        case OpUndef: return(instruction->OpUndef.result_type);
+        case OpLoad: return(instruction->OpLoad.result_type);
+        case OpCopyObject: return(instruction->OpCopyObject.result_type);
+        case OpPhi: return(instruction->OpPhi.result_type);
+        case OpConstant: return(instruction->OpConstant.result_type);
+        
+        case OpExtInst:
+        case OpVectorShuffle:
+        case OpCompositeExtract:
+        case OpCompositeInsert: {
+            return(instruction->unparsed_words[1]);
+        }
+        
+        default: {
+            if (slp_arithmetic(instruction->opcode) || (instruction->opcode >= OpSNegate && instruction->opcode <= OpFMod)) {
+                return(instruction->binary_arithmetics.result_type);
+            }
+            return(instruction_all_operands(instruction->opcode) ? instruction->unparsed_words[1] : 0);
+        }
+    }
+}
+
+static bool
+slp_candidate(struct slp *slp, struct instruction_t *instruction)
+{
+    if (!slp_arithmetic(instruction->opcode)) {
+        return(false);
+    }
+    
+    u32 type = instruction->binary_arithmetics.result_type;
+    u32 id = instruction->binary_arithmetics.result_id;
+    
+    return(type < slp->bound && slp->scalar_float[type] && id < slp->bound && slp->group[id] == -1);
+}
+
+// NOTE: the vector, and the component which a scalar is extracted from. False unless 
+// it is a single component of a vector with the given component type
+static bool
+slp_extracted(struct slp *slp, u32 id, u32 component, u32 *vector, u32 *index)
+{
+    if (id >= slp->bound || !slp->definition[id] || slp->definition[id]->data.opcode != OpCompositeExtract ||
+        slp->definition[id]->data.wordcount != 5) {
+        return(false);
+    }
+    
+    u32 *words = slp->definition[id]->data.unparsed_words;
+    u32 from = words[3];
+    
+    if (from >= slp->bound || !slp->definition[from]) {
+        return(false);
+    }
+    
+    u32 type = slp_result_type(&slp->definition[from]->data);
+    if (type >= slp->bound || !slp->vector_size[type] || slp->vector_component[type] != component) {
+        return(false);
+    }
+    
+    *vector = from;
+    *index = words[4];
+    
+    return(true);
+}
+
+// NOTE: vector type with the given component type and size, it is declared if the module does not have it yet
+static u32
+slp_vector_type(struct slp *slp, u32 component, u32 size, bool declare)
+{
+    for (u32 i = 0; i < slp->vector_types.size; i += 3) {
+        if (slp->vector_types.data[i + 1] == component && slp->vector_types.data[i + 2] == size) {
+            return(slp->vector_types.data[i]);
+        }
+    }
+    
+    if (!declare) {
+        return(0);
+    }
+    
+    u32 id = slp->file->header.bound++;
+    u32 words[] = { OpTypeVector | (4 << 16), id, component, size };
+    struct instruction_t instruction = { .opcode = OpTypeVector, .wordcount = 4, .unparsed_words = memdup(words, sizeof(words)) };
+    
+    ir_add_global(slp->file, instruction);
+    
+    vector_push(&slp->vector_types, id);
+    vector_push(&slp->vector_types, component);
+    vector_push(&slp->vector_types, size);
+    
+    return(id);
+}
+
+// NOTE: an instruction which is not parsed, 'words' are the words after the first one
+static struct instruction_t
+slp_instruction(enum opcode_t opcode, u32 *words, u32 count)
+{
+    struct instruction_t instruction = { .opcode = opcode, .wordcount = count + 1 };
+    
+    instruction.unparsed_words = malloc((count + 1) * sizeof(u32));
+    instruction.unparsed_words[0] = opcode | ((count + 1) << 16);
+    memcpy(instruction.unparsed_words + 1, words, count * sizeof(u32));
+    
+    return(instruction);
+}
+
+static s32
+slp_compare_entries(const void *a, const void *b)
+{
+    const struct slp_entry *x = a;
+    const struct slp_entry *y = b;
+    
+    for (u32 i = 0; i < 3; ++i) {
+        if (x->key[i] != y->key[i]) {
+            return(x->key[i] < y->key[i] ? -1 : 1);
+        }
+    }
+    
+    return(x->position < y->position ? -1 : (x->position > y->position));
+}
+
+// NOTE: index of the first entry with the given key, 'count' if there is none
+static u32
+slp_find_entry(struct slp_entry *entries, u32 count, u32 key_0, u32 key_1, u32 key_2)
+{
+    struct slp_entry key = { .key = { key_0, key_1, key_2 }, .position = 0 };
+    u32 low = 0;
+    u32 high = count;
+    
+    while (low < high) {
+        u32 middle = (low + high) / 2;
+        if (slp_compare_entries(entries + middle, &key) < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    
+    return(low);
+}
+
+static bool
+slp_same_key(struct slp_entry *entry, u32 key_0, u32 key_1, u32 key_2)
+{
+    return(entry->key[0] == key_0 && entry->key[1] == key_1 && entry->key[2] == key_2);
+}
+
+// NOTE: the lanes are replaced by one vector operation after the last of them. That is only 
+// possible if nothing between the first and the last lane (the lanes included) uses any of 
+// the lanes, which also rules out the lanes which depend on each other
+static bool
+slp_add_group(struct slp *slp, enum opcode_t opcode, u32 type, u32 *lanes, u32 size)
+{
+    u32 first = lanes[0];
+    u32 last = lanes[0];
+    
+    for (u32 i = 1; i < size; ++i) {
+        if (slp->position[lanes[i]] < slp->position[first]) {
+            first = lanes[i];
+        }
+        if (slp->position[lanes[i]] > slp->position[last]) {
+            last = lanes[i];
+        }
+    }
+    
+    for (struct instruction_list *inst = slp->definition[first]->next; inst != slp->definition[last]->next; inst = inst->next) {
+        s32 count = instruction_operands(&inst->data, slp->operands);
+        
+        for (s32 i = 0; i < count; ++i) {
+            if (search_item_u32(lanes, size, *slp->operands[i]) != -1) {
+                return(false);
+            }
+        }
+        
+        for (u32 word = 1; count == -1 && word < inst->data.wordcount; ++word) {
+            if (search_item_u32(lanes, size, inst->data.unparsed_words[word]) != -1) {
+                return(false);
+            }
+        }
+    }
+    
+    if (slp->group_count == slp->group_capacity) {
+        slp->group_capacity = (slp->group_capacity ? slp->group_capacity * 2 : 16);
+        slp->groups = realloc(slp->groups, slp->group_capacity * sizeof(struct slp_group));
+    }
+    
+    struct slp_group *group = slp->groups + slp->group_count;
+    
+    group->opcode = opcode;
+    group->type = type;
+    group->size = size;
+    group->last = slp->definition[last];
+    group->vector = 0;
+    group->selected = true;
+    
+    for (u32 i = 0; i < size; ++i) {
+        group->lanes[i] = lanes[i];
+        slp->group[lanes[i]] = slp->group_count;
+        slp->lane[lanes[i]] = i;
+    }
+    
+    ++slp->group_count;
+    
+    return(true);
+}
+
+// NOTE: the seeds are the operations on the components of the same vector, taken in the
+// order of the components (e.g. a.x * b.x, a.y * b.y, ...). The first unpacked operation 
+// is taken for every component, a group needs at least two lanes starting with the first one
+static void
+slp_seed(struct slp *slp, struct slp_entry *seeds, u32 seed_count)
+{
+    u32 start = 0;
+    
+    while (start < seed_count) {
+        u32 end = start;
+        while (end < seed_count && slp_same_key(seeds + end, seeds[start].key[0], seeds[start].key[1], seeds[start].key[2])) {
+            ++end;
+        }
+        
+        for (;;) {
+            u32 lanes[SLP_MAX_LANES];
+            u32 size = 0;
+            
+            while (size < SLP_MAX_LANES) {
+                u32 i = start;
+                while (i < end && (seeds[i].index != size || slp->group[seeds[i].id] != -1)) {
+                    ++i;
+                }
+                
+                if (i == end) {
+                    break;
+                }
+                
+                lanes[size++] = seeds[i].id;
+            }
+            
+            if (size < 2) {
+                break;
+            }
+            
+            u32 type = slp->definition[lanes[0]]->data.binary_arithmetics.result_type;
+            if (!slp_add_group(slp, seeds[start].key[0], type, lanes, size)) {
+                break;
+            }
+        }
+        
+        start = end;
+    }
+}
+
+// NOTE: the operations which use the lanes of a group in the same operand slot, one 
+// per lane, are isomorphic too. New groups are extended the same way in turn
+static void
+slp_extend(struct slp *slp, struct slp_entry *users, u32 user_count, u32 first_group)
+{
+    for (u32 g = first_group; g < slp->group_count; ++g) {
+        for (u32 slot = 0; slot < 2; ++slot) {
+            struct slp_group group = slp->groups[g];
+            u32 from = slp_find_entry(users, user_count, group.lanes[0], slot, 0);
+            
+            for (u32 u = from; u < user_count && slp_same_key(users + u, group.lanes[0], slot, 0); ++u) {
+                if (slp->group[users[u].id] != -1) {
+                    continue;
+                }
+                
+                struct instruction_t *instruction = &slp->definition[users[u].id]->data;
+                u32 lanes[SLP_MAX_LANES] = { users[u].id };
+                u32 size = 1;
+                
+                while (size < group.size) {
+                    u32 i = slp_find_entry(users, user_count, group.lanes[size], slot, 0);
+                    while (i < user_count && slp_same_key(users + i, group.lanes[size], slot, 0) &&
+                           (slp->group[users[i].id] != -1 || search_item_u32(lanes, size, users[i].id) != -1 ||
+                            slp->definition[users[i].id]->data.opcode != instruction->opcode ||
+                            slp->definition[users[i].id]->data.binary_arithmetics.result_type != group.type)) {
+                        ++i;
+                    }
+                    
+                    if (i == user_count || !slp_same_key(users + i, group.lanes[size], slot, 0)) {
+                        break;
+                    }
+                    
+                    lanes[size++] = users[i].id;
+                }
+                
+                if (size == group.size && instruction->binary_arithmetics.result_type == group.type) {
+                    slp_add_group(slp, instruction->opcode, group.type, lanes, size);
+                }
+            }
+        }
+    }
+}
+
+static void
+slp_find_source(struct slp *slp, struct slp_group *group, u32 slot, u32 first_group)
+{
+    struct slp_source *source = group->sources + slot;
+    u32 ids[SLP_MAX_LANES] = { 0 };
+    bool same_group = true;
+    bool same_vector = true;
+    bool constant = true;
+    u32 vector = 0;
+    
+    for (u32 i = 0; i < group->size; ++i) {
+        ids[i] = *slp_operand(&slp->definition[group->lanes[i]]->data, slot);
+        
+        s32 from = (ids[i] < slp->bound ? slp->group[ids[i]] : -1);
+        same_group = same_group && from >= (s32) first_group && slp->groups[from].selected && 
+                     slp->groups[from].size == group->size && from == slp->group[ids[0]];
+        
+        u32 index = 0;
+        same_vector = same_vector && slp_extracted(slp, ids[i], group->type, &vector, &index) && 
+                      (i == 0 || vector == source->from);
+        source->from = vector;
+        source->indices[i] = index;
+        
+        constant = constant && ids[i] < slp->bound && slp->constant[ids[i]];
+    }
+    
+    if (same_group) {
+        source->kind = SLP_SOURCE_GROUP;
+        source->from = slp->group[ids[0]];
+        source->shuffle = false;
+        for (u32 i = 0; i < group->size; ++i) {
+            source->indices[i] = slp->lane[ids[i]];
+            source->shuffle = source->shuffle || source->indices[i] != i;
+        }
+    } else if (same_vector) {
+        source->kind = SLP_SOURCE_VECTOR;
+        source->shuffle = (slp->vector_size[slp_result_type(&slp->definition[source->from]->data)] != group->size);
+        for (u32 i = 0; i < group->size; ++i) {
+            source->shuffle = source->shuffle || source->indices[i] != i;
+        }
+    } else {
+        source->kind = (constant ? SLP_SOURCE_CONSTANT : SLP_SOURCE_CONSTRUCT);
+    }
+}
+
+// NOTE: an OpCompositeConstruct which builds a vector out of the lanes of a group, in order. 
+// It becomes a copy of the vector of the group
+static s32
+slp_sink(struct slp *slp, struct instruction_t *instruction, u32 first_group)
+{
+    if (instruction->opcode != OpCompositeConstruct || instruction->wordcount < 5) {
+        return(-1);
+    }
+    
+    u32 *words = instruction->unparsed_words;
+    s32 g = (words[3] < slp->bound ? slp->group[words[3]] : -1);
+    
+    if (g < (s32) first_group || slp->groups[g].size != instruction->wordcount - 3 ||
+        slp_vector_type(slp, slp->groups[g].type, slp->groups[g].size, false) != words[1]) {
+        return(-1);
+    }
+    
+    for (u32 i = 0; i < slp->groups[g].size; ++i) {
+        if (words[3 + i] != slp->groups[g].lanes[i]) {
+            return(-1);
+        }
+    }
+    
+    return(g);
+}
+
+// NOTE: all the groups of the block start out selected. A group is dropped if its vector code 
+// costs as much as the scalar code. Dropping a group only makes the groups connected to it 
+// more expensive (their operands have to be constructed, their results extracted), so this 
+// converges after a few iterations
+static void
+slp_select(struct slp *slp, struct basic_block *block, u32 first_group)
+{
+    bool changed = true;
+    
+    while (changed) {
+        changed = false;
+        
+        for (u32 g = first_group; g < slp->group_count; ++g) {
+            for (u32 i = 0; i < slp->groups[g].size; ++i) {
+                slp->packed_uses[slp->groups[g].lanes[i]] = 0;
+            }
+        }
+        
+        for (u32 g = first_group; g < slp->group_count; ++g) {
+            struct slp_group *group = slp->groups + g;
+            
+            for (u32 slot = 0; group->selected && slot < slp_arity(group->opcode); ++slot) {
+                slp_find_source(slp, group, slot, first_group);
+                
+                if (group->sources[slot].kind == SLP_SOURCE_GROUP) {
+                    struct slp_group *from = slp->groups + group->sources[slot].from;
+                    for (u32 i = 0; i < group->size; ++i) {
+                        ++slp->packed_uses[from->lanes[group->sources[slot].indices[i]]];
+                    }
+                }
+            }
+        }
+        
+        for (struct instruction_list *inst = block->instructions; inst; inst = inst->next) {
+            s32 g = slp_sink(slp, &inst->data, first_group);
+            for (u32 i = 0; g != -1 && slp->groups[g].selected && i < slp->groups[g].size; ++i) {
+                ++slp->packed_uses[slp->groups[g].lanes[i]];
+            }
+        }
+        
+        for (u32 g = first_group; g < slp->group_count; ++g) {
+            struct slp_group *group = slp->groups + g;
+            u32 cost = SLP_COST_ARITHMETIC;
+            
+            if (!group->selected) {
+                continue;
+            }
+            
+            for (u32 slot = 0; slot < slp_arity(group->opcode); ++slot) {
+                struct slp_source *source = group->sources + slot;
+                if (source->kind == SLP_SOURCE_CONSTRUCT) {
+                    cost += SLP_COST_LANE * group->size;
+                } else if (source->kind != SLP_SOURCE_CONSTANT && source->shuffle) {
+                    cost += SLP_COST_SHUFFLE;
+                }
+            }
+            
+            for (u32 i = 0; i < group->size; ++i) {
+                if (slp->uses[group->lanes[i]] > slp->packed_uses[group->lanes[i]]) {
+                    cost += SLP_COST_LANE;
+                }
+            }
+            
+            if (cost >= SLP_COST_ARITHMETIC * group->size) {
+                group->selected = false;
+                changed = true;
+            }
+        }
+    }
+}
+
+// NOTE: the vector operand of a group for the given operand slot, the code which makes 
+// it is inserted after 'after'. Returns the new 'after'
+static struct instruction_list *
+slp_emit_source(struct slp *slp, struct basic_block *block, struct instruction_list *after, 
+                struct slp_group *group, u32 slot, u32 vector_type, u32 *operand)
+{
+    struct slp_source *source = group->sources + slot;
+    u32 words[4 + SLP_MAX_LANES];
+    u32 id = slp->file->header.bound++;
+    
+    words[0] = vector_type;
+    words[1] = id;
+    *operand = id;
+    
+    switch (source->kind) {
+        case SLP_SOURCE_GROUP:
+        case SLP_SOURCE_VECTOR: {
+            u32 from = (source->kind == SLP_SOURCE_GROUP ? slp->groups[source->from].vector : source->from);
+            
+            if (!source->shuffle) {
+                --slp->file->header.bound;
+                *operand = from;
+                return(after);
+            }
+            
+            words[2] = from;
+            words[3] = from;
+            memcpy(words + 4, source->indices, group->size * sizeof(u32));
+            
+            return(ir_insert_instruction(block, after, slp_instruction(OpVectorShuffle, words, 4 + group->size)));
+        }
+        
+        case SLP_SOURCE_CONSTANT:
+        case SLP_SOURCE_CONSTRUCT: {
+            for (u32 i = 0; i < group->size; ++i) {
+                words[2 + i] = *slp_operand(&slp->definition[group->lanes[i]]->data, slot);
+            }
+            
+            if (source->kind == SLP_SOURCE_CONSTANT) {
+                ir_add_global(slp->file, slp_instruction(OpConstantComposite, words, 2 + group->size));
+                return(after);
+            }
+            
+            return(ir_insert_instruction(block, after, slp_instruction(OpCompositeConstruct, words, 2 + group->size)));
+        }
+    }
+    
+    return(after);
+}
+
+// NOTE: the selected groups are replaced with the vector code. A lane is extracted from 
+// the vector under its old id, unless all of its uses take the whole vector
+static void
+slp_emit(struct slp *slp, struct basic_block *block, u32 first_group, bool *deleted)
+{
+    for (u32 g = first_group; g < slp->group_count; ++g) {
+        if (slp->groups[g].selected) {
+            slp->groups[g].vector = slp->file->header.bound++;
+        }
+    }
+    
+    for (u32 g = first_group; g < slp->group_count; ++g) {
+        struct slp_group *group = slp->groups + g;
+        
+        if (!group->selected) {
+            continue;
+        }
+        
+        u32 vector_type = slp_vector_type(slp, group->type, group->size, true);
+        struct instruction_list *after = group->last;
+        struct instruction_t operation = { .opcode = group->opcode, .wordcount = 3 + slp_arity(group->opcode), .unparsed_words = NULL };
+        
+        operation.binary_arithmetics.result_type = vector_type;
+        operation.binary_arithmetics.result_id = group->vector;
+        
+        for (u32 slot = 0; slot < slp_arity(group->opcode); ++slot) {
+            after = slp_emit_source(slp, block, after, group, slot, vector_type, slp_operand(&operation, slot));
+        }
+        
+        after = ir_insert_instruction(block, after, operation);
+        
+        for (u32 i = 0; i < group->size; ++i) {
+            u32 lane = group->lanes[i];
+            
+            ir_delete_instruction(block, slp->definition[lane]);
+            slp->definition[lane] = NULL;
+            
+            if (slp->uses[lane] > slp->packed_uses[lane]) {
+                u32 words[] = { group->type, lane, group->vector, i };
+                after = ir_insert_instruction(block, after, slp_instruction(OpCompositeExtract, words, 4));
+                slp->definition[lane] = after;
+            } else {
+                deleted[lane] = true;
+            }
+        }
+    }
+    
+    for (struct instruction_list *inst = block->instructions; inst; inst = inst->next) {
+        s32 g = slp_sink(slp, &inst->data, first_group);
+        
+        if (g != -1 && slp->groups[g].selected) {
+            struct instruction_t copy = { .opcode = OpCopyObject, .wordcount = 4, .unparsed_words = NULL };
+            copy.OpCopyObject.result_type = inst->data.unparsed_words[1];
+            copy.OpCopyObject.result_id = inst->data.unparsed_words[2];
+            copy.OpCopyObject.operand = slp->groups[g].vector;
+            free(inst->data.unparsed_words);
+            inst->data = copy;
+        }
+    }
+}
+
+static void
+slp_count_uses(struct slp *slp, struct instruction_t *instruction)
+{
+    s32 count = instruction_operands(instruction, slp->operands);
+    
+    for (s32 i = 0; i < count; ++i) {
+        if (*slp->operands[i] < slp->bound) {
+            ++slp->uses[*slp->operands[i]];
+        }
+    }
+    
+    for (u32 word = 1; count == -1 && word < instruction->wordcount; ++word) {
+        if (instruction->unparsed_words[word] < slp->bound) {
+            ++slp->uses[instruction->unparsed_words[word]];
+        }
+    }
+}
+
+// NOTE: superword level parallelism (as per Larsen S., Amarasinghe S.). The frontend writes 
+// the vector math as independent scalar operations on the components. Isomorphic scalar 
+// float operations of a block are packed into groups, seeded by the operations on the 
+// components of the same vector and extended along the def-use chains, and a group is 
+// replaced with one vector operation if the cost model finds it profitable. The lanes which 
+// are still used as scalars are extracted from the vector
+static void
+slp_vectorization(struct ir *file)
+{
+    u32 bound = file->header.bound;
+    u32 block_count = file->cfg.labels.size;
+    bool *deleted = calloc(bound, sizeof(bool));
+    
+    struct slp slp = {
+        .file = file,
+        .bound = bound,
+        .operands = malloc((WORDCOUNT_MASK >> 16) * sizeof(u32 *)),
+        .definition = calloc(bound, sizeof(struct instruction_list *)),
+        .position = calloc(bound, sizeof(u32)),
+        .uses = calloc(bound, sizeof(u32)),
+        .packed_uses = calloc(bound, sizeof(u32)),
+        .group = malloc(bound * sizeof(s32)),
+        .lane = calloc(bound, sizeof(u8)),
+        .constant = calloc(bound, sizeof(bool)),
+        .scalar_float = calloc(bound, sizeof(bool)),
+        .vector_size = calloc(bound, sizeof(u32)),
+        .vector_component = calloc(bound, sizeof(u32)),
+        .vector_types = vector_init(),
+        .groups = NULL
+    };
+    
+    for (u32 id = 0; id < bound; ++id) {
+        slp.group[id] = -1;
+    }
+    
+    for (struct instruction_list *inst = file->pre_cfg; inst; inst = inst->next) {
+        u32 *words = inst->data.unparsed_words;
+        
+        if (inst->data.opcode == OpTypeFloat) {
+            slp.scalar_float[words[1]] = true;
+        } else if (inst->data.opcode == OpTypeVector) {
+            slp.vector_component[words[1]] = words[2];
+            slp.vector_size[words[1]] = words[3];
+            vector_push(&slp.vector_types, words[1]);
+            vector_push(&slp.vector_types, words[2]);
+            vector_push(&slp.vector_types, words[3]);
+        } else if (inst->data.opcode == OpConstant) {
+            slp.constant[inst->data.OpConstant.result_id] = true;
+        }
+    }
+    
+    struct instruction_list *globals[] = { file->pre_cfg, file->post_cfg };
+    for (u32 i = 0; i < 2; ++i) {
+        for (struct instruction_list *inst = globals[i]; inst; inst = inst->next) {
+            u32 result_id = instruction_result_id(&inst->data);
+            if (result_id && result_id < bound) {
+                slp.definition[result_id] = inst;
+            }
+            slp_count_uses(&slp, &inst->data);
+        }
+    }
+    
+    u32 capacity = 0;
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        u32 count = 0;
+        for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+            u32 result_id = instruction_result_id(&inst->data);
+            if (result_id && result_id < bound) {
+                slp.definition[result_id] = inst;
+            }
+            slp_count_uses(&slp, &inst->data);
+            ++count;
+        }
+        
+        // NOTE: the terminator
+        if (file->cfg.conditions[block_index] < bound) {
+            ++slp.uses[file->cfg.conditions[block_index]];
+        }
+        
+        if (count > capacity) {
+            capacity = count;
+        }
+    }
+    
+    struct slp_entry *seeds = malloc(2 * capacity * sizeof(struct slp_entry));
+    struct slp_entry *users = malloc(2 * capacity * sizeof(struct slp_entry));
+    
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        struct basic_block *block = file->blocks + block_index;
+        u32 seed_count = 0;
+        u32 user_count = 0;
+        u32 position = 0;
+        
+        for (struct instruction_list *inst = block->instructions; inst; inst = inst->next, ++position) {
+            struct instruction_t *instruction = &inst->data;
+            
+            if (!slp_candidate(&slp, instruction)) {
+                continue;
+            }
+            
+            u32 id = instruction->binary_arithmetics.result_id;
+            u32 type = instruction->binary_arithmetics.result_type;
+            slp.position[id] = position;
+            
+            for (u32 slot = 0; slot < slp_arity(instruction->opcode); ++slot) {
+                u32 operand = *slp_operand(instruction, slot);
+                u32 vector;
+                u32 index;
+                
+                users[user_count++] = (struct slp_entry) { .key = { operand, slot, 0 }, .position = position, .id = id };
+                
+                if (slp_extracted(&slp, operand, type, &vector, &index) && index < SLP_MAX_LANES) {
+                    seeds[seed_count++] = (struct slp_entry) {
+                        .key = { instruction->opcode, slot, vector }, .index = index, .position = position, .id = id
+                    };
+                }
+            }
+        }
+        
+        if (seed_count == 0) {
+            continue;
+        }
+        
+        qsort(seeds, seed_count, sizeof(struct slp_entry), slp_compare_entries);
+        qsort(users, user_count, sizeof(struct slp_entry), slp_compare_entries);
+        
+        u32 first_group = slp.group_count;
+        
+        slp_seed(&slp, seeds, seed_count);
+        slp_extend(&slp, users, user_count, first_group);
+        
+        if (slp.group_count > first_group) {
+            slp_select(&slp, block, first_group);
+            slp_emit(&slp, block, first_group, deleted);
+        }
+    }
+    
+    ir_delete_opnames(file, deleted);
+    
+    free(seeds);
+    free(users);
+    free(deleted);
+    free(slp.operands);
+    free(slp.definition);
+    free(slp.position);
+    free(slp.uses);
+    free(slp.packed_uses);
+    free(slp.group);
+    free(slp.lane);
+    free(slp.constant);
+    free(slp.scalar_float);
+    free(slp.vector_size);
+    free(slp.vector_component);
+    free(slp.groups);
+    vector_free(&slp.vector_types);
+}
+
+static const u32 INLINE_MAX_SIZE = 64;
+static const u32 INLINE_MAX_SIZE_SINGLE_CALL = 1024;
+static const u32 INLINE_CONSTANT_ARGUMENT_BONUS = 16;
+static const u32 INLINE_MAX_TOTAL_GROWTH = 16384;
+
+// NOTE: a function of the module. Only the function in the CFG is parsed into blocks, the 
+// other ones are plain lists of instructions in post_cfg, from OpFunction to OpFunctionEnd
+struct inline_function {
+    u32 id;
+    struct instruction_list *function; // NOTE: OpFunction, NULL for the function in the CFG
+    struct instruction_list *end;      // NOTE: OpFunctionEnd
+    struct uint_vector callees;        // NOTE: the call graph edges, one per call site
+    u32 size;                          // NOTE: instructions, not counting the labels and the terminators
+    u32 call_sites;
+    bool inlinable;
+    bool recursive;
+    bool wrap;                         // NOTE: the returns have to break out of a one-trip loop
+};
+
+struct call_graph {
+    struct inline_function *functions;
+    u32 count;
+    s32 *index; // NOTE: function id -> index in 'functions', -1 if not a function with a body
+};
+
+struct inliner {
+    struct ir *file;
+    struct call_graph graph;
+    u32 bound;
+    u32 **operands;
+    u32 *map;        // NOTE: callee id -> id in the caller
+    u32 *block;      // NOTE: callee label -> index of the block in the caller
+    bool *constant;
+    bool *deleted;
+    u32 growth;
+};
+
+static void
+call_graph_add_call(struct inline_function *caller, struct instruction_t *instruction)
+{
+    if (instruction->opcode == OpFunctionCall) {
+        vector_push(&caller->callees, instruction->unparsed_words[3]);
+    }
+}
+
+// NOTE: the nodes are the functions with a body, the function in the CFG is the first one. A
+// function is recursive if it can reach itself, these are never inlined
+static struct call_graph
+call_graph_build(struct ir *file)
+{
+    u32 bound = file->header.bound;
+    struct call_graph graph = {
+        .functions = malloc(sizeof(struct inline_function)),
+        .count = 1,
+        .index = malloc(bound * sizeof(s32))
+    };
+    
+    for (u32 id = 0; id < bound; ++id) {
+        graph.index[id] = -1;
+    }
+    
+    struct inline_function root = { .function = NULL, .callees = vector_init() };
+    for (struct instruction_list *inst = file->pre_cfg; inst; inst = inst->next) {
+        if (inst->data.opcode == OpFunction) {
+            root.id = inst->data.unparsed_words[2];
+        }
+    }
+    
+    for (u32 block_index = 0; block_index < file->cfg.labels.size; ++block_index) {
+        for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+            call_graph_add_call(&root, &inst->data);
+        }
+    }
+    
+    graph.functions[0] = root;
+    graph.index[root.id] = 0;
+    
+    for (struct instruction_list *inst = file->post_cfg; inst; inst = inst->next) {
+        if (inst->data.opcode != OpFunction) {
+            continue;
+        }
+        
+        struct inline_function function = { .id = inst->data.unparsed_words[2], .function = inst, .callees = vector_init() };
+        
+        for (inst = inst->next; inst->data.opcode != OpFunctionEnd; inst = inst->next) {
+            call_graph_add_call(&function, &inst->data);
+        }
+        
+        function.end = inst;
+        
+        // NOTE: a declaration (e.g. an imported function) has no blocks
+        if (function.end->prev->data.opcode == OpFunction || function.end->prev->data.opcode == OpFunctionParameter) {
+            vector_free(&function.callees);
+            continue;
+        }
+        
+        graph.functions = realloc(graph.functions, (graph.count + 1) * sizeof(struct inline_function));
+        graph.functions[graph.count] = function;
+        graph.index[function.id] = graph.count;
+        ++graph.count;
+    }
+    
+    for (u32 i = 0; i < graph.count; ++i) {
+        for (u32 c = 0; c < graph.functions[i].callees.size; ++c) {
+            s32 callee = graph.index[graph.functions[i].callees.data[c]];
+            if (callee != -1) {
+                ++graph.functions[callee].call_sites;
+            }
+        }
+    }
+    
+    // NOTE: a depth first search from every function, shaders have few of them
+    u32 *visited = calloc(graph.count, sizeof(u32));
+    struct uint_vector stack = vector_init();
+    
+    for (u32 i = 0; i < graph.count; ++i) {
+        vector_push(&stack, i);
+        
+        while (stack.size && !graph.functions[i].recursive) {
+            struct inline_function *function = graph.functions + stack.data[--stack.size];
+            
+            for (u32 c = 0; c < function->callees.size; ++c) {
+                s32 callee = graph.index[function->callees.data[c]];
+                if (callee == (s32) i) {
+                    graph.functions[i].recursive = true;
+                } else if (callee != -1 && visited[callee] != i + 1) {
+                    visited[callee] = i + 1;
+                    vector_push(&stack, callee);
+                }
+            }
+        }
+        
+        stack.size = 0;
+    }
+    
+    free(visited);
+    vector_free(&stack);
+    
+    return(graph);
+}
+
+static void
+call_graph_free(struct call_graph *graph)
+{
+    for (u32 i = 0; i < graph->count; ++i) {
+        vector_free(&graph->functions[i].callees);
+    }
+    
+    free(graph->functions);
+    free(graph->index);
+}
+
+// NOTE: a function can be inlined if all of its instructions are understood, so that they can 
+// be renamed. The returns become branches to the block after the call. A return which is nested 
+// in a selection construct has to leave it, which is only allowed as a break out of a loop: such 
+// a body is wrapped into a loop which runs once. A break can not leave more than one loop, so a 
+// function which returns from inside a loop is not inlined
+static void
+inline_analyze(struct inliner *inliner, struct inline_function *function)
+{
+    struct uint_vector labels = vector_init();
+    struct uint_vector returns = vector_init();
+    struct uint_vector merges = vector_init(); // NOTE: (header, merge label, is a loop)
+    u32 current = 0;
+    
+    function->inlinable = !function->recursive;
+    
+    for (struct instruction_list *inst = function->function->next; inst != function->end; inst = inst->next) {
+        if (inst->data.opcode == OpLabel) {
+            inliner->block[inst->data.OpLabel.result_id] = labels.size;
+            vector_push(&labels, inst->data.OpLabel.result_id);
+        }
+    }
+    
+    struct ir_cfg cfg = cfg_init(labels.data, labels.size);
+    
+    for (struct instruction_list *inst = function->function->next; inst != function->end; inst = inst->next) {
+        struct instruction_t *instruction = &inst->data;
+        
+        switch (instruction->opcode) {
+            case OpFunctionParameter:
+            case OpUnreachable: {
+            } break;
+            
+            case OpLabel: {
+                current = inliner->block[instruction->OpLabel.result_id];
+            } break;
+            
+            case OpBranch: {
+                cfg_add_edge(&cfg, current, inliner->block[instruction->OpBranch.target_label]);
+            } break;
+            
+            case OpBranchConditional: {
+                cfg_add_edge(&cfg, current, inliner->block[instruction->OpBranchConditional.true_label]);
+                cfg_add_edge(&cfg, current, inliner->block[instruction->OpBranchConditional.false_label]);
+            } break;
+            
+            case OpReturn:
+            case OpReturnValue: {
+                vector_push(&returns, current);
+            } break;
+            
+            case OpSwitch:
+            case OpKill: {
+                function->inlinable = false;
+            } break;
+            
+            case OpSelectionMerge:
+            case OpLoopMerge: {
+                bool loop = (instruction->opcode == OpLoopMerge);
+                vector_push(&merges, current);
+                vector_push(&merges, loop ? instruction->OpLoopMerge.merge_block : instruction->OpSelectionMerge.merge_block);
+                vector_push(&merges, loop);
+                ++function->size;
+            } break;
+            
+            default: {
+                if (instruction->opcode != OpFunctionCall && instruction_operands(instruction, inliner->operands) == -1) {
+                    function->inlinable = false;
+                }
+                ++function->size;
+            }
+        }
+    }
+    
+    struct cfg_dfs_result dfs = cfg_dfs(&cfg);
+    cfg.dominators = cfg_dominators(&cfg, &dfs);
+    
+    function->wrap = (returns.size > 1);
+    
+    for (u32 r = 0; r < returns.size; ++r) {
+        for (u32 m = 0; m < merges.size; m += 3) {
+            u32 header = merges.data[m];
+            u32 merge = inliner->block[merges.data[m + 1]];
+            
+            if (dominates(header, returns.data[r], cfg.dominators) && !dominates(merge, returns.data[r], cfg.dominators)) {
+                function->inlinable = function->inlinable && !merges.data[m + 2];
+                function->wrap = true;
+            }
+        }
+    }
+    
+    cfg_dfs_free(&dfs);
+    cfg_free(&cfg);
+    vector_free(&labels);
+    vector_free(&returns);
+    vector_free(&merges);
+}
+
+// NOTE: small functions are always inlined, a function with a single call site is inlined 
+// up to a much larger size, since its body is not duplicated. Every constant argument is 
+// likely to fold some of the body away, so it raises the limit
+static bool
+inline_profitable(struct inliner *inliner, struct inline_function *function, struct instruction_t *call)
+{
+    u32 limit = (function->call_sites == 1 ? INLINE_MAX_SIZE_SINGLE_CALL : INLINE_MAX_SIZE);
+    
+    for (u32 i = 4; i < call->wordcount; ++i) {
+        if (call->unparsed_words[i] < inliner->bound && inliner->constant[call->unparsed_words[i]]) {
+            limit += INLINE_CONSTANT_ARGUMENT_BONUS;
+        }
+    }
+    
+    return(function->inlinable && function->size <= limit && inliner->growth + function->size <= INLINE_MAX_TOTAL_GROWTH);
+}
+
+static u32
+inline_id(struct inliner *inliner, u32 id)
+{
+    return(id < inliner->bound ? inliner->map[id] : id);
+}
+
+// NOTE: a copy of a callee instruction with the ids of the caller. Calls are not parsed, 
+// their result and arguments are renamed here. A call which is copied is a new call site
+static struct instruction_t
+inline_rename(struct inliner *inliner, struct instruction_t *instruction)
+{
+    struct instruction_t copy = unroll_rename(instruction, inliner->map, inliner->bound, inliner->operands);
+    
+    if (copy.opcode == OpFunctionCall) {
+        copy.unparsed_words[2] = inline_id(inliner, copy.unparsed_words[2]);
+        for (u32 i = 4; i < copy.wordcount; ++i) {
+            copy.unparsed_words[i] = inline_id(inliner, copy.unparsed_words[i]);
+        }
+        
+        s32 callee = (copy.unparsed_words[3] < inliner->bound ? inliner->graph.index[copy.unparsed_words[3]] : -1);
+        if (callee != -1) {
+            ++inliner->graph.functions[callee].call_sites;
+        }
+    }
+    
+    return(copy);
+}
+
+static void
+inline_recount(struct basic_block *block)
+{
+    block->count = 0;
+    for (struct instruction_list *inst = block->instructions; inst; inst = inst->next) {
+        ++block->count;
+    }
+}
+
+// NOTE: the block of the call is split in two, the part after the call moves to a new block
+// with the outgoing edges. The blocks of the callee are cloned in between, with fresh ids, and 
+// the parameters are replaced by the arguments. The Function class variables of the callee go 
+// to the entry block of the caller, an initializer becomes a store at the start of the inlined 
+// body. The return value is a phi in the block after the call if there are several returns
+static void
+inline_call(struct inliner *inliner, u32 block_index, struct instruction_list *call, struct inline_function *function)
+{
+    struct ir *file = inliner->file;
+    struct ir_cfg *cfg = &file->cfg;
+    u32 *words = call->data.unparsed_words;
+    struct instruction_list *body = function->function->next;
+    struct uint_vector renamed = vector_init();
+    struct uint_vector returns = vector_init(); // NOTE: (value, label) of the returns
+    
+    for (u32 argument = 4; body->data.opcode == OpFunctionParameter; body = body->next, ++argument) {
+        inliner->map[body->data.unparsed_words[2]] = words[argument];
+        vector_push(&renamed, body->data.unparsed_words[2]);
+    }
+    
+    for (struct instruction_list *inst = body; inst != function->end; inst = inst->next) {
+        u32 id = (inst->data.opcode == OpFunctionCall ? inst->data.unparsed_words[2] : instruction_result_id(&inst->data));
+        
+        if (inst->data.opcode == OpLabel) {
+            u32 new_block = ir_add_bb(file);
+            id = inst->data.OpLabel.result_id;
+            inliner->block[id] = new_block;
+            inliner->map[id] = cfg->labels.data[new_block];
+        } else if (id) {
+            inliner->map[id] = file->header.bound++;
+        }
+        
+        if (id) {
+            vector_push(&renamed, id);
+        }
+    }
+    
+    u32 rest = ir_add_bb(file);
+    u32 entry = inliner->block[body->data.OpLabel.result_id];
+    
+    // NOTE: of the existing blocks, the one with the call, its successors (the parents of 
+    // their phis change) and the entry block (the variables of the callee go there) change
+    ir_cfg_write(file);
+    ir_block_write(file, block_index);
+    ir_block_write(file, 0);
+    
+    if (function->wrap) {
+        u32 header = ir_add_bb(file);
+        u32 continue_target = ir_add_bb(file);
+        struct instruction_t merge = { .opcode = OpLoopMerge, .wordcount = 4, .unparsed_words = NULL };
+        
+        merge.OpLoopMerge.merge_block = cfg->labels.data[rest];
+        merge.OpLoopMerge.continue_block = cfg->labels.data[continue_target];
+        merge.OpLoopMerge.loop_control = LoopControlNone;
+        
+        ir_append_instruction(file->blocks + header, merge);
+        cfg_add_edge(cfg, header, entry);
+        
+        // NOTE: the continue target is never reached, but it still has to branch back to the header
+        cfg_add_edge(cfg, continue_target, header);
+        entry = header;
+    }
+    
+    struct basic_block *block = file->blocks + block_index;
+    struct basic_block *after = file->blocks + rest;
+    
+    after->instructions = call->next;
+    if (call->next) {
+        call->next->prev = NULL;
+    }
+    
+    if (block->instructions == call) {
+        block->instructions = NULL;
+    } else {
+        call->prev->next = NULL;
+    }
+    
+    inline_recount(block);
+    inline_recount(after);
+    
+    for (struct edge_list *edge = cfg->out[block_index]; edge; edge = edge->next) {
+        cfg_add_edge(cfg, rest, edge->data);
+        ir_block_write(file, edge->data);
+        simplify_relabel_phis(file->blocks + edge->data, cfg->labels.data[block_index], cfg->labels.data[rest]);
+    }
+    
+    while (cfg->out[block_index]) {
+        cfg_remove_edge(cfg, block_index, cfg->out[block_index]->data);
+    }
+    
+    cfg->conditions[rest] = cfg->conditions[block_index];
+    cfg->conditions[block_index] = 0;
+    cfg_add_edge(cfg, block_index, entry);
+    
+    u32 current = 0;
+    struct instruction_list *last = NULL;
+    
+    for (struct instruction_list *inst = body; inst != function->end; inst = inst->next) {
+        struct instruction_t *instruction = &inst->data;
+        
+        switch (instruction->opcode) {
+            case OpUnreachable: {
+            } break;
+            
+            case OpLabel: {
+                current = inliner->block[instruction->OpLabel.result_id];
+                last = NULL;
+            } break;
+            
+            case OpBranch: {
+                cfg_add_edge(cfg, current, inliner->block[instruction->OpBranch.target_label]);
+            } break;
+            
+            case OpBranchConditional: {
+                cfg->conditions[current] = inline_id(inliner, instruction->OpBranchConditional.condition);
+                cfg_add_edge(cfg, current, inliner->block[instruction->OpBranchConditional.true_label]);
+                cfg_add_edge(cfg, current, inliner->block[instruction->OpBranchConditional.false_label]);
+            } break;
+            
+            case OpReturnValue: {
+                vector_push(&returns, inline_id(inliner, instruction->unparsed_words[1]));
+                vector_push(&returns, cfg->labels.data[current]);
+                cfg_add_edge(cfg, current, rest);
+            } break;
+            
+            case OpReturn: {
+                cfg_add_edge(cfg, current, rest);
+            } break;
+            
+            case OpVariable: {
+                struct instruction_t variable = inline_rename(inliner, instruction);
+                
+                if (variable.wordcount == 5) {
+                    struct instruction_t store = { .opcode = OpStore, .wordcount = 3, .unparsed_words = NULL };
+                    store.OpStore.pointer = variable.OpVariable.result_id;
+                    store.OpStore.object = variable.OpVariable.initializer;
+                    last = ir_insert_instruction(file->blocks + current, last, store);
+                    variable.wordcount = 4;
+                }
+                
+                ir_prepend_instruction(file->blocks, variable);
+            } break;
+            
+            default: {
+                last = ir_insert_instruction(file->blocks + current, last, inline_rename(inliner, instruction));
+            }
+        }
+    }
+    
+    u32 return_count = returns.size / 2;
+    
+    if (return_count == 1) {
+        struct instruction_t copy = { .opcode = OpCopyObject, .wordcount = 4, .unparsed_words = NULL };
+        copy.OpCopyObject.result_type = words[1];
+        copy.OpCopyObject.result_id = words[2];
+        copy.OpCopyObject.operand = returns.data[0];
+        ir_prepend_instruction(file->blocks + rest, copy);
+    } else if (return_count > 1) {
+        struct instruction_t phi = { .opcode = OpPhi, .wordcount = 3 + 2 * return_count, .unparsed_words = NULL };
+        phi.OpPhi.result_type = words[1];
+        phi.OpPhi.result_id = words[2];
+        phi.OpPhi.variables = malloc(return_count * sizeof(u32));
+        phi.OpPhi.parents = malloc(return_count * sizeof(u32));
+        
+        for (u32 i = 0; i < return_count; ++i) {
+            phi.OpPhi.variables[i] = returns.data[2 * i];
+            phi.OpPhi.parents[i] = returns.data[2 * i + 1];
+        }
+        
+        ir_prepend_instruction(file->blocks + rest, phi);
+    } else if (words[2] < inliner->bound) {
+        inliner->deleted[words[2]] = true;
+    }
+    
+    for (u32 i = 0; i < renamed.size; ++i) {
+        inliner->map[renamed.data[i]] = renamed.data[i];
+    }
+    
+    inliner->growth += function->size;
+    --function->call_sites;
+    
+    free(words);
+    free(call);
+    vector_free(&renamed);
+    vector_free(&returns);
+}
+
+static bool
+inline_has_loop_merge(struct basic_block *block)
+{
+    for (struct instruction_list *inst = block->instructions; inst; inst = inst->next) {
+        if (inst->data.opcode == OpLoopMerge) {
+            return(true);
+        }
+    }
+    
+    return(false);
+}
+
+// NOTE: calls in the function of the CFG are replaced with the bodies of the callees, as 
+// long as the size heuristic agrees. The inlined bodies are scanned for calls in turn, the 
+// call graph makes sure this terminates (recursive functions are never inlined). A call in a 
+// loop header is kept, the loop merge instruction has to stay in the block the back edge 
+// targets. The functions themselves are left in place, even if nothing calls them anymore
+static void
+function_inlining(struct ir *file)
+{
+    u32 bound = file->header.bound;
+    
+    struct inliner inliner = {
+        .file = file,
+        .graph = call_graph_build(file),
+        .bound = bound,
+        .operands = malloc((WORDCOUNT_MASK >> 16) * sizeof(u32 *)),
+        .map = malloc(bound * sizeof(u32)),
+        .block = malloc(bound * sizeof(u32)),
+        .constant = calloc(bound, sizeof(bool)),
+        .deleted = calloc(bound, sizeof(bool)),
+        .growth = 0
+    };
+    
+    for (u32 id = 0; id < bound; ++id) {
+        inliner.map[id] = id;
+    }
+    
+    for (struct instruction_list *inst = file->pre_cfg; inst; inst = inst->next) {
+        enum opcode_t opcode = inst->data.opcode;
+        if (opcode == OpConstantTrue || opcode == OpConstantFalse || opcode == OpConstant || opcode == OpConstantComposite) {
+            inliner.constant[instruction_result_id(&inst->data)] = true;
+        }
+    }
+    
+    for (u32 i = 1; i < inliner.graph.count; ++i) {
+        inline_analyze(&inliner, inliner.graph.functions + i);
+    }
+    
+    for (u32 block_index = 0; block_index < file->cfg.labels.size; ++block_index) {
+        if (inline_has_loop_merge(file->blocks + block_index)) {
+            continue;
+        }
+        
+        for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+            if (inst->data.opcode != OpFunctionCall || inst->data.unparsed_words[3] >= bound) {
+                continue;
+            }
+            
+            s32 callee = inliner.graph.index[inst->data.unparsed_words[3]];
+            
+            // NOTE: the rest of the block is in a new block now, which is scanned later
+            if (callee > 0 && inline_profitable(&inliner, inliner.graph.functions + callee, &inst->data)) {
+                inline_call(&inliner, block_index, inst, inliner.graph.functions + callee);
+                break;
+            }
+        }
+    }
+    
+    ir_delete_opnames(file, inliner.deleted);
+    
+    call_graph_free(&inliner.graph);
+    free(inliner.operands);
+    free(inliner.map);
+    free(inliner.block);
+    free(inliner.constant);
+    free(inliner.deleted);
+}
+
+// NOTE: result id of a module level declaration which can be deleted if nothing refers to 
+// it: types, constants, global variables, strings and extended instruction set imports. 
+// Returns 0 for everything else, which then stays, along with all the ids it refers to
+static u32
+global_declaration_id(struct instruction_t *instruction)
+{
+    enum opcode_t opcode = instruction->opcode;
+    
+    if (opcode == OpTypeArray || opcode == OpTypeStruct || opcode == OpTypePointer || opcode == OpVariable ||
+        opcode == OpConstantTrue || opcode == OpConstantFalse || opcode == OpConstant || opcode == OpUndef) {
+        return(instruction_result_id(instruction));
+    }
+    
+    if ((opcode >= OpTypeVoid && opcode < OpTypeForwardPointer) || opcode == OpString || opcode == OpExtInstImport) {
+        return(instruction->unparsed_words[1]);
+    }
+    
+    if (opcode >= OpConstantTrue && opcode <= OpSpecConstantOp) {
+        return(instruction->unparsed_words[2]);
+    }
+    
+    return(0);
+}
+
+static bool
+global_annotation(enum opcode_t opcode)
+{
+    return(opcode == OpName || opcode == OpMemberName || opcode == OpDecorate || opcode == OpMemberDecorate);
+}
+
+struct dead_globals {
+    u32 bound;
+    bool *live;
+    struct instruction_list **declaration; // NOTE: id -> deletable declaration in pre_cfg
+    struct instruction_list **function;    // NOTE: id -> OpFunction of a function in post_cfg
+    u32 *buffer;
+    struct uint_vector worklist;
+};
+
+static void
+dead_globals_mark(struct dead_globals *globals, u32 id)
+{
+    if (id < globals->bound && !globals->live[id]) {
+        globals->live[id] = true;
+        vector_push(&globals->worklist, id);
+    }
+}
+
+// NOTE: ids are found by dumping the instruction, so a literal might be mistaken for an id, 
+// which is safe
+static void
+dead_globals_mark_words(struct dead_globals *globals, struct instruction_t *instruction)
+{
+    instruction_dump(instruction, globals->buffer);
+    for (u32 i = 1; i < instruction->wordcount; ++i) {
+        dead_globals_mark(globals, globals->buffer[i]);
+    }
+}
+
+static void
+dead_globals_unlink(struct instruction_list **list, struct instruction_list *first, struct instruction_list *last)
+{
+    if (first->prev) {
+        first->prev->next = last->next;
+    } else {
+        *list = last->next;
+    }
+    
+    if (last->next) {
+        last->next->prev = first->prev;
+    }
+    
+    last->next = NULL;
+    instruction_list_free(first);
+}
+
+// NOTE: everything the entry point can reach, through calls and id references, stays. The
+// roots are the function in the CFG and the module level instructions which do not declare
+// an id, like OpEntryPoint and OpExecutionMode. Names and decorations do not keep their 
+// targets alive, they go away with them. The Function class variables nothing refers to 
+// anymore (e.g. after the SSA conversion promoted all their loads and stores) are deleted too
+static void
+dead_global_elimination(struct ir *file)
+{
+    u32 bound = file->header.bound;
+    
+    struct dead_globals globals = {
+        .bound = bound,
+        .live = calloc(bound, sizeof(bool)),
+        .declaration = calloc(bound, sizeof(struct instruction_list *)),
+        .function = calloc(bound, sizeof(struct instruction_list *)),
+        .buffer = malloc((WORDCOUNT_MASK >> 16) * sizeof(u32)),
+        .worklist = vector_init()
+    };
+    
+    for (u32 block_index = 0; block_index < file->cfg.labels.size; ++block_index) {
+        for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+            if (inst->data.opcode != OpVariable) {
+                dead_globals_mark_words(&globals, &inst->data);
+            }
+        }
+        dead_globals_mark(&globals, file->cfg.conditions[block_index]);
+    }
+    
+    for (u32 block_index = 0; block_index < file->cfg.labels.size; ++block_index) {
+        struct instruction_list *inst = file->blocks[block_index].instructions;
+        
+        while (inst) {
+            struct instruction_list *next = inst->next;
+            
+            if (inst->data.opcode == OpVariable) {
+                if (globals.live[inst->data.OpVariable.result_id]) {
+                    dead_globals_mark_words(&globals, &inst->data);
+                } else {
+                    ir_delete_instruction(file->blocks + block_index, inst);
+                }
+            }
+            
+            inst = next;
+        }
+    }
+    
+    for (struct instruction_list *inst = file->pre_cfg; inst; inst = inst->next) {
+        u32 id = global_declaration_id(&inst->data);
+        if (id) {
+            globals.declaration[id] = inst;
+        } else if (!global_annotation(inst->data.opcode)) {
+            dead_globals_mark_words(&globals, &inst->data);
+        }
+    }
+    
+    for (struct instruction_list *inst = file->post_cfg; inst; inst = inst->next) {
+        if (inst->data.opcode == OpFunction) {
+            globals.function[inst->data.unparsed_words[2]] = inst;
+        }
+    }
+    
+    while (globals.worklist.size) {
+        u32 id = globals.worklist.data[--globals.worklist.size];
+        
+        if (globals.declaration[id]) {
+            dead_globals_mark_words(&globals, &globals.declaration[id]->data);
+        } else if (globals.function[id]) {
+            for (struct instruction_list *inst = globals.function[id]; inst->data.opcode != OpFunctionEnd; inst = inst->next) {
+                dead_globals_mark_words(&globals, &inst->data);
+            }
+        }
+    }
+    
+    struct instruction_list *inst = file->pre_cfg;
+    while (inst) {
+        struct instruction_list *next = inst->next;
+        
+        if (global_annotation(inst->data.opcode)) {
+            instruction_dump(&inst->data, globals.buffer);
+            if (!globals.live[globals.buffer[1]]) {
+                dead_globals_unlink(&file->pre_cfg, inst, inst);
+            }
+        } else {
+            u32 id = global_declaration_id(&inst->data);
+            if (id && !globals.live[id]) {
+                dead_globals_unlink(&file->pre_cfg, inst, inst);
+            }
+        }
+        
+        inst = next;
+    }
+    
+    inst = file->post_cfg;
+    while (inst) {
+        struct instruction_list *end = inst;
+        
+        if (inst->data.opcode == OpFunction) {
+            while (end->data.opcode != OpFunctionEnd) {
+                end = end->next;
+            }
+            
+            if (!globals.live[inst->data.unparsed_words[2]]) {
+                struct instruction_list *next = end->next;
+                dead_globals_unlink(&file->post_cfg, inst, end);
+                inst = next;
+                continue;
+            }
+        }
+        
+        inst = end->next;
+    }
+    
+    free(globals.live);
+    free(globals.declaration);
+    free(globals.function);
+    free(globals.buffer);
+    vector_free(&globals.worklist);
+}
+
+#define DSE_MAX_STATE (1 << 24)
+
+// NOTE: a location is a pointer which is stored to, together with the variable it points 
+// into. Two pointers with the same id always point to the same place, different ids might 
+// still overlap, so a load kills every location of the variable it reads from
+struct dse {
+    struct ir *file;
+    struct memory memory;
+    s32 *location;           // NOTE: pointer id -> location, -1 if not stored to
+    s32 *first_location;     // NOTE: variable id -> first location in it, -1 if none
+    s32 *next_location;      // NOTE: location -> next location in the same variable, -1 if none
+    u32 *root;               // NOTE: location -> variable
+    bool *whole;             // NOTE: location -> is the whole variable
+    u32 count;
+    bool *dead_in;           // NOTE: block * count + location -> is overwritten or dies on every path from the block entry
+    bool *state;
+};
+
+// NOTE: a load from a variable which is not private might read any other such variable
+static void
+dse_kill_variable(struct dse *dse, u32 variable)
+{
+    if (!memory_private(&dse->memory, variable)) {
+        for (u32 location = 0; location < dse->count; ++location) {
+            if (!memory_private(&dse->memory, dse->root[location])) {
+                dse->state[location] = false;
+            }
+        }
+    }
+    
+    for (s32 location = dse->first_location[variable]; location != -1; location = dse->next_location[location]) {
+        dse->state[location] = false;
+    }
+}
+
+// NOTE: walks a block backwards, starting with what is dead at its exit, and leaves what 
+// is dead at its entry in 'state'. A store to a location which is dead right after it is
+// deleted if 'sweep' is set. Instructions which are not understood might read anything
+static void
+dse_block(struct dse *dse, u32 block_index, bool sweep)
+{
+    struct ir_cfg *cfg = &dse->file->cfg;
+    struct basic_block *block = dse->file->blocks + block_index;
+    
+    if (cfg->out[block_index]) {
+        memset(dse->state, true, dse->count * sizeof(bool));
+        for (struct edge_list *edge = cfg->out[block_index]; edge; edge = edge->next) {
+            bool *dead = dse->dead_in + (u64) edge->data * dse->count;
+            for (u32 location = 0; location < dse->count; ++location) {
+                dse->state[location] = dse->state[location] && dead[location];
+            }
+        }
+    } else {
+        // NOTE: Function and Private class variables die with the invocation, the rest is visible
+        for (u32 location = 0; location < dse->count; ++location) {
+            dse->state[location] = memory_private(&dse->memory, dse->root[location]);
+        }
+    }
+    
+    struct instruction_list *inst = block->instructions;
+    while (inst && inst->next) {
+        inst = inst->next;
+    }
+    
+    while (inst) {
+        struct instruction_list *prev = (inst == block->instructions ? NULL : inst->prev);
+        struct instruction_t *instruction = &inst->data;
+        
+        if (instruction->opcode == OpStore) {
+            s32 location = dse->location[memory_canonical(&dse->memory, instruction->OpStore.pointer)];
+            
+            if (location != -1) {
+                // NOTE: stores with memory operands (e.g. Volatile) stay
+                if (sweep && dse->state[location] && instruction->wordcount == 3) {
+                    ir_delete_instruction(block, inst);
+                }
+                
+                if (dse->whole[location]) {
+                    for (s32 l = dse->first_location[dse->root[location]]; l != -1; l = dse->next_location[l]) {
+                        dse->state[l] = true;
+                    }
+                }
+                
+                dse->state[location] = true;
+            }
+        } else if (instruction->opcode == OpLoad) {
+            u32 root = memory_root(&dse->memory, instruction->OpLoad.pointer);
+            if (root) {
+                dse_kill_variable(dse, root);
+            } else {
+                memset(dse->state, false, dse->count * sizeof(bool));
+            }
+        } else if (memory_clobbers(&dse->memory, instruction)) {
+            memset(dse->state, false, dse->count * sizeof(bool));
+        }
+        
+        inst = prev;
+    }
+}
+
+// NOTE: a store is dead if every path from it overwrites the location before anything 
+// can read it, or reaches the function exit while the variable is private to the invocation. 
+// This is a backward must-analysis: a location is dead at the end of a block if it is dead 
+// at the entry of all its successors, i.e. the overwriting stores post-dominate the store.
+// The Output stores the SSA conversion puts into every exit block are left alone, but all
+// the earlier stores to the same Output on the way there are removed
+static void
+dead_store_elimination(struct ir *file)
+{
+    u32 bound = file->header.bound;
+    u32 block_count = file->cfg.labels.size;
+    
+    struct dse dse = {
+        .file = file,
+        .memory = memory_init(file),
+        .location = malloc(bound * sizeof(s32)),
+        .first_location = malloc(bound * sizeof(s32)),
+        .count = 0
+    };
+    
+    memset(dse.location, 0xFF, bound * sizeof(s32));
+    memset(dse.first_location, 0xFF, bound * sizeof(s32));
+    
+    u32 store_count = 0;
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+            store_count += (inst->data.opcode == OpStore);
+        }
+    }
+    
+    dse.next_location = malloc((store_count + 1) * sizeof(s32));
+    dse.root = malloc((store_count + 1) * sizeof(u32));
+    dse.whole = malloc((store_count + 1) * sizeof(bool));
+    
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+            if (inst->data.opcode != OpStore) {
+                continue;
+            }
+            
+            u32 pointer = memory_canonical(&dse.memory, inst->data.OpStore.pointer);
+            u32 root = memory_root(&dse.memory, pointer);
+            
+            if (root && dse.location[pointer] == -1) {
+                dse.location[pointer] = dse.count;
+                dse.root[dse.count] = root;
+                dse.whole[dse.count] = (pointer == root);
+                dse.next_location[dse.count] = dse.first_location[root];
+                dse.first_location[root] = dse.count;
+                ++dse.count;
+            }
+        }
+    }
+    
+    // NOTE: the state is kept per block and location, which is cheap for shaders. Huge 
+    // functions with lots of stored to variables are left as they are
+    if (dse.count > 0 && (u64) block_count * dse.count <= DSE_MAX_STATE) {
+        struct cfg_dfs_result dfs = cfg_dfs(&file->cfg);
+        
+        dse.dead_in = malloc((u64) block_count * dse.count * sizeof(bool));
+        dse.state = malloc(dse.count * sizeof(bool));
+        memset(dse.dead_in, true, (u64) block_count * dse.count * sizeof(bool));
+        
+        // NOTE: in postorder the successors mostly come first, the back edges need more rounds
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            
+            for (u32 i = 0; i < dfs.size; ++i) {
+                u32 block_index = dfs.sorted_postorder[i];
+                bool *dead = dse.dead_in + (u64) block_index * dse.count;
+                
+                dse_block(&dse, block_index, false);
+                
+                if (memcmp(dead, dse.state, dse.count * sizeof(bool))) {
+                    memcpy(dead, dse.state, dse.count * sizeof(bool));
+                    changed = true;
+                }
+            }
+        }
+        
+        for (u32 i = 0; i < dfs.size; ++i) {
+            dse_block(&dse, dfs.sorted_postorder[i], true);
+        }
+        
+        free(dse.dead_in);
+        free(dse.state);
+        cfg_dfs_free(&dfs);
+    }
+    
+    memory_free(&dse.memory);
+    free(dse.location);
+    free(dse.first_location);
+    free(dse.next_location);
+    free(dse.root);
+    free(dse.whole);
+}
+
+#define RLE_MAX_STATE (1 << 24)
+
+static const u32 RLE_UNVISITED = 0xFFFFFFFF;
+
+// NOTE: a location is a pointer which is loaded from or stored to, in a variable which keeps
+// its loaded values (see memory_tracked). The state of a location is the value it is known
+// to hold, 0 if not known. A store makes the other locations of the variable unknown, as
+// different pointers might still overlap
+struct rle {
+    struct ir *file;
+    struct memory memory;
+    s32 *location;           // NOTE: pointer id -> location, -1 if not accessed
+    s32 *first_location;     // NOTE: variable id -> first location in it, -1 if none
+    s32 *next_location;      // NOTE: location -> next location in the same variable, -1 if none
+    u32 *root;               // NOTE: location -> variable
+    u32 count;
+    u32 *available_out;      // NOTE: block * count + location -> value at the block exit, RLE_UNVISITED before the block is seen
+    u32 *state;
+};
+
+// NOTE: a store to a variable which is not private might write to any other such variable.
+// The read-only variables are never written to
+static void
+rle_kill_variable(struct rle *rle, u32 variable)
+{
+    if (!memory_private(&rle->memory, variable)) {
+        for (u32 location = 0; location < rle->count; ++location) {
+            u32 root = rle->root[location];
+            if (!memory_private(&rle->memory, root) && !memory_read_only(&rle->memory, root)) {
+                rle->state[location] = 0;
+            }
+        }
+    }
+    
+    for (s32 location = rle->first_location[variable]; location != -1; location = rle->next_location[location]) {
+        rle->state[location] = 0;
+    }
+}
+
+static void
+rle_kill_all(struct rle *rle)
+{
+    for (u32 location = 0; location < rle->count; ++location) {
+        if (!memory_read_only(&rle->memory, rle->root[location])) {
+            rle->state[location] = 0;
+        }
+    }
+}
+
+// NOTE: walks a block forwards, starting with what all the predecessors agree on, and leaves
+// what is known at its exit in 'state'. A predecessor which has not been seen yet, i.e. the
+// latch of a loop, knows nothing. A load from a location with a known value becomes a copy
+static void
+rle_block(struct rle *rle, u32 block_index)
+{
+    struct ir_cfg *cfg = &rle->file->cfg;
+    struct basic_block *block = rle->file->blocks + block_index;
+    
+    memset(rle->state, 0xFF, rle->count * sizeof(u32));
+    
+    if (block_index != 0) {
+        for (struct edge_list *edge = cfg->in[block_index]; edge; edge = edge->next) {
+            u32 *out = rle->available_out + (u64) edge->data * rle->count;
+            for (u32 location = 0; location < rle->count; ++location) {
+                u32 value = (out[location] == RLE_UNVISITED ? 0 : out[location]);
+                if (rle->state[location] == RLE_UNVISITED) {
+                    rle->state[location] = value;
+                } else if (rle->state[location] != value) {
+                    rle->state[location] = 0;
+                }
+            }
+        }
+    }
+    
+    for (u32 location = 0; location < rle->count; ++location) {
+        if (rle->state[location] == RLE_UNVISITED) {
+            rle->state[location] = 0;
+        }
+    }
+    
+    for (struct instruction_list *inst = block->instructions; inst; inst = inst->next) {
+        struct instruction_t *instruction = &inst->data;
+        
+        if (instruction->opcode == OpLoad) {
+            s32 location = rle->location[memory_canonical(&rle->memory, instruction->OpLoad.pointer)];
+            
+            // NOTE: loads with memory operands (e.g. Volatile) stay
+            if (location == -1 || instruction->wordcount != 4) {
+                continue;
+            }
+            
+            u32 value = rle->state[location];
+            
+            if (!value) {
+                rle->state[location] = instruction->OpLoad.result_id;
+            } else {
+                struct instruction_t copy = { .opcode = OpCopyObject, .wordcount = 4, .unparsed_words = NULL };
+                copy.OpCopyObject.result_type = instruction->OpLoad.result_type;
+                copy.OpCopyObject.result_id = instruction->OpLoad.result_id;
+                copy.OpCopyObject.operand = value;
+                inst->data = copy;
+            }
+        } else if (instruction->opcode == OpStore) {
+            u32 pointer = memory_canonical(&rle->memory, instruction->OpStore.pointer);
+            u32 root = memory_root(&rle->memory, pointer);
+            
+            if (!root) {
+                rle_kill_all(rle);
+                continue;
+            }
+            
+            rle_kill_variable(rle, root);
+            
+            if (rle->location[pointer] != -1 && instruction->wordcount == 3) {
+                rle->state[rle->location[pointer]] = instruction->OpStore.object;
+            }
+        } else if (memory_clobbers(&rle->memory, instruction)) {
+            rle_kill_all(rle);
+        }
+    }
+}
+
+// NOTE: a load is redundant if on every path to it the same value has already been loaded from
+// or stored to the same pointer, with nothing in between that might write there. This is a
+// forward must-analysis, in which a location holds a value at the entry of a block if it holds
+// it at the exit of all the predecessors. The value is then defined on every path to the block,
+// so it dominates the load. The blocks are visited once in reverse postorder, so nothing is
+// known at a loop header: the loads which the loop does not change are hoisted by licm, after
+// which this pass can remove them. Redundant loads become OpCopyObject's, which copyprop folds away
+static void
+redundant_load_elimination(struct ir *file)
+{
+    u32 bound = file->header.bound;
+    u32 block_count = file->cfg.labels.size;
+    
+    struct rle rle = {
+        .file = file,
+        .memory = memory_init(file),
+        .location = malloc(bound * sizeof(s32)),
+        .first_location = malloc(bound * sizeof(s32)),
+        .count = 0
+    };
+    
+    memset(rle.location, 0xFF, bound * sizeof(s32));
+    memset(rle.first_location, 0xFF, bound * sizeof(s32));
+    
+    u32 access_count = 0;
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+            access_count += (inst->data.opcode == OpLoad || inst->data.opcode == OpStore);
+        }
+    }
+    
+    rle.next_location = malloc((access_count + 1) * sizeof(s32));
+    rle.root = malloc((access_count + 1) * sizeof(u32));
+    
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+            u32 pointer = 0;
+            
+            if (inst->data.opcode == OpLoad) {
+                pointer = memory_canonical(&rle.memory, inst->data.OpLoad.pointer);
+            } else if (inst->data.opcode == OpStore) {
+                pointer = memory_canonical(&rle.memory, inst->data.OpStore.pointer);
+            } else {
+                continue;
+            }
+            
+            u32 root = memory_root(&rle.memory, pointer);
+            
+            if (root && memory_tracked(&rle.memory, root) && rle.location[pointer] == -1) {
+                rle.location[pointer] = rle.count;
+                rle.root[rle.count] = root;
+                rle.next_location[rle.count] = rle.first_location[root];
+                rle.first_location[root] = rle.count;
+                ++rle.count;
+            }
+        }
+    }
+    
+    // NOTE: same as in dead_store_elimination, huge functions are left as they are
+    if (rle.count > 0 && (u64) block_count * rle.count <= RLE_MAX_STATE) {
+        struct cfg_dfs_result dfs = cfg_dfs(&file->cfg);
+        
+        rle.available_out = malloc((u64) block_count * rle.count * sizeof(u32));
+        rle.state = malloc(rle.count * sizeof(u32));
+        memset(rle.available_out, 0xFF, (u64) block_count * rle.count * sizeof(u32));
+        
+        for (u32 i = dfs.size; i > 0; --i) {
+            u32 block_index = dfs.sorted_postorder[i - 1];
+            rle_block(&rle, block_index);
+            memcpy(rle.available_out + (u64) block_index * rle.count, rle.state, rle.count * sizeof(u32));
+        }
+        
+        free(rle.available_out);
+        free(rle.state);
+        cfg_dfs_free(&dfs);
+    }
+    
+    memory_free(&rle.memory);
+    free(rle.location);
+    free(rle.first_location);
+    free(rle.next_location);
+    free(rle.root);
+}
+
+#define PRE_MAX_STATE (1 << 22)
+
+// NOTE: the lazy code motion of one function. An expression is a key of gvn_key, i.e. all
+// the instructions which compute the same thing from the same ids. In SSA form nothing is
+// ever assigned twice, so the only thing that "kills" an expression is the definition of
+// one of its operands: above it the expression can not be computed. The sets are kept per
+// block and expression, at 'block * count + expression'
+struct pre {
+    struct ir *file;
+    u32 count;
+    u32 block_count;
+    bool *reachable;
+    bool *use;         // NOTE: computed in the block, with all the operands defined before it
+    bool *comp;        // NOTE: computed in the block
+    bool *kill;        // NOTE: an operand is defined in the block
+    bool *antin;       // NOTE: computed on every path from the block entry before it is killed
+    bool *antout;
+    bool *avin;        // NOTE: computed on every path to the block entry, or would be after the insertions
+    bool *avout;
+    bool *earliest;    // NOTE: anticipated and not available, the highest point to compute at
+    bool *postin;      // NOTE: the computation can be moved down to the block entry
+    bool *postout;
+    bool *latest;      // NOTE: the computation can not be moved further down
+    bool *usedin;      // NOTE: the value computed at a latest point is still needed
+    bool *usedout;
+};
+
+// NOTE: an edge from a block with several successors to a block with several predecessors
+// gets a block of its own, so that code can be placed on that edge only. Returns the new blocks
+static struct uint_vector
+pre_split_critical_edges(struct ir *file)
+{
+    struct ir_cfg *cfg = &file->cfg;
+    u32 block_count = cfg->labels.size;
+    struct uint_vector split = vector_init();
+    
+    for (u32 from = 0; from < block_count; ++from) {
+        if (!cfg->labels.data[from] || !cfg->out[from] || !cfg->out[from]->next) {
+            continue;
+        }
+        
+        for (struct edge_list *edge = cfg->out[from]; edge; edge = edge->next) {
+            u32 to = edge->data;
+            if (!cfg->in[to]->next) {
+                continue;
+            }
+            
+            u32 middle = ir_add_bb(file);
+            cfg_redirect_edge(cfg, from, to, middle);
+            cfg_add_edge(cfg, middle, to);
+            simplify_relabel_phis(file->blocks + to, cfg->labels.data[from], cfg->labels.data[middle]);
+            vector_push(&split, middle);
+        }
+    }
+    
+    return(split);
+}
+
+// NOTE: undoes the split of an edge, if nothing has been placed on it
+static void
+pre_join_edge(struct ir *file, u32 middle)
+{
+    struct ir_cfg *cfg = &file->cfg;
+    u32 from = cfg->in[middle]->data;
+    u32 to = cfg->out[middle]->data;
+    
+    cfg_remove_edge(cfg, middle, to);
+    cfg_redirect_edge(cfg, from, middle, to);
+    simplify_relabel_phis(file->blocks + to, cfg->labels.data[middle], cfg->labels.data[from]);
+    ir_remove_bb(file, middle);
+}
+
+// NOTE: the instructions which can be moved around, with a result that is not referenced
+// by a decoration. Access chains stay, as a pointer can not go through an OpPhi
+static bool
+pre_candidate(struct instruction_t *instruction, bool *opaque, u32 bound)
+{
+    if (!gvn_candidate(instruction) || instruction->opcode == OpAccessChain) {
+        return(false);
+    }
+    
+    u32 result_id = instruction_result_id(instruction);
+    return(result_id != 0 && result_id < bound && !opaque[result_id]);
+}
+
+// NOTE: the four data flow problems of lazy code motion, and the placement they lead to
+// (the version from the Dragon book, 9.5). The anticipation and the use are backward
+// problems, iterated in postorder. The availability and the postponability are forward,
+// iterated in reverse postorder. The unreachable blocks are not in the DFS order, they are
+// never computed and stay false (the sets are calloc'd), the unreachable predecessors do not count
+static void
+pre_analyze(struct pre *pre, struct cfg_dfs_result *dfs)
+{
+    struct ir_cfg *cfg = &pre->file->cfg;
+    u32 count = pre->count;
+    u64 size = (u64) pre->block_count * count;
+    
+    memset(pre->antin, true, size * sizeof(bool));
+    memset(pre->avout, true, size * sizeof(bool));
+    memset(pre->postout, true, size * sizeof(bool));
+    memset(pre->usedin, false, size * sizeof(bool));
+    
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        
+        for (u32 i = 0; i < dfs->size; ++i) {
+            u32 block_index = dfs->sorted_postorder[i];
+            u64 base = (u64) block_index * count;
+            
+            for (u32 e = 0; e < count; ++e) {
+                bool out = (cfg->out[block_index] != NULL);
+                for (struct edge_list *edge = cfg->out[block_index]; edge && out; edge = edge->next) {
+                    out = pre->antin[(u64) edge->data * count + e];
+                }
+                
+                bool in = pre->use[base + e] || (out && !pre->kill[base + e]);
+                pre->antout[base + e] = out;
+                changed |= (in != pre->antin[base + e]);
+                pre->antin[base + e] = in;
+            }
+        }
+    }
+    
+    changed = true;
+    while (changed) {
+        changed = false;
+        
+        for (u32 i = dfs->size; i > 0; --i) {
+            u32 block_index = dfs->sorted_postorder[i - 1];
+            u64 base = (u64) block_index * count;
+            
+            for (u32 e = 0; e < count; ++e) {
+                bool in = (block_index != 0);
+                for (struct edge_list *edge = cfg->in[block_index]; edge && in; edge = edge->next) {
+                    if (pre->reachable[edge->data]) {
+                        in = pre->avout[(u64) edge->data * count + e];
+                    }
+                }
+                
+                bool out = ((pre->antin[base + e] || in) && !pre->kill[base + e]) || pre->comp[base + e];
+                pre->avin[base + e] = in;
+                changed |= (out != pre->avout[base + e]);
+                pre->avout[base + e] = out;
+            }
+        }
+    }
+    
+    for (u32 i = 0; i < dfs->size; ++i) {
+        u64 base = (u64) dfs->sorted_postorder[i] * count;
+        for (u32 e = 0; e < count; ++e) {
+            pre->earliest[base + e] = pre->antin[base + e] && !pre->avin[base + e];
+        }
+    }
+    
+    changed = true;
+    while (changed) {
+        changed = false;
+        
+        for (u32 i = dfs->size; i > 0; --i) {
+            u32 block_index = dfs->sorted_postorder[i - 1];
+            u64 base = (u64) block_index * count;
+            
+            for (u32 e = 0; e < count; ++e) {
+                bool in = (block_index != 0);
+                for (struct edge_list *edge = cfg->in[block_index]; edge && in; edge = edge->next) {
+                    if (pre->reachable[edge->data]) {
+                        in = pre->postout[(u64) edge->data * count + e];
+                    }
+                }
+                
+                bool out = (pre->earliest[base + e] || in) && !pre->use[base + e];
+                pre->postin[base + e] = in;
+                changed |= (out != pre->postout[base + e]);
+                pre->postout[base + e] = out;
+            }
+        }
+    }
+    
+    for (u32 i = 0; i < dfs->size; ++i) {
+        u32 block_index = dfs->sorted_postorder[i];
+        u64 base = (u64) block_index * count;
+        
+        for (u32 e = 0; e < count; ++e) {
+            bool successors = true;
+            for (struct edge_list *edge = cfg->out[block_index]; edge && successors; edge = edge->next) {
+                u64 index = (u64) edge->data * count + e;
+                successors = pre->earliest[index] || pre->postin[index];
+            }
+            
+            pre->latest[base + e] = (pre->earliest[base + e] || pre->postin[base + e]) &&
+                                    (pre->use[base + e] || !successors);
+        }
+    }
+    
+    // NOTE: a block which computes the expression itself does not need the value from above
+    changed = true;
+    while (changed) {
+        changed = false;
+        
+        for (u32 i = 0; i < dfs->size; ++i) {
+            u32 block_index = dfs->sorted_postorder[i];
+            u64 base = (u64) block_index * count;
+            
+            for (u32 e = 0; e < count; ++e) {
+                bool out = false;
+                for (struct edge_list *edge = cfg->out[block_index]; edge && !out; edge = edge->next) {
+                    out = pre->usedin[(u64) edge->data * count + e];
+                }
+                
+                bool in = (pre->use[base + e] || (out && !pre->comp[base + e])) && !pre->latest[base + e];
+                pre->usedout[base + e] = out;
+                changed |= (in != pre->usedin[base + e]);
+                pre->usedin[base + e] = in;
+            }
+        }
+    }
+}
+
+// NOTE: partial redundancy elimination by lazy code motion. A computation which is redundant
+// on some paths is made fully redundant by computing the expression on the other paths, as
+// late as possible, but never on a path which did not compute it before. Where the values from
+// different paths meet, an OpPhi merges them. The critical edges are split first, and the
+// new blocks which did not get a computation are removed again. This also moves the loop
+// invariant computations of a loop which is always entered (e.g. a do-while) above it
+static void
+partial_redundancy_elimination(struct ir *file)
+{
+    struct uint_vector split = pre_split_critical_edges(file);
+    
+    u32 bound = file->header.bound;
+    u32 block_count = file->cfg.labels.size;
+    struct ir_cfg *cfg = &file->cfg;
+    struct cfg_dfs_result dfs = cfg_dfs(cfg);
+    u32 **operands = malloc((WORDCOUNT_MASK >> 16) * sizeof(u32 *));
+    bool *opaque = calloc(bound, sizeof(bool));
+    s32 *def_block = malloc(bound * sizeof(s32));
+    bool *reachable = calloc(block_count, sizeof(bool));
+    u32 candidates = 0;
+    
+    memset(def_block, 0xFF, bound * sizeof(s32));
+    
+    struct instruction_list *globals[] = { file->pre_cfg, file->post_cfg };
+    for (u32 i = 0; i < 2; ++i) {
+        for (struct instruction_list *inst = globals[i]; inst; inst = inst->next) {
+            opt_mark_opaque(&inst->data, operands, opaque, bound);
+        }
+    }
+    
+    // NOTE: the result of an instruction which is not parsed is guessed to be the third word,
+    // as in licm_init. A wrong guess only kills more
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        reachable[block_index] = (block_index == 0 || dfs.preorder[block_index] != 0);
+        
+        for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+            struct instruction_t *instruction = &inst->data;
+            u32 result_id = instruction_result_id(instruction);
+            
+            opt_mark_opaque(instruction, operands, opaque, bound);
+            candidates += gvn_candidate(instruction);
+            
+            if (!result_id && instruction->unparsed_words && instruction->wordcount >= 3 &&
+                instruction_operands(instruction, operands) == -1) {
+                result_id = instruction->unparsed_words[2];
+            }
+            
+            if (result_id && result_id < bound) {
+                def_block[result_id] = block_index;
+            }
+        }
+    }
+    
+    u32 capacity = 16;
+    while (capacity < candidates * 2) {
+        capacity *= 2;
+    }
+    
+    struct gvn table = {
+        .table = calloc(capacity, sizeof(struct gvn_entry)),
+        .mask = capacity - 1,
+        .keys = vector_init(),
+        .undo = stack_init(),
+        .buffer = malloc((WORDCOUNT_MASK >> 16) * sizeof(u32)),
+        .key = malloc((WORDCOUNT_MASK >> 16) * sizeof(u32))
+    };
+    
+    // NOTE: the expression of every candidate in a reachable block, and the first instruction
+    // computing it, which is what gets copied to the new places
+    struct instruction_t **first = malloc((candidates + 1) * sizeof(struct instruction_t *));
+    u32 *key_offset = malloc((candidates + 1) * sizeof(u32));
+    u32 *key_length = malloc((candidates + 1) * sizeof(u32));
+    s32 *expression = malloc(bound * sizeof(s32));
+    u32 count = 0;
+    
+    memset(expression, 0xFF, bound * sizeof(s32));
+    
+    for (u32 i = dfs.size; i > 0; --i) {
+        u32 block_index = dfs.sorted_postorder[i - 1];
+        for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+            if (!pre_candidate(&inst->data, opaque, bound)) {
+                continue;
+            }
+            
+            u32 offset = table.keys.size;
+            u32 length = gvn_key(&inst->data, table.buffer, table.key);
+            u32 e = gvn_find_or_insert(&table, table.key, length, count);
+            
+            if (e == count) {
+                first[count] = &inst->data;
+                key_offset[count] = offset;
+                key_length[count] = length;
+                ++count;
+            }
+            
+            expression[instruction_result_id(&inst->data)] = e;
+        }
+    }
+    
+    u64 size = (u64) block_count * count;
+    
+    if (count > 0 && size <= PRE_MAX_STATE) {
+        struct pre pre = {
+            .file = file,
+            .count = count,
+            .block_count = block_count,
+            .reachable = reachable,
+            .use = calloc(size, sizeof(bool)),
+            .comp = calloc(size, sizeof(bool)),
+            .kill = calloc(size, sizeof(bool)),
+            .antin = calloc(size, sizeof(bool)),
+            .antout = calloc(size, sizeof(bool)),
+            .avin = calloc(size, sizeof(bool)),
+            .avout = calloc(size, sizeof(bool)),
+            .earliest = calloc(size, sizeof(bool)),
+            .postin = calloc(size, sizeof(bool)),
+            .postout = calloc(size, sizeof(bool)),
+            .latest = calloc(size, sizeof(bool)),
+            .usedin = calloc(size, sizeof(bool)),
+            .usedout = calloc(size, sizeof(bool))
+        };
+        
+        for (u32 e = 0; e < count; ++e) {
+            u32 *key = table.keys.data + key_offset[e];
+            for (u32 i = 2; i < key_length[e]; ++i) {
+                if (key[i] < bound && def_block[key[i]] != -1) {
+                    pre.kill[(u64) def_block[key[i]] * count + e] = true;
+                }
+            }
+        }
+        
+        // NOTE: in SSA form an operand is defined before its use, so a computation in a
+        // block which kills the expression is never upward exposed
+        for (u32 i = 0; i < dfs.size; ++i) {
+            u32 block_index = dfs.sorted_postorder[i];
+            u64 base = (u64) block_index * count;
+            
+            for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+                if (pre_candidate(&inst->data, opaque, bound)) {
+                    s32 e = expression[instruction_result_id(&inst->data)];
+                    pre.comp[base + e] = true;
+                    pre.use[base + e] = !pre.kill[base + e];
+                }
+            }
+        }
+        
+        pre_analyze(&pre, &dfs);
+        
+        // NOTE: the value of every expression at the exit of every block, 0 if it is not there.
+        // In reverse postorder the predecessor of a block with a single one comes first, the
+        // phis of the blocks with more get their operands at the end
+        u32 *value = calloc(size, sizeof(u32));
+        u32 *replace = malloc(bound * sizeof(u32));
+        bool *deleted = calloc(bound, sizeof(bool));
+        struct uint_vector phis = vector_init();
+        
+        for (u32 id = 0; id < bound; ++id) {
+            replace[id] = id;
+        }
+        
+        for (u32 i = dfs.size; i > 0; --i) {
+            u32 block_index = dfs.sorted_postorder[i - 1];
+            struct basic_block *block = file->blocks + block_index;
+            u64 base = (u64) block_index * count;
+            u32 pred_count = 0;
+            u32 pred = 0;
+            
+            for (struct edge_list *edge = cfg->in[block_index]; edge; edge = edge->next) {
+                if (reachable[edge->data]) {
+                    pred = edge->data;
+                    ++pred_count;
+                }
+            }
+            
+            for (u32 e = 0; e < count; ++e) {
+                if (!pre.usedin[base + e]) {
+                    continue;
+                }
+                
+                if (pred_count == 1) {
+                    value[base + e] = value[(u64) pred * count + e];
+                } else {
+                    value[base + e] = file->header.bound++;
+                    vector_push(&phis, block_index);
+                    vector_push(&phis, e);
+                }
+                
+                ASSERT(value[base + e] != 0);
+            }
+            
+            struct instruction_list *last_phi = NULL;
+            
+            for (struct instruction_list *inst = block->instructions; inst; inst = inst->next) {
+                if (inst->data.opcode == OpPhi) {
+                    last_phi = inst;
+                }
+                
+                if (!pre_candidate(&inst->data, opaque, bound)) {
+                    continue;
+                }
+                
+                u32 result_id = instruction_result_id(&inst->data);
+                s32 e = expression[result_id];
+                
+                if (value[base + e]) {
+                    replace[result_id] = value[base + e];
+                    deleted[result_id] = true;
+                } else {
+                    value[base + e] = result_id;
+                }
+            }
+            
+            for (u32 e = 0; e < count; ++e) {
+                if (pre.latest[base + e] && pre.usedout[base + e] && !pre.comp[base + e]) {
+                    struct instruction_t copy = instruction_clone(first[e]);
+                    u32 result_id = file->header.bound++;
+                    
+                    *instruction_result_pointer(&copy) = result_id;
+                    last_phi = ir_insert_instruction(block, last_phi, copy);
+                    value[base + e] = result_id;
+                }
+            }
+        }
+        
+        for (u32 i = 0; i < phis.size; i += 2) {
+            u32 block_index = phis.data[i];
+            u32 e = phis.data[i + 1];
+            u32 operand_count = 0;
+            u32 fallback = 0;
+            
+            for (struct edge_list *edge = cfg->in[block_index]; edge; edge = edge->next) {
+                if (reachable[edge->data]) {
+                    fallback = value[(u64) edge->data * count + e];
+                }
+                ++operand_count;
+            }
+            
+            struct instruction_t phi = {
+                .opcode = OpPhi,
+                .wordcount = 3 + operand_count * 2,
+                .unparsed_words = NULL
+            };
+            
+            phi.OpPhi.result_type = table.keys.data[key_offset[e] + 1];
+            phi.OpPhi.result_id = value[(u64) block_index * count + e];
+            phi.OpPhi.variables = malloc(operand_count * sizeof(u32));
+            phi.OpPhi.parents = malloc(operand_count * sizeof(u32));
+            
+            // NOTE: an unreachable predecessor passes any of the values, it never runs
+            u32 j = 0;
+            for (struct edge_list *edge = cfg->in[block_index]; edge; edge = edge->next, ++j) {
+                u32 incoming = value[(u64) edge->data * count + e];
+                phi.OpPhi.variables[j] = (reachable[edge->data] ? incoming : fallback);
+                phi.OpPhi.parents[j] = cfg->labels.data[edge->data];
+                ASSERT(phi.OpPhi.variables[j] != 0);
+            }
+            
+            ir_prepend_instruction(file->blocks + block_index, phi);
+        }
+        
+        for (u32 block_index = 0; block_index < block_count; ++block_index) {
+            struct instruction_list *inst = file->blocks[block_index].instructions;
+            
+            while (inst) {
+                struct instruction_list *next = inst->next;
+                u32 result_id = instruction_result_id(&inst->data);
+                
+                if (result_id && result_id < bound && deleted[result_id]) {
+                    ir_delete_instruction(file->blocks + block_index, inst);
+                } else {
+                    s32 operand_count = instruction_operands(&inst->data, operands);
+                    for (s32 i = 0; i < operand_count; ++i) {
+                        if (*operands[i] < bound) {
+                            *operands[i] = replace[*operands[i]];
+                        }
+                    }
+                }
+                
+                inst = next;
+            }
+            
+            if (cfg->conditions[block_index] && cfg->conditions[block_index] < bound) {
+                cfg->conditions[block_index] = replace[cfg->conditions[block_index]];
+            }
+        }
+        
+        ir_delete_opnames(file, deleted);
+        
+        vector_free(&phis);
+        free(value);
+        free(replace);
+        free(deleted);
+        free(pre.use);
+        free(pre.comp);
+        free(pre.kill);
+        free(pre.antin);
+        free(pre.antout);
+        free(pre.avin);
+        free(pre.avout);
+        free(pre.earliest);
+        free(pre.postin);
+        free(pre.postout);
+        free(pre.latest);
+        free(pre.usedin);
+        free(pre.usedout);
+    }
+    
+    for (u32 i = 0; i < split.size; ++i) {
+        if (!file->blocks[split.data[i]].instructions) {
+            pre_join_edge(file, split.data[i]);
+        }
+    }
+    
+    ir_compact_blocks(file);
+    
+    stack_free(&table.undo);
+    vector_free(&table.keys);
+    free(table.table);
+    free(table.buffer);
+    free(table.key);
+    free(first);
+    free(key_offset);
+    free(key_length);
+    free(expression);
+    vector_free(&split);
+    free(operands);
+    free(opaque);
+    free(def_block);
+    free(reachable);
+    cfg_dfs_free(&dfs);
+}
+
+// NOTE: a use of a value, in the block of the instruction 'user' if it is set (that instruction
+// might move as well), in 'block' otherwise. A phi uses its operand at the end of the parent
+struct sink_use {
+    u32 user;
+    u32 block;
+    s32 next;
+};
+
+struct sink {
+    s32 *first_use;        // NOTE: id -> first use, -1 if none
+    struct sink_use *uses;
+    u32 use_count;
+    u32 use_capacity;
+    s32 *block_of;         // NOTE: id -> block of the instruction which defines it, if it can move
+    s32 *dominators;
+    u32 *depth;            // NOTE: block -> depth in the dominator tree
+};
+
+static void
+sink_add_use(struct sink *sink, u32 id, u32 user, u32 block)
+{
+    if (sink->use_count == sink->use_capacity) {
+        sink->use_capacity = (sink->use_capacity ? sink->use_capacity * 2 : 256);
+        sink->uses = realloc(sink->uses, sink->use_capacity * sizeof(struct sink_use));
+    }
+    
+    struct sink_use use = {
+        .user = user,
+        .block = block,
+        .next = sink->first_use[id]
+    };
+    
+    sink->first_use[id] = sink->use_count;
+    sink->uses[sink->use_count++] = use;
+}
+
+static u32
+sink_common_dominator(struct sink *sink, u32 a, u32 b)
+{
+    while (a != b) {
+        if (sink->depth[a] > sink->depth[b]) {
+            a = sink->dominators[a];
+        } else {
+            b = sink->dominators[b];
+        }
+    }
+    
+    return(a);
+}
+
+// NOTE: every pure instruction moves down to the lowest block which dominates all of its uses,
+// i.e. the block the uses have in common in the dominator tree, so that it is not computed
+// on the paths which do not need it. It never moves into a loop, the block has to be in the
+// same innermost loop. The blocks are visited in postorder and the instructions from the
+// last one, so the uses of an instruction have already moved when it is looked at
+static void
+code_sinking(struct ir *file)
+{
+    u32 bound = file->header.bound;
+    u32 block_count = file->cfg.labels.size;
+    struct ir_cfg *cfg = &file->cfg;
+    struct cfg_dfs_result dfs = cfg_dfs(cfg);
+    struct licm_loop *loops;
+    u32 loop_count;
+    struct licm licm = licm_init(file, &dfs, &loops, &loop_count, 0);
+    u32 **operands = malloc((WORDCOUNT_MASK >> 16) * sizeof(u32 *));
+    s32 *innermost = malloc(block_count * sizeof(s32));
+    u32 *label_block = calloc(bound, sizeof(u32));
+    
+    struct sink sink = {
+        .first_use = malloc(bound * sizeof(s32)),
+        .block_of = malloc(bound * sizeof(s32)),
+        .dominators = cfg->dominators,
+        .depth = calloc(block_count, sizeof(u32))
+    };
+    
+    memset(sink.first_use, 0xFF, bound * sizeof(s32));
+    memset(sink.block_of, 0xFF, bound * sizeof(s32));
+    memset(innermost, 0xFF, block_count * sizeof(s32));
+    
+    // NOTE: the loops are sorted innermost first
+    for (u32 i = 0; i < loop_count; ++i) {
+        struct uint_vector body = licm_body(&licm, loops[i].header, loop_count + i + 1);
+        for (u32 b = 0; b < body.size; ++b) {
+            if (innermost[body.data[b]] == -1) {
+                innermost[body.data[b]] = loops[i].header;
+            }
+        }
+        vector_free(&body);
+    }
+    
+    for (u32 i = dfs.size; i > 0; --i) {
+        u32 block_index = dfs.sorted_postorder[i - 1];
+        if (block_index != 0) {
+            sink.depth[block_index] = sink.depth[cfg->dominators[block_index]] + 1;
+        }
+    }
+    
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        label_block[cfg->labels.data[block_index]] = block_index;
+    }
+    
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+            struct instruction_t *instruction = &inst->data;
+            u32 result_id = instruction_result_id(instruction);
+            bool movable = (gvn_candidate(instruction) && result_id && result_id < bound);
+            s32 count = instruction_operands(instruction, operands);
+            
+            if (movable) {
+                sink.block_of[result_id] = block_index;
+            }
+            
+            if (count == -1) {
+                for (u32 word = 1; word < instruction->wordcount; ++word) {
+                    if (instruction->unparsed_words[word] < bound) {
+                        sink_add_use(&sink, instruction->unparsed_words[word], 0, block_index);
+                    }
+                }
+            } else if (instruction->opcode == OpPhi) {
+                for (u32 j = 0; j < (instruction->wordcount - 3) / 2; ++j) {
+                    if (instruction->OpPhi.variables[j] < bound) {
+                        u32 parent = label_block[instruction->OpPhi.parents[j]];
+                        sink_add_use(&sink, instruction->OpPhi.variables[j], 0, parent);
+                    }
+                }
+            } else {
+                for (s32 i = 0; i < count; ++i) {
+                    if (*operands[i] < bound) {
+                        sink_add_use(&sink, *operands[i], movable ? result_id : 0, block_index);
+                    }
+                }
+            }
+        }
+        
+        if (cfg->conditions[block_index] && cfg->conditions[block_index] < bound) {
+            sink_add_use(&sink, cfg->conditions[block_index], 0, block_index);
+        }
+    }
+    
+    for (u32 i = 0; i < dfs.size; ++i) {
+        u32 block_index = dfs.sorted_postorder[i];
+        struct basic_block *block = file->blocks + block_index;
+        struct instruction_list *inst = block->instructions;
+        
+        while (inst && inst->next) {
+            inst = inst->next;
+        }
+        
+        while (inst) {
+            struct instruction_list *prev = (inst == block->instructions ? NULL : inst->prev);
+            u32 result_id = instruction_result_id(&inst->data);
+            
+            if (!gvn_candidate(&inst->data) || !result_id || result_id >= bound) {
+                inst = prev;
+                continue;
+            }
+            
+            // NOTE: a use in an unreachable block keeps the instruction where it is
+            s32 target = -1;
+            for (s32 u = sink.first_use[result_id]; u != -1 && target != (s32) block_index; u = sink.uses[u].next) {
+                struct sink_use *use = sink.uses + u;
+                u32 use_block = (use->user ? (u32) sink.block_of[use->user] : use->block);
+                
+                if (!licm.reachable[use_block]) {
+                    target = block_index;
+                } else {
+                    target = (target == -1 ? (s32) use_block : (s32) sink_common_dominator(&sink, target, use_block));
+                }
+            }
+            
+            while (target != -1 && target != (s32) block_index && innermost[target] != innermost[block_index]) {
+                target = cfg->dominators[target];
+            }
+            
+            if (target != -1 && target != (s32) block_index) {
+                struct basic_block *to = file->blocks + target;
+                struct instruction_list *last_phi = NULL;
+                
+                for (struct instruction_list *phi = to->instructions; phi && phi->data.opcode == OpPhi; phi = phi->next) {
+                    last_phi = phi;
+                }
+                
+                ir_insert_instruction(to, last_phi, inst->data);
+                ir_delete_instruction(block, inst);
+                sink.block_of[result_id] = target;
+            }
+            
+            inst = prev;
+        }
+    }
+    
+    free(sink.first_use);
+    free(sink.uses);
+    free(sink.block_of);
+    free(sink.depth);
+    free(operands);
+    free(innermost);
+    free(label_block);
+    free(loops);
+    licm_free(&licm);
+    cfg_dfs_free(&dfs);
+}
+
+// NOTE: instructions speculated per flattened selection, both arms together
+static const u32 IFCONV_MAX_COST = 8;
+
+// NOTE: pure, and can not go wrong on the paths which did not need it. An integer division
+// by zero is undefined, so the divisions stay behind the branch
+static bool
+ifconv_speculatable(struct instruction_t *instruction)
+{
+    switch (instruction->opcode) {
+        case OpUDiv:
+        case OpSDiv:
+        case OpUMod:
+        case OpSRem:
+        case OpSMod: {
+            return(false);
+        }
+        
+        default: {
+            return(gvn_candidate(instruction));
+        }
+    }
+}
+
+// NOTE: one side of the selection, either the merge block itself or a block which is only 
+// entered from the header, only continues to the merge block and only computes values
+static bool
+ifconv_arm(struct ir *file, u32 *structural, u32 arm, u32 header, u32 merge, u32 *cost)
+{
+    struct ir_cfg *cfg = &file->cfg;
+    
+    if (arm == merge) {
+        return(true);
+    }
+    
+    if (arm == 0 || structural[arm] || !cfg->in[arm] || cfg->in[arm]->data != header || cfg->in[arm]->next ||
+        !cfg->out[arm] || cfg->out[arm]->data != merge || cfg->out[arm]->next) {
+        return(false);
+    }
+    
+    for (struct instruction_list *inst = file->blocks[arm].instructions; inst; inst = inst->next) {
+        if (!ifconv_speculatable(&inst->data)) {
+            return(false);
+        }
+    }
+    
+    *cost += file->blocks[arm].count;
+    
+    return(true);
+}
+
+// NOTE: the incoming value of a two-entry phi function from the given parent label
+static u32
+ifconv_incoming(struct instruction_t *phi, u32 parent)
+{
+    return(phi->OpPhi.parents[0] == parent ? phi->OpPhi.variables[0] : phi->OpPhi.variables[1]);
+}
+
+// NOTE: a selection whose arms only compute values is replaced by straight-line code. Both arms
+// are executed unconditionally in the header, and the phi functions of the merge block become
+// OpSelect on the branch condition. OpSelect on vectors needs SPIR-V 1.4, before that only the
+// scalar phi functions can be converted. The blocks are visited in postorder, so an inner
+// selection is flattened (and merged into its header) before the enclosing one is looked at
+static void
+if_conversion(struct ir *file)
+{
+    u32 bound = file->header.bound;
+    u32 block_count = file->cfg.labels.size;
+    struct ir_cfg *cfg = &file->cfg;
+    struct cfg_dfs_result dfs = cfg_dfs(cfg);
+    u32 *structural = calloc(block_count, sizeof(u32));
+    u32 *label_block = calloc(bound, sizeof(u32));
+    bool *selectable = calloc(bound, sizeof(bool));
+    bool *deleted = calloc(bound, sizeof(bool));
+    
+    for (struct instruction_list *inst = file->pre_cfg; inst; inst = inst->next) {
+        enum opcode_t opcode = inst->data.opcode;
+        if (opcode == OpTypeBool || opcode == OpTypeInt || opcode == OpTypeFloat ||
+            (opcode == OpTypeVector && file->header.version >= 0x00010400)) {
+            if (inst->data.unparsed_words[1] < bound) {
+                selectable[inst->data.unparsed_words[1]] = true;
+            }
+        }
+    }
+    
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        if (cfg->labels.data[block_index]) {
+            label_block[cfg->labels.data[block_index]] = block_index;
+        }
+    }
+    
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+            if (inst->data.opcode == OpSelectionMerge) {
+                ++structural[label_block[inst->data.OpSelectionMerge.merge_block]];
+            } else if (inst->data.opcode == OpLoopMerge) {
+                ++structural[label_block[inst->data.OpLoopMerge.merge_block]];
+                ++structural[label_block[inst->data.OpLoopMerge.continue_block]];
+            }
+        }
+    }
+    
+    for (u32 i = 0; i < dfs.size; ++i) {
+        u32 header = dfs.sorted_postorder[i];
+        struct basic_block *block = file->blocks + header;
+        struct instruction_list *selection = NULL;
+        
+        bool loop = false;
+        
+        if (!cfg->labels.data[header] || !cfg->conditions[header] || !cfg->out[header] || !cfg->out[header]->next) {
+            continue;
+        }
+        
+        for (struct instruction_list *inst = block->instructions; inst; inst = inst->next) {
+            if (inst->data.opcode == OpSelectionMerge) {
+                selection = inst;
+            }
+            loop |= (inst->data.opcode == OpLoopMerge);
+        }
+        
+        if (!selection || loop) {
+            continue;
+        }
+        
+        u32 merge = label_block[selection->data.OpSelectionMerge.merge_block];
+        u32 arms[2] = { cfg->out[header]->data, cfg->out[header]->next->data };
+        u32 cost = 0;
+        bool convertible = (merge != 0 && cfg->labels.data[merge] && cfg->in[merge] && cfg->in[merge]->next &&
+                            !cfg->in[merge]->next->next);
+        
+        for (u32 a = 0; a < 2 && convertible; ++a) {
+            convertible = ifconv_arm(file, structural, arms[a], header, merge, &cost);
+        }
+        
+        for (struct instruction_list *inst = file->blocks[merge].instructions;
+             convertible && inst && inst->data.opcode == OpPhi; inst = inst->next) {
+            convertible = (inst->data.wordcount == 7 && inst->data.OpPhi.result_type < bound &&
+                           selectable[inst->data.OpPhi.result_type]);
+        }
+        
+        if (!convertible || cost > IFCONV_MAX_COST) {
+            continue;
+        }
+        
+        // NOTE: the edge from the header is the incoming one when an arm is the merge block itself
+        u32 parents[2];
+        for (u32 a = 0; a < 2; ++a) {
+            parents[a] = cfg->labels.data[arms[a] == merge ? header : arms[a]];
+        }
+        
+        ir_delete_instruction(block, selection);
+        
+        for (u32 a = 0; a < 2; ++a) {
+            if (arms[a] != merge) {
+                struct instruction_list *inst = file->blocks[arms[a]].instructions;
+                while (inst) {
+                    struct instruction_list *next = inst->next;
+                    ir_append_instruction(block, inst->data);
+                    ir_delete_instruction(file->blocks + arms[a], inst);
+                    inst = next;
+                }
+            }
+        }
+        
+        for (struct instruction_list *inst = file->blocks[merge].instructions; inst && inst->data.opcode == OpPhi; inst = inst->next) {
+            u32 words[] = {
+                inst->data.OpPhi.result_type,
+                inst->data.OpPhi.result_id,
+                cfg->conditions[header],
+                ifconv_incoming(&inst->data, parents[0]),
+                ifconv_incoming(&inst->data, parents[1])
+            };
+            
+            inst->data = slp_instruction(OpSelect, words, 5);
+        }
+        
+        for (u32 a = 0; a < 2; ++a) {
+            if (arms[a] != merge) {
+                deleted[cfg->labels.data[arms[a]]] = true;
+                ir_remove_bb(file, arms[a]);
+            }
+        }
+        
+        cfg_add_edge(cfg, header, merge);
+        cfg->conditions[header] = 0;
+        
+        // NOTE: nothing else needs the merge block to stay separate, so it joins the header
+        if (--structural[merge] == 0) {
+            deleted[cfg->labels.data[merge]] = true;
+            simplify_merge_blocks(file, header, merge);
+        }
+    }
+    
+    ir_delete_opnames(file, deleted);
+    ir_compact_blocks(file);
+    
+    free(structural);
+    free(label_block);
+    free(selectable);
+    free(deleted);
+    cfg_dfs_free(&dfs);
+}
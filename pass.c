@@ -0,0 +1,423 @@
+#include <time.h>
+
+#ifdef _WIN32
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+// NOTE: the pass registry. A pipeline is a comma separated list of pass names (e.g.
+// 'ssa,licm'), which is run in order. The whole list can be repeated for several
+// rounds, stopping early as soon as a round leaves the module unchanged. Passes which
+// are not idempotent, like the SSA conversion of the Output stores, only run in the first round.
+// A pass name prefixed with '?' (e.g. 'ssa,?unroll,sccp,dce') starts a speculation: the module
+// is snapshotted before the pass, and at the end of the round (or at the next '?') the static
+// cost is compared, and the module goes back to the snapshot if the cost has grown. A pass 
+// which only runs in the first round also ends the speculation before it, a rollback must not
+// undo it, since it would never run again. Such a pass can not be speculative itself
+
+struct pass {
+    const char *name;
+    void (*run)(struct ir *file);
+    bool once;
+    bool cow; // NOTE: saves what it changes with the ir_*_write functions, see ir_snapshot
+};
+
+struct pipeline {
+    struct uint_vector passes;      // NOTE: indices into PASSES
+    struct uint_vector speculative; // NOTE: per pass of the pipeline, starts a speculation
+    u32 rounds;
+    bool stats;
+};
+
+// NOTE: every instruction of a block counts this many times more for every loop the block is in
+static const u64 PASS_LOOP_WEIGHT = 8;
+static const u64 PASS_MAX_WEIGHT = (u64) 1 << 40;
+
+static void
+pass_ssa_parallel(struct ir *file)
+{
+    ssa_convert_parallel(file, thread_cores());
+}
+
+static const struct pass PASSES[] = {
+    { "ssa",         ssa_convert,                             true,  false },
+    { "ssa-braun",   ssa_convert_braun,                       true,  false },
+    { "ssa-par",     pass_ssa_parallel,                       true,  false },
+    { "ssa-loops",   ssa_convert_loops,                       true,  false },
+    { "licm",        loop_invariant_code_motion,              false, false },
+    { "copyprop",    copy_propagation,                        false, false },
+    { "dce",         aggressive_dead_code_elimination,        false, false },
+    { "gvn",         global_value_numbering,                  false, false },
+    { "sccp",        sparse_conditional_constant_propagation, false, false },
+    { "strength",    strength_reduction,                      false, false },
+    { "peephole",    peephole_optimization,                   false, false },
+    { "unroll",      loop_unrolling,                          false, true  },
+    { "simplifycfg", simplify_cfg,                            false, false },
+    { "slp",         slp_vectorization,                       false, false },
+    { "inline",      function_inlining,                       false, true  },
+    { "globaldce",   dead_global_elimination,                 false, false },
+    { "dse",         dead_store_elimination,                  false, false },
+    { "loadelim",    redundant_load_elimination,              false, false },
+    { "pre",         partial_redundancy_elimination,          false, false },
+    { "sink",        code_sinking,                            false, false },
+    { "ifconv",      if_conversion,                           false, false },
+};
+
+static const u32 PASS_COUNT = sizeof(PASSES) / sizeof(PASSES[0]);
+
+static void
+pipeline_unknown(const char *name, u32 length)
+{
+    fprintf(stderr, "[ERROR] Unknown pass '%.*s'. Known passes:", (s32) length, name);
+    for (u32 i = 0; i < PASS_COUNT; ++i) {
+        fprintf(stderr, " %s", PASSES[i].name);
+    }
+    fprintf(stderr, "\n");
+}
+
+// NOTE: an empty name ('ssa,,dce', 'ssa,' or a lone '?') is an unknown pass, it is checked
+// before the length goes down by the '?'
+static bool
+pipeline_parse(struct pipeline *pipeline, const char *list)
+{
+    while (*list) {
+        u32 length = 0;
+        while (list[length] && list[length] != ',') {
+            ++length;
+        }
+        
+        bool speculative = (length > 0 && *list == '?');
+        if (speculative) {
+            ++list;
+            --length;
+        }
+        
+        if (length == 0) {
+            pipeline_unknown(list, length);
+            return(false);
+        }
+        
+        u32 pass_index = 0;
+        while (pass_index < PASS_COUNT &&
+               (strlen(PASSES[pass_index].name) != length || strncmp(PASSES[pass_index].name, list, length))) {
+            ++pass_index;
+        }
+        
+        if (pass_index == PASS_COUNT) {
+            pipeline_unknown(list, length);
+            return(false);
+        }
+        
+        if (speculative && PASSES[pass_index].once) {
+            fprintf(stderr, "[ERROR] Pass '%s' only runs in the first round, it can not be speculative\n", 
+                    PASSES[pass_index].name);
+            return(false);
+        }
+        
+        vector_push(&pipeline->passes, pass_index);
+        vector_push(&pipeline->speculative, speculative);
+        
+        list += length;
+        if (*list == ',' && !*++list) {
+            pipeline_unknown(list, 0);
+            return(false);
+        }
+    }
+    
+    return(true);
+}
+
+// NOTE: instructions as they would be written out, i.e. including
+// the labels and the terminators of the basic blocks
+static u32
+pass_instruction_count(struct ir *file)
+{
+    u32 count = 0;
+    
+    for (struct instruction_list *inst = file->pre_cfg; inst; inst = inst->next) {
+        ++count;
+    }
+    
+    for (u32 block_index = 0; block_index < file->cfg.labels.size; ++block_index) {
+        if (file->cfg.labels.data[block_index]) {
+            count += 2;
+            for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+                ++count;
+            }
+        }
+    }
+    
+    for (struct instruction_list *inst = file->post_cfg; inst; inst = inst->next) {
+        ++count;
+    }
+    
+    return(count);
+}
+
+static f64
+pass_now(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER now;
+    LARGE_INTEGER frequency;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&frequency);
+    return(now.QuadPart * 1000.0 / frequency.QuadPart);
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return(now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0);
+#endif
+}
+
+// NOTE: peak resident set size (working set on Windows) of the whole process so far, in 
+// kilobytes. It is not per pass: it only grows when a pass goes above all the previous ones
+static u64
+pass_peak_memory(void)
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return((u64) counters.PeakWorkingSetSize / 1024);
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return((u64) usage.ru_maxrss);
+#endif
+}
+
+static u64
+pass_weighted(u64 weight, u64 count)
+{
+    return(weight < PASS_MAX_WEIGHT ? weight * count : PASS_MAX_WEIGHT * count);
+}
+
+// NOTE: what a call costs, i.e. what the callee would cost inlined: all of its instructions,
+// from OpFunction to OpFunctionEnd, and the calls in it costed the same way. The callee is
+// not in the CFG, so its loops are taken from the layout: the blocks from a loop header up
+// to its merge block. 'costs' is id -> cost + 1, 0 if not known yet. A recursive call costs 1
+static u64
+pass_call_cost(struct ir *file, u64 *costs, u32 function)
+{
+    if (function >= file->header.bound) {
+        return(1);
+    }
+    
+    if (costs[function]) {
+        return(costs[function] - 1);
+    }
+    
+    costs[function] = 2;
+    
+    struct instruction_list *inst = file->post_cfg;
+    while (inst && !(inst->data.opcode == OpFunction && inst->data.unparsed_words[2] == function)) {
+        inst = inst->next;
+    }
+    
+    struct uint_vector merges = vector_init(); // NOTE: of the loops the current block is in
+    u64 weight = 1;
+    u64 cost = 0;
+    
+    for (; inst; inst = inst->next) {
+        if (inst->data.opcode == OpLabel || inst->data.opcode == OpLoopMerge) {
+            if (inst->data.opcode == OpLoopMerge) {
+                vector_push(&merges, inst->data.OpLoopMerge.merge_block);
+            }
+            
+            while (inst->data.opcode == OpLabel && merges.size && merges.data[merges.size - 1] == inst->data.OpLabel.result_id) {
+                --merges.size;
+            }
+            
+            weight = 1;
+            for (u32 i = 0; i < merges.size && weight < PASS_MAX_WEIGHT; ++i) {
+                weight *= PASS_LOOP_WEIGHT;
+            }
+        }
+        
+        u64 count = (inst->data.opcode == OpFunctionCall ? pass_call_cost(file, costs, inst->data.unparsed_words[3]) : 1);
+        cost += pass_weighted(weight, count);
+        
+        if (inst->data.opcode == OpFunctionEnd) {
+            break;
+        }
+    }
+    
+    vector_free(&merges);
+    
+    // NOTE: a function which is not defined in post_cfg is the one in the CFG
+    cost = (cost ? cost : 1);
+    costs[function] = cost + 1;
+    
+    return(cost);
+}
+
+// NOTE: a static estimate of the work of one invocation, the instructions of the reachable 
+// blocks weighted by the loops they are in. A call costs as much as the callee (see 
+// pass_call_cost), so that inlining only pays for the code around the call
+static u64
+pass_static_cost(struct ir *file)
+{
+    u32 block_count = file->cfg.labels.size;
+    struct cfg_dfs_result dfs = cfg_dfs(&file->cfg);
+    struct licm_loop *loops;
+    u32 loop_count;
+    struct licm licm = licm_init(file, &dfs, &loops, &loop_count, 0);
+    u64 *weight = malloc(block_count * sizeof(u64));
+    u64 *costs = calloc(file->header.bound, sizeof(u64));
+    u64 cost = 0;
+    
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        weight[block_index] = 1;
+    }
+    
+    for (u32 i = 0; i < loop_count; ++i) {
+        struct uint_vector body = licm_body(&licm, loops[i].header, loop_count + i + 1);
+        
+        // NOTE: a loop which can not branch back runs once, e.g. the wrapper of an inlined body
+        bool iterates = false;
+        for (struct edge_list *edge = file->cfg.in[loops[i].header]; edge; edge = edge->next) {
+            iterates |= (licm.reachable[edge->data] && dominates(loops[i].header, edge->data, file->cfg.dominators));
+        }
+        
+        for (u32 b = 0; iterates && b < body.size; ++b) {
+            if (weight[body.data[b]] < PASS_MAX_WEIGHT) {
+                weight[body.data[b]] *= PASS_LOOP_WEIGHT;
+            }
+        }
+        vector_free(&body);
+    }
+    
+    for (u32 i = 0; i < dfs.size; ++i) {
+        u32 block_index = dfs.sorted_preorder[i];
+        cost += weight[block_index] * (file->blocks[block_index].count + 1);
+        
+        for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+            if (inst->data.opcode == OpFunctionCall) {
+                cost += pass_weighted(weight[block_index], pass_call_cost(file, costs, inst->data.unparsed_words[3]) - 1);
+            }
+        }
+    }
+    
+    free(weight);
+    free(costs);
+    free(loops);
+    licm_free(&licm);
+    cfg_dfs_free(&dfs);
+    
+    return(cost);
+}
+
+// NOTE: keep the changes since the snapshot if they did not make the module more expensive
+static void
+pass_end_speculation(struct ir *file, struct pipeline *pipeline, const char *name, u64 cost)
+{
+    if (!file->snapshot.active) {
+        return;
+    }
+    
+    u64 new_cost = pass_static_cost(file);
+    bool keep = (new_cost <= cost);
+    
+    if (keep) {
+        ir_commit(file);
+    } else {
+        ir_restore(file);
+    }
+    
+    if (pipeline->stats) {
+        fprintf(stderr, "[INFO] Speculation from '%s' %s, cost %llu -> %llu\n", name, keep ? "kept" : "rolled back",
+                (unsigned long long) cost, (unsigned long long) new_cost);
+    }
+}
+
+static bool
+pass_same_words(struct uint_vector *a, struct uint_vector *b)
+{
+    return(a->size == b->size && !memcmp(a->data, b->data, a->size * sizeof(u32)));
+}
+
+static void
+pipeline_run(struct ir *file, struct pipeline *pipeline)
+{
+    struct uint_vector before = vector_init();
+    struct uint_vector after = vector_init();
+    f64 total_ms = 0.0;
+    u32 initial_count = pass_instruction_count(file);
+    
+    if (pipeline->stats) {
+        fprintf(stderr, "%6s %-12s %10s %13s %14s\n", "round", "pass", "ms", "proc peak KB", "instructions");
+    }
+    
+    if (pipeline->rounds > 1) {
+        ir_serialize(file, &before);
+    }
+    
+    for (u32 round = 0; round < pipeline->rounds; ++round) {
+        const char *speculation = NULL;
+        u64 speculation_cost = 0;
+        
+        for (u32 i = 0; i < pipeline->passes.size; ++i) {
+            const struct pass *pass = PASSES + pipeline->passes.data[i];
+            
+            if (pass->once && round > 0) {
+                continue;
+            }
+            
+            u32 count = pass_instruction_count(file);
+            f64 start = pass_now();
+            
+            if (pipeline->speculative.data[i]) {
+                pass_end_speculation(file, pipeline, speculation, speculation_cost);
+                speculation = pass->name;
+                speculation_cost = pass_static_cost(file);
+                ir_snapshot(file);
+            } else if (pass->once) {
+                pass_end_speculation(file, pipeline, speculation, speculation_cost);
+            }
+            
+            // NOTE: a pass which does not save what it changes gets everything saved up front
+            if (file->snapshot.active && !pass->cow) {
+                ir_write_all(file);
+            }
+            
+            pass->run(file);
+            
+            f64 pass_ms = pass_now() - start;
+            total_ms += pass_ms;
+            
+            if (pipeline->stats) {
+                s32 delta = (s32) pass_instruction_count(file) - (s32) count;
+                fprintf(stderr, "%6u %-12s %10.3f %13llu %+14d\n", round + 1, pass->name, pass_ms,
+                        (unsigned long long) pass_peak_memory(), delta);
+            }
+        }
+        
+        pass_end_speculation(file, pipeline, speculation, speculation_cost);
+        
+        // NOTE: fixed point, another round would not change anything either
+        if (pipeline->rounds > 1) {
+            ir_serialize(file, &after);
+            if (pass_same_words(&before, &after)) {
+                if (pipeline->stats) {
+                    fprintf(stderr, "[INFO] Fixed point reached after %u round(s)\n", round + 1);
+                }
+                break;
+            }
+            
+            struct uint_vector swap = before;
+            before = after;
+            after = swap;
+        }
+    }
+    
+    if (pipeline->stats) {
+        s32 delta = (s32) pass_instruction_count(file) - (s32) initial_count;
+        fprintf(stderr, "%6s %-12s %10.3f %13llu %+14d\n", "", "total", total_ms,
+                (unsigned long long) pass_peak_memory(), delta);
+    }
+    
+    vector_free(&before);
+    vector_free(&after);
+}
@@ -15,12 +15,13 @@ dominates(u32 parent, s32 child, s32 *dominators)
     return(false);
 }
 
+// NOTE: dominance frontiers of all vertices as per Cooper, Harvey and Kennedy:
+// walk up the dominator tree from each predecessor of a join point until
+// reaching the join point's immediate dominator
 static struct uint_vector *
 ssa_dominance_frontier_all(struct ir_cfg *cfg, struct cfg_dfs_result *dfs)
 {
     struct uint_vector *df = malloc(cfg->labels.size * sizeof(struct uint_vector));
-    struct int_stack children_stack = stack_init();
-    bool *visited = malloc(cfg->labels.size * sizeof(bool));
     
     for (u32 i = 0; i < cfg->labels.size; ++i) {
         df[i] = vector_init();
@@ -28,421 +29,1894 @@ ssa_dominance_frontier_all(struct ir_cfg *cfg, struct cfg_dfs_result *dfs)
     
     for (u32 i = 0; i < dfs->size; ++i) {
         u32 vertex = dfs->sorted_postorder[i];
-        ASSERT(cfg->labels.data[i]);
+        struct edge_list *edge = cfg->in[vertex];
         
-        // NOTE: only compute DF for passed vertices
-        memset(visited, 0x00, cfg->labels.size * sizeof(bool));
-        stack_clear(&children_stack);
+        // NOTE: only join points are in someone's frontier
+        if (!edge || !edge->next) {
+            continue;
+        }
+        
+        while (edge) {
+            s32 runner = edge->data;
+            while (runner != -1 && runner != cfg->dominators[vertex]) {
+                // NOTE: 'vertex' is the last one pushed if it has been pushed at all
+                struct uint_vector *runner_df = df + runner;
+                if (runner_df->size == 0 || runner_df->data[runner_df->size - 1] != vertex) {
+                    vector_push(runner_df, vertex);
+                }
+                runner = cfg->dominators[runner];
+            }
+            edge = edge->next;
+        }
+    }
+    
+    return(df);
+}
+
+// NOTE: iterated dominance frontier of a set of vertices. 'has_phi' and 'enqueued'
+// are per-vertex marks which are equal to 'stamp' if the vertex has been visited for
+// the current set, so that the same arrays can be reused without clearing them
+static struct uint_vector
+ssa_dominance_frontier(struct uint_vector *df, struct uint_vector *vertices, 
+                       u32 *has_phi, u32 *enqueued, u32 stamp)
+{
+    struct uint_vector idf = vector_init();
+    struct int_stack work = stack_init();
+    
+    for (u32 i = 0; i < vertices->size; ++i) {
+        enqueued[vertices->data[i]] = stamp;
+        stack_push(&work, vertices->data[i]);
+    }
+    
+    while (work.size) {
+        u32 vertex = stack_pop(&work);
+        for (u32 i = 0; i < df[vertex].size; ++i) {
+            u32 frontier = df[vertex].data[i];
+            if (has_phi[frontier] != stamp) {
+                has_phi[frontier] = stamp;
+                vector_push(&idf, frontier);
+                if (enqueued[frontier] != stamp) {
+                    enqueued[frontier] = stamp;
+                    stack_push(&work, frontier);
+                }
+            }
+        }
+    }
+    
+    stack_free(&work);
+    
+    return(idf);
+}
+
+#if 0
+static u32
+ssa_insert_variable(struct ir *file, u32 block_index, struct instruction_t variable)
+{
+    u32 res_id = file->header.bound++;
+    variable.OpVariable.result_id = res_id;
+    ir_prepend_instruction(file->blocks + block_index, variable); // NOTE: only a copy is inserted
+    return(res_id);
+}
+#endif
+
+static void
+ssa_delete_variable(struct basic_block *block, struct instruction_list *instruction)
+{
+    if (block) {
+        ir_delete_instruction(block, instruction);
+    } else if (instruction->data.OpVariable.storage_class == StorageClassPrivate) {
+        // NOTE: we know that OpVariable can not be the first instruction.
+        // Input and Output class variables are the interface, so they stay
+        instruction->prev->next = instruction->next;
+        if (instruction->next) {
+            instruction->next->prev = instruction->prev;
+        }
+        free(instruction);
+    }
+}
+
+// NOTE: Input, Output, Private and Function class variables are private to the 
+// invocation. Everything else can be read or written behind our back, so it stays in memory
+static bool
+ssa_promotable(u32 storage_class)
+{
+    return(storage_class == StorageClassInput || 
+           storage_class == StorageClassOutput || 
+           storage_class == StorageClassPrivate || 
+           storage_class == StorageClassFunction);
+}
+
+// NOTE: the value a variable has before anything is stored to it. Only 
+// Input class variables and variables with an initializer have one
+static u32
+ssa_initializer(struct instruction_list *variable)
+{
+    return(variable->data.wordcount == 5 ? variable->data.OpVariable.initializer : 0);
+}
+
+// NOTE: marks every id which is referenced by the instruction
+static void
+ssa_mark_ids(struct instruction_t *instruction, u32 *buffer, bool *marks, u32 bound)
+{
+    instruction_dump(instruction, buffer);
+    for (u32 i = 1; i < instruction->wordcount; ++i) {
+        if (buffer[i] < bound) {
+            marks[buffer[i]] = true;
+        }
+    }
+}
+
+// NOTE: marks every id which is used by a basic block instruction in any other way
+// than being the pointer of an OpLoad or an OpStore. A variable like this has its 
+// address taken (by OpAccessChain, a function call, ...) and can not be promoted.
+// Everything the other functions (post_cfg) reference escapes too, e.g. a Private
+// variable written by a callee. Ids are found by dumping the instruction, so a literal 
+// might be mistaken for an id, which is safe
+static bool *
+ssa_escaping(struct ir *file)
+{
+    bool *escaping = calloc(file->header.bound, sizeof(bool));
+    u32 *buffer = malloc((WORDCOUNT_MASK >> 16) * sizeof(u32));
+    
+    for (u32 block_index = 0; block_index < file->cfg.labels.size; ++block_index) {
+        struct instruction_list *inst = file->blocks[block_index].instructions;
+        
+        while (inst) {
+            if (inst->data.opcode == OpStore) {
+                escaping[inst->data.OpStore.object] = true;
+            } else if (inst->data.opcode != OpLoad && inst->data.opcode != OpVariable) {
+                ssa_mark_ids(&inst->data, buffer, escaping, file->header.bound);
+            }
+            inst = inst->next;
+        }
+    }
+    
+    for (struct instruction_list *inst = file->post_cfg; inst; inst = inst->next) {
+        ssa_mark_ids(&inst->data, buffer, escaping, file->header.bound);
+    }
+    
+    free(buffer);
+    
+    return(escaping);
+}
+
+struct ssa_variables {
+    u32 count;
+    u32 *ids;
+    u32 *types; // NOTE: pointee types
+    u32 *storage_classes;
+    struct instruction_list **instructions;
+    struct basic_block **blocks; // NOTE: NULL for pre_cfg variables
+    s32 *index;                  // NOTE: id -> variable index, -1 if not a promoted variable
+};
+
+// NOTE: pointer type id -> pointee type id for all OpTypePointer's
+static u32 *
+ssa_pointer_types(struct ir *file)
+{
+    u32 *pointee = calloc(file->header.bound, sizeof(u32));
+    struct instruction_list *inst = file->pre_cfg;
+    
+    while (inst) {
+        if (inst->data.opcode == OpTypePointer) {
+            pointee[inst->data.OpTypePointer.result_id] = inst->data.OpTypePointer.type;
+        }
+        inst = inst->next;
+    }
+    
+    return(pointee);
+}
+
+static bool
+ssa_selected(bool *selected, bool *escaping, u32 id)
+{
+    return(!escaping[id] && (!selected || selected[id]));
+}
+
+static void
+ssa_add_variable(struct ssa_variables *variables, u32 *pointee, 
+                 struct instruction_list *instruction, struct basic_block *block)
+{
+    u32 var_index = variables->count++;
+    variables->ids[var_index] = instruction->data.OpVariable.result_id;
+    variables->types[var_index] = pointee[instruction->data.OpVariable.result_type];
+    variables->storage_classes[var_index] = instruction->data.OpVariable.storage_class;
+    variables->instructions[var_index] = instruction;
+    variables->blocks[var_index] = block;
+    variables->index[instruction->data.OpVariable.result_id] = var_index;
+}
+
+// NOTE: find all promotable OpVariables in pre_cfg and at the beginning of the
+// basic blocks. Counts them first, so that all the tables are sized exactly. If
+// 'selected' is not NULL, only the variables with the id marked in it are taken
+static struct ssa_variables
+ssa_find_variables(struct ir *file, bool *selected)
+{
+    struct ssa_variables variables = { 0 };
+    bool *escaping = ssa_escaping(file);
+    u32 total = 0;
+    
+    for (u32 pass = 0; pass < 2; ++pass) {
+        if (pass == 1) {
+            variables.ids = malloc(total * sizeof(u32));
+            variables.types = malloc(total * sizeof(u32));
+            variables.storage_classes = malloc(total * sizeof(u32));
+            variables.instructions = malloc(total * sizeof(struct instruction_list *));
+            variables.blocks = malloc(total * sizeof(struct basic_block *));
+            variables.index = malloc(file->header.bound * sizeof(s32));
+            memset(variables.index, 0xFF, file->header.bound * sizeof(s32));
+        }
+        
+        u32 *pointee = (pass == 1 ? ssa_pointer_types(file) : NULL);
+        struct instruction_list *instruction = file->pre_cfg;
+        
+        while (instruction) {
+            if (instruction->data.opcode == OpVariable && ssa_promotable(instruction->data.OpVariable.storage_class) && 
+                ssa_selected(selected, escaping, instruction->data.OpVariable.result_id)) {
+                if (pass == 0) {
+                    ++total;
+                } else {
+                    ssa_add_variable(&variables, pointee, instruction, NULL);
+                }
+            }
+            instruction = instruction->next;
+        }
+        
+        for (u32 i = 0; i < file->cfg.labels.size; ++i) {
+            instruction = file->blocks[i].instructions;
+            bool reading = false;
+            
+            while (instruction) {
+                if (instruction->data.opcode == OpVariable) {
+                    reading = true;
+                    if (ssa_promotable(instruction->data.OpVariable.storage_class) && 
+                        ssa_selected(selected, escaping, instruction->data.OpVariable.result_id)) {
+                        if (pass == 0) {
+                            ++total;
+                        } else {
+                            ssa_add_variable(&variables, pointee, instruction, file->blocks + i);
+                        }
+                    }
+                } else if (reading) {
+                    // NOTE: we've read all OpVariables. 
+                    // This is based on the SPIR-V specification!
+                    break;
+                }
+                instruction = instruction->next;
+            }
+        }
+        
+        free(pointee);
+    }
+    
+    free(escaping);
+    
+    return(variables);
+}
+
+static void
+ssa_variables_free(struct ssa_variables *variables)
+{
+    free(variables->ids);
+    free(variables->types);
+    free(variables->storage_classes);
+    free(variables->instructions);
+    free(variables->blocks);
+    free(variables->index);
+}
+
+#define SSA_MAX_SCALARS 64
+
+// NOTE: the number of scalars an aggregate is split into, 0 for non-aggregates
+static u32
+ssa_scalar_count(u32 *scalars, u32 type)
+{
+    return(scalars[type] ? scalars[type] : 1);
+}
+
+// NOTE: offset of the scalar an OpAccessChain with constant indexes points to,
+// -1 if the chain does not end at a scalar or has non-constant indexes
+static s32
+ssa_chain_offset(struct instruction_list **globals, u32 *scalars, u32 type, struct instruction_t *chain)
+{
+    u32 offset = 0;
+    
+    for (u32 i = 0; i < chain->wordcount - 4; ++i) {
+        struct instruction_list *index = globals[chain->OpAccessChain.indexes[i]];
+        struct instruction_list *aggregate = globals[type];
+        
+        // NOTE: a vector component is not split from the vector
+        if (!index || index->data.opcode != OpConstant || !scalars[type]) {
+            return(-1);
+        }
+        
+        u32 value = index->data.OpConstant.value;
+        
+        if (aggregate->data.opcode == OpTypeStruct) {
+            if (value >= aggregate->data.wordcount - 2) {
+                return(-1);
+            }
+            for (u32 member = 0; member < value; ++member) {
+                offset += ssa_scalar_count(scalars, aggregate->data.OpTypeStruct.members[member]);
+            }
+            type = aggregate->data.OpTypeStruct.members[value];
+        } else if (aggregate->data.opcode == OpTypeArray) {
+            u32 length = globals[aggregate->data.OpTypeArray.length]->data.OpConstant.value;
+            if (value >= length) {
+                return(-1);
+            }
+            type = aggregate->data.OpTypeArray.element_type;
+            offset += value * ssa_scalar_count(scalars, type);
+        }
+    }
+    
+    return(scalars[type] ? -1 : (s32) offset);
+}
+
+// NOTE: scalar replacement of aggregates. Function and Private class struct and array 
+// variables, which are only accessed by OpLoad's and OpStore's through OpAccessChain's with
+// constant indexes, are split into one variable per accessed scalar. The new variables are
+// then promoted like any other variable. Whole aggregate loads and stores are not split.
+// If '*selected' is not NULL, only the selected variables are split, and the selection
+// is grown to select the new variables instead
+static void
+ssa_scalar_replace(struct ir *file, bool **selected)
+{
+    u32 bound = file->header.bound;
+    u32 *pointee = ssa_pointer_types(file);
+    struct instruction_list **globals = calloc(bound, sizeof(struct instruction_list *));
+    struct instruction_list **candidates = calloc(bound, sizeof(struct instruction_list *));
+    u32 *scalars = calloc(bound, sizeof(u32));  // NOTE: type id -> number of scalars, 0 if not an aggregate
+    u32 *owner = calloc(bound, sizeof(u32));    // NOTE: candidate or chain id -> candidate id, 0 if neither
+    u32 *offset = calloc(bound, sizeof(u32));   // NOTE: candidate or chain id -> index of the first scalar
+    bool *escaped = calloc(bound, sizeof(bool));
+    struct uint_vector candidate_ids = vector_init();
+    u32 scalar_total = 0;
+    
+    // NOTE: types come before their uses, so the number of scalars is known for all members
+    for (struct instruction_list *inst = file->pre_cfg; inst; inst = inst->next) {
+        struct instruction_t *data = &inst->data;
+        u32 count = 0;
+        
+        if (data->opcode == OpConstant || data->opcode == OpTypePointer) {
+            globals[get_result_id(data)] = inst;
+        } else if (data->opcode == OpTypeStruct) {
+            for (u32 i = 0; i < data->wordcount - 2; ++i) {
+                count += ssa_scalar_count(scalars, data->OpTypeStruct.members[i]);
+            }
+        } else if (data->opcode == OpTypeArray) {
+            struct instruction_list *length = globals[data->OpTypeArray.length];
+            count = (length && length->data.OpConstant.value <= SSA_MAX_SCALARS ? length->data.OpConstant.value : SSA_MAX_SCALARS + 1);
+            count *= ssa_scalar_count(scalars, data->OpTypeArray.element_type);
+        }
+        
+        if (data->opcode == OpTypeStruct || data->opcode == OpTypeArray) {
+            globals[get_result_id(data)] = inst;
+            scalars[get_result_id(data)] = (count > SSA_MAX_SCALARS ? SSA_MAX_SCALARS + 1 : count);
+        }
+    }
+    
+    // NOTE: candidates are Private variables in pre_cfg and Function variables at 
+    // the beginning of the entry block. Initialized variables are not split
+    struct instruction_list *inst = file->pre_cfg;
+    bool function_variables = false;
+    
+    while (inst) {
+        struct instruction_t *data = &inst->data;
+        
+        if (data->opcode == OpVariable) {
+            u32 id = data->OpVariable.result_id;
+            u32 count = scalars[pointee[data->OpVariable.result_type]];
+            u32 storage_class = data->OpVariable.storage_class;
+            
+            if (count && count <= SSA_MAX_SCALARS && data->wordcount == 4 && (!*selected || (*selected)[id]) &&
+                (storage_class == StorageClassPrivate || storage_class == StorageClassFunction)) {
+                candidates[id] = inst;
+                owner[id] = id;
+                offset[id] = scalar_total;
+                scalar_total += count;
+                vector_push(&candidate_ids, id);
+            }
+        } else if (function_variables) {
+            break;
+        }
+        
+        inst = inst->next;
+        if (!inst && !function_variables) {
+            inst = file->blocks[0].instructions;
+            function_variables = true;
+        }
+    }
+    
+    if (scalar_total) {
+        u32 *buffer = malloc((WORDCOUNT_MASK >> 16) * sizeof(u32));
+        u32 *split = calloc(scalar_total, sizeof(u32));       // NOTE: scalar -> new variable id
+        u32 *split_types = calloc(scalar_total, sizeof(u32)); // NOTE: scalar -> pointer type, 0 if never accessed
+        
+        // NOTE: escape check. Anything but a constant OpAccessChain to a scalar, which is 
+        // then only used as the pointer of OpLoad's and OpStore's, keeps the variable whole
+        for (u32 block_index = 0; block_index < file->cfg.labels.size; ++block_index) {
+            for (inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+                struct instruction_t *data = &inst->data;
+                
+                if (data->opcode == OpAccessChain && candidates[data->OpAccessChain.base]) {
+                    u32 variable = data->OpAccessChain.base;
+                    u32 type = pointee[candidates[variable]->data.OpVariable.result_type];
+                    s32 scalar = ssa_chain_offset(globals, scalars, type, data);
+                    
+                    if (scalar == -1) {
+                        escaped[variable] = true;
+                    } else {
+                        owner[data->OpAccessChain.result_id] = variable;
+                        offset[data->OpAccessChain.result_id] = offset[variable] + scalar;
+                        split_types[offset[variable] + scalar] = data->OpAccessChain.result_type;
+                    }
+                } else if (data->opcode == OpLoad) {
+                    if (candidates[data->OpLoad.pointer]) {
+                        escaped[data->OpLoad.pointer] = true;
+                    }
+                } else if (data->opcode == OpStore) {
+                    if (candidates[data->OpStore.pointer]) {
+                        escaped[data->OpStore.pointer] = true;
+                    }
+                    escaped[owner[data->OpStore.object]] = true;
+                } else if (data->opcode != OpVariable) {
+                    instruction_dump(data, buffer);
+                    for (u32 i = 1; i < data->wordcount; ++i) {
+                        if (buffer[i] < bound) {
+                            escaped[owner[buffer[i]]] = true;
+                        }
+                    }
+                }
+            }
+        }
+        
+        // NOTE: a Private aggregate which another function uses stays whole
+        for (inst = file->post_cfg; inst; inst = inst->next) {
+            instruction_dump(&inst->data, buffer);
+            for (u32 i = 1; i < inst->data.wordcount; ++i) {
+                if (buffer[i] < bound) {
+                    escaped[owner[buffer[i]]] = true;
+                }
+            }
+        }
+        
+        // NOTE: indexed by the new ids too, the interface of the entry points lists them
+        bool *deleted = calloc(bound + scalar_total, sizeof(bool));
+        
+        for (u32 i = 0; i < candidate_ids.size; ++i) {
+            u32 variable = candidate_ids.data[i];
+            u32 storage_class = candidates[variable]->data.OpVariable.storage_class;
+            u32 count = scalars[pointee[candidates[variable]->data.OpVariable.result_type]];
+            
+            if (escaped[variable]) {
+                continue;
+            }
+            
+            for (u32 scalar = offset[variable]; scalar < offset[variable] + count; ++scalar) {
+                if (split_types[scalar]) {
+                    struct instruction_t new_variable = {
+                        .opcode = OpVariable,
+                        .wordcount = 4,
+                        .unparsed_words = NULL
+                    };
+                    
+                    new_variable.OpVariable.result_type = split_types[scalar];
+                    new_variable.OpVariable.result_id = file->header.bound++;
+                    new_variable.OpVariable.storage_class = storage_class;
+                    split[scalar] = new_variable.OpVariable.result_id;
+                    
+                    if (storage_class == StorageClassFunction) {
+                        ir_prepend_instruction(file->blocks + 0, new_variable);
+                    } else {
+                        ir_add_global(file, new_variable);
+                        ir_add_interface(file, variable, split[scalar]);
+                    }
+                }
+            }
+            
+            deleted[variable] = true;
+            ssa_delete_variable(storage_class == StorageClassFunction ? file->blocks + 0 : NULL, candidates[variable]);
+        }
+        
+        if (*selected) {
+            *selected = realloc(*selected, file->header.bound * sizeof(bool));
+            memset(*selected + bound, 0, (file->header.bound - bound) * sizeof(bool));
+            for (u32 scalar = 0; scalar < scalar_total; ++scalar) {
+                (*selected)[split[scalar]] = (split[scalar] != 0);
+            }
+        }
+        
+        // NOTE: point loads and stores straight to the new variables, the chains are not needed anymore
+        for (u32 block_index = 0; block_index < file->cfg.labels.size; ++block_index) {
+            inst = file->blocks[block_index].instructions;
+            
+            while (inst) {
+                struct instruction_list *next = inst->next;
+                struct instruction_t *data = &inst->data;
+                
+                if (data->opcode == OpLoad && deleted[owner[data->OpLoad.pointer]]) {
+                    data->OpLoad.pointer = split[offset[data->OpLoad.pointer]];
+                } else if (data->opcode == OpStore && deleted[owner[data->OpStore.pointer]]) {
+                    data->OpStore.pointer = split[offset[data->OpStore.pointer]];
+                } else if (data->opcode == OpAccessChain && deleted[owner[data->OpAccessChain.result_id]]) {
+                    free(data->OpAccessChain.indexes);
+                    ir_delete_instruction(file->blocks + block_index, inst);
+                }
+                
+                inst = next;
+            }
+        }
+        
+        ir_delete_opnames(file, deleted);
+        ir_delete_decorations(file, deleted);
+        
+        free(deleted);
+        free(buffer);
+        free(split);
+        free(split_types);
+    }
+    
+    vector_free(&candidate_ids);
+    free(pointee);
+    free(globals);
+    free(candidates);
+    free(scalars);
+    free(owner);
+    free(offset);
+    free(escaped);
+}
+
+// NOTE: a value for reads which no store reaches. One OpUndef per type is
+// declared next to the other globals
+static u32
+ssa_undef(struct ir *file, u32 *undefs, u32 type)
+{
+    if (!undefs[type]) {
+        struct instruction_t undef = {
+            .opcode = OpUndef,
+            .wordcount = 3,
+            .unparsed_words = NULL
+        };
         
-        // NOTE: DF-local
-        {
-            struct edge_list *edge = cfg->out[vertex];
+        undef.OpUndef.result_type = type;
+        undef.OpUndef.result_id = file->header.bound++;
+        
+        ir_add_global(file, undef);
+        undefs[type] = undef.OpUndef.result_id;
+    }
+    
+    return(undefs[type]);
+}
+
+// NOTE(genious): we REPLACE the OpLoad with OpCopyObject, but
+// PRESERVE the result id. This automatically resolves all 
+// references to this OpLoad!
+static void
+ssa_rewrite_load(struct instruction_t *instruction, u32 data_type, u32 version)
+{
+    u32 result_id = instruction->OpLoad.result_id;
+    
+    instruction->opcode = OpCopyObject;
+    instruction->wordcount = 4;
+    instruction->OpCopyObject.result_type = data_type;
+    instruction->OpCopyObject.result_id = result_id;
+    instruction->OpCopyObject.operand = version;
+}
+
+// NOTE: new assignment to variable. Replace with OpCopyObject once again,
+// the copies are removed later by the copy propagation pass (see opt.c)
+static void
+ssa_rewrite_store(struct instruction_t *instruction, u32 data_type, u32 new_version)
+{
+    u32 object = instruction->OpStore.object; 
+    
+    instruction->opcode = OpCopyObject;
+    instruction->wordcount = 4;
+    instruction->OpCopyObject.result_type = data_type;
+    instruction->OpCopyObject.result_id = new_version; 
+    instruction->OpCopyObject.operand = object;
+}
+
+// NOTE: the OpVariable's have to stay the first instructions of the entry block, anything 
+// which is moved there goes after them. The last of them is found once per conversion, then
+// the tail follows what is inserted (walking the variables for every load is O(vars * loads))
+static struct instruction_list *
+ssa_entry_tail(struct ir *file)
+{
+    struct instruction_list *tail = NULL;
+    
+    for (struct instruction_list *inst = file->blocks[0].instructions; inst && inst->data.opcode == OpVariable; inst = inst->next) {
+        tail = inst;
+    }
+    
+    return(tail);
+}
+
+static void
+ssa_insert_entry(struct ir *file, struct instruction_list **tail, struct instruction_t instruction)
+{
+    *tail = ir_insert_instruction(file->blocks + 0, *tail, instruction);
+}
+
+// NOTE: the value of an Input class variable which is written to has to be
+// loaded in the entry block before anything can overwrite it
+static void
+ssa_load_input(struct ir *file, struct instruction_list **tail, struct ssa_variables *variables, u32 var_index, u32 result_id)
+{
+    struct instruction_t load = {
+        .opcode = OpLoad,
+        .wordcount = 4,
+        .unparsed_words = NULL
+    };
+    
+    load.OpLoad.result_type = variables->types[var_index];
+    load.OpLoad.result_id = result_id;
+    load.OpLoad.pointer = variables->ids[var_index];
+    load.OpLoad.memory_access = 0;
+    
+    ssa_insert_entry(file, tail, load);
+}
+
+// NOTE: a termination block needs one *special* OpStore per Output class
+// variable, which is preserved
+static void
+ssa_store_output(struct ir *file, u32 block_index, u32 pointer, u32 object)
+{
+    struct instruction_t store;
+    store.opcode = OpStore;
+    store.wordcount = 3;
+    store.unparsed_words = NULL;
+    
+    store.OpStore.pointer = pointer;
+    store.OpStore.object = object;
+    
+    ir_append_instruction(file->blocks + block_index, store);
+}
+
+// NOTE: if this is an OpLoad of an Input class variable, which has 
+// not been written to, then move the instruction to the entry block
+static void
+ssa_hoist_input(struct ir *file, struct instruction_list **tail, u32 block_index, struct instruction_list *instruction)
+{
+    ssa_insert_entry(file, tail, instruction->data);
+    ir_delete_instruction(file->blocks + block_index, instruction);
+}
+
+// NOTE: name the new versions after the variable they came from (unless the module is
+// stripped), then delete the promoted Function and Private variables, which are not 
+// referenced anymore, together with their names, decorations and entry point interface slots
+static void
+ssa_finish(struct ir *file, struct ssa_variables *variables, struct uint_vector *names)
+{
+    struct instruction_list *anchor = (file->strip ? NULL : ir_opname_anchor(file));
+    for (u32 i = 0; anchor && i < names->size; i += 2) {
+        char var_name[16];
+        snprintf(var_name, sizeof(var_name), "ssa%u", names->data[i + 1]);
+        anchor = ir_insert_opname(anchor, names->data[i], var_name);
+    }
+    
+    bool *deleted = calloc(file->header.bound, sizeof(bool));
+    for (u32 var_index = 0; var_index < variables->count; ++var_index) {
+        if (variables->blocks[var_index] || variables->storage_classes[var_index] == StorageClassPrivate) {
+            deleted[variables->ids[var_index]] = true;
+        }
+        ssa_delete_variable(variables->blocks[var_index], variables->instructions[var_index]);
+    }
+    ir_delete_opnames(file, deleted);
+    ir_delete_decorations(file, deleted);
+    
+    free(deleted);
+}
+
+// NOTE: state shared by the workers of ssa_convert_parallel. Every variable gets its own
+// range of ids for its phi's and versions, and is handled by exactly one worker. All the
+// instruction list manipulations are done before or after the workers run, in a fixed 
+// order, so that the result does not depend on the number of workers
+struct ssa_builder {
+    struct ir *file;
+    struct ssa_variables *variables;
+    u32 worker_count;
+    u32 worker_size;               // NOTE: a worker owns a contiguous range of this many variables
+    struct uint_vector *df;
+    struct uint_vector *store_blocks;
+    struct uint_vector *phi_blocks;
+    s32 *first_child;
+    s32 *next_sibling;
+    struct uint_vector outputs;
+    struct uint_vector exits;      // NOTE: termination blocks
+    u32 *exit_values;              // NOTE: exit * outputs.size + output -> last version, 0 if none
+    u32 *initial;                  // NOTE: variable index -> version before any store, 0 if none
+    u32 *first_version;            // NOTE: variable index -> first id of the variable's range
+    u32 *next_version;             // NOTE: variable index -> next free id of the variable's range
+    u32 first_id;
+    u32 id_count;
+    s32 *phi_variables;            // NOTE: id - first_id -> variable index, -1 if not a phi
+    u32 *undefs;                   // NOTE: type id -> reserved OpUndef id, 0 if none
+};
+
+// NOTE: per worker state
+struct ssa_rename {
+    struct ssa_builder *builder;
+    u32 worker;
+    u32 *current;                  // NOTE: variable index -> id of the current version, 0 if none
+    struct int_stack undo;         // NOTE: (variable index, previous version) pairs
+    u32 *undo_marks;
+    bool *undef_used;              // NOTE: type id -> the reserved OpUndef is referenced
+    struct instruction_list **instructions; // NOTE: phi's, loads and stores of the worker's variables
+    u32 *block_first;              // NOTE: block index -> first of the block's 'instructions'
+};
+
+// NOTE: contiguous ranges rather than every n-th variable, so that the workers do not write
+// to the same cache lines of 'next_version', 'exit_values' and the phi operands
+static u32
+ssa_worker(struct ssa_builder *builder, u32 var_index)
+{
+    return(var_index / builder->worker_size);
+}
+
+static bool
+ssa_owns(struct ssa_rename *rename, u32 var_index)
+{
+    return(ssa_worker(rename->builder, var_index) == rename->worker);
+}
+
+static u32
+ssa_first_owned(struct ssa_rename *rename)
+{
+    return(rename->worker * rename->builder->worker_size);
+}
+
+static u32
+ssa_end_owned(struct ssa_rename *rename)
+{
+    u32 end = (rename->worker + 1) * rename->builder->worker_size;
+    return(end < rename->builder->variables->count ? end : rename->builder->variables->count);
+}
+
+static s32
+ssa_phi_variable(struct ssa_builder *builder, struct instruction_t *instruction)
+{
+    if (instruction->opcode == OpPhi) {
+        u32 id = instruction->OpPhi.result_id - builder->first_id;
+        if (instruction->OpPhi.result_id >= builder->first_id && id < builder->id_count) {
+            return(builder->phi_variables[id]);
+        }
+    }
+    return(-1);
+}
+
+// NOTE: Input class variables which are never written to are not renamed,
+// the loads are moved to the entry block instead
+static s32
+ssa_renamed_variable(struct ssa_builder *builder, u32 pointer)
+{
+    s32 var_index = builder->variables->index[pointer];
+    
+    if (var_index != -1 && builder->variables->storage_classes[var_index] == StorageClassInput && 
+        !builder->store_blocks[var_index].size) {
+        return(-1);
+    }
+    
+    return(var_index);
+}
+
+static u32
+ssa_current(struct ssa_rename *rename, u32 var_index)
+{
+    u32 version = rename->current[var_index];
+    
+    if (!version) {
+        u32 type = rename->builder->variables->types[var_index];
+        rename->undef_used[type] = true;
+        version = rename->builder->undefs[type];
+    }
+    
+    return(version);
+}
+
+static void
+ssa_set_current(struct ssa_rename *rename, u32 var_index, u32 version)
+{
+    stack_push(&rename->undo, var_index);
+    stack_push(&rename->undo, rename->current[var_index]);
+    rename->current[var_index] = version;
+}
+
+static void
+ssa_restore(struct ssa_rename *rename, u32 undo_size)
+{
+    while (rename->undo.size > undo_size) {
+        u32 version = stack_pop(&rename->undo);
+        u32 var_index = stack_pop(&rename->undo);
+        rename->current[var_index] = version;
+    }
+}
+
+static void
+ssa_traverse(struct ssa_rename *rename, u32 block_index)
+{
+    struct ssa_builder *builder = rename->builder;
+    struct ssa_variables *variables = builder->variables;
+    struct ir_cfg *cfg = &builder->file->cfg;
+    
+    for (u32 i = rename->block_first[block_index]; i < rename->block_first[block_index + 1]; ++i) {
+        struct instruction_t *inst = &rename->instructions[i]->data;
+        
+        // NOTE: phi functions placed for a variable define its new version
+        if (inst->opcode == OpPhi) {
+            ssa_set_current(rename, ssa_phi_variable(builder, inst), inst->OpPhi.result_id);
+        } else if (inst->opcode == OpLoad) {
+            u32 var_index = variables->index[inst->OpLoad.pointer];
+            ssa_rewrite_load(inst, variables->types[var_index], ssa_current(rename, var_index));
+        } else {
+            u32 var_index = variables->index[inst->OpStore.pointer];
+            u32 new_version = builder->next_version[var_index]++;
+            ssa_rewrite_store(inst, variables->types[var_index], new_version);
+            ssa_set_current(rename, var_index, new_version);
+        }
+    }
+    
+    if (!cfg->out[block_index]) {
+        u32 exit_index = search_item_u32(builder->exits.data, builder->exits.size, block_index);
+        for (u32 i = 0; i < builder->outputs.size; ++i) {
+            u32 var_index = builder->outputs.data[i];
+            if (ssa_owns(rename, var_index)) {
+                builder->exit_values[exit_index * builder->outputs.size + i] = rename->current[var_index];
+            }
+        }
+    }
+    
+    struct edge_list *succ_edge = cfg->out[block_index];
+    while (succ_edge) {
+        u32 succ_index = succ_edge->data;
+        u32 pred_index = cfg_whichpred(cfg, succ_index, block_index);
+        
+        // NOTE: OpPhi's are always the first instructions of a block
+        for (u32 i = rename->block_first[succ_index]; i < rename->block_first[succ_index + 1]; ++i) {
+            struct instruction_t *inst = &rename->instructions[i]->data;
+            if (inst->opcode != OpPhi) {
+                break;
+            }
+            inst->OpPhi.variables[pred_index] = ssa_current(rename, ssa_phi_variable(builder, inst));
+        }
+        
+        succ_edge = succ_edge->next;
+    }
+}
+
+// NOTE: phi functions go to the iterated dominance frontier of the blocks
+// which store to the variable
+static void *
+ssa_place_phis(void *data)
+{
+    struct ssa_rename *rename = data;
+    struct ssa_builder *builder = rename->builder;
+    u32 block_count = builder->file->cfg.labels.size;
+    u32 *has_phi = calloc(block_count, sizeof(u32));
+    u32 *enqueued = calloc(block_count, sizeof(u32));
+    
+    for (u32 var_index = ssa_first_owned(rename); var_index < ssa_end_owned(rename); ++var_index) {
+        builder->phi_blocks[var_index] = ssa_dominance_frontier(builder->df, builder->store_blocks + var_index, 
+                                                                has_phi, enqueued, var_index + 1);
+    }
+    
+    free(has_phi);
+    free(enqueued);
+    
+    return(NULL);
+}
+
+// NOTE: rename the worker's variables in one walk over the dominator tree. 
+// Versions defined in a block are undone on the way out
+static void *
+ssa_rename_variables(void *data)
+{
+    struct ssa_rename *rename = data;
+    struct ssa_builder *builder = rename->builder;
+    struct int_stack walk = stack_init();
+    
+    for (u32 var_index = ssa_first_owned(rename); var_index < ssa_end_owned(rename); ++var_index) {
+        rename->current[var_index] = builder->initial[var_index];
+    }
+    
+    stack_push(&walk, 0);
+    
+    while (walk.size) {
+        s32 block_index = stack_pop(&walk);
+        
+        if (block_index < 0) {
+            ssa_restore(rename, rename->undo_marks[-block_index - 1]);
+            continue;
+        }
+        
+        rename->undo_marks[block_index] = rename->undo.size;
+        ssa_traverse(rename, block_index);
+        
+        stack_push(&walk, -block_index - 1);
+        for (s32 child = builder->first_child[block_index]; child != -1; child = builder->next_sibling[child]) {
+            stack_push(&walk, child);
+        }
+    }
+    
+    stack_free(&walk);
+    
+    return(NULL);
+}
+
+static void
+ssa_run_workers(struct ssa_rename *renames, u32 worker_count, void *(*work)(void *))
+{
+    if (worker_count == 1) {
+        work(renames);
+        return;
+    }
+    
+    struct thread *threads = malloc(worker_count * sizeof(struct thread));
+    
+    for (u32 i = 0; i < worker_count; ++i) {
+        thread_start(threads + i, work, renames + i);
+    }
+    
+    for (u32 i = 0; i < worker_count; ++i) {
+        thread_join(threads + i);
+    }
+    
+    free(threads);
+}
+
+// NOTE: every worker gets the phi's, loads and stores of its variables in 
+// block order, so that the workers never look at each other's instructions
+static void
+ssa_distribute(struct ssa_builder *builder, struct ssa_rename *renames)
+{
+    u32 block_count = builder->file->cfg.labels.size;
+    
+    for (u32 pass = 0; pass < 2; ++pass) {
+        for (u32 block_index = 0; block_index < block_count; ++block_index) {
+            struct instruction_list *inst = builder->file->blocks[block_index].instructions;
+            
+            while (inst) {
+                s32 var_index = -1;
+                
+                if (inst->data.opcode == OpPhi) {
+                    var_index = ssa_phi_variable(builder, &inst->data);
+                } else if (inst->data.opcode == OpLoad) {
+                    var_index = ssa_renamed_variable(builder, inst->data.OpLoad.pointer);
+                } else if (inst->data.opcode == OpStore) {
+                    var_index = ssa_renamed_variable(builder, inst->data.OpStore.pointer);
+                }
+                
+                if (var_index != -1) {
+                    struct ssa_rename *rename = renames + ssa_worker(builder, var_index);
+                    if (pass == 0) {
+                        ++rename->block_first[block_index + 1];
+                    } else {
+                        rename->instructions[rename->block_first[block_index]++] = inst;
+                    }
+                }
+                
+                inst = inst->next;
+            }
+        }
+        
+        // NOTE: the first pass counts, the second one fills and moves each 
+        // 'block_first' to the end of the block, i.e. the start of the next one
+        for (u32 i = 0; i < builder->worker_count; ++i) {
+            struct ssa_rename *rename = renames + i;
+            if (pass == 0) {
+                for (u32 block_index = 0; block_index < block_count; ++block_index) {
+                    rename->block_first[block_index + 1] += rename->block_first[block_index];
+                }
+                rename->instructions = malloc(rename->block_first[block_count] * sizeof(struct instruction_list *));
+            } else {
+                memmove(rename->block_first + 1, rename->block_first, block_count * sizeof(u32));
+                rename->block_first[0] = 0;
+            }
+        }
+    }
+}
+
+// NOTE: 'selected' is indexed by variable id, NULL selects all promotable variables.
+// The selection is freed here, because splitting aggregates reallocates it
+static void
+ssa_convert_(struct ir *file, u32 thread_count, bool *selected)
+{
+    u32 block_count = file->cfg.labels.size;
+    
+    ssa_scalar_replace(file, &selected);
+    
+    struct cfg_dfs_result dfs = cfg_dfs(&file->cfg);
+    free(file->cfg.dominators);
+    file->cfg.dominators = cfg_dominators(&file->cfg, &dfs);
+    
+    struct ssa_variables variables = ssa_find_variables(file, selected);
+    u32 *store_counts = calloc(variables.count, sizeof(u32));
+    
+    struct ssa_builder builder = {
+        .file = file,
+        .variables = &variables,
+        .worker_count = (thread_count ? thread_count : 1),
+        .store_blocks = malloc(variables.count * sizeof(struct uint_vector)),
+        .phi_blocks = malloc(variables.count * sizeof(struct uint_vector)),
+        .first_child = malloc(block_count * sizeof(s32)),
+        .next_sibling = malloc(block_count * sizeof(s32)),
+        .outputs = vector_init(),
+        .exits = vector_init(),
+        .initial = calloc(variables.count, sizeof(u32)),
+        .first_version = malloc(variables.count * sizeof(u32)),
+        .next_version = malloc(variables.count * sizeof(u32)),
+        .undefs = calloc(file->header.bound, sizeof(u32))
+    };
+    
+    for (u32 var_index = 0; var_index < variables.count; ++var_index) {
+        builder.store_blocks[var_index] = vector_init();
+        if (variables.storage_classes[var_index] == StorageClassOutput) {
+            vector_push(&builder.outputs, var_index);
+        }
+    }
+    
+    // NOTE: find all OpStores to found OpVariables
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        struct instruction_list *instruction = file->blocks[block_index].instructions;
+        
+        if (!file->cfg.out[block_index]) {
+            vector_push(&builder.exits, block_index);
+        }
+        
+        while (instruction) {
+            if (instruction->data.opcode == OpStore) {
+                s32 store_to = variables.index[instruction->data.OpStore.pointer];
+                if (store_to != -1) {
+                    struct uint_vector *blocks = builder.store_blocks + store_to;
+                    // NOTE: blocks are visited in order, so a duplicate can only be the last one
+                    if (blocks->size == 0 || blocks->data[blocks->size - 1] != block_index) {
+                        vector_push(blocks, block_index);
+                    }
+                    ++store_counts[store_to];
+                }
+            }
+            instruction = instruction->next;
+        }
+    }
+    
+    u32 workers = builder.worker_count;
+    struct ssa_rename *renames = calloc(workers, sizeof(struct ssa_rename));
+    
+    builder.worker_size = (variables.count + workers - 1) / workers;
+    builder.worker_size = (builder.worker_size ? builder.worker_size : 1);
+    
+    for (u32 i = 0; i < workers; ++i) {
+        renames[i].builder = &builder;
+        renames[i].worker = i;
+    }
+    
+    builder.df = ssa_dominance_frontier_all(&file->cfg, &dfs);
+    ssa_run_workers(renames, workers, ssa_place_phis);
+    
+    // NOTE: the id ranges, in the order of variables: phi's, the loaded Input value
+    // and one version per store. OpUndef ids are reserved for all variable types
+    builder.first_id = file->header.bound;
+    
+    for (u32 var_index = 0; var_index < variables.count; ++var_index) {
+        builder.first_version[var_index] = file->header.bound;
+        file->header.bound += builder.phi_blocks[var_index].size;
+        
+        if (variables.storage_classes[var_index] == StorageClassInput && store_counts[var_index]) {
+            builder.initial[var_index] = file->header.bound++;
+        } else {
+            builder.initial[var_index] = ssa_initializer(variables.instructions[var_index]);
+        }
+        
+        builder.next_version[var_index] = file->header.bound;
+        file->header.bound += store_counts[var_index];
+    }
+    
+    builder.id_count = file->header.bound - builder.first_id;
+    builder.phi_variables = malloc(builder.id_count * sizeof(s32));
+    memset(builder.phi_variables, 0xFF, builder.id_count * sizeof(s32));
+    
+    for (u32 var_index = 0; var_index < variables.count; ++var_index) {
+        if (!builder.undefs[variables.types[var_index]]) {
+            builder.undefs[variables.types[var_index]] = file->header.bound++;
+        }
+    }
+    
+    for (u32 var_index = 0; var_index < variables.count; ++var_index) {
+        for (u32 i = 0; i < builder.phi_blocks[var_index].size; ++i) {
+            u32 soldier = builder.phi_blocks[var_index].data[i];
+            
+            u32 pred_count = 0;
+            struct edge_list *edge = file->cfg.in[soldier];
+            while (edge) {
+                ++pred_count;
+                edge = edge->next;
+            }
+            
+            struct instruction_t phi = {
+                .opcode = OpPhi,
+                .wordcount = 3 + pred_count * 2,
+                .unparsed_words = NULL
+            };
+            
+            phi.OpPhi.result_id = builder.first_version[var_index] + i;
+            phi.OpPhi.result_type = variables.types[var_index];
+            phi.OpPhi.variables = calloc(pred_count, sizeof(u32));
+            phi.OpPhi.parents = malloc(pred_count * sizeof(u32));
+            
+            u32 pred_index = 0;
+            edge = file->cfg.in[soldier];
             while (edge) {
-                u32 to = edge->data;
-                stack_push(&children_stack, to); // NOTE: used in DF-up some five lines below
-                if (cfg->dominators[to] != (s32) vertex) {
-                    vector_push(df + vertex, to);
-                }
+                phi.OpPhi.parents[pred_index++] = file->cfg.labels.data[edge->data];
                 edge = edge->next;
             }
+            
+            // NOTE: remember which variable this phi function resolves
+            builder.phi_variables[phi.OpPhi.result_id - builder.first_id] = var_index;
+            
+            // NOTE: there are no OpStore's inserted, so the phi's can go 
+            // straight to the beginning of the block
+            ir_prepend_instruction(file->blocks + soldier, phi);
         }
+    }
+    
+    // NOTE: loads of Input class variables, which are never written to, go to the entry block
+    struct instruction_list *entry_tail = ssa_entry_tail(file);
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        struct instruction_list *inst = file->blocks[block_index].instructions;
         
-        visited[vertex] = true;
-        
-        // NOTE: DF-up
-        while (children_stack.size > 0) {
-            u32 node = stack_pop(&children_stack);
-            if (visited[node]) {
-                continue;
+        while (inst) {
+            struct instruction_list *next = inst->next;
+            if (inst->data.opcode == OpLoad && variables.index[inst->data.OpLoad.pointer] != -1 && 
+                ssa_renamed_variable(&builder, inst->data.OpLoad.pointer) == -1) {
+                ssa_hoist_input(file, &entry_tail, block_index, inst);
             }
+            inst = next;
+        }
+    }
+    
+    memset(builder.first_child, 0xFF, block_count * sizeof(s32));
+    for (u32 i = block_count - 1; i > 0; --i) {
+        s32 parent = file->cfg.dominators[i];
+        if (parent != -1) {
+            builder.next_sibling[i] = builder.first_child[parent];
+            builder.first_child[parent] = i;
+        }
+    }
+    
+    builder.exit_values = calloc(builder.exits.size * builder.outputs.size, sizeof(u32));
+    
+    for (u32 i = 0; i < workers; ++i) {
+        renames[i].current = calloc(variables.count, sizeof(u32));
+        renames[i].undo = stack_init();
+        renames[i].undo_marks = malloc(block_count * sizeof(u32));
+        renames[i].undef_used = calloc(file->header.bound, sizeof(bool));
+        renames[i].block_first = calloc(block_count + 1, sizeof(u32));
+    }
+    
+    ssa_distribute(&builder, renames);
+    ssa_run_workers(renames, workers, ssa_rename_variables);
+    
+    // NOTE: everything the workers could not insert themselves, in a fixed order
+    for (u32 var_index = 0; var_index < variables.count; ++var_index) {
+        u32 type = variables.types[var_index];
+        bool used = false;
+        
+        for (u32 i = 0; i < workers; ++i) {
+            used |= renames[i].undef_used[type];
+            renames[i].undef_used[type] = false;
+        }
+        
+        if (used) {
+            struct instruction_t undef = {
+                .opcode = OpUndef,
+                .wordcount = 3,
+                .unparsed_words = NULL
+            };
             
-            for (u32 j = 0; j < df[node].size; ++j) {
-                u32 dfv = df[node].data[j];
-                if (cfg->dominators[dfv] != (s32) vertex) {
-                    vector_push_maybe(df + vertex, dfv);
-                }
-            }
+            undef.OpUndef.result_type = type;
+            undef.OpUndef.result_id = builder.undefs[type];
             
-            struct edge_list *edge = cfg->out[node];
-            while (edge) {
-                if (!visited[edge->data]) {
-                    stack_push(&children_stack, edge->data);
-                }
-                edge = edge->next;
+            ir_add_global(file, undef);
+        }
+    }
+    
+    for (u32 var_index = 0; var_index < variables.count; ++var_index) {
+        if (variables.storage_classes[var_index] == StorageClassInput && store_counts[var_index]) {
+            ssa_load_input(file, &entry_tail, &variables, var_index, builder.initial[var_index]);
+        }
+    }
+    
+    for (u32 exit_index = 0; exit_index < builder.exits.size; ++exit_index) {
+        for (u32 i = 0; i < builder.outputs.size; ++i) {
+            u32 version = builder.exit_values[exit_index * builder.outputs.size + i];
+            if (version) {
+                u32 var_index = builder.outputs.data[i];
+                ssa_store_output(file, builder.exits.data[exit_index], variables.ids[var_index], version);
             }
-            
-            visited[node] = true;
         }
     }
     
-    free(visited);
-    stack_free(&children_stack);
+    // NOTE: all the ids in the range of a variable are its versions
+    struct uint_vector names = vector_init();
+    for (u32 var_index = 0; var_index < variables.count; ++var_index) {
+        for (u32 id = builder.first_version[var_index]; id < builder.next_version[var_index]; ++id) {
+            vector_push(&names, id);
+            vector_push(&names, var_index);
+        }
+    }
     
-    return(df);
+    ssa_finish(file, &variables, &names);
+    
+    for (u32 i = 0; i < block_count; ++i) {
+        vector_free(builder.df + i);
+    }
+    
+    for (u32 var_index = 0; var_index < variables.count; ++var_index) {
+        vector_free(builder.store_blocks + var_index);
+        vector_free(builder.phi_blocks + var_index);
+    }
+    
+    for (u32 i = 0; i < workers; ++i) {
+        free(renames[i].current);
+        stack_free(&renames[i].undo);
+        free(renames[i].undo_marks);
+        free(renames[i].undef_used);
+        free(renames[i].instructions);
+        free(renames[i].block_first);
+    }
+    
+    free(renames);
+    free(builder.df);
+    free(builder.store_blocks);
+    free(builder.phi_blocks);
+    free(builder.first_child);
+    free(builder.next_sibling);
+    vector_free(&builder.outputs);
+    vector_free(&builder.exits);
+    free(builder.exit_values);
+    free(builder.initial);
+    free(builder.first_version);
+    free(builder.next_version);
+    free(builder.phi_variables);
+    free(builder.undefs);
+    vector_free(&names);
+    free(store_counts);
+    free(selected);
+    ssa_variables_free(&variables);
+    cfg_dfs_free(&dfs);
 }
 
-static struct uint_vector
-ssa_dominance_frontier_subset(struct ir_cfg *cfg, struct cfg_dfs_result *dfs, struct uint_vector *vertices)
+void
+ssa_convert_parallel(struct ir *file, u32 thread_count)
+{
+    ssa_convert_(file, thread_count, NULL);
+}
+
+void
+ssa_convert(struct ir *file)
+{
+    ssa_convert_(file, 1, NULL);
+}
+
+void
+ssa_convert_selected(struct ir *file, bool (*select)(struct instruction_t *variable, void *data), void *data)
 {
-    struct uint_vector *df = ssa_dominance_frontier_all(cfg, dfs);
-    struct uint_vector total_df = vector_init();
+    bool *selected = calloc(file->header.bound, sizeof(bool));
     
-    for (u32 i = 0; i < vertices->size; ++i) {
-        u32 vertex = vertices->data[i];
-        for (u32 j = 0; j < df[vertex].size; ++j) {
-            vector_push_maybe(&total_df, df[vertex].data[j]); 
+    for (struct instruction_list *inst = file->pre_cfg; inst; inst = inst->next) {
+        if (inst->data.opcode == OpVariable) {
+            selected[inst->data.OpVariable.result_id] = select(&inst->data, data);
+        }
+    }
+    
+    for (u32 block_index = 0; block_index < file->cfg.labels.size; ++block_index) {
+        for (struct instruction_list *inst = file->blocks[block_index].instructions; inst; inst = inst->next) {
+            if (inst->data.opcode == OpVariable) {
+                selected[inst->data.OpVariable.result_id] = select(&inst->data, data);
+            }
         }
     }
     
-    return(total_df);
+    ssa_convert_(file, 1, selected);
 }
 
-static struct uint_vector
-ssa_iterate_frontier(struct ir_cfg *cfg, struct cfg_dfs_result *dfs, struct uint_vector *df,
-                     struct uint_vector *vertices)
+void
+ssa_convert_ids(struct ir *file, u32 *ids, u32 count)
+{
+    bool *selected = calloc(file->header.bound, sizeof(bool));
+    
+    for (u32 i = 0; i < count; ++i) {
+        if (ids[i] < file->header.bound) {
+            selected[ids[i]] = true;
+        }
+    }
+    
+    ssa_convert_(file, 1, selected);
+}
+
+// NOTE: the region of a structured loop is everything reachable from the
+// header without going through the merge block. Variables which are not selected 
+// stay at the head of the entry block, the hoisted Input loads are inserted after 
+// them (see ssa_insert_entry)
+void
+ssa_convert_loops(struct ir *file)
 {
+    bool *selected = calloc(file->header.bound, sizeof(bool));
     
-    struct uint_vector next_df;
-    while (true) {
-        // TODO: clear temp memory
-        struct uint_vector arg = vector_union(df, vertices);
-        next_df = ssa_dominance_frontier_subset(cfg, dfs, &arg);
+    for (u32 block_index = 0; block_index < file->cfg.labels.size; ++block_index) {
+        struct instruction_list *inst = file->blocks[block_index].instructions;
         
-        if (vector_unique_same(df, &next_df)) {
-            break;
-        } else {
-            vector_free(df);
-            df = &next_df;
+        while (inst && inst->data.opcode != OpLoopMerge) {
+            inst = inst->next;
         }
-    };
+        
+        if (!inst) {
+            continue;
+        }
+        
+        s32 merge_block = search_item_u32(file->cfg.labels.data, file->cfg.labels.size, 
+                                          inst->data.OpLoopMerge.merge_block);
+        struct uint_vector region = cfg_bfs_order_r(&file->cfg, block_index, merge_block);
+        
+        for (u32 i = 0; i < region.size; ++i) {
+            for (inst = file->blocks[region.data[i]].instructions; inst; inst = inst->next) {
+                if (inst->data.opcode == OpLoad) {
+                    selected[inst->data.OpLoad.pointer] = true;
+                } else if (inst->data.opcode == OpStore) {
+                    selected[inst->data.OpStore.pointer] = true;
+                } else if (inst->data.opcode == OpAccessChain) {
+                    selected[inst->data.OpAccessChain.base] = true;
+                }
+            }
+        }
+        
+        vector_free(&region);
+    }
     
-    return(next_df);
+    ssa_convert_(file, 1, selected);
 }
 
+// NOTE: SSA construction as per Braun et al. "Simple and Efficient Construction
+// of Static Single Assignment Form". Blocks are filled in reverse postorder and 
+// a block is sealed once all its predecessors are filled. Reads look the current
+// definition up on the fly, and phi functions which turn out to be trivial are 
+// removed right away. No dominator tree or dominance frontiers are needed.
+// This is a reference implementation and is slower than ssa_convert: a read walks
+// back block by block until it finds a definition, which costs up to blocks times
+// variables, while the renaming there costs blocks plus instructions
+#define SSA_BRAUN_MAX_DEPTH 256
+#define SSA_BRAUN_MAX_DEFS (1 << 24)
 
-static struct uint_vector
-ssa_dominance_frontier(struct ir_cfg *cfg, struct cfg_dfs_result *dfs, struct uint_vector *vertices)
+// NOTE: phi's only become instructions once it is known that they are not trivial,
+// until then the operands live in a shared pool
+struct ssa_braun_phi {
+    bool is_phi;
+    u32 operands;                  // NOTE: offset into the operand pool
+    u32 block;
+    u32 var_index;
+    u32 replacement;               // NOTE: the value this phi has been replaced with, 0 if none
+    s32 first_user;                // NOTE: head of the list of phi's using this phi, -1 if none
+    bool pending;                  // NOTE: operands have not been filled yet
+};
+
+struct ssa_braun {
+    struct ir *file;
+    struct ssa_variables *variables;
+    u32 *defs;                     // NOTE: block * variable count + variable index -> current definition
+    bool *sealed;
+    bool *cyclic;                  // NOTE: block is entered by a retreating edge
+    struct uint_vector *incomplete; // NOTE: phi's placed in a block before it was sealed
+    u32 first_id;
+    u32 phi_cap;
+    struct ssa_braun_phi *phis;    // NOTE: id - first_id -> phi information
+    struct uint_vector operands;
+    u32 *pred_counts;
+    struct uint_vector users;      // NOTE: (user phi, next) pairs, linked from 'first_user'
+    struct int_stack fill;         // NOTE: phi's to fill operands of
+    struct int_stack trivial;      // NOTE: phi's to check for triviality
+    struct uint_vector chain;
+    u32 *undefs;
+    struct uint_vector names;
+    struct instruction_list *entry_tail; // NOTE: where the next Input load goes, see ssa_entry_tail
+};
+
+static struct ssa_braun_phi *
+ssa_braun_phi(struct ssa_braun *braun, u32 id)
 {
-    struct uint_vector df1 = ssa_dominance_frontier_subset(cfg, dfs, vertices);
-    struct uint_vector dfp = ssa_iterate_frontier(cfg, dfs, &df1, vertices);
-    return(dfp);
+    if (id >= braun->first_id && id - braun->first_id < braun->phi_cap) {
+        struct ssa_braun_phi *phi = braun->phis + (id - braun->first_id);
+        if (phi->is_phi) {
+            return(phi);
+        }
+    }
+    return(NULL);
 }
 
-#if 0
 static u32
-ssa_insert_variable(struct ir *file, u32 block_index, struct instruction_t variable)
+ssa_braun_resolve(struct ssa_braun *braun, u32 id)
 {
-    u32 res_id = file->header.bound++;
-    variable.OpVariable.result_id = res_id;
-    ir_prepend_instruction(file->blocks + block_index, variable); // NOTE: only a copy is inserted
-    return(res_id);
+    struct ssa_braun_phi *phi = ssa_braun_phi(braun, id);
+    
+    while (phi && phi->replacement) {
+        id = phi->replacement;
+        phi = ssa_braun_phi(braun, id);
+    }
+    
+    return(id);
 }
-#endif
 
 static void
-ssa_delete_variable(struct ir *file, u32 id, struct basic_block *block, 
-                    struct instruction_list *instruction)
+ssa_braun_write(struct ssa_braun *braun, u32 var_index, u32 block_index, u32 value)
 {
-    if (block) {
-    	ir_delete_opname(file, id);
-    	// TODO: deletes things it shouldn't
-    	ir_delete_instruction(block, instruction);
-    } else {
-        // TODO: delete pre_cfg OpVariable and OpName, but not Output class!!!
+    braun->defs[(u64) block_index * braun->variables->count + var_index] = value;
+}
+
+static void
+ssa_braun_add_user(struct ssa_braun *braun, struct ssa_braun_phi *phi, u32 user)
+{
+    vector_push(&braun->users, user);
+    vector_push(&braun->users, phi->first_user);
+    phi->first_user = braun->users.size - 2;
+}
+
+static u32
+ssa_braun_new_phi(struct ssa_braun *braun, u32 var_index, u32 block_index)
+{
+    u32 id = braun->file->header.bound++;
+    
+    if (id - braun->first_id >= braun->phi_cap) {
+        u32 old_cap = braun->phi_cap;
+        braun->phi_cap = (id - braun->first_id + 1) * 2;
+        braun->phis = realloc(braun->phis, braun->phi_cap * sizeof(struct ssa_braun_phi));
+        memset(braun->phis + old_cap, 0, (braun->phi_cap - old_cap) * sizeof(struct ssa_braun_phi));
+    }
+    
+    struct ssa_braun_phi *phi = braun->phis + (id - braun->first_id);
+    phi->is_phi = true;
+    phi->operands = braun->operands.size;
+    phi->block = block_index;
+    phi->var_index = var_index;
+    phi->replacement = 0;
+    phi->first_user = -1;
+    phi->pending = true;
+    
+    for (u32 i = 0; i < braun->pred_counts[block_index]; ++i) {
+        vector_push(&braun->operands, 0);
     }
+    
+    return(id);
 }
 
+// NOTE: turn a phi which survived into an actual instruction
 static void
-ssa_traverse(struct ir *file, struct int_stack *versions, u32 counter, u32 data_type,
-             struct instruction_t *original_variable, struct uint_vector *mapping,
-             struct uint_vector *phi_functions, u32 var_index, u32 block_index)
+ssa_braun_emit_phi(struct ssa_braun *braun, u32 id)
 {
-    u32 variable = original_variable->OpVariable.result_id;
-    struct instruction_list *inst = file->blocks[block_index].instructions;
+    struct ir *file = braun->file;
+    struct ssa_braun_phi *info = ssa_braun_phi(braun, id);
+    u32 block_index = info->block;
+    u32 pred_count = braun->pred_counts[block_index];
     
+    struct instruction_t phi = {
+        .opcode = OpPhi,
+        .wordcount = 3 + pred_count * 2,
+        .unparsed_words = NULL
+    };
     
-    u32 out_edge_count = 0;
-    struct edge_list *out_edge = file->cfg.out[block_index];
-    bool is_termination_block = false;
+    phi.OpPhi.result_id = id;
+    phi.OpPhi.result_type = braun->variables->types[info->var_index];
+    phi.OpPhi.variables = malloc(pred_count * sizeof(u32));
+    phi.OpPhi.parents = malloc(pred_count * sizeof(u32));
     
-    while (out_edge) {
-        ++out_edge_count;
-        out_edge = out_edge->next;
+    u32 pred_index = 0;
+    struct edge_list *edge = file->cfg.in[block_index];
+    while (edge) {
+        phi.OpPhi.variables[pred_index] = ssa_braun_resolve(braun, braun->operands.data[info->operands + pred_index]);
+        phi.OpPhi.parents[pred_index] = file->cfg.labels.data[edge->data];
+        ++pred_index;
+        edge = edge->next;
     }
     
-    is_termination_block = (out_edge_count == 0);
+    ir_prepend_instruction(file->blocks + block_index, phi);
+}
+
+// NOTE: the value a variable has when entering the function. Input class variables
+// are loaded once in the entry block, everything else is either initialized or undefined
+static u32
+ssa_braun_entry_value(struct ssa_braun *braun, u32 var_index)
+{
+    struct ssa_variables *variables = braun->variables;
     
-    while (inst) {
-        // NOTE: use of variable
-        if (inst->data.opcode == OpLoad) {
-            if (inst->data.OpLoad.pointer == variable) {
-                if (original_variable->OpVariable.storage_class == 1 && versions->size == 0) {
-                    // NOTE: if this is the FIRST OpLoad of an Input class variable in the entry block
-                    // then move the instruction to the entry block
-                    ir_prepend_instruction(file->blocks + 0, inst->data);
-                    ir_delete_instruction(file->blocks + block_index, inst);
-                } else {
-                    inst->data.opcode = OpCopyObject;
-                    inst->data.wordcount = 4;
-                    // NOTE(genious): we REPLACE the OpLoad with OpCopyObject, but
-                    // PRESERVE the result id. This automatically resolves all 
-                    // references to this OpLoad!
-                    inst->data.OpCopyObject.result_type = data_type;
-                    inst->data.OpCopyObject.result_id = inst->data.OpLoad.result_id;
-                    
-                    u32 version = stack_top(versions);
-                    u32 version_id = mapping->data[version];
-                    inst->data.OpCopyObject.operand = version_id;
-                }
-            }
+    if (variables->storage_classes[var_index] == StorageClassInput) {
+        u32 value = braun->file->header.bound++;
+        ssa_load_input(braun->file, &braun->entry_tail, variables, var_index, value);
+        return(value);
+    } else if (ssa_initializer(variables->instructions[var_index])) {
+        return(ssa_initializer(variables->instructions[var_index]));
+    }
+    
+    return(ssa_undef(braun->file, braun->undefs, variables->types[var_index]));
+}
+
+// NOTE: walks up single predecessor chains without recursion, and remembers the 
+// result in every block on the way. A join point which is not on a cycle reads its
+// predecessors first and only gets a phi if they disagree. Otherwise the phi is
+// placed right away and queued to have its operands filled later, which breaks
+// cycles (and the recursion once it gets too deep)
+static u32
+ssa_braun_read(struct ssa_braun *braun, u32 var_index, u32 block_index, u32 depth)
+{
+    struct ir_cfg *cfg = &braun->file->cfg;
+    u32 chain_start = braun->chain.size;
+    u32 value;
+    
+    for (;;) {
+        value = braun->defs[(u64) block_index * braun->variables->count + var_index];
+        if (value) {
+            value = ssa_braun_resolve(braun, value);
+            break;
         }
         
-        // NOTE: new assignment to variable. Replace with OpCopyObject once again
-        // TODO(longterm): copy propogation
-        if (inst->data.opcode == OpStore) {
-            if (inst->data.OpStore.pointer == variable) {
-                u32 new_version = file->header.bound++;
-                u32 object = inst->data.OpStore.object; 
-                
-                char var_name[6] = { 's', 's', 'a', '0' + (u8) var_index, 0x00 };
-                ir_add_opname(file, new_version, var_name);
-                
-                if (counter < mapping->size) {
-                    mapping->data[counter] = new_version;
-                } else {
-                    vector_push(mapping, new_version);
+        struct edge_list *preds = cfg->in[block_index];
+        
+        if (!braun->sealed[block_index]) {
+            value = ssa_braun_new_phi(braun, var_index, block_index);
+            vector_push(braun->incomplete + block_index, value);
+            break;
+        } else if (!preds) {
+            value = ssa_braun_entry_value(braun, var_index);
+            break;
+        } else if (!preds->next) {
+            vector_push(&braun->chain, block_index);
+            block_index = preds->data;
+        } else {
+            bool same = !braun->cyclic[block_index] && depth < SSA_BRAUN_MAX_DEPTH;
+            
+            if (same) {
+                value = ssa_braun_read(braun, var_index, preds->data, depth + 1);
+                for (struct edge_list *edge = preds->next; edge && same; edge = edge->next) {
+                    same = (ssa_braun_read(braun, var_index, edge->data, depth + 1) == value);
                 }
-                
-                inst->data.opcode = OpCopyObject;
-                inst->data.wordcount = 4;
-                inst->data.OpCopyObject.result_type = data_type;
-                inst->data.OpCopyObject.result_id = new_version; 
-                inst->data.OpCopyObject.operand = object;
-                
-                stack_push(versions, counter);
-                ++counter;
             }
+            
+            // NOTE: the predecessors already have their values memoized, so filling
+            // this phi is cheap
+            if (!same) {
+                value = ssa_braun_new_phi(braun, var_index, block_index);
+                stack_push(&braun->fill, value);
+            }
+            break;
         }
-        
-        inst = inst->next;
     }
     
-    // NOTE: if this is a termination block, we need to insert one *special* OpStore
-    // and preserve it. It's an OpStore to the Output class variable
-    if (is_termination_block && original_variable->OpVariable.storage_class == 3) {
-        struct instruction_t store;
-        store.opcode = OpStore;
-        store.wordcount = 3;
-        store.unparsed_words = NULL;
-        
-        store.OpStore.pointer = original_variable->OpVariable.result_id;
-        store.OpStore.object = mapping->data[counter - 1];
-        
-        ir_append_instruction(file->blocks + block_index, store);
+    ssa_braun_write(braun, var_index, block_index, value);
+    for (u32 i = chain_start; i < braun->chain.size; ++i) {
+        ssa_braun_write(braun, var_index, braun->chain.data[i], value);
     }
     
-    struct edge_list *succ_edge = file->cfg.out[block_index];
-    u32 succ_order = 0;
-    while (succ_edge) {
-        u32 succ_index = succ_edge->data;
-        u32 pred_index = cfg_whichpred(&file->cfg, succ_index, block_index);
-        struct basic_block *succ = file->blocks + succ_index;
-        struct instruction_list *succ_inst = succ->instructions;
+    braun->chain.size = chain_start;
+    
+    return(value);
+}
+
+static void
+ssa_braun_fill(struct ssa_braun *braun, u32 id)
+{
+    struct ssa_braun_phi *phi = ssa_braun_phi(braun, id);
+    u32 block_index = phi->block;
+    u32 var_index = phi->var_index;
+    u32 pred_index = 0;
+    
+    struct edge_list *edge = braun->file->cfg.in[block_index];
+    while (edge) {
+        u32 value = ssa_braun_read(braun, var_index, edge->data, 0);
+        struct ssa_braun_phi *operand = ssa_braun_phi(braun, value);
         
-        while (succ_inst) {
-            if (succ_inst->data.opcode == OpPhi && search_item_u32(phi_functions->data, phi_functions->size, succ_inst->data.OpPhi.result_id) != -1) {
-                u32 version = stack_top(versions);
-                succ_inst->data.OpPhi.variables[pred_index] = mapping->data[version];
-                succ_inst->data.OpPhi.parents[pred_index] = file->cfg.labels.data[block_index];
-            }
-            succ_inst = succ_inst->next;
+        if (operand) {
+            ssa_braun_add_user(braun, operand, id);
         }
         
-        ++succ_order;
-        succ_edge = succ_edge->next;
+        // NOTE: the phi array might have been moved by the read
+        braun->operands.data[ssa_braun_phi(braun, id)->operands + pred_index++] = value;
+        edge = edge->next;
     }
     
-    for (u32 i = 0; i < file->cfg.labels.size; ++i) {
-        if (file->cfg.dominators[i] == (s32) block_index) {
-            ssa_traverse(file, versions, counter, data_type, original_variable, mapping, phi_functions, var_index, i);
+    phi = ssa_braun_phi(braun, id);
+    phi->pending = false;
+    stack_push(&braun->trivial, id);
+}
+
+// NOTE: a phi which only references itself and one other value is replaced
+// with that value. Phi's using it might become trivial too
+static void
+ssa_braun_try_remove(struct ssa_braun *braun, u32 id)
+{
+    struct ssa_braun_phi *phi = ssa_braun_phi(braun, id);
+    
+    if (phi->pending || phi->replacement) {
+        return;
+    }
+    
+    u32 operand_count = braun->pred_counts[phi->block];
+    u32 same = 0;
+    
+    for (u32 i = 0; i < operand_count; ++i) {
+        u32 operand = ssa_braun_resolve(braun, braun->operands.data[phi->operands + i]);
+        if (operand == same || operand == id) {
+            continue;
         }
+        if (same) {
+            return;
+        }
+        same = operand;
     }
     
-    inst = file->blocks[block_index].instructions;
-    while (inst) {
-        if (inst->data.opcode == OpStore) {
-            if (search_item_u32(mapping->data, mapping->size, inst->data.OpStore.pointer) != -1) { 
-                stack_pop(versions);
+    if (!same) {
+        // NOTE: the phi is unreachable or in the start block
+        same = ssa_undef(braun->file, braun->undefs, braun->variables->types[phi->var_index]);
+    }
+    
+    phi->replacement = same;
+    
+    struct ssa_braun_phi *target = ssa_braun_phi(braun, same);
+    s32 user = phi->first_user;
+    
+    while (user != -1) {
+        u32 user_id = braun->users.data[user];
+        s32 next = braun->users.data[user + 1];
+        
+        if (user_id != id) {
+            stack_push(&braun->trivial, user_id);
+            
+            // NOTE: users of this phi now use the replacement
+            if (target) {
+                braun->users.data[user + 1] = target->first_user;
+                target->first_user = user;
             }
         }
-        inst = inst->next;
+        
+        user = next;
     }
+    
+    phi->first_user = -1;
 }
 
-static u32
-get_variable_type(struct ir *file, u32 pointer_type)
+static void
+ssa_braun_drain(struct ssa_braun *braun)
 {
-    struct instruction_list *inst = file->pre_cfg;
-    while (inst) {
-        if (inst->data.opcode == OpTypePointer) {
-            if (inst->data.OpTypePointer.result_id == pointer_type) {
-                return(inst->data.OpTypePointer.type);
-            }
+    while (braun->fill.size || braun->trivial.size) {
+        if (braun->fill.size) {
+            ssa_braun_fill(braun, stack_pop(&braun->fill));
+        } else {
+            ssa_braun_try_remove(braun, stack_pop(&braun->trivial));
         }
-        inst = inst->next;
     }
-    
-    SHOULDNOTHAPPEN;
 }
 
-void
-ssa_convert(struct ir *file)
+static u32
+ssa_braun_use(struct ssa_braun *braun, u32 var_index, u32 block_index)
+{
+    u32 value = ssa_braun_read(braun, var_index, block_index, 0);
+    ssa_braun_drain(braun);
+    return(value);
+}
+
+static void
+ssa_braun_seal(struct ssa_braun *braun, u32 block_index)
 {
-    struct uint_vector variables = vector_init();
+    struct uint_vector *phis = braun->incomplete + block_index;
     
-    // TODO: count and malloc
-    struct instruction_list *variable_instructions[100];
-    struct basic_block *variable_blocks[100];
-    u32 variable_types[100];
+    for (u32 i = 0; i < phis->size; ++i) {
+        stack_push(&braun->fill, phis->data[i]);
+    }
     
-    struct cfg_dfs_result dfs = cfg_dfs(&file->cfg); // NOTE: need postorder for DF
+    phis->size = 0;
+    braun->sealed[block_index] = true;
     
-    // NOTE: find all OpVariables and their data types
-    {
-        struct instruction_list *instruction = file->pre_cfg;
-        while (instruction) {
-            if (instruction->data.opcode == OpVariable) {
-                variable_instructions[variables.head] = instruction;
-                variable_blocks[variables.head] = NULL;
-                variable_types[variables.head] = get_variable_type(file, instruction->data.OpVariable.result_type);
-                vector_push(&variables, instruction->data.OpVariable.result_id);
+    ssa_braun_drain(braun);
+}
+
+static void
+ssa_braun_block(struct ssa_braun *braun, u32 *store_counts, struct uint_vector *outputs, u32 block_index)
+{
+    struct ir *file = braun->file;
+    struct ssa_variables *variables = braun->variables;
+    struct instruction_list *inst = file->blocks[block_index].instructions;
+    
+    while (inst) {
+        struct instruction_list *next = inst->next;
+        
+        if (inst->data.opcode == OpLoad) {
+            s32 var_index = variables->index[inst->data.OpLoad.pointer];
+            if (var_index != -1) {
+                if (store_counts[var_index]) {
+                    u32 value = ssa_braun_use(braun, var_index, block_index);
+                    ssa_rewrite_load(&inst->data, variables->types[var_index], value);
+                } else if (variables->storage_classes[var_index] == StorageClassInput) {
+                    ssa_hoist_input(file, &braun->entry_tail, block_index, inst);
+                } else {
+                    u32 value = ssa_braun_entry_value(braun, var_index);
+                    ssa_rewrite_load(&inst->data, variables->types[var_index], value);
+                }
+            }
+        } else if (inst->data.opcode == OpStore) {
+            s32 var_index = variables->index[inst->data.OpStore.pointer];
+            if (var_index != -1) {
+                u32 new_version = file->header.bound++;
+                
+                vector_push(&braun->names, new_version);
+                vector_push(&braun->names, var_index);
+                
+                ssa_rewrite_store(&inst->data, variables->types[var_index], new_version);
+                ssa_braun_write(braun, var_index, block_index, new_version);
             }
-            instruction = instruction->next;
         }
+        
+        inst = next;
     }
     
-    for (u32 i = 0; i < file->cfg.labels.size; ++i) {
-        struct basic_block *block = file->blocks + i;
-        struct instruction_list *instruction = block->instructions;
-        bool reading = false;
-        
-        while (instruction) {
-            if (instruction->data.opcode == OpVariable) {
-                reading = true;
-                variable_instructions[variables.head] = instruction;
-                variable_blocks[variables.head] = file->blocks + i;
-                variable_types[variables.head] = get_variable_type(file, instruction->data.OpVariable.result_type);
-                vector_push(&variables, instruction->data.OpVariable.result_id);
-            } else if (reading) {
-                // NOTE: we've read all OpVariables. 
-                // This is based on the SPIR-V specification!
-                break;
+    if (!file->cfg.out[block_index]) {
+        for (u32 i = 0; i < outputs->size; ++i) {
+            u32 var_index = outputs->data[i];
+            if (store_counts[var_index]) {
+                u32 value = ssa_braun_use(braun, var_index, block_index);
+                ssa_store_output(file, block_index, variables->ids[var_index], value);
             }
-            instruction = instruction->next;
         }
     }
+}
+
+void
+ssa_convert_braun(struct ir *file)
+{
+    u32 block_count = file->cfg.labels.size;
+    bool *selected = NULL;
     
+    ssa_scalar_replace(file, &selected);
     
-    struct uint_vector *store_blocks = malloc(variables.size * sizeof(struct uint_vector));
+    struct ssa_variables variables = ssa_find_variables(file, NULL);
     
-    for (u32 i = 0; i < variables.size; ++i) {
-        store_blocks[i] = vector_init();
+    // NOTE: the current definitions are kept per block and variable. This is cheap
+    // for shaders, but huge functions with lots of variables are better off with
+    // the pruned phi placement of the dominance frontier based construction
+    if ((u64) block_count * variables.count > SSA_BRAUN_MAX_DEFS) {
+        ssa_variables_free(&variables);
+        ssa_convert(file);
+        return;
     }
     
-    // NOTE: find all OpStores to found OpVariables
-    for (u32 block_index = 0; block_index < file->cfg.labels.size; ++block_index) {
-        struct basic_block *block = file->blocks + block_index;
-        struct instruction_list *instruction = block->instructions;
+    struct cfg_dfs_result dfs = cfg_dfs(&file->cfg);
+    
+    struct ssa_braun braun = {
+        .file = file,
+        .variables = &variables,
+        .defs = calloc((u64) block_count * variables.count, sizeof(u32)),
+        .sealed = calloc(block_count, sizeof(bool)),
+        .cyclic = calloc(block_count, sizeof(bool)),
+        .incomplete = malloc(block_count * sizeof(struct uint_vector)),
+        .first_id = file->header.bound,
+        .phi_cap = 0,
+        .phis = NULL,
+        .operands = vector_init(),
+        .users = vector_init(),
+        .fill = stack_init(),
+        .trivial = stack_init(),
+        .chain = vector_init(),
+        .undefs = calloc(file->header.bound, sizeof(u32)),
+        .names = vector_init(),
+        .entry_tail = ssa_entry_tail(file)
+    };
+    
+    u32 *store_counts = calloc(variables.count, sizeof(u32));
+    u32 *filled = calloc(block_count, sizeof(u32));
+    u32 *pred_counts = calloc(block_count, sizeof(u32));
+    struct uint_vector outputs = vector_init();
+    
+    braun.pred_counts = pred_counts;
+    
+    for (u32 var_index = 0; var_index < variables.count; ++var_index) {
+        if (variables.storage_classes[var_index] == StorageClassOutput) {
+            vector_push(&outputs, var_index);
+        }
+    }
+    
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        braun.incomplete[block_index] = vector_init();
+        
+        for (struct edge_list *edge = file->cfg.in[block_index]; edge; edge = edge->next) {
+            ++pred_counts[block_index];
+        }
         
+        struct instruction_list *instruction = file->blocks[block_index].instructions;
         while (instruction) {
             if (instruction->data.opcode == OpStore) {
-                u32 store_to = search_item_u32(variables.data, variables.size, 
-                                               instruction->data.OpStore.pointer);
-                vector_push_maybe(store_blocks + store_to, block_index);
+                s32 store_to = variables.index[instruction->data.OpStore.pointer];
+                if (store_to != -1) {
+                    ++store_counts[store_to];
+                }
             }
             instruction = instruction->next;
         }
     }
     
-    struct uint_vector *phi_functions = malloc(sizeof(struct uint_vector) * variables.size);
-    for (u32 var_index = 0; var_index < variables.size; ++var_index) {
-        phi_functions[var_index] = vector_init();
+    // NOTE: every cycle has an edge going backwards in reverse postorder. Its
+    // target needs a phi before the predecessors are read
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        for (struct edge_list *edge = file->cfg.in[block_index]; edge; edge = edge->next) {
+            bool unreachable = (edge->data != 0 && dfs.preorder[edge->data] == 0);
+            if (unreachable || dfs.postorder[edge->data] <= dfs.postorder[block_index]) {
+                braun.cyclic[block_index] = true;
+            }
+        }
     }
     
-    // NOTE: insert phi functions. Delay inserting phi's, as there could be multiple OpPhi's
-    // and they all have to be first instructions of the block. So we prepend all the OpStore's first
-    // and only then prepend all OpPhi's
-    struct instruction_t phi_queue[100];
-    u32 phi_blocks[100];
-    u32 delayed_phis = 0;
+    braun.sealed[0] = true;
     
-    for (u32 var_index = 0; var_index < variables.size; ++var_index) {
-        struct instruction_t variable = variable_instructions[var_index]->data;
-        if (store_blocks[var_index].size > 1) {
-            struct uint_vector df = ssa_dominance_frontier(&file->cfg, &dfs, store_blocks + var_index);
-            for (u32 soldier_index = 0; soldier_index < df.size; ++soldier_index) {
-                u32 soldier = df.data[soldier_index];
-                struct edge_list *edge = file->cfg.in[soldier];
-                
-                u32 pred_count = 0;
-                while (edge) {
-                    ++pred_count;
-                    edge = edge->next;
-                }
-                
-                struct instruction_t phi = {
-                    .opcode = OpPhi,
-                    .wordcount = 3 + pred_count * 2 
-                };
-                
-                phi.OpPhi.result_id = file->header.bound++;
-                phi.OpPhi.result_type = variable_types[var_index];
-                phi.OpPhi.variables = malloc(pred_count * sizeof(u32));
-                phi.OpPhi.parents = malloc(pred_count * sizeof(u32));
-                
-                // NOTE: remember which variable this phi function resolves
-                vector_push(phi_functions + var_index, phi.OpPhi.result_id);
-                
-                // NOTE: insert OpStore to later be replaced with OpCopyObject
-                struct instruction_t store = {
-                    .opcode = OpStore,
-                    .wordcount = 3
-                };
-                
-                store.OpStore.pointer = variable.OpVariable.result_id;
-                store.OpStore.object = phi.OpPhi.result_id;
-                
-                ir_prepend_instruction(file->blocks + soldier, store);
-                
-                phi_blocks[delayed_phis] = soldier;
-                phi_queue[delayed_phis] = phi;
-                ++delayed_phis;
+    for (u32 i = dfs.size; i > 0; --i) {
+        u32 block_index = dfs.sorted_postorder[i - 1];
+        
+        ssa_braun_block(&braun, store_counts, &outputs, block_index);
+        
+        for (struct edge_list *edge = file->cfg.out[block_index]; edge; edge = edge->next) {
+            if (++filled[edge->data] == pred_counts[edge->data]) {
+                ssa_braun_seal(&braun, edge->data);
             }
         }
     }
     
-    for (u32 i = 0; i < delayed_phis; ++i) {
-        ir_prepend_instruction(file->blocks + phi_blocks[i], phi_queue[i]);
+    // NOTE: blocks with unreachable predecessors never get all of them filled
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        if (!braun.sealed[block_index]) {
+            ssa_braun_seal(&braun, block_index);
+        }
     }
     
-    // NOTE: insert/rename SSA variables
-    struct int_stack versions = stack_init();
-    struct uint_vector *mapping = malloc(sizeof(struct uint_vector) * variables.size);
+    // NOTE: values which were read before a phi was found to be trivial 
+    // still reference that phi, resolve them to the replacement
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        struct instruction_list *inst = file->blocks[block_index].instructions;
+        
+        while (inst) {
+            if (inst->data.opcode == OpCopyObject) {
+                inst->data.OpCopyObject.operand = ssa_braun_resolve(&braun, inst->data.OpCopyObject.operand);
+            } else if (inst->data.opcode == OpStore) {
+                inst->data.OpStore.object = ssa_braun_resolve(&braun, inst->data.OpStore.object);
+            }
+            inst = inst->next;
+        }
+    }
     
-    for (u32 var_index = 0; var_index < variables.size; ++var_index) {
-        mapping[var_index] = vector_init();
-        // TODO: move storage class to enum
-        if (variable_blocks[var_index] == NULL && variable_instructions[var_index]->data.OpVariable.storage_class == 1) {
-            vector_push(mapping + var_index, variables.data[var_index]);
+    for (u32 i = 0; i < braun.phi_cap; ++i) {
+        struct ssa_braun_phi *phi = braun.phis + i;
+        if (phi->is_phi && !phi->replacement) {
+            ssa_braun_emit_phi(&braun, braun.first_id + i);
+            vector_push(&braun.names, braun.first_id + i);
+            vector_push(&braun.names, phi->var_index);
         }
     }
     
-    for (u32 var_index = 0; var_index < variables.size; ++var_index) {
-        struct instruction_t original_variable = variable_instructions[var_index]->data;
-        stack_clear(&versions);
-        ssa_traverse(file, &versions, 0, variable_types[var_index], &original_variable, mapping + var_index, 
-                     phi_functions + var_index, var_index, 0);
-        ssa_delete_variable(file, original_variable.OpVariable.result_id, 
-                            variable_blocks[var_index], variable_instructions[var_index]);
+    ssa_finish(file, &variables, &braun.names);
+    
+    for (u32 block_index = 0; block_index < block_count; ++block_index) {
+        vector_free(braun.incomplete + block_index);
     }
+    
+    free(braun.defs);
+    free(braun.sealed);
+    free(braun.cyclic);
+    free(braun.incomplete);
+    free(braun.phis);
+    vector_free(&braun.operands);
+    vector_free(&braun.users);
+    stack_free(&braun.fill);
+    stack_free(&braun.trivial);
+    vector_free(&braun.chain);
+    free(braun.undefs);
+    vector_free(&braun.names);
+    free(store_counts);
+    free(filled);
+    free(pred_counts);
+    vector_free(&outputs);
+    ssa_variables_free(&variables);
+    cfg_dfs_free(&dfs);
 }
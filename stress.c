@@ -0,0 +1,304 @@
+#include <time.h>
+
+#include "headers.h"
+
+#include "opt.c"
+
+// NOTE: generates a synthetic fragment shader with a given number of Function
+// class variables and (roughly) a given number of instructions, and measures how
+// the passes scale. The control flow is a chain of if-else diamonds and loops,
+// each block does a handful of 'c = a + b' statements on random variables
+
+enum stress_ids {
+    STRESS_VOID = 1,
+    STRESS_FN,
+    STRESS_INT,
+    STRESS_BOOL,
+    STRESS_PTR_FUNCTION,
+    STRESS_PTR_INPUT,
+    STRESS_PTR_OUTPUT,
+    STRESS_ZERO,
+    STRESS_ONE,
+    STRESS_CONDITION,
+    STRESS_INPUT,
+    STRESS_OUTPUT,
+    STRESS_MAIN,
+    STRESS_FIRST_VARIABLE
+};
+
+static const u32 STATEMENTS_PER_BLOCK = 8;
+
+struct stress_module {
+    struct uint_vector words;
+    u32 bound;
+    u32 variables;
+    u32 instructions;
+    u32 blocks;
+    u32 seed;
+};
+
+static void
+stress_op(struct stress_module *module, enum opcode_t opcode, u32 *operands, u32 count)
+{
+    vector_push(&module->words, opcode | ((count + 1) << 16));
+    for (u32 i = 0; i < count; ++i) {
+        vector_push(&module->words, operands[i]);
+    }
+}
+
+static u32
+stress_random(struct stress_module *module, u32 range)
+{
+    // NOTE: Numerical Recipes LCG, good enough to scatter variable accesses
+    module->seed = module->seed * 1664525u + 1013904223u;
+    return((module->seed >> 8) % range);
+}
+
+static u32
+stress_label(struct stress_module *module)
+{
+    u32 label = module->bound++;
+    stress_op(module, OpLabel, (u32[]) { label }, 1);
+    ++module->blocks;
+    return(label);
+}
+
+static void
+stress_statements(struct stress_module *module)
+{
+    for (u32 i = 0; i < STATEMENTS_PER_BLOCK; ++i) {
+        u32 a = module->bound++;
+        u32 b = module->bound++;
+        u32 c = module->bound++;
+        u32 from = STRESS_FIRST_VARIABLE + stress_random(module, module->variables);
+        u32 to = STRESS_FIRST_VARIABLE + stress_random(module, module->variables);
+        
+        // NOTE: every fourth statement reads an invariant Input instead
+        u32 pointer = (i % 4 == 0 ? STRESS_INPUT : STRESS_FIRST_VARIABLE + stress_random(module, module->variables));
+        
+        stress_op(module, OpLoad, (u32[]) { STRESS_INT, a, from }, 3);
+        stress_op(module, OpLoad, (u32[]) { STRESS_INT, b, pointer }, 3);
+        stress_op(module, OpIAdd, (u32[]) { STRESS_INT, c, a, b }, 4);
+        stress_op(module, OpStore, (u32[]) { to, c }, 2);
+    }
+    
+    module->instructions += STATEMENTS_PER_BLOCK * 4;
+}
+
+static struct stress_module
+stress_generate(u32 variables, u32 instructions)
+{
+    struct stress_module module = {
+        .words = vector_init_sized(instructions * 4),
+        .bound = STRESS_FIRST_VARIABLE + variables,
+        .variables = variables,
+        .seed = 12345
+    };
+    
+    u32 main_name[] = { 0x6E69616D, 0x00000000 }; // NOTE: "main"
+    
+    // NOTE: header, the bound is patched in the end
+    u32 header[] = { 0x07230203, 0x00010000, 0, 0, 0 };
+    for (u32 i = 0; i < 5; ++i) {
+        vector_push(&module.words, header[i]);
+    }
+    
+    stress_op(&module, 17, (u32[]) { 1 }, 1);    // NOTE: OpCapability Shader
+    stress_op(&module, 14, (u32[]) { 0, 1 }, 2); // NOTE: OpMemoryModel Logical GLSL450
+    stress_op(&module, OpEntryPoint, (u32[]) { 4, STRESS_MAIN, main_name[0], main_name[1], STRESS_INPUT, STRESS_OUTPUT }, 6);
+    stress_op(&module, OpExecutionMode, (u32[]) { STRESS_MAIN, 7 }, 2);
+    stress_op(&module, OpName, (u32[]) { STRESS_MAIN, main_name[0], main_name[1] }, 3);
+    
+    stress_op(&module, 19, (u32[]) { STRESS_VOID }, 1);                // NOTE: OpTypeVoid
+    stress_op(&module, 33, (u32[]) { STRESS_FN, STRESS_VOID }, 2);     // NOTE: OpTypeFunction
+    stress_op(&module, 21, (u32[]) { STRESS_INT, 32, 1 }, 3);          // NOTE: OpTypeInt
+    stress_op(&module, 20, (u32[]) { STRESS_BOOL }, 1);                // NOTE: OpTypeBool
+    stress_op(&module, OpTypePointer, (u32[]) { STRESS_PTR_FUNCTION, StorageClassFunction, STRESS_INT }, 3);
+    stress_op(&module, OpTypePointer, (u32[]) { STRESS_PTR_INPUT, StorageClassInput, STRESS_INT }, 3);
+    stress_op(&module, OpTypePointer, (u32[]) { STRESS_PTR_OUTPUT, StorageClassOutput, STRESS_INT }, 3);
+    stress_op(&module, 43, (u32[]) { STRESS_INT, STRESS_ZERO, 0 }, 3); // NOTE: OpConstant
+    stress_op(&module, 43, (u32[]) { STRESS_INT, STRESS_ONE, 1 }, 3);
+    stress_op(&module, 41, (u32[]) { STRESS_BOOL, STRESS_CONDITION }, 2); // NOTE: OpConstantTrue
+    stress_op(&module, OpVariable, (u32[]) { STRESS_PTR_INPUT, STRESS_INPUT, StorageClassInput }, 3);
+    stress_op(&module, OpVariable, (u32[]) { STRESS_PTR_OUTPUT, STRESS_OUTPUT, StorageClassOutput }, 3);
+    
+    stress_op(&module, OpFunction, (u32[]) { STRESS_VOID, STRESS_MAIN, 0, STRESS_FN }, 4);
+    stress_label(&module);
+    
+    for (u32 i = 0; i < variables; ++i) {
+        stress_op(&module, OpVariable, (u32[]) { STRESS_PTR_FUNCTION, STRESS_FIRST_VARIABLE + i, StorageClassFunction }, 3);
+    }
+    
+    for (u32 i = 0; i < variables; ++i) {
+        stress_op(&module, OpStore, (u32[]) { STRESS_FIRST_VARIABLE + i, STRESS_ZERO }, 2);
+    }
+    
+    module.instructions = variables * 2;
+    
+    while (module.instructions < instructions) {
+        u32 merge = module.bound++;
+        u32 first = module.bound++;
+        u32 second = module.bound++;
+        
+        if (stress_random(&module, 4) == 0) {
+            // NOTE: loop, 'first' is the body and 'second' is the continue target
+            u32 header = module.bound++;
+            stress_op(&module, OpBranch, (u32[]) { header }, 1);
+            
+            stress_op(&module, OpLabel, (u32[]) { header }, 1);
+            stress_op(&module, OpLoopMerge, (u32[]) { merge, second, 0 }, 3);
+            stress_op(&module, OpBranchConditional, (u32[]) { STRESS_CONDITION, first, merge }, 3);
+            
+            stress_op(&module, OpLabel, (u32[]) { first }, 1);
+            stress_statements(&module);
+            stress_op(&module, OpBranch, (u32[]) { second }, 1);
+            
+            stress_op(&module, OpLabel, (u32[]) { second }, 1);
+            stress_statements(&module);
+            stress_op(&module, OpBranch, (u32[]) { header }, 1);
+            
+            module.blocks += 3;
+            module.instructions += 6;
+        } else {
+            // NOTE: if-else diamond
+            stress_op(&module, OpSelectionMerge, (u32[]) { merge, 0 }, 2);
+            stress_op(&module, OpBranchConditional, (u32[]) { STRESS_CONDITION, first, second }, 3);
+            
+            stress_op(&module, OpLabel, (u32[]) { first }, 1);
+            stress_statements(&module);
+            stress_op(&module, OpBranch, (u32[]) { merge }, 1);
+            
+            stress_op(&module, OpLabel, (u32[]) { second }, 1);
+            stress_statements(&module);
+            stress_op(&module, OpBranch, (u32[]) { merge }, 1);
+            
+            module.blocks += 2;
+            module.instructions += 6;
+        }
+        
+        stress_op(&module, OpLabel, (u32[]) { merge }, 1);
+        ++module.blocks;
+    }
+    
+    u32 result = module.bound++;
+    stress_op(&module, OpLoad, (u32[]) { STRESS_INT, result, STRESS_FIRST_VARIABLE }, 3);
+    stress_op(&module, OpStore, (u32[]) { STRESS_OUTPUT, result }, 2);
+    stress_op(&module, OpReturn, NULL, 0);
+    stress_op(&module, 56, NULL, 0); // NOTE: OpFunctionEnd
+    
+    module.words.data[3] = module.bound;
+    
+    return(module);
+}
+
+static u32 stress_threads = 1;
+
+// NOTE: wall clock time, CPU time would add up the time of all the threads
+static f64
+stress_now(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER now;
+    LARGE_INTEGER frequency;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&frequency);
+    return(now.QuadPart * 1000.0 / frequency.QuadPart);
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return(now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0);
+#endif
+}
+
+static f64
+stress_ms(f64 start)
+{
+    return(stress_now() - start);
+}
+
+static void
+stress_ssa_parallel(struct ir *file)
+{
+    ssa_convert_parallel(file, stress_threads);
+}
+
+static f64
+stress_time_ssa(struct stress_module *module, void (*convert)(struct ir *), u32 repeat)
+{
+    f64 total = 0.0;
+    
+    // NOTE: both modes get the same, freshly parsed input every time
+    for (u32 i = 0; i < repeat; ++i) {
+        struct ir file = ir_eat(module->words.data, module->words.size, false);
+        
+        f64 start = stress_now();
+        convert(&file);
+        total += stress_ms(start);
+        
+        ir_destroy(&file);
+    }
+    
+    return(total / repeat);
+}
+
+static void
+stress_run(u32 variables, u32 instructions, u32 repeat, const char *filename)
+{
+    struct stress_module module = stress_generate(variables, instructions);
+    
+    if (filename) {
+        FILE *stream = fopen(filename, "wb");
+        if (!stream) {
+            fprintf(stderr, "[ERROR] Can not write output\n");
+            exit(1);
+        }
+        fwrite(module.words.data, module.words.size * sizeof(u32), 1, stream);
+        fclose(stream);
+    }
+    
+    f64 start = stress_now();
+    struct ir file = ir_eat(module.words.data, module.words.size, false);
+    f64 parse_ms = stress_ms(start);
+    
+    f64 ssa_ms = stress_time_ssa(&module, ssa_convert, repeat);
+    f64 ssa_braun_ms = stress_time_ssa(&module, ssa_convert_braun, repeat);
+    f64 ssa_parallel_ms = stress_time_ssa(&module, stress_ssa_parallel, repeat);
+    
+    ssa_convert(&file);
+    
+    start = stress_now();
+    loop_invariant_code_motion(&file);
+    f64 licm_ms = stress_ms(start);
+    
+    printf("%10u %12u %8u %10.3f %10.3f %12.3f %12.3f %10.1f\n", variables, module.instructions,
+           module.blocks, parse_ms, ssa_ms, ssa_braun_ms, ssa_parallel_ms, licm_ms);
+    
+    ir_destroy(&file);
+    vector_free(&module.words);
+}
+
+s32
+main(s32 argc, char **argv)
+{
+    stress_threads = thread_cores();
+    
+    printf("%10s %12s %8s %10s %10s %12s %12s %10s\n", "variables", "instructions", "blocks", 
+           "parse ms", "ssa ms", "ssa-braun ms", "ssa-par ms", "licm ms");
+    
+    if (argc >= 3) {
+        stress_run(atoi(argv[1]), atoi(argv[2]), 1, argc == 4 ? argv[3] : NULL);
+    } else if (argc == 1) {
+        // NOTE: typical fragment shaders first, averaged over many runs
+        stress_run(8, 100, 1000, NULL);
+        stress_run(32, 500, 1000, NULL);
+        stress_run(64, 2000, 100, NULL);
+        stress_run(1000, 10000, 10, NULL);
+        stress_run(10000, 100000, 1, NULL);
+        stress_run(100000, 1000000, 1, NULL);
+    } else {
+        fprintf(stderr, "[ERROR] Usage: ./%s [variables instructions [out]]", argv[0]);
+        return(1);
+    }
+    
+    return(0);
+}
@@ -0,0 +1,877 @@
+// NOTE: a small interpreter of the entry point of a module, to check that a pass does not change
+// what the module computes: the Input variables of both modules are filled with the same pseudo
+// random values, and after the run their Output variables have to hold the same values. Scalars
+// are 32 bits wide, composites are laid out flat (one word per scalar), a pointer is the offset of
+// what it points to in the memory of the run. Values are never freed until the end of the run
+
+#define INTERP_MAX_WORDS 256
+#define INTERP_MAX_STEPS (1 << 22)
+#define INTERP_RUNS 8
+
+enum interp_kind {
+    INTERP_OTHER,
+    INTERP_INT,
+    INTERP_FLOAT,
+    INTERP_BOOL,
+    INTERP_COMPOSITE,
+    INTERP_STRUCT,
+    INTERP_POINTER
+};
+
+struct interp_type {
+    enum interp_kind kind;
+    u32 size;     // NOTE: in words
+    u32 element;  // NOTE: the element type of a vector, array or matrix, the pointee of a pointer
+    u32 count;    // NOTE: of the elements or the members
+    u32 *members; // NOTE: of a struct
+};
+
+struct interp {
+    const char *filename;
+    u32 *words;
+    u32 size;
+    u32 bound;
+    struct interp_type *types; // NOTE: by the id of the type
+    u32 *type_of;              // NOTE: id -> the type of its value
+    u32 *defined_at;           // NOTE: id -> word offset of the OpFunction or OpLabel
+    u32 *globals;              // NOTE: id -> offset of the value in the memory + 1
+    struct uint_vector outputs;
+    struct uint_vector inputs;
+    struct uint_vector memory;
+    u32 zeros;                 // NOTE: INTERP_MAX_WORDS zeros, for the values which could not be computed
+    u32 steps;
+    bool killed;
+    bool failed;
+};
+
+static void
+interp_error(struct interp *interp, const char *format, ...)
+{
+    if (interp->failed) {
+        return;
+    }
+    
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "[ERROR] %s: ", interp->filename);
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    
+    interp->failed = true;
+}
+
+static u32
+interp_alloc(struct interp *interp, u32 size)
+{
+    u32 offset = interp->memory.size;
+    for (u32 i = 0; i < size; ++i) {
+        vector_push(&interp->memory, 0);
+    }
+    return(offset);
+}
+
+// NOTE: 'value' may point into the memory itself, which moves when it grows
+static u32
+interp_store(struct interp *interp, u32 *value, u32 size)
+{
+    bool in_memory = (interp->memory.data && value >= interp->memory.data && value < interp->memory.data + interp->memory.size);
+    u32 from = (in_memory ? (u32) (value - interp->memory.data) : 0);
+    u32 offset = interp_alloc(interp, size);
+    
+    memcpy(interp->memory.data + offset, in_memory ? interp->memory.data + from : value, size * sizeof(u32));
+    
+    return(offset);
+}
+
+static u32
+interp_size(struct interp *interp, u32 type)
+{
+    return(type < interp->bound ? interp->types[type].size : 0);
+}
+
+// NOTE: the scalar kind of a type, the element kind of a vector
+static enum interp_kind
+interp_scalar(struct interp *interp, u32 type)
+{
+    while (type < interp->bound && interp->types[type].kind == INTERP_COMPOSITE) {
+        type = interp->types[type].element;
+    }
+    return(type < interp->bound ? interp->types[type].kind : INTERP_OTHER);
+}
+
+// NOTE: offset of the value of an id in the memory, 'values' are the ones of the current call
+static u32
+interp_value(struct interp *interp, u32 *values, u32 id)
+{
+    if (id < interp->bound && values && values[id]) {
+        return(values[id] - 1);
+    }
+    
+    if (id < interp->bound && interp->globals[id]) {
+        return(interp->globals[id] - 1);
+    }
+    
+    interp_error(interp, "%%%u is used before it is computed", id);
+    return(interp->zeros);
+}
+
+static void
+interp_set(struct interp *interp, u32 *values, u32 id, u32 type, u32 *value, u32 size)
+{
+    if (id >= interp->bound) {
+        interp_error(interp, "%%%u is not below the bound", id);
+        return;
+    }
+    
+    values[id] = interp_store(interp, value, size) + 1;
+    interp->type_of[id] = type;
+}
+
+// NOTE: walks one index into a composite type, returns the offset of the part in words
+static u32
+interp_index(struct interp *interp, u32 *type, u32 index)
+{
+    struct interp_type *composite = interp->types + *type;
+    
+    if ((composite->kind != INTERP_COMPOSITE && composite->kind != INTERP_STRUCT) || index >= composite->count) {
+        interp_error(interp, "index %u is out of the bounds of type %%%u", index, *type);
+        return(0);
+    }
+    
+    if (composite->kind == INTERP_COMPOSITE) {
+        *type = composite->element;
+        return(index * interp_size(interp, composite->element));
+    }
+    
+    u32 offset = 0;
+    for (u32 i = 0; i < index; ++i) {
+        offset += interp_size(interp, composite->members[i]);
+    }
+    *type = composite->members[index];
+    
+    return(offset);
+}
+
+static f32
+interp_f32(u32 word)
+{
+    f32 value;
+    memcpy(&value, &word, sizeof(f32));
+    return(value);
+}
+
+static u32
+interp_word(f32 value)
+{
+    u32 word;
+    memcpy(&word, &value, sizeof(f32));
+    return(word);
+}
+
+// NOTE: the component-wise instructions, 'a' and 'b' are the components of the operands.
+// Returns false if the opcode is not one of them
+static bool
+interp_component(u32 opcode, u32 a, u32 b, u32 *result)
+{
+    s32 sa = (s32) a;
+    s32 sb = (s32) b;
+    f32 fa = interp_f32(a);
+    f32 fb = interp_f32(b);
+    
+    switch (opcode) {
+        case OpConvertFToU: *result = (fa <= 0.0f ? 0 : (u32) fa); break;
+        case 110: // NOTE: OpConvertFToS
+            *result = (u32) (s32) fa; break;
+        case 111: // NOTE: OpConvertSToF
+            *result = interp_word((f32) sa); break;
+        case 112: // NOTE: OpConvertUToF
+            *result = interp_word((f32) a); break;
+        case 113: case 114: case 115: // NOTE: OpUConvert, OpSConvert, OpFConvert, all 32 bits wide
+        case OpBitcast: *result = a; break;
+        case OpSNegate: *result = (u32) -(s64) sa; break;
+        case OpFNegate: *result = interp_word(-fa); break;
+        case OpNot: *result = ~a; break;
+        case OpLogicalNot: *result = !a; break;
+        case OpIsNan: *result = (fa != fa); break;
+        case OpIsInf: *result = (fa == fa && fa - fa != fa - fa); break;
+        case OpIAdd: *result = a + b; break;
+        case OpISub: *result = a - b; break;
+        case OpIMul: *result = a * b; break;
+        case OpUDiv: *result = (b ? a / b : 0); break;
+        case OpSDiv: *result = (sb && !(sa == INT32_MIN && sb == -1) ? (u32) (sa / sb) : 0); break;
+        case OpUMod: *result = (b ? a % b : 0); break;
+        case OpSRem: *result = (sb && sb != -1 ? (u32) (sa % sb) : 0); break;
+        case OpSMod: {
+            s32 rem = (sb && sb != -1 ? sa % sb : 0);
+            *result = (u32) (rem && ((rem < 0) != (sb < 0)) ? rem + sb : rem);
+        } break;
+        case OpFAdd: *result = interp_word(fa + fb); break;
+        case OpFSub: *result = interp_word(fa - fb); break;
+        case OpFMul: *result = interp_word(fa * fb); break;
+        case OpFDiv: *result = interp_word(fa / fb); break;
+        case OpShiftRightLogical: *result = a >> (b & 31); break;
+        case OpShiftRightArithmetic: *result = (u32) (sa >> (b & 31)); break;
+        case OpShiftLeftLogical: *result = a << (b & 31); break;
+        case OpBitwiseOr: *result = a | b; break;
+        case OpBitwiseXor: *result = a ^ b; break;
+        case OpBitwiseAnd: *result = a & b; break;
+        case OpLogicalEqual: *result = (!a == !b); break;
+        case OpLogicalNotEqual: *result = (!a != !b); break;
+        case OpLogicalOr: *result = (a || b); break;
+        case OpLogicalAnd: *result = (a && b); break;
+        case OpIEqual: *result = (a == b); break;
+        case OpINotEqual: *result = (a != b); break;
+        case OpUGreaterThan: *result = (a > b); break;
+        case OpSGreaterThan: *result = (sa > sb); break;
+        case OpUGreaterThanEqual: *result = (a >= b); break;
+        case OpSGreaterThanEqual: *result = (sa >= sb); break;
+        case OpULessThan: *result = (a < b); break;
+        case OpSLessThan: *result = (sa < sb); break;
+        case OpULessThanEqual: *result = (a <= b); break;
+        case OpSLessThanEqual: *result = (sa <= sb); break;
+        case OpFOrdEqual: *result = (fa == fb); break;
+        case OpFUnordEqual: *result = (fa == fb || fa != fa || fb != fb); break;
+        case OpFOrdNotEqual: *result = (fa != fb && fa == fa && fb == fb); break;
+        case OpFUnordNotEqual: *result = (fa != fb); break;
+        case OpFOrdLessThan: *result = (fa < fb); break;
+        case OpFUnordLessThan: *result = !(fa >= fb); break;
+        case OpFOrdGreaterThan: *result = (fa > fb); break;
+        case OpFUnordGreaterThan: *result = !(fa <= fb); break;
+        case OpFOrdLessThanEqual: *result = (fa <= fb); break;
+        case OpFUnordLessThanEqual: *result = !(fa > fb); break;
+        case OpFOrdGreaterThanEqual: *result = (fa >= fb); break;
+        case OpFUnordGreaterThanEqual: *result = !(fa < fb); break;
+        default: return(false);
+    }
+    
+    return(true);
+}
+
+// NOTE: the instructions of GLSL.std.450 which can be computed without libm
+static bool
+interp_glsl(u32 instruction, u32 *operands, u32 *result)
+{
+    f32 a = interp_f32(operands[0]);
+    f32 b = interp_f32(operands[1]);
+    f32 c = interp_f32(operands[2]);
+    s32 sa = (s32) operands[0];
+    s32 sb = (s32) operands[1];
+    s32 sc = (s32) operands[2];
+    
+    switch (instruction) {
+        case 4: *result = operands[0] & 0x7FFFFFFFu; break;                       // NOTE: FAbs
+        case 5: *result = (u32) (sa < 0 ? -(s64) sa : sa); break;                 // NOTE: SAbs
+        case 37: *result = interp_word(b < a ? b : a); break;                     // NOTE: FMin
+        case 38: *result = (operands[1] < operands[0] ? operands[1] : operands[0]); break;
+        case 39: *result = (u32) (sb < sa ? sb : sa); break;                      // NOTE: SMin
+        case 40: *result = interp_word(a < b ? b : a); break;                     // NOTE: FMax
+        case 41: *result = (operands[0] < operands[1] ? operands[1] : operands[0]); break;
+        case 42: *result = (u32) (sa < sb ? sb : sa); break;                      // NOTE: SMax
+        case 43: *result = interp_word(a < b ? b : (c < a ? c : a)); break;       // NOTE: FClamp
+        case 45: *result = (u32) (sa < sb ? sb : (sc < sa ? sc : sa)); break;     // NOTE: SClamp
+        case 46: *result = interp_word(a * (1.0f - c) + b * c); break;            // NOTE: FMix
+        case 50: *result = interp_word(a * b + c); break;                         // NOTE: Fma
+        default: return(false);
+    }
+    
+    return(true);
+}
+
+// NOTE: fills the storage of an Input variable with small values, so that loops bounded by
+// them stay short
+static void
+interp_fill(struct interp *interp, u32 type, u32 offset, u32 *state)
+{
+    struct interp_type *t = interp->types + type;
+    
+    if (t->kind == INTERP_COMPOSITE || t->kind == INTERP_STRUCT) {
+        for (u32 i = 0; i < t->count; ++i) {
+            u32 part = type;
+            u32 at = interp_index(interp, &part, i);
+            interp_fill(interp, part, offset + at, state);
+        }
+        return;
+    }
+    
+    *state = *state * 1664525u + 1013904223u;
+    u32 random = *state >> 8;
+    
+    if (t->kind == INTERP_INT) {
+        interp->memory.data[offset] = (u32) ((s32) (random % 13) - 3);
+    } else if (t->kind == INTERP_FLOAT) {
+        interp->memory.data[offset] = interp_word(((f32) (random % 17) - 8.0f) * 0.5f);
+    } else if (t->kind == INTERP_BOOL) {
+        interp->memory.data[offset] = random & 1;
+    }
+}
+
+// NOTE: the types, the constants and the global variables, in the order they are declared
+static void
+interp_init(struct interp *interp, const char *filename, u32 *words, u32 size)
+{
+    *interp = (struct interp) {
+        .filename = filename,
+        .words = words,
+        .size = size,
+        .bound = words[3],
+        .types = calloc(words[3], sizeof(struct interp_type)),
+        .type_of = calloc(words[3], sizeof(u32)),
+        .defined_at = calloc(words[3], sizeof(u32)),
+        .globals = calloc(words[3], sizeof(u32)),
+        .outputs = vector_init(),
+        .inputs = vector_init(),
+        .memory = vector_init()
+    };
+    
+    interp->zeros = interp_alloc(interp, INTERP_MAX_WORDS);
+    
+    for (u32 offset = 5; offset < size; offset += words[offset] >> 16) {
+        u32 *w = words + offset;
+        u32 opcode = w[0] & OPCODE_MASK;
+        u32 wordcount = w[0] >> 16;
+        
+        if (opcode == OpFunction || opcode == OpLabel) {
+            interp->defined_at[opcode == OpFunction ? w[2] : w[1]] = offset;
+        }
+        
+        if (w[1] >= interp->bound || (wordcount > 2 && w[2] >= interp->bound && opcode > OpTypeForwardPointer)) {
+            continue;
+        }
+        
+        struct interp_type *type = interp->types + w[1];
+        u32 value[INTERP_MAX_WORDS] = { 0 };
+        
+        switch (opcode) {
+            case OpTypeVoid:
+            case 33: { // NOTE: OpTypeFunction
+                type->kind = INTERP_OTHER;
+            } break;
+            
+            case OpTypeBool: {
+                *type = (struct interp_type) { .kind = INTERP_BOOL, .size = 1 };
+            } break;
+            
+            case OpTypeInt:
+            case OpTypeFloat: {
+                if (w[2] != 32) {
+                    interp_error(interp, "only 32 bit wide scalars are supported");
+                }
+                *type = (struct interp_type) { .kind = (opcode == OpTypeInt ? INTERP_INT : INTERP_FLOAT), .size = 1 };
+            } break;
+            
+            case OpTypeVector:
+            case 24:   // NOTE: OpTypeMatrix
+            case OpTypeArray: {
+                u32 count = w[3];
+                if (opcode == OpTypeArray) {
+                    u32 length = (w[3] < interp->bound ? interp->globals[w[3]] : 0);
+                    count = (length ? interp->memory.data[length - 1] : 0);
+                }
+                *type = (struct interp_type) { .kind = INTERP_COMPOSITE, .element = w[2], .count = count,
+                    .size = count * interp_size(interp, w[2]) };
+            } break;
+            
+            case OpTypeStruct: {
+                *type = (struct interp_type) { .kind = INTERP_STRUCT, .count = wordcount - 2, .members = w + 2 };
+                for (u32 i = 2; i < wordcount; ++i) {
+                    type->size += interp_size(interp, w[i]);
+                }
+            } break;
+            
+            case OpTypePointer: {
+                *type = (struct interp_type) { .kind = INTERP_POINTER, .element = w[3], .size = 1 };
+            } break;
+            
+            case OpConstantTrue:
+            case OpConstantFalse:
+            case OpConstant:
+            case OpConstantComposite:
+            case 46:   // NOTE: OpConstantNull
+            case OpUndef: {
+                u32 words_size = interp_size(interp, w[1]);
+                if (opcode == OpConstantTrue) {
+                    value[0] = 1;
+                } else if (opcode == OpConstant) {
+                    value[0] = w[3];
+                }
+                
+                u32 at = 0;
+                for (u32 i = 3; opcode == OpConstantComposite && i < wordcount && at < INTERP_MAX_WORDS; ++i) {
+                    u32 part = (w[i] < interp->bound ? interp->globals[w[i]] : 0);
+                    u32 part_size = (part ? interp_size(interp, interp->type_of[w[i]]) : 0);
+                    if (part && at + part_size <= INTERP_MAX_WORDS) {
+                        memcpy(value + at, interp->memory.data + part - 1, part_size * sizeof(u32));
+                    }
+                    at += part_size;
+                }
+                
+                interp_set(interp, interp->globals, w[2], w[1], value, words_size);
+            } break;
+            
+            case OpVariable: {
+                if (w[3] == StorageClassFunction) {
+                    break;
+                }
+                
+                u32 pointee = interp->types[w[1]].element;
+                u32 storage = interp_alloc(interp, interp_size(interp, pointee));
+                if (wordcount > 4 && interp->globals[w[4]]) {
+                    memcpy(interp->memory.data + storage, interp->memory.data + interp->globals[w[4]] - 1,
+                           interp_size(interp, pointee) * sizeof(u32));
+                }
+                
+                value[0] = storage;
+                interp_set(interp, interp->globals, w[2], w[1], value, 1);
+                
+                if (w[3] == StorageClassInput) {
+                    vector_push(&interp->inputs, w[2]);
+                } else if (w[3] == StorageClassOutput) {
+                    vector_push(&interp->outputs, w[2]);
+                }
+            } break;
+        }
+    }
+}
+
+static void
+interp_free(struct interp *interp)
+{
+    free(interp->types);
+    free(interp->type_of);
+    free(interp->defined_at);
+    free(interp->globals);
+    vector_free(&interp->outputs);
+    vector_free(&interp->inputs);
+    vector_free(&interp->memory);
+}
+
+// NOTE: the phi's at the start of 'label' take their values from 'parent', all at once
+static void
+interp_phis(struct interp *interp, u32 *values, u32 label, u32 parent)
+{
+    u32 offset = interp->defined_at[label] + 2;
+    u32 first = offset;
+    u32 count = 0;
+    u32 chosen[INTERP_MAX_WORDS];
+    
+    for (; offset < interp->size && (interp->words[offset] & OPCODE_MASK) == OpPhi; offset += interp->words[offset] >> 16) {
+        u32 *w = interp->words + offset;
+        u32 wordcount = w[0] >> 16;
+        u32 pick = UINT32_MAX;
+        
+        for (u32 i = 3; i + 1 < wordcount; i += 2) {
+            pick = (w[i + 1] == parent ? w[i] : pick);
+        }
+        
+        if (pick == UINT32_MAX || count == INTERP_MAX_WORDS) {
+            interp_error(interp, "OpPhi %%%u has no operand for %%%u", w[2], parent);
+            return;
+        }
+        
+        chosen[count++] = interp_value(interp, values, pick);
+    }
+    
+    count = 0;
+    for (offset = first; offset < interp->size && (interp->words[offset] & OPCODE_MASK) == OpPhi; offset += interp->words[offset] >> 16) {
+        u32 *w = interp->words + offset;
+        values[w[2]] = chosen[count++] + 1;
+        interp->type_of[w[2]] = w[1];
+    }
+}
+
+// NOTE: runs a function, returns the offset of the returned value + 1, 0 if there is none
+static u32
+interp_call(struct interp *interp, u32 function, u32 *args, u32 arg_count)
+{
+    u32 *values = calloc(interp->bound, sizeof(u32));
+    u32 offset = interp->defined_at[function];
+    u32 result = 0;
+    u32 arg = 0;
+    
+    if (!offset) {
+        interp_error(interp, "function %%%u is not defined", function);
+        free(values);
+        return(0);
+    }
+    
+    for (offset += interp->words[offset] >> 16; (interp->words[offset] & OPCODE_MASK) == OpFunctionParameter; offset += interp->words[offset] >> 16) {
+        if (arg < arg_count) {
+            values[interp->words[offset + 2]] = args[arg++] + 1;
+            interp->type_of[interp->words[offset + 2]] = interp->words[offset + 1];
+        }
+    }
+    
+    u32 label = interp->words[offset + 1];
+    offset += 2;
+    
+    while (!interp->failed && !interp->killed && offset < interp->size) {
+        u32 *w = interp->words + offset;
+        u32 opcode = w[0] & OPCODE_MASK;
+        u32 wordcount = w[0] >> 16;
+        u32 next_label = 0;
+        u32 value[INTERP_MAX_WORDS] = { 0 };
+        u32 size = (wordcount > 2 ? interp_size(interp, w[1]) : 0);
+        
+        if (++interp->steps > INTERP_MAX_STEPS) {
+            interp_error(interp, "the entry point does not finish in %u steps", INTERP_MAX_STEPS);
+            break;
+        }
+        
+        if (size > INTERP_MAX_WORDS) {
+            interp_error(interp, "the value of %%%u is too large", w[2]);
+            break;
+        }
+        
+        switch (opcode) {
+            case OpPhi:
+            case OpLoopMerge:
+            case OpSelectionMerge:
+            case OpLine:
+            case OpNoLine: {
+            } break;
+            
+            case OpVariable: {
+                u32 pointee = interp->types[w[1]].element;
+                u32 storage = interp_alloc(interp, interp_size(interp, pointee));
+                if (wordcount > 4) {
+                    u32 init = interp_value(interp, values, w[4]);
+                    memcpy(interp->memory.data + storage, interp->memory.data + init, interp_size(interp, pointee) * sizeof(u32));
+                }
+                value[0] = storage;
+                interp_set(interp, values, w[2], w[1], value, 1);
+            } break;
+            
+            case OpLoad: {
+                u32 pointer = interp->memory.data[interp_value(interp, values, w[3])];
+                interp_set(interp, values, w[2], w[1], interp->memory.data + pointer, size);
+            } break;
+            
+            case OpStore: {
+                u32 pointer = interp->memory.data[interp_value(interp, values, w[1])];
+                u32 object = interp_value(interp, values, w[2]);
+                u32 pointee = interp->types[interp->type_of[w[1]]].element;
+                memmove(interp->memory.data + pointer, interp->memory.data + object, interp_size(interp, pointee) * sizeof(u32));
+            } break;
+            
+            case OpAccessChain:
+            case 66: { // NOTE: OpInBoundsAccessChain
+                u32 type = interp->types[interp->type_of[w[3]]].element;
+                value[0] = interp->memory.data[interp_value(interp, values, w[3])];
+                for (u32 i = 4; i < wordcount; ++i) {
+                    value[0] += interp_index(interp, &type, interp->memory.data[interp_value(interp, values, w[i])]);
+                }
+                interp_set(interp, values, w[2], w[1], value, 1);
+            } break;
+            
+            case OpCopyObject: {
+                interp_set(interp, values, w[2], w[1], interp->memory.data + interp_value(interp, values, w[3]), size);
+            } break;
+            
+            case OpUndef: {
+                interp_set(interp, values, w[2], w[1], value, size);
+            } break;
+            
+            case OpCompositeExtract: {
+                u32 type = interp->type_of[w[3]];
+                u32 at = interp_value(interp, values, w[3]);
+                for (u32 i = 4; i < wordcount; ++i) {
+                    at += interp_index(interp, &type, w[i]);
+                }
+                interp_set(interp, values, w[2], w[1], interp->memory.data + at, size);
+            } break;
+            
+            case OpCompositeInsert: {
+                u32 type = w[1];
+                u32 at = 0;
+                memcpy(value, interp->memory.data + interp_value(interp, values, w[4]), size * sizeof(u32));
+                for (u32 i = 5; i < wordcount; ++i) {
+                    at += interp_index(interp, &type, w[i]);
+                }
+                memcpy(value + at, interp->memory.data + interp_value(interp, values, w[3]), interp_size(interp, type) * sizeof(u32));
+                interp_set(interp, values, w[2], w[1], value, size);
+            } break;
+            
+            case OpCompositeConstruct: {
+                u32 at = 0;
+                for (u32 i = 3; i < wordcount; ++i) {
+                    u32 part_size = interp_size(interp, interp->type_of[w[i]]);
+                    u32 part = interp_value(interp, values, w[i]);
+                    if (at + part_size <= size) {
+                        memcpy(value + at, interp->memory.data + part, part_size * sizeof(u32));
+                    }
+                    at += part_size;
+                }
+                interp_set(interp, values, w[2], w[1], value, size);
+            } break;
+            
+            case OpVectorShuffle: {
+                u32 first_size = interp_size(interp, interp->type_of[w[3]]);
+                u32 second_size = interp_size(interp, interp->type_of[w[4]]);
+                u32 first = interp_value(interp, values, w[3]);
+                u32 second = interp_value(interp, values, w[4]);
+                for (u32 i = 5; i < wordcount && i - 5 < size; ++i) {
+                    if (w[i] < first_size) {
+                        value[i - 5] = interp->memory.data[first + w[i]];
+                    } else if (w[i] < first_size + second_size) {
+                        value[i - 5] = interp->memory.data[second + w[i] - first_size];
+                    }
+                }
+                interp_set(interp, values, w[2], w[1], value, size);
+            } break;
+            
+            case OpSelect: {
+                u32 condition = interp_value(interp, values, w[3]);
+                u32 a = interp_value(interp, values, w[4]);
+                u32 b = interp_value(interp, values, w[5]);
+                bool per_component = (interp_size(interp, interp->type_of[w[3]]) > 1);
+                for (u32 i = 0; i < size; ++i) {
+                    bool pick = interp->memory.data[condition + (per_component ? i : 0)];
+                    value[i] = interp->memory.data[(pick ? a : b) + i];
+                }
+                interp_set(interp, values, w[2], w[1], value, size);
+            } break;
+            
+            case OpVectorTimesScalar: {
+                u32 vector = interp_value(interp, values, w[3]);
+                f32 scalar = interp_f32(interp->memory.data[interp_value(interp, values, w[4])]);
+                for (u32 i = 0; i < size; ++i) {
+                    value[i] = interp_word(interp_f32(interp->memory.data[vector + i]) * scalar);
+                }
+                interp_set(interp, values, w[2], w[1], value, size);
+            } break;
+            
+            case OpDot: {
+                u32 a = interp_value(interp, values, w[3]);
+                u32 b = interp_value(interp, values, w[4]);
+                f32 sum = 0.0f;
+                for (u32 i = 0; i < interp_size(interp, interp->type_of[w[3]]); ++i) {
+                    sum += interp_f32(interp->memory.data[a + i]) * interp_f32(interp->memory.data[b + i]);
+                }
+                value[0] = interp_word(sum);
+                interp_set(interp, values, w[2], w[1], value, 1);
+            } break;
+            
+            case OpAny:
+            case OpAll: {
+                u32 vector = interp_value(interp, values, w[3]);
+                value[0] = (opcode == OpAll);
+                for (u32 i = 0; i < interp_size(interp, interp->type_of[w[3]]); ++i) {
+                    value[0] = (opcode == OpAll ? value[0] && interp->memory.data[vector + i] : value[0] || interp->memory.data[vector + i]);
+                }
+                interp_set(interp, values, w[2], w[1], value, 1);
+            } break;
+            
+            case OpExtInst: {
+                u32 operands[3] = { 0 };
+                for (u32 i = 0; i < size; ++i) {
+                    for (u32 j = 5; j < wordcount && j < 8; ++j) {
+                        u32 operand = interp_value(interp, values, w[j]);
+                        operands[j - 5] = interp->memory.data[operand + (interp_size(interp, interp->type_of[w[j]]) > 1 ? i : 0)];
+                    }
+                    if (!interp_glsl(w[4], operands, value + i)) {
+                        interp_error(interp, "extended instruction %u is not supported", w[4]);
+                        break;
+                    }
+                }
+                interp_set(interp, values, w[2], w[1], value, size);
+            } break;
+            
+            case OpFunctionCall: {
+                u32 call_args[INTERP_MAX_WORDS];
+                for (u32 i = 4; i < wordcount && i - 4 < INTERP_MAX_WORDS; ++i) {
+                    call_args[i - 4] = interp_value(interp, values, w[i]);
+                }
+                
+                u32 returned = interp_call(interp, w[3], call_args, wordcount - 4);
+                if (returned && size) {
+                    interp_set(interp, values, w[2], w[1], interp->memory.data + returned - 1, size);
+                }
+            } break;
+            
+            case OpBranch: {
+                next_label = w[1];
+            } break;
+            
+            case OpBranchConditional: {
+                next_label = (interp->memory.data[interp_value(interp, values, w[1])] ? w[2] : w[3]);
+            } break;
+            
+            case OpSwitch: {
+                u32 selector = interp->memory.data[interp_value(interp, values, w[1])];
+                next_label = w[2];
+                for (u32 i = 3; i + 1 < wordcount; i += 2) {
+                    next_label = (w[i] == selector ? w[i + 1] : next_label);
+                }
+            } break;
+            
+            case OpReturn: {
+                free(values);
+                return(0);
+            }
+            
+            case OpReturnValue: {
+                result = interp_value(interp, values, w[1]) + 1;
+                free(values);
+                return(result);
+            }
+            
+            case OpKill: {
+                interp->killed = true;
+            } break;
+            
+            case OpUnreachable: {
+                interp_error(interp, "OpUnreachable in %%%u is reached", label);
+            } break;
+            
+            default: {
+                u32 a = (wordcount > 3 ? interp_value(interp, values, w[3]) : interp->zeros);
+                u32 b = (wordcount > 4 ? interp_value(interp, values, w[4]) : interp->zeros);
+                bool a_scalar = (wordcount > 3 && interp_size(interp, interp->type_of[w[3]]) == 1);
+                bool b_scalar = (wordcount > 4 && interp_size(interp, interp->type_of[w[4]]) == 1);
+                
+                if (interp->failed) {
+                    break;
+                }
+                
+                for (u32 i = 0; i < size; ++i) {
+                    u32 x = interp->memory.data[a + (a_scalar ? 0 : i)];
+                    u32 y = interp->memory.data[b + (b_scalar ? 0 : i)];
+                    if (!interp_component(opcode, x, y, value + i)) {
+                        interp_error(interp, "opcode %u is not supported", opcode);
+                        break;
+                    }
+                }
+                
+                if (!size) {
+                    interp_error(interp, "opcode %u is not supported", opcode);
+                }
+                
+                interp_set(interp, values, w[2], w[1], value, size);
+            }
+        }
+        
+        if (next_label) {
+            if (next_label >= interp->bound || !interp->defined_at[next_label]) {
+                interp_error(interp, "branch to %%%u, which is not a block", next_label);
+                break;
+            }
+            
+            interp_phis(interp, values, next_label, label);
+            label = next_label;
+            offset = interp->defined_at[label] + 2;
+        } else {
+            offset += wordcount;
+        }
+    }
+    
+    free(values);
+    
+    return(0);
+}
+
+// NOTE: runs the first entry point with the Input variables filled from 'seed', and puts the
+// values of the Output variables, by id, to 'outputs': the id, the size, then the words
+static void
+interp_run(struct interp *interp, u32 seed, struct uint_vector *outputs)
+{
+    u32 state = seed * 2654435761u + 1;
+    u32 entry = 0;
+    
+    for (u32 offset = 5; offset < interp->size; offset += interp->words[offset] >> 16) {
+        if ((interp->words[offset] & OPCODE_MASK) == OpEntryPoint) {
+            entry = interp->words[offset + 2];
+            break;
+        }
+    }
+    
+    for (u32 i = 0; i < interp->inputs.size; ++i) {
+        u32 pointer = interp->memory.data[interp->globals[interp->inputs.data[i]] - 1];
+        interp_fill(interp, interp->types[interp->type_of[interp->inputs.data[i]]].element, pointer, &state);
+    }
+    
+    interp_call(interp, entry, NULL, 0);
+    
+    vector_push(outputs, interp->killed);
+    for (u32 i = 0; i < interp->outputs.size; ++i) {
+        u32 id = interp->outputs.data[i];
+        u32 pointer = interp->memory.data[interp->globals[id] - 1];
+        u32 type = interp->types[interp->type_of[id]].element;
+        
+        vector_push(outputs, id);
+        vector_push(outputs, type);
+        for (u32 word = 0; word < interp_size(interp, type); ++word) {
+            vector_push(outputs, interp->memory.data[pointer + word]);
+        }
+    }
+}
+
+// NOTE: two words of an Output are the same if they are equal as floats (0 and -0 are, and so
+// are two NaN's), or equal bitwise
+static bool
+interp_same_word(u32 a, u32 b, bool is_float)
+{
+    f32 fa = interp_f32(a);
+    f32 fb = interp_f32(b);
+    return(a == b || (is_float && (fa == fb || (fa != fa && fb != fb))));
+}
+
+// NOTE: the module 'words' has to compute the same Outputs as the reference for INTERP_RUNS inputs
+static bool
+interp_same(const char *reference_name, u32 *reference_words, u32 reference_size,
+            const char *filename, u32 *words, u32 size)
+{
+    bool same = true;
+    
+    for (u32 run = 0; run < INTERP_RUNS && same; ++run) {
+        struct interp reference;
+        struct interp result;
+        struct uint_vector expected = vector_init();
+        struct uint_vector computed = vector_init();
+        
+        interp_init(&reference, reference_name, reference_words, reference_size);
+        interp_init(&result, filename, words, size);
+        
+        interp_run(&reference, run, &expected);
+        interp_run(&result, run, &computed);
+        
+        same = !reference.failed && !result.failed;
+        
+        if (same && expected.data[0] != computed.data[0]) {
+            fprintf(stderr, "[ERROR] %s: run %u is %s, it is not in %s\n", filename, run,
+                    computed.data[0] ? "killed" : "not killed", reference_name);
+            same = false;
+        }
+        
+        // NOTE: an Output of the reference which is not in the result is not written by either
+        for (u32 i = 1; same && i < expected.size;) {
+            u32 id = expected.data[i];
+            u32 type = expected.data[i + 1];
+            u32 words_size = interp_size(&reference, type);
+            bool is_float = (interp_scalar(&reference, type) == INTERP_FLOAT);
+            
+            u32 j = 1;
+            while (j < computed.size && computed.data[j] != id) {
+                j += 2 + interp_size(&result, computed.data[j + 1]);
+            }
+            
+            for (u32 word = 0; j < computed.size && word < words_size; ++word) {
+                if (!interp_same_word(expected.data[i + 2 + word], computed.data[j + 2 + word], is_float)) {
+                    fprintf(stderr, "[ERROR] %s: run %u, Output %%%u word %u is 0x%08x, it is 0x%08x in %s\n", filename,
+                            run, id, word, computed.data[j + 2 + word], expected.data[i + 2 + word], reference_name);
+                    same = false;
+                    break;
+                }
+            }
+            
+            i += 2 + words_size;
+        }
+        
+        vector_free(&expected);
+        vector_free(&computed);
+        interp_free(&reference);
+        interp_free(&result);
+    }
+    
+    return(same);
+}
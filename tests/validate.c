@@ -0,0 +1,633 @@
+#include <stdarg.h>
+
+#include "../headers.h"
+#include "interp.c"
+
+// NOTE: checks that a module is valid SPIR-V, as far as what the passes can break goes: ids
+// are defined once and below the bound, operands, names, decorations and the interface of
+// the entry points refer to defined ids, and in every function the blocks are well formed
+// (OpVariable first in the entry block, OpPhi first in a block and one operand per predecessor,
+// a merge instruction right before the branch, a reachable loop header has a back edge).
+// Usage: ./validate [-e] file.spv [expectation ...] [file.spv [expectation ...] ...], the exit code
+// is 0 if all of them are valid and meet their expectations. An expectation is on the number
+// of instructions with an opcode in the whole module, e.g. 'OpPhi=0', 'OpIAdd<3' or 'OpSelect>0',
+// or in the block with an OpName, e.g. 'body:OpIMul=0'. It is what checks that a pass did its
+// job, e.g. that a copy was forwarded or a branch folded.
+// With -e the files after the first have to compute the same Outputs as the first (interp.c)
+
+struct validate {
+    const char *filename;
+    u32 *words;
+    u32 size;
+    u32 bound;
+    bool *defined;
+    u32 errors;
+};
+
+#define VALIDATE_OPCODE(opcode) { #opcode, opcode }
+
+static const struct {
+    const char *name;
+    u32 opcode;
+} VALIDATE_OPCODES[] = {
+    VALIDATE_OPCODE(OpUndef), VALIDATE_OPCODE(OpSourceContinued), VALIDATE_OPCODE(OpSource),
+    VALIDATE_OPCODE(OpSourceExtension), VALIDATE_OPCODE(OpName), VALIDATE_OPCODE(OpMemberName),
+    VALIDATE_OPCODE(OpString), VALIDATE_OPCODE(OpLine), VALIDATE_OPCODE(OpExtension),
+    VALIDATE_OPCODE(OpExtInstImport), VALIDATE_OPCODE(OpExtInst), VALIDATE_OPCODE(OpMemoryModel),
+    VALIDATE_OPCODE(OpEntryPoint), VALIDATE_OPCODE(OpExecutionMode), VALIDATE_OPCODE(OpCapability),
+    VALIDATE_OPCODE(OpTypeVoid), VALIDATE_OPCODE(OpTypeBool), VALIDATE_OPCODE(OpTypeInt),
+    VALIDATE_OPCODE(OpTypeFloat), VALIDATE_OPCODE(OpTypeVector), VALIDATE_OPCODE(OpTypeArray),
+    VALIDATE_OPCODE(OpTypeStruct), VALIDATE_OPCODE(OpTypePointer),
+    VALIDATE_OPCODE(OpTypeForwardPointer), VALIDATE_OPCODE(OpConstantTrue),
+    VALIDATE_OPCODE(OpConstantFalse), VALIDATE_OPCODE(OpConstant),
+    VALIDATE_OPCODE(OpConstantComposite), VALIDATE_OPCODE(OpSpecConstantOp),
+    VALIDATE_OPCODE(OpFunction), VALIDATE_OPCODE(OpFunctionParameter),
+    VALIDATE_OPCODE(OpFunctionEnd), VALIDATE_OPCODE(OpFunctionCall), VALIDATE_OPCODE(OpVariable),
+    VALIDATE_OPCODE(OpLoad), VALIDATE_OPCODE(OpStore), VALIDATE_OPCODE(OpAccessChain),
+    VALIDATE_OPCODE(OpDecorate), VALIDATE_OPCODE(OpMemberDecorate),
+    VALIDATE_OPCODE(OpVectorShuffle), VALIDATE_OPCODE(OpCompositeConstruct),
+    VALIDATE_OPCODE(OpCompositeExtract), VALIDATE_OPCODE(OpCompositeInsert),
+    VALIDATE_OPCODE(OpCopyObject), VALIDATE_OPCODE(OpTranspose), VALIDATE_OPCODE(OpConvertFToU),
+    VALIDATE_OPCODE(OpBitcast), VALIDATE_OPCODE(OpSNegate), VALIDATE_OPCODE(OpFNegate),
+    VALIDATE_OPCODE(OpIAdd), VALIDATE_OPCODE(OpFAdd), VALIDATE_OPCODE(OpISub),
+    VALIDATE_OPCODE(OpFSub), VALIDATE_OPCODE(OpIMul), VALIDATE_OPCODE(OpFMul),
+    VALIDATE_OPCODE(OpUDiv), VALIDATE_OPCODE(OpSDiv), VALIDATE_OPCODE(OpFDiv),
+    VALIDATE_OPCODE(OpUMod), VALIDATE_OPCODE(OpSRem), VALIDATE_OPCODE(OpSMod),
+    VALIDATE_OPCODE(OpFRem), VALIDATE_OPCODE(OpFMod), VALIDATE_OPCODE(OpVectorTimesScalar),
+    VALIDATE_OPCODE(OpMatrixTimesScalar), VALIDATE_OPCODE(OpVectorTimesMatrix),
+    VALIDATE_OPCODE(OpMatrixTimesVector), VALIDATE_OPCODE(OpMatrixTimesMatrix),
+    VALIDATE_OPCODE(OpOuterProduct), VALIDATE_OPCODE(OpDot), VALIDATE_OPCODE(OpAny),
+    VALIDATE_OPCODE(OpAll), VALIDATE_OPCODE(OpIsNan), VALIDATE_OPCODE(OpIsInf),
+    VALIDATE_OPCODE(OpLogicalEqual), VALIDATE_OPCODE(OpLogicalNotEqual),
+    VALIDATE_OPCODE(OpLogicalOr), VALIDATE_OPCODE(OpLogicalAnd), VALIDATE_OPCODE(OpLogicalNot),
+    VALIDATE_OPCODE(OpSelect), VALIDATE_OPCODE(OpIEqual), VALIDATE_OPCODE(OpINotEqual),
+    VALIDATE_OPCODE(OpUGreaterThan), VALIDATE_OPCODE(OpSGreaterThan),
+    VALIDATE_OPCODE(OpUGreaterThanEqual), VALIDATE_OPCODE(OpSGreaterThanEqual),
+    VALIDATE_OPCODE(OpULessThan), VALIDATE_OPCODE(OpSLessThan), VALIDATE_OPCODE(OpULessThanEqual),
+    VALIDATE_OPCODE(OpSLessThanEqual), VALIDATE_OPCODE(OpFOrdEqual), VALIDATE_OPCODE(OpFUnordEqual),
+    VALIDATE_OPCODE(OpFOrdNotEqual), VALIDATE_OPCODE(OpFUnordNotEqual),
+    VALIDATE_OPCODE(OpFOrdLessThan), VALIDATE_OPCODE(OpFUnordLessThan),
+    VALIDATE_OPCODE(OpFOrdGreaterThan), VALIDATE_OPCODE(OpFUnordGreaterThan),
+    VALIDATE_OPCODE(OpFOrdLessThanEqual), VALIDATE_OPCODE(OpFUnordLessThanEqual),
+    VALIDATE_OPCODE(OpFOrdGreaterThanEqual), VALIDATE_OPCODE(OpFUnordGreaterThanEqual),
+    VALIDATE_OPCODE(OpShiftRightLogical), VALIDATE_OPCODE(OpShiftRightArithmetic),
+    VALIDATE_OPCODE(OpShiftLeftLogical), VALIDATE_OPCODE(OpBitwiseOr),
+    VALIDATE_OPCODE(OpBitwiseXor), VALIDATE_OPCODE(OpBitwiseAnd), VALIDATE_OPCODE(OpNot),
+    VALIDATE_OPCODE(OpPhi), VALIDATE_OPCODE(OpLoopMerge), VALIDATE_OPCODE(OpSelectionMerge),
+    VALIDATE_OPCODE(OpLabel), VALIDATE_OPCODE(OpBranch), VALIDATE_OPCODE(OpBranchConditional),
+    VALIDATE_OPCODE(OpSwitch), VALIDATE_OPCODE(OpKill), VALIDATE_OPCODE(OpReturn),
+    VALIDATE_OPCODE(OpReturnValue), VALIDATE_OPCODE(OpUnreachable), VALIDATE_OPCODE(OpNoLine),
+    VALIDATE_OPCODE(OpModuleProcessed)
+};
+
+static void
+validate_error(struct validate *v, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "[ERROR] %s: ", v->filename);
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    
+    ++v->errors;
+}
+
+// NOTE: the result id of an instruction, 0 if it has none. Types, labels and the imports have
+// it first, all the other instructions with a result have the result type before it
+static u32
+validate_result_id(u32 *words)
+{
+    u32 opcode = words[0] & OPCODE_MASK;
+    u32 wordcount = words[0] >> 16;
+    
+    switch (opcode) {
+        case OpSourceContinued:
+        case OpSource:
+        case OpSourceExtension:
+        case OpName:
+        case OpMemberName:
+        case OpLine:
+        case OpExtension:
+        case OpMemoryModel:
+        case OpEntryPoint:
+        case OpExecutionMode:
+        case OpCapability:
+        case OpTypeForwardPointer:
+        case OpFunctionEnd:
+        case OpStore:
+        case OpDecorate:
+        case OpMemberDecorate:
+        case OpLoopMerge:
+        case OpSelectionMerge:
+        case OpBranch:
+        case OpBranchConditional:
+        case OpSwitch:
+        case OpKill:
+        case OpReturn:
+        case OpReturnValue:
+        case OpUnreachable:
+        case OpNoLine:
+        case OpModuleProcessed: {
+            return(0);
+        }
+        
+        case OpString:
+        case OpExtInstImport:
+        case OpLabel: {
+            return(words[1]);
+        }
+        
+        default: {
+            if (opcode >= OpTypeVoid && opcode < OpTypeForwardPointer) {
+                return(words[1]);
+            }
+            return(wordcount > 2 ? words[2] : 0);
+        }
+    }
+}
+
+static bool
+validate_terminator(u32 opcode)
+{
+    return(opcode == OpBranch || opcode == OpBranchConditional || opcode == OpSwitch || opcode == OpKill ||
+           opcode == OpReturn || opcode == OpReturnValue || opcode == OpUnreachable);
+}
+
+static void
+validate_use(struct validate *v, u32 id, u32 opcode)
+{
+    if (id >= v->bound || !v->defined[id]) {
+        validate_error(v, "%%%u used by an instruction with opcode %u is not defined", id, opcode);
+    }
+}
+
+// NOTE: every id is defined once and is below the bound
+static void
+validate_definitions(struct validate *v)
+{
+    for (u32 offset = 5; offset < v->size; offset += v->words[offset] >> 16) {
+        u32 wordcount = v->words[offset] >> 16;
+        
+        if (wordcount == 0 || offset + wordcount > v->size) {
+            validate_error(v, "instruction at word %u has a bad word count %u", offset, wordcount);
+            v->size = offset;
+            return;
+        }
+        
+        u32 id = validate_result_id(v->words + offset);
+        if (!id) {
+            continue;
+        }
+        
+        if (id >= v->bound) {
+            validate_error(v, "%%%u is not below the bound %u", id, v->bound);
+        } else if (v->defined[id]) {
+            validate_error(v, "%%%u is defined twice", id);
+        } else {
+            v->defined[id] = true;
+        }
+    }
+}
+
+// NOTE: every operand refers to a defined id. Labels are checked per function, and the operands
+// of the instructions the layout of which is not known are not checked
+static void
+validate_operands(struct validate *v)
+{
+    u32 **operands = malloc((WORDCOUNT_MASK >> 16) * sizeof(u32 *));
+    
+    for (u32 offset = 5; offset < v->size; offset += v->words[offset] >> 16) {
+        u32 *words = v->words + offset;
+        u32 opcode = words[0] & OPCODE_MASK;
+        u32 wordcount = words[0] >> 16;
+        
+        switch (opcode) {
+            case OpName:
+            case OpMemberName:
+            case OpDecorate:
+            case OpMemberDecorate: {
+                validate_use(v, words[1], opcode);
+            } break;
+            
+            // NOTE: the interface starts after the name, the last word of which has a zero top byte
+            case OpEntryPoint: {
+                validate_use(v, words[2], opcode);
+                u32 word = 3;
+                while (word < wordcount && (words[word] >> 24)) {
+                    ++word;
+                }
+                for (++word; word < wordcount; ++word) {
+                    validate_use(v, words[word], opcode);
+                }
+            } break;
+            
+            case OpFunction: {
+                validate_use(v, words[4], opcode);
+            } break;
+            
+            case OpFunctionCall: {
+                for (u32 word = 3; word < wordcount; ++word) {
+                    validate_use(v, words[word], opcode);
+                }
+            } break;
+            
+            case OpReturnValue:
+            case OpSwitch: {
+                validate_use(v, words[1], opcode);
+            } break;
+            
+            default: {
+                struct instruction_t instruction = instruction_parse(words);
+                s32 count = instruction_operands(&instruction, operands);
+                
+                for (s32 i = 0; i < count; ++i) {
+                    validate_use(v, *operands[i], opcode);
+                }
+                
+                if (opcode == OpPhi) {
+                    free(instruction.OpPhi.variables);
+                    free(instruction.OpPhi.parents);
+                }
+                free(instruction.unparsed_words);
+            }
+        }
+        
+        // NOTE: the result type
+        u32 id = validate_result_id(words);
+        if (id && wordcount > 2 && id == words[2]) {
+            validate_use(v, words[1], opcode);
+        }
+    }
+    
+    free(operands);
+}
+
+// NOTE: 'blocks' are the offsets of the OpLabel's, 'ends' of the terminators
+static void
+validate_function(struct validate *v, struct uint_vector *blocks, struct uint_vector *ends)
+{
+    u32 count = blocks->size;
+    u32 *labels = malloc(count * sizeof(u32));
+    
+    for (u32 b = 0; b < count; ++b) {
+        labels[b] = v->words[blocks->data[b] + 1];
+    }
+    
+    struct ir_cfg cfg = cfg_init(labels, count);
+    
+    for (u32 b = 0; b < count; ++b) {
+        u32 *words = v->words + ends->data[b];
+        u32 opcode = words[0] & OPCODE_MASK;
+        u32 wordcount = words[0] >> 16;
+        struct uint_vector targets = vector_init();
+        
+        if (opcode == OpBranch) {
+            vector_push(&targets, words[1]);
+        } else if (opcode == OpBranchConditional) {
+            vector_push(&targets, words[2]);
+            vector_push(&targets, words[3]);
+        } else if (opcode == OpSwitch) {
+            // NOTE: 32 bit selectors only, the literal and the label alternate after the default
+            vector_push(&targets, words[2]);
+            for (u32 word = 4; word < wordcount; word += 2) {
+                vector_push(&targets, words[word]);
+            }
+        }
+        
+        for (u32 i = 0; i < targets.size; ++i) {
+            s32 target = search_item_u32(labels, count, targets.data[i]);
+            
+            if (target == -1) {
+                validate_error(v, "%%%u branches to %%%u, which is not a block of the function", labels[b], targets.data[i]);
+                continue;
+            }
+            
+            bool known = false;
+            for (struct edge_list *edge = cfg.out[b]; edge; edge = edge->next) {
+                known = known || edge->data == (u32) target;
+            }
+            
+            if (!known) {
+                cfg_add_edge(&cfg, b, target);
+            }
+        }
+        
+        vector_free(&targets);
+    }
+    
+    struct cfg_dfs_result dfs = cfg_dfs(&cfg);
+    cfg.dominators = cfg_dominators(&cfg, &dfs);
+    
+    for (u32 b = 0; b < count; ++b) {
+        for (u32 offset = blocks->data[b] + 2; offset < ends->data[b]; offset += v->words[offset] >> 16) {
+            u32 *words = v->words + offset;
+            u32 opcode = words[0] & OPCODE_MASK;
+            u32 wordcount = words[0] >> 16;
+            
+            if (opcode == OpPhi) {
+                u32 preds = 0;
+                for (struct edge_list *edge = cfg.in[b]; edge; edge = edge->next) {
+                    ++preds;
+                }
+                
+                if ((wordcount - 3) / 2 != preds) {
+                    validate_error(v, "OpPhi %%%u in %%%u has %u operands, the block has %u predecessors",
+                                   words[2], labels[b], (wordcount - 3) / 2, preds);
+                }
+                
+                for (u32 word = 4; word < wordcount; word += 2) {
+                    s32 parent = search_item_u32(labels, count, words[word]);
+                    bool pred = false;
+                    
+                    for (struct edge_list *edge = cfg.in[b]; edge && parent != -1; edge = edge->next) {
+                        pred = pred || edge->data == (u32) parent;
+                    }
+                    
+                    if (!pred) {
+                        validate_error(v, "OpPhi %%%u in %%%u has %%%u as a parent, which is not a predecessor",
+                                       words[2], labels[b], words[word]);
+                    }
+                }
+            } else if (opcode == OpLoopMerge || opcode == OpSelectionMerge) {
+                s32 merge = search_item_u32(labels, count, words[1]);
+                s32 next = (opcode == OpLoopMerge ? search_item_u32(labels, count, words[2]) : 0);
+                
+                if (merge == -1 || next == -1) {
+                    validate_error(v, "the merge instruction of %%%u names a block outside of the function", labels[b]);
+                    continue;
+                }
+                
+                // NOTE: the back edge comes from a reachable block dominated by the header, or
+                // from the continue target, which may be unreachable
+                bool reachable = (b == 0 || cfg.dominators[b] != -1);
+                if (opcode == OpLoopMerge && reachable) {
+                    bool back_edge = false;
+                    for (struct edge_list *edge = cfg.in[b]; edge; edge = edge->next) {
+                        bool latch = (edge->data == 0 || cfg.dominators[edge->data] != -1) &&
+                                     dominates(b, edge->data, cfg.dominators);
+                        back_edge = back_edge || latch || edge->data == (u32) next;
+                    }
+                    
+                    if (!back_edge) {
+                        validate_error(v, "loop header %%%u has no back edge", labels[b]);
+                    }
+                }
+            }
+        }
+    }
+    
+    cfg_dfs_free(&dfs);
+    cfg_free(&cfg);
+    free(labels);
+}
+
+// NOTE: the layout of the functions: every block starts with OpLabel and ends with a terminator,
+// OpPhi's come first in a block, OpVariable's first in the entry block, and a merge instruction
+// comes right before the branch
+static void
+validate_functions(struct validate *v)
+{
+    struct uint_vector blocks = vector_init();
+    struct uint_vector ends = vector_init();
+    bool in_function = false;
+    bool in_block = false;
+    bool phis = false;
+    bool variables = false;
+    
+    for (u32 offset = 5; offset < v->size; offset += v->words[offset] >> 16) {
+        u32 *words = v->words + offset;
+        u32 opcode = words[0] & OPCODE_MASK;
+        u32 next = offset + (words[0] >> 16);
+        
+        if (opcode == OpFunction) {
+            in_function = true;
+            blocks.size = ends.size = 0;
+            continue;
+        }
+        
+        if (!in_function) {
+            continue;
+        }
+        
+        if (opcode == OpFunctionEnd) {
+            if (in_block) {
+                validate_error(v, "block %%%u has no terminator", v->words[blocks.data[blocks.size - 1] + 1]);
+            } else {
+                validate_function(v, &blocks, &ends);
+            }
+            in_function = in_block = false;
+        } else if (opcode == OpLabel) {
+            if (in_block) {
+                validate_error(v, "block %%%u has no terminator", v->words[blocks.data[blocks.size - 1] + 1]);
+                ends.size = blocks.size;
+                ends.data[ends.size - 1] = offset;
+            }
+            vector_push(&blocks, offset);
+            in_block = true;
+            phis = true;
+            variables = (blocks.size == 1);
+        } else if (!in_block) {
+            if (opcode != OpFunctionParameter || blocks.size) {
+                validate_error(v, "instruction with opcode %u is outside of a block", opcode);
+            }
+        } else {
+            if (opcode == OpPhi && !phis) {
+                validate_error(v, "OpPhi %%%u after other instructions in %%%u", words[2], v->words[blocks.data[blocks.size - 1] + 1]);
+            }
+            phis = phis && opcode == OpPhi;
+            
+            if (opcode == OpVariable && !variables) {
+                validate_error(v, "OpVariable %%%u after other instructions or outside of the entry block", words[2]);
+            }
+            variables = variables && opcode == OpVariable;
+            
+            u32 branch = (next < v->size ? v->words[next] & OPCODE_MASK : 0);
+            if ((opcode == OpLoopMerge || opcode == OpSelectionMerge) &&
+                branch != OpBranch && branch != OpBranchConditional && branch != OpSwitch) {
+                validate_error(v, "merge instruction is not followed by a branch in %%%u", v->words[blocks.data[blocks.size - 1] + 1]);
+            }
+            
+            if (validate_terminator(opcode)) {
+                vector_push(&ends, offset);
+                in_block = false;
+            }
+        }
+    }
+    
+    if (in_function) {
+        validate_error(v, "the last function has no OpFunctionEnd");
+    }
+    
+    vector_free(&blocks);
+    vector_free(&ends);
+}
+
+// NOTE: the label of the block with the OpName 'name' (of 'length' chars), 0 if there is none
+static u32
+validate_named_block(struct validate *v, const char *name, u32 length)
+{
+    for (u32 offset = 5; offset < v->size; offset += v->words[offset] >> 16) {
+        u32 wordcount = v->words[offset] >> 16;
+        const char *string = (const char *) (v->words + offset + 2);
+        
+        if ((v->words[offset] & OPCODE_MASK) == OpName && wordcount > 2 && 
+            strnlen(string, (wordcount - 2) * sizeof(u32)) == length && !strncmp(string, name, length)) {
+            return(v->words[offset + 1]);
+        }
+    }
+    
+    return(0);
+}
+
+// NOTE: the expectation is '[<block name>:]<opcode name><=|<|>><count>', with a block name
+// only the instructions of the block with that OpName are counted
+static void
+validate_expect(struct validate *v, const char *expect)
+{
+    const char *colon = strchr(expect, ':');
+    u32 block = 0;
+    
+    if (colon) {
+        block = validate_named_block(v, expect, colon - expect);
+        if (!block) {
+            validate_error(v, "bad expectation '%s', there is no block with that name", expect);
+            return;
+        }
+        expect = colon + 1;
+    }
+    
+    u32 length = strcspn(expect, "=<>");
+    u32 opcode = UINT32_MAX;
+    
+    for (u32 i = 0; i < sizeof(VALIDATE_OPCODES) / sizeof(VALIDATE_OPCODES[0]); ++i) {
+        if (strlen(VALIDATE_OPCODES[i].name) == length && !strncmp(VALIDATE_OPCODES[i].name, expect, length)) {
+            opcode = VALIDATE_OPCODES[i].opcode;
+        }
+    }
+    
+    char *end = NULL;
+    long expected = (expect[length] ? strtol(expect + length + 1, &end, 10) : -1);
+    
+    if (opcode == UINT32_MAX || !end || *end || expected < 0) {
+        validate_error(v, "bad expectation '%s'", expect);
+        return;
+    }
+    
+    long count = 0;
+    bool in_block = !block;
+    for (u32 offset = 5; offset < v->size; offset += v->words[offset] >> 16) {
+        u32 instruction = v->words[offset] & OPCODE_MASK;
+        if (block && (instruction == OpLabel || instruction == OpFunctionEnd)) {
+            in_block = (instruction == OpLabel && v->words[offset + 1] == block);
+        }
+        count += (in_block && instruction == opcode);
+    }
+    
+    char relation = expect[length];
+    bool met = ((relation == '=' && count == expected) || (relation == '<' && count < expected) || 
+                (relation == '>' && count > expected));
+    
+    if (!met) {
+        validate_error(v, "expected %s, the %s has %ld", expect, block ? "block" : "module", count);
+    }
+}
+
+// NOTE: with -e the first file is the reference, the others have to compute the same as it
+struct validate_reference {
+    const char *filename;
+    u32 *words;
+    u32 size;
+};
+
+static bool
+validate_file(const char *filename, char **expects, u32 expect_count, struct validate_reference *reference)
+{
+    FILE *file = fopen(filename, "rb");
+    
+    if (!file) {
+        fprintf(stderr, "[ERROR] %s: file could not be opened\n", filename);
+        return(false);
+    }
+    
+    fseek(file, 0L, SEEK_END);
+    u32 size = ftell(file);
+    rewind(file);
+    
+    struct validate v = {
+        .filename = filename,
+        .words = malloc(size + sizeof(u32)),
+        .size = size / sizeof(u32)
+    };
+    
+    fread((u8 *) v.words, size, 1, file);
+    fclose(file);
+    
+    if (v.size < 5 || v.words[0] != 0x07230203) {
+        validate_error(&v, "not a SPIR-V module");
+        free(v.words);
+        return(false);
+    }
+    
+    v.bound = v.words[3];
+    v.defined = calloc(v.bound, sizeof(bool));
+    
+    validate_definitions(&v);
+    validate_operands(&v);
+    validate_functions(&v);
+    
+    for (u32 i = 0; i < expect_count; ++i) {
+        validate_expect(&v, expects[i]);
+    }
+    
+    if (reference && !reference->words) {
+        *reference = (struct validate_reference) { filename, v.words, v.size };
+    } else if (reference) {
+        v.errors += !interp_same(reference->filename, reference->words, reference->size, filename, v.words, v.size);
+        free(v.words);
+    } else {
+        free(v.words);
+    }
+    
+    free(v.defined);
+    
+    return(v.errors == 0);
+}
+
+static bool
+validate_is_expectation(const char *arg)
+{
+    const char *colon = strchr(arg, ':');
+    const char *opcode = (colon ? colon + 1 : arg);
+    return(!strncmp(opcode, "Op", 2) && strpbrk(opcode, "=<>"));
+}
+
+s32
+main(s32 argc, char **argv)
+{
+    bool equivalent = (argc > 1 && !strcmp(argv[1], "-e"));
+    s32 first = (equivalent ? 2 : 1);
+    
+    if (argc <= first || validate_is_expectation(argv[first])) {
+        fprintf(stderr, "[ERROR] Usage: ./%s [-e] file.spv [expectation ...] [file.spv [expectation ...] ...]\n", argv[0]);
+        return(1);
+    }
+    
+    bool valid = true;
+    struct validate_reference reference = { 0 };
+    
+    for (s32 arg = first; arg < argc;) {
+        s32 expects = arg + 1;
+        while (expects < argc && validate_is_expectation(argv[expects])) {
+            ++expects;
+        }
+        
+        valid = validate_file(argv[arg], argv + arg + 1, expects - arg - 1,
+                               equivalent ? &reference : NULL) && valid;
+        arg = expects;
+    }
+    
+    free(reference.words);
+    
+    return(valid ? 0 : 1);
+}
@@ -0,0 +1,62 @@
+// NOTE: a thin wrapper over the threads of the platform, pthreads or Win32
+#ifdef _WIN32
+struct thread {
+    HANDLE handle;
+    void *(*work)(void *);
+    void *data;
+};
+
+static DWORD WINAPI
+thread_entry(LPVOID param)
+{
+    struct thread *thread = param;
+    thread->work(thread->data);
+    return(0);
+}
+
+static void
+thread_start(struct thread *thread, void *(*work)(void *), void *data)
+{
+    thread->work = work;
+    thread->data = data;
+    thread->handle = CreateThread(NULL, 0, thread_entry, thread, 0, NULL);
+}
+
+static void
+thread_join(struct thread *thread)
+{
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+}
+
+static u32
+thread_cores(void)
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return(info.dwNumberOfProcessors > 1 ? (u32) info.dwNumberOfProcessors : 1);
+}
+#else
+struct thread {
+    pthread_t handle;
+};
+
+static void
+thread_start(struct thread *thread, void *(*work)(void *), void *data)
+{
+    pthread_create(&thread->handle, NULL, work, data);
+}
+
+static void
+thread_join(struct thread *thread)
+{
+    pthread_join(thread->handle, NULL);
+}
+
+static u32
+thread_cores(void)
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return(cores > 1 ? (u32) cores : 1);
+}
+#endif